@@ -53,13 +53,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 //#include <conio.h>
 
+/* Threads, relógio e arquivos mapeados em memória do sistema, usados pelos
+benchmarks, pelo trace contínuo e pelos modos que rodam fora do agendador do
+FreeRTOS. */
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Quando mainUSAR_FREERTOS é 0 o arquivo é compilado sem o kernel (por exemplo
+com gcc no Linux: gcc -O2 -DmainUSAR_FREERTOS=0 main.c -lm -lpthread) e apenas o motor de
+eventos discretos fica disponível. */
+#ifndef mainUSAR_FREERTOS
+	#define mainUSAR_FREERTOS	1
+#endif
+
+#if ( mainUSAR_FREERTOS == 1 )
 /* FreeRTOS kernel includes. */
 #include "FreeRTOS.h"
 #include "task.h"
 #include <queue.h>
 #include <semphr.h>
+#endif
 
 /* This project provides two demo applications.  A simple blinky style demo
 application, and a more comprehensive test and demo application.  The
@@ -98,377 +125,9781 @@ choice.  See http://www.freertos.org/a00111.html for an explanation. */
 //void vFullDemoTickHookFunction( void );
 //void vFullDemoIdleFunction( void );
 
+#if ( mainUSAR_FREERTOS == 1 )
+
 /*
  * This demo uses heap_5.c, so start by defining some heap regions.  It is not
  * necessary for this demo to use heap_5, as it could define one large heap
  * region.  Heap_5 is only used for test and example purposes.  See
  * http://www.freertos.org/a00111.html for an explanation.
  */
-static void  prvInitialiseHeap( void );
+static void  prvInitialiseHeap( void );
+
+/*
+ * Prototypes for the standard FreeRTOS application hook (callback) functions
+ * implemented within this file.  See http://www.freertos.org/a00016.html .
+ */
+void vApplicationMallocFailedHook( void );
+void vApplicationIdleHook( void );
+void vApplicationStackOverflowHook( TaskHandle_t pxTask, char *pcTaskName );
+void vApplicationTickHook( void );
+void vApplicationGetIdleTaskMemory( StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize );
+void vApplicationGetTimerTaskMemory( StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer, uint32_t *pulTimerTaskStackSize );
+
+/*
+ * Writes trace data to a disk file when the trace recording is stopped.
+ * This function will simply overwrite any trace files that already exist.
+ */
+static void prvSaveTraceFile( void );
+
+/*-----------------------------------------------------------*/
+
+/* When configSUPPORT_STATIC_ALLOCATION is set to 1 the application writer can
+use a callback function to optionally provide the memory required by the idle
+and timer tasks.  This is the stack that will be used by the timer task.  It is
+declared here, as a global, so it can be checked by a test that is implemented
+in a different file. */
+StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+
+/* Notes if the trace is running or not. */
+static BaseType_t xTraceRunning = pdTRUE;
+
+#endif /* mainUSAR_FREERTOS */
+
+/*-----------------------------------------------------------*/
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*----------------- INÍCIO ------------------*/
+
+
+#include <stdbool.h>
+
+#ifndef REDE_LINHAS
+#define REDE_LINHAS 2          // Linhas da grade de cruzamentos
+#endif
+#ifndef REDE_COLUNAS
+#define REDE_COLUNAS 2         // Colunas da grade de cruzamentos
+#endif
+#define REDE_COMPRIMENTO_M 500 // Distância entre cruzamentos vizinhos, em metros
+#define REDE_MAX_CRUZAMENTOS 0xFFFFFF // Maior rede suportada: o cruzamento cabe nos 24 bits de agente da sequência dos eventos
+#define REDE_MAX_VERDE_S 3600  // Maior verde de uma fase e maior defasagem de um plano, em segundos
+#define REDE_MAX_COMPRIMENTO_M 1000000 // Maior via aceita de um arquivo, em metros
+#define VELOCIDADE_MAX_NS 60   // Velocidade máxima nas vias norte-sul, em km/h
+#define VELOCIDADE_MAX_EW 50   // Velocidade máxima nas vias leste-oeste, em km/h
+#define TEMPO_CICLO 3 // Tempo de verde de cada fase em segundos (plano padrão dos cruzamentos)
+
+// Definições das direções
+#define NS 1
+#define SN 2
+#define EW 3
+#define WE 4
+#define NUM_DIRECOES 4
+
+#define INTERVALO_SATURACAO_MS 2000 // Intervalo entre veículos liberados em sequência por um sinal verde
+#ifndef ESPERA_POR_NOTIFICACAO
+#define ESPERA_POR_NOTIFICACAO 1    // 1: o cruzamento acorda os veículos parados; 0: consulta o sinal a cada 1 s
+#endif
+#ifndef TEMPORIZACAO_POR_RODA
+#define TEMPORIZACAO_POR_RODA 1     // 1: uma task com roda de temporização percorre vias e troca fases; 0: vTaskDelay em cada task
+#endif
+#define MAX_FILA_ESPERA 32          // Capacidade da fila de espera de cada aproximação (modo em tempo real)
+#ifndef FILAS_POR_VIA
+#define FILAS_POR_VIA 1             // 1: vias com capacidade limitada, veículos retidos a montante quando a via à frente enche; 0: vias sem limite
+#endif
+#ifndef VIAGENS_OD
+#define VIAGENS_OD 1                // 1: veículos com viagem até uma saída da rede, virando nos cruzamentos pela tabela de rotas; 0: seguem reto até sair
+#endif
+#ifndef FASES_PROTEGIDAS
+#define FASES_PROTEGIDAS 1          // 1: com viagens, só movimentos sem conflito abrem juntos e cada eixo termina com as conversões à esquerda; 0: o eixo abre todos os movimentos
+#endif
+#ifndef FASES_ESQUERDA_PCT
+#define FASES_ESQUERDA_PCT 25       // Parte do verde de cada eixo dada às conversões à esquerda protegidas, em %
+#endif
+#define ESPACAMENTO_VEICULO_CM 750  // Espaço ocupado por um veículo parado na via (comprimento e distância ao da frente)
+#define VELOCIDADE_ONDA_VAGA_KMH 20 // Velocidade com que a vaga deixada por quem sai de uma via volta à entrada dela (eventos discretos)
+#define ADMISSAO_FILA_MAX 64        // Veículos parados nas aproximações de um cruzamento a partir dos quais novas entradas são adiadas
+#define ADMISSAO_MAX_ADIADOS 32     // Veículos adiados por entrada; os que passam disso são descartados
+#define ADMISSAO_ADIAMENTO_MS 1000  // Intervalo entre as tentativas de admitir os veículos adiados
+#define ADMISSAO_HEAP_MIN_BYTES 8192 // Heap livre abaixo do qual novas entradas são adiadas (modo em tempo real)
+#define ADMISSAO_POOL_MAX_PCT 90    // Ocupação do pool de veículos a partir da qual novas entradas são adiadas (modo em tempo real)
+#define RELATORIO_ESPERA_S 30       // Período do relatório de esperas do modo em tempo real, em segundos
+#define MAX_VEICULOS 64             // Veículos simultâneos no modo em tempo real (vagas do pool, com TCB e pilha estáticos)
+
+// Motores de simulação disponíveis
+#define MODO_TEMPO_REAL        1 // Uma task do FreeRTOS por veículo (demonstração em tempo real)
+#define MODO_EVENTOS_DISCRETOS 2 // Veículos como registros e eventos em fila de prioridade
+#define MODO_BENCH_SEMAFORO    3 // Microbenchmark de consultas concorrentes ao estado dos semáforos
+#define MODO_BENCH_CINEMATICA  4 // Benchmark da cinemática em lote (tabela SoA) contra o modelo por task
+#define MODO_PARALELO          5 // Eventos discretos com a rede dividida em regiões, uma thread por região
+#define MODO_DECODIFICAR_LOG   6 // Converte um log binário de eventos nas mensagens de texto
+#define MODO_BENCH_SIMULADOR   7 // Cenários de grade e demanda com resultados em JSON
+#define MODO_EXPORTAR_TRACE    8 // Converte um log ou trace binário para o JSON do Chrome/Perfetto
+#define MODO_COMPILAR_CENARIO  9 // Converte um cenário em texto para o formato binário
+#define MODO_BENCH_TEMPORIZADORES 10 // Custo por temporizador da roda de temporização contra um heap binário
+#define MODO_MESOSCOPICO       11 // Pelotões de veículos por via avançados em passos de tempo, para redes inteiras
+#define MODO_CONJUNTO          12 // Milhares de replicações independentes de eventos discretos em todos os núcleos, com estatísticas agregadas
+
+#ifndef MODO_SIMULACAO
+#if ( mainUSAR_FREERTOS == 1 )
+#define MODO_SIMULACAO MODO_TEMPO_REAL
+#else
+#define MODO_SIMULACAO MODO_EVENTOS_DISCRETOS
+#endif
+#endif
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) && ( mainUSAR_FREERTOS != 1 )
+#error "MODO_TEMPO_REAL exige o kernel do FreeRTOS (mainUSAR_FREERTOS = 1)"
+#endif
+
+/**
+ * @brief Retorna o nome curto de uma direção ("NS", "SN", "EW" ou "WE").
+ */
+static inline const char* nomeDirecao(int direcao) {
+    switch (direcao) {
+    case NS: return "NS";
+    case SN: return "SN";
+    case EW: return "EW";
+    case WE: return "WE";
+    }
+    return "??";
+}
+
+/*----------------- NÚMEROS ALEATÓRIOS ------------------*/
+
+#ifndef SIM_SEMENTE
+#define SIM_SEMENTE 1 // Semente padrão da execução (a variável de ambiente SIM_SEMENTE tem precedência)
+#endif
+
+// Fluxos independentes derivados da semente da execução
+#define FLUXO_GERACAO(regiao)  (0x100000000ull + (uint64_t)(regiao)) // Criação de veículos de uma região (0 na rede inteira)
+#define FLUXO_CRUZAMENTO(c)    (0x200000000ull + (uint64_t)(c))      // Atributos dos veículos que entram no cruzamento c
+#define FLUXO_CINEMATICA       0x300000000ull                        // Frota e sementes por veículo da cinemática em lote
+#define FLUXO_BENCH            0x400000000ull                        // Consultas sorteadas pelos benchmarks
+
+/**
+ * @brief Gerador xoshiro128** de um fluxo de números aleatórios.
+ *
+ * Cada fluxo pertence a uma única task ou thread, de modo que nenhum sorteio
+ * disputa estado compartilhado e a sequência não depende do escalonamento.
+ */
+typedef struct {
+    uint32_t s[4]; /**< Estado do gerador (nunca todo zero). */
+} GeradorAleatorio;
+
+/**
+ * @brief Avança um gerador splitmix64, usado apenas para espalhar a semente pelo estado.
+ */
+static inline uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Inicializa o fluxo `fluxo` (ver FLUXO_GERACAO...) da semente `semente`.
+ *
+ * A mesma semente e o mesmo fluxo produzem sempre a mesma sequência.
+ */
+static inline void geradorIniciar(GeradorAleatorio* g, uint64_t semente, uint64_t fluxo) {
+    uint64_t x = splitmix64(&semente) ^ fluxo;
+    uint64_t a = splitmix64(&x);
+    uint64_t b = splitmix64(&x);
+
+    g->s[0] = (uint32_t)a;
+    g->s[1] = (uint32_t)(a >> 32);
+    g->s[2] = (uint32_t)b;
+    g->s[3] = (uint32_t)(b >> 32);
+    if ((g->s[0] | g->s[1] | g->s[2] | g->s[3]) == 0) g->s[0] = 1;
+}
+
+static inline uint32_t rotacionar32(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+/**
+ * @brief Retorna os próximos 32 bits aleatórios do fluxo.
+ */
+static inline uint32_t geradorProximo(GeradorAleatorio* g) {
+    uint32_t* s = g->s;
+    uint32_t resultado = rotacionar32(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotacionar32(s[3], 11);
+    return resultado;
+}
+
+/**
+ * @brief Sorteia um inteiro em [0, limite) por multiplicação, sem divisão.
+ *
+ * O viés é de no máximo limite / 2^32, desprezível para os limites usados.
+ */
+static inline int geradorIntervalo(GeradorAleatorio* g, uint32_t limite) {
+    return (int)(((uint64_t)geradorProximo(g) * limite) >> 32);
+}
+
+/**
+ * @brief Semente da execução: SIM_SEMENTE do ambiente (decimal ou 0x...) ou a padrão.
+ *
+ * Repetir a semente informada no início da execução reproduz os mesmos sorteios.
+ */
+static inline uint64_t sementeExecucao(void) {
+    const char* variavel = getenv("SIM_SEMENTE");
+    return (variavel != NULL) ? (uint64_t)strtoull(variavel, NULL, 0) : (uint64_t)SIM_SEMENTE;
+}
+
+/**
+ * @brief Avança um gerador xorshift de 32 bits (o estado não pode ser zero).
+ *
+ * Usado como gerador por veículo nos laços em lote, que o compilador vetoriza;
+ * as sementes de cada veículo saem de um `GeradorAleatorio`.
+ */
+static inline uint32_t xorshift32(uint32_t x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/*----------------- PRIMITIVAS DE CONCORRÊNCIA ------------------*/
+
+/*
+ * Leitura, escrita e soma atômicas de palavras de 32 bits. No MSVC (x86/x64)
+ * leituras voláteis já têm semântica de aquisição; as escritas e somas usam
+ * operações Interlocked. `atomicoSomar32` retorna o valor após a soma.
+ *
+ * Os contadores de 64 bits usam ordem relaxada: só a indivisibilidade importa
+ * (no x86 de 32 bits um leitor nunca vê metade de um valor).
+ * `atomicoAcumular32` e `atomicoAcumular64` são a soma de quem é o único
+ * escritor do contador, sem instrução de trava; `atomicoSomarRelaxado64`
+ * serve a vários escritores. `atomicoEscrever64` publica um contador com
+ * semântica de liberação, como `atomicoEscrever32`. `atomicoTrocarSeIgual64`
+ * grava `valor` só se a palavra ainda valer `esperado` e retorna 1 nesse caso.
+ * `atomicoSomar64` e `atomicoTrocar64` têm semântica de aquisição e
+ * liberação; a primeira retorna o valor após a soma e a segunda, o anterior.
+ * `atomicoBarreiraLiberacao` impede que escritas posteriores sejam vistas
+ * antes das anteriores, e `atomicoBarreiraAquisicao` que leituras
+ * posteriores sejam feitas antes das anteriores.
+ */
+#if defined( _MSC_VER )
+static inline uint32_t atomicoLer32(volatile uint32_t* p) {
+    uint32_t valor = *p;
+    _ReadWriteBarrier();
+    return valor;
+}
+static inline void atomicoEscrever32(volatile uint32_t* p, uint32_t valor) {
+    _InterlockedExchange((volatile long*)p, (long)valor);
+}
+static inline uint32_t atomicoSomar32(volatile uint32_t* p, uint32_t valor) {
+    return (uint32_t)_InterlockedExchangeAdd((volatile long*)p, (long)valor) + valor;
+}
+static inline uint64_t atomicoLerRelaxado64(volatile uint64_t* p) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, 0, 0);
+}
+static inline void atomicoSomarRelaxado64(volatile uint64_t* p, uint64_t valor) {
+    InterlockedExchangeAdd64((volatile LONG64*)p, (LONG64)valor);
+}
+static inline void atomicoAcumular32(volatile uint32_t* p, uint32_t valor) {
+    *p = *p + valor;
+}
+static inline void atomicoAcumular64(volatile uint64_t* p, uint64_t valor) {
+    InterlockedExchange64((volatile LONG64*)p, (LONG64)(*p + valor));
+}
+static inline void atomicoEscrever64(volatile uint64_t* p, uint64_t valor) {
+    InterlockedExchange64((volatile LONG64*)p, (LONG64)valor);
+}
+static inline int atomicoTrocarSeIgual64(volatile uint64_t* p, uint64_t esperado, uint64_t valor) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, (LONG64)valor, (LONG64)esperado) == esperado;
+}
+static inline uint64_t atomicoSomar64(volatile uint64_t* p, uint64_t valor) {
+    return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)p, (LONG64)valor) + valor;
+}
+static inline uint64_t atomicoTrocar64(volatile uint64_t* p, uint64_t valor) {
+    return (uint64_t)InterlockedExchange64((volatile LONG64*)p, (LONG64)valor);
+}
+static inline void atomicoBarreiraLiberacao(void) {
+    _ReadWriteBarrier(); // No x86 as escritas já ficam visíveis em ordem
+}
+static inline void atomicoBarreiraAquisicao(void) {
+    _ReadWriteBarrier();
+}
+#else
+static inline uint32_t atomicoLer32(volatile uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void atomicoEscrever32(volatile uint32_t* p, uint32_t valor) {
+    __atomic_store_n(p, valor, __ATOMIC_RELEASE);
+}
+static inline uint32_t atomicoSomar32(volatile uint32_t* p, uint32_t valor) {
+    return __atomic_add_fetch(p, valor, __ATOMIC_ACQ_REL);
+}
+static inline uint64_t atomicoLerRelaxado64(volatile uint64_t* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static inline void atomicoSomarRelaxado64(volatile uint64_t* p, uint64_t valor) {
+    __atomic_fetch_add(p, valor, __ATOMIC_RELAXED);
+}
+static inline void atomicoAcumular32(volatile uint32_t* p, uint32_t valor) {
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + valor, __ATOMIC_RELAXED);
+}
+static inline void atomicoAcumular64(volatile uint64_t* p, uint64_t valor) {
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + valor, __ATOMIC_RELAXED);
+}
+static inline void atomicoEscrever64(volatile uint64_t* p, uint64_t valor) {
+    __atomic_store_n(p, valor, __ATOMIC_RELEASE);
+}
+static inline int atomicoTrocarSeIgual64(volatile uint64_t* p, uint64_t esperado, uint64_t valor) {
+    return __atomic_compare_exchange_n(p, &esperado, valor, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+static inline uint64_t atomicoSomar64(volatile uint64_t* p, uint64_t valor) {
+    return __atomic_add_fetch(p, valor, __ATOMIC_ACQ_REL);
+}
+static inline uint64_t atomicoTrocar64(volatile uint64_t* p, uint64_t valor) {
+    return __atomic_exchange_n(p, valor, __ATOMIC_ACQ_REL);
+}
+static inline void atomicoBarreiraLiberacao(void) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+static inline void atomicoBarreiraAquisicao(void) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+#endif
+
+/*
+ * Threads, mutexes e relógio nativos do sistema operacional. Não devem ser
+ * usados por tasks do FreeRTOS: servem aos benchmarks e aos modos que não
+ * iniciam o agendador.
+ */
+#if defined( _WIN32 )
+typedef HANDLE ThreadNativa;
+typedef CRITICAL_SECTION MutexNativo;
+
+typedef struct {
+    void (*funcao)(void*);
+    void* argumento;
+} InicioThread;
+
+static DWORD WINAPI prvIniciarThread(LPVOID pvParametro) {
+    InicioThread inicio = *(InicioThread*)pvParametro;
+    free(pvParametro);
+    inicio.funcao(inicio.argumento);
+    return 0;
+}
+
+static inline int threadCriar(ThreadNativa* thread, void (*funcao)(void*), void* argumento) {
+    InicioThread* inicio = (InicioThread*)malloc(sizeof(InicioThread));
+    if (inicio == NULL) return 0;
+    inicio->funcao = funcao;
+    inicio->argumento = argumento;
+    *thread = CreateThread(NULL, 0, prvIniciarThread, inicio, 0, NULL);
+    if (*thread == NULL) {
+        free(inicio);
+        return 0;
+    }
+    return 1;
+}
+static inline void threadAguardar(ThreadNativa thread) { WaitForSingleObject(thread, INFINITE); CloseHandle(thread); }
+static inline void threadCeder(void) { SwitchToThread(); }
+static inline void threadDormirMs(uint32_t ms) { Sleep(ms); }
+static inline int processadoresDisponiveis(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+static inline void mutexIniciar(MutexNativo* mutex) { InitializeCriticalSection(mutex); }
+static inline void mutexTravar(MutexNativo* mutex) { EnterCriticalSection(mutex); }
+static inline void mutexDestravar(MutexNativo* mutex) { LeaveCriticalSection(mutex); }
+static inline void mutexDestruir(MutexNativo* mutex) { DeleteCriticalSection(mutex); }
+
+static inline uint64_t relogioNs(void) {
+    static LARGE_INTEGER frequencia;
+    LARGE_INTEGER contador;
+    if (frequencia.QuadPart == 0) QueryPerformanceFrequency(&frequencia);
+    QueryPerformanceCounter(&contador);
+    return (uint64_t)((double)contador.QuadPart * 1e9 / (double)frequencia.QuadPart);
+}
+#else
+typedef pthread_t ThreadNativa;
+typedef pthread_mutex_t MutexNativo;
+
+typedef struct {
+    void (*funcao)(void*);
+    void* argumento;
+} InicioThread;
+
+static void* prvIniciarThread(void* pvParametro) {
+    InicioThread inicio = *(InicioThread*)pvParametro;
+    free(pvParametro);
+    inicio.funcao(inicio.argumento);
+    return NULL;
+}
+
+static inline int threadCriar(ThreadNativa* thread, void (*funcao)(void*), void* argumento) {
+    InicioThread* inicio = (InicioThread*)malloc(sizeof(InicioThread));
+    if (inicio == NULL) return 0;
+    inicio->funcao = funcao;
+    inicio->argumento = argumento;
+    if (pthread_create(thread, NULL, prvIniciarThread, inicio) != 0) {
+        free(inicio);
+        return 0;
+    }
+    return 1;
+}
+static inline void threadAguardar(ThreadNativa thread) { pthread_join(thread, NULL); }
+static inline void threadCeder(void) { sched_yield(); }
+static inline void threadDormirMs(uint32_t ms) {
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+static inline int processadoresDisponiveis(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int)n : 1;
+}
+static inline void mutexIniciar(MutexNativo* mutex) { pthread_mutex_init(mutex, NULL); }
+static inline void mutexTravar(MutexNativo* mutex) { pthread_mutex_lock(mutex); }
+static inline void mutexDestravar(MutexNativo* mutex) { pthread_mutex_unlock(mutex); }
+static inline void mutexDestruir(MutexNativo* mutex) { pthread_mutex_destroy(mutex); }
+
+static inline uint64_t relogioNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/*
+ * Arquivos mapeados em memória. `arquivoMapearEscrita` cria (ou trunca) um
+ * arquivo com `bytes` zerados e o mapeia compartilhado, de modo que as
+ * escritas chegam ao arquivo; `arquivoMapearLeitura` mapeia um arquivo
+ * inteiro só para leitura. O mapeamento mantém o arquivo aberto até
+ * `arquivoDesmapear`, que antes grava no disco as páginas alteradas.
+ */
+#if defined( _WIN32 )
+static inline void* arquivoMapearEscrita(const char* caminho, size_t bytes) {
+    HANDLE arquivo = CreateFileA(caminho, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (arquivo == INVALID_HANDLE_VALUE) return NULL;
+
+    HANDLE mapeamento = CreateFileMappingA(arquivo, NULL, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, NULL);
+    void* mapa = (mapeamento != NULL) ? MapViewOfFile(mapeamento, FILE_MAP_WRITE, 0, 0, bytes) : NULL;
+    if (mapeamento != NULL) CloseHandle(mapeamento); // A visão mantém o mapeamento e o arquivo abertos
+    CloseHandle(arquivo);
+    return mapa;
+}
+static inline const void* arquivoMapearLeitura(const char* caminho, size_t* bytes) {
+    HANDLE arquivo = CreateFileA(caminho, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER tamanho;
+    if (arquivo == INVALID_HANDLE_VALUE) return NULL;
+
+    const void* mapa = NULL;
+    if (GetFileSizeEx(arquivo, &tamanho) && tamanho.QuadPart > 0) {
+        HANDLE mapeamento = CreateFileMappingA(arquivo, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapeamento != NULL) {
+            mapa = MapViewOfFile(mapeamento, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapeamento);
+        }
+        *bytes = (size_t)tamanho.QuadPart;
+    }
+    CloseHandle(arquivo);
+    return mapa;
+}
+static inline void arquivoDesmapear(const void* mapa, size_t bytes) {
+    FlushViewOfFile(mapa, bytes);
+    UnmapViewOfFile(mapa);
+}
+#else
+static inline void* arquivoMapearEscrita(const char* caminho, size_t bytes) {
+    int descritor = open(caminho, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (descritor < 0) return NULL;
+
+    void* mapa = MAP_FAILED;
+    if (ftruncate(descritor, (off_t)bytes) == 0) {
+        mapa = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, descritor, 0);
+    }
+    close(descritor); // O mapeamento mantém o arquivo aberto
+    return (mapa != MAP_FAILED) ? mapa : NULL;
+}
+static inline const void* arquivoMapearLeitura(const char* caminho, size_t* bytes) {
+    int descritor = open(caminho, O_RDONLY);
+    struct stat estado;
+    if (descritor < 0) return NULL;
+
+    void* mapa = MAP_FAILED;
+    if (fstat(descritor, &estado) == 0 && estado.st_size > 0) {
+        *bytes = (size_t)estado.st_size;
+        mapa = mmap(NULL, *bytes, PROT_READ, MAP_PRIVATE, descritor, 0);
+    }
+    close(descritor);
+    return (mapa != MAP_FAILED) ? mapa : NULL;
+}
+static inline void arquivoDesmapear(const void* mapa, size_t bytes) {
+    msync((void*)mapa, bytes, MS_SYNC);
+    munmap((void*)mapa, bytes);
+}
+#endif
+
+/*
+ * Leitura de arquivos maiores que a memória por janelas mapeadas.
+ * `arquivoAbrirJanelas` abre o arquivo e informa o seu tamanho;
+ * `arquivoMapearJanela` mapeia `bytes` a partir de `inicio` (múltiplo de
+ * ARQUIVO_ALINHAMENTO_JANELA), avisa que a leitura será sequencial e pede ao
+ * sistema que comece a carregar a janela do disco sem esperar, de modo que a
+ * janela seguinte é lida enquanto a atual é processada. No Windows a leitura
+ * antecipada fica a cargo do cache do sistema.
+ */
+#define ARQUIVO_ALINHAMENTO_JANELA 65536 // Granularidade de alocação do Windows, múltiplo das páginas usuais
+
+#if defined( _WIN32 )
+typedef HANDLE ArquivoJanelas; // Mapeamento do arquivo inteiro, do qual as janelas são visões
+
+static inline int arquivoAbrirJanelas(ArquivoJanelas* arquivo, const char* caminho, uint64_t* bytes) {
+    HANDLE descritor = CreateFileA(caminho, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER tamanho;
+    if (descritor == INVALID_HANDLE_VALUE) return 0;
+
+    int ok = 0;
+    *arquivo = NULL;
+    if (GetFileSizeEx(descritor, &tamanho)) {
+        *bytes = (uint64_t)tamanho.QuadPart;
+        if (tamanho.QuadPart > 0) *arquivo = CreateFileMappingA(descritor, NULL, PAGE_READONLY, 0, 0, NULL);
+        ok = (tamanho.QuadPart == 0 || *arquivo != NULL); // Um arquivo vazio não pode ser mapeado, mas é válido
+    }
+    CloseHandle(descritor); // O mapeamento mantém o arquivo aberto
+    return ok;
+}
+static inline const void* arquivoMapearJanela(ArquivoJanelas arquivo, uint64_t inicio, size_t bytes) {
+    return MapViewOfFile(arquivo, FILE_MAP_READ, (DWORD)(inicio >> 32), (DWORD)inicio, bytes);
+}
+static inline void arquivoDesmapearJanela(const void* mapa, size_t bytes) {
+    (void)bytes;
+    UnmapViewOfFile(mapa);
+}
+static inline void arquivoFecharJanelas(ArquivoJanelas arquivo) {
+    if (arquivo != NULL) CloseHandle(arquivo);
+}
+#else
+typedef int ArquivoJanelas; // Descritor do arquivo
+
+static inline int arquivoAbrirJanelas(ArquivoJanelas* arquivo, const char* caminho, uint64_t* bytes) {
+    struct stat estado;
+    *arquivo = open(caminho, O_RDONLY);
+    if (*arquivo < 0) return 0;
+    if (fstat(*arquivo, &estado) != 0) {
+        close(*arquivo);
+        return 0;
+    }
+    *bytes = (uint64_t)estado.st_size;
+    return 1;
+}
+static inline const void* arquivoMapearJanela(ArquivoJanelas arquivo, uint64_t inicio, size_t bytes) {
+    void* mapa = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, arquivo, (off_t)inicio);
+    if (mapa == MAP_FAILED) return NULL;
+    madvise(mapa, bytes, MADV_SEQUENTIAL); // Leitura antecipada maior e páginas lidas descartadas primeiro
+    madvise(mapa, bytes, MADV_WILLNEED);   // Começa a ler a janela do disco agora, sem bloquear
+    return mapa;
+}
+static inline void arquivoDesmapearJanela(const void* mapa, size_t bytes) {
+    munmap((void*)mapa, bytes);
+}
+static inline void arquivoFecharJanelas(ArquivoJanelas arquivo) {
+    close(arquivo);
+}
+#endif
+
+/*----------------- RODA DE TEMPORIZAÇÃO ------------------*/
+
+#if ( ( MODO_SIMULACAO == MODO_TEMPO_REAL ) && ( TEMPORIZACAO_POR_RODA == 1 ) ) || \
+    ( MODO_SIMULACAO == MODO_BENCH_TEMPORIZADORES )
+
+#define RODA_BITS_NIVEL 8                        // Cada nível cobre 2^8 vezes o alcance do anterior
+#define RODA_POSICOES (1u << RODA_BITS_NIVEL)    // Posições de cada nível
+#define RODA_NIVEIS 4                            // 4 níveis de 8 bits cobrem os 32 bits do tick
+#define RODA_ENTRADAS_BLOCO 6                    // Temporizadores por bloco (um bloco ocupa uma linha de cache)
+
+// Blocos necessários para `capacidade` temporizadores: os completos, um incompleto por posição ocupada e
+// a folga da cascata (o bloco que está descendo e o que recebe as suas cópias)
+#define RODA_BLOCOS(capacidade) \
+    ((capacidade) / RODA_ENTRADAS_BLOCO + ((capacidade) < RODA_NIVEIS * RODA_POSICOES ? (capacidade) : RODA_NIVEIS * RODA_POSICOES) + 2)
+// Bytes a reservar para os blocos de `capacidade` temporizadores (inclui a folga do alinhamento)
+#define RODA_BYTES(capacidade) ((size_t)RODA_BLOCOS(capacidade) * sizeof(BlocoRoda) + 64)
+
+#if defined( __GNUC__ )
+#define rodaPrefetch(p) __builtin_prefetch(p)
+#else
+#define rodaPrefetch(p) ((void)(p))
+#endif
+
+/**
+ * @brief Bloco de uma posição da roda: até RODA_ENTRADAS_BLOCO temporizadores em uma linha de cache.
+ *
+ * Cada temporizador é só a expiração e um identificador escolhido por quem
+ * usa a roda, de modo que descer de nível ou expirar lê blocos contíguos e
+ * não toca os objetos temporizados.
+ */
+typedef struct BlocoRoda {
+    struct BlocoRoda* proximo;                   /**< Próximo bloco da mesma posição (ou da lista de livres). */
+    uint32_t quantidade;                         /**< Temporizadores ocupados no bloco. */
+    uint32_t expiracao[RODA_ENTRADAS_BLOCO];     /**< Tick em que cada temporizador expira. */
+    uint32_t identificador[RODA_ENTRADAS_BLOCO]; /**< Identificador de cada temporizador. */
+} BlocoRoda;
+
+/**
+ * @brief Roda de temporização hierárquica.
+ *
+ * O nível 0 tem uma posição por tick; cada posição do nível `n` cobre
+ * 2^(8n) ticks. Um temporizador entra no menor nível cujo alcance contém a
+ * sua expiração, em O(1), e desce de nível (cascata) quando o relógio chega
+ * à posição que o contém. Avançar um tick custa O(1) mais os temporizadores
+ * que expiram ou descem, independentemente de quantos estão pendentes. Os
+ * blocos vêm de uma área fixa entregue a `rodaIniciar`, sem alocação depois
+ * disso.
+ */
+typedef struct {
+    uint32_t agora;                                 /**< Último tick processado. */
+    uint32_t pendentes;                             /**< Temporizadores registrados e ainda não expirados. */
+    uint32_t capacidade;                            /**< Máximo de temporizadores pendentes. */
+    BlocoRoda* livres;                              /**< Blocos livres. */
+    BlocoRoda* posicoes[RODA_NIVEIS][RODA_POSICOES]; /**< Blocos de cada nível e posição; só o primeiro pode estar incompleto. */
+} RodaTemporizacao;
+
+/**
+ * @brief Inicia uma roda vazia no tick `agora`.
+ *
+ * @param area Memória para os blocos, com RODA_BYTES(capacidade) bytes, mantida pelo chamador.
+ */
+static void rodaIniciar(RodaTemporizacao* roda, uint32_t agora, void* area, uint32_t capacidade) {
+    BlocoRoda* blocos = (BlocoRoda*)(((uintptr_t)area + 63) & ~(uintptr_t)63);
+
+    memset(roda, 0, sizeof(*roda));
+    roda->agora = agora;
+    roda->capacidade = capacidade;
+    for (uint32_t i = 0; i < RODA_BLOCOS(capacidade); i++) {
+        blocos[i].proximo = roda->livres;
+        roda->livres = &blocos[i];
+    }
+}
+
+/**
+ * @brief Acrescenta um temporizador à posição correspondente à sua expiração, que não pode estar no passado.
+ */
+static inline void rodaColocar(RodaTemporizacao* roda, uint32_t expiracao, uint32_t identificador) {
+    uint32_t diferenca = expiracao ^ roda->agora;
+    int nivel = 0;
+
+    // O nível é o primeiro acima do qual expiração e relógio coincidem
+    while (nivel < RODA_NIVEIS - 1 && (diferenca >> (RODA_BITS_NIVEL * (nivel + 1))) != 0) nivel++;
+
+    BlocoRoda** posicao = &roda->posicoes[nivel][(expiracao >> (RODA_BITS_NIVEL * nivel)) & (RODA_POSICOES - 1)];
+    BlocoRoda* bloco = *posicao;
+    if (bloco == NULL || bloco->quantidade == RODA_ENTRADAS_BLOCO) {
+        // Dimensionada por RODA_BLOCOS, a lista de livres nunca se esgota
+        BlocoRoda* novo = roda->livres;
+        roda->livres = novo->proximo;
+        novo->proximo = bloco;
+        novo->quantidade = 0;
+        *posicao = bloco = novo;
+    }
+    bloco->expiracao[bloco->quantidade] = expiracao;
+    bloco->identificador[bloco->quantidade++] = identificador;
+}
+
+/**
+ * @brief Registra um temporizador para o tick `expiracao`, em O(1).
+ *
+ * Expirações que já passaram são antecipadas para o próximo tick.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se a roda já tiver `capacidade` temporizadores pendentes.
+ */
+static inline int rodaInserir(RodaTemporizacao* roda, uint32_t expiracao, uint32_t identificador) {
+    if (roda->pendentes == roda->capacidade) return 0;
+    if ((int32_t)(expiracao - roda->agora) <= 0) expiracao = roda->agora + 1;
+    rodaColocar(roda, expiracao, identificador);
+    roda->pendentes++;
+    return 1;
+}
+
+/**
+ * @brief Devolve à lista de livres uma cadeia de blocos já processada.
+ */
+static inline void rodaLiberarBlocos(RodaTemporizacao* roda, BlocoRoda* primeiro, BlocoRoda* ultimo) {
+    ultimo->proximo = roda->livres;
+    roda->livres = primeiro;
+}
+
+/**
+ * @brief Avança a roda até o tick `ate` e copia para `expirados` os identificadores que expiraram.
+ *
+ * O lote é entregue de uma vez para que quem chama trate todas as
+ * expirações juntas. Sem temporizadores pendentes o relógio salta direto
+ * para `ate`.
+ *
+ * @param expirados Vetor com espaço para `capacidade` identificadores.
+ * @return Quantidade de temporizadores expirados.
+ */
+static size_t rodaAvancar(RodaTemporizacao* roda, uint32_t ate, uint32_t* expirados) {
+    size_t quantidade = 0;
+
+    while (roda->agora != ate) {
+        if (roda->pendentes == 0) {
+            roda->agora = ate;
+            break;
+        }
+        uint32_t agora = ++roda->agora;
+
+        // Ao completar uma volta de um nível, a posição seguinte do nível de cima desce
+        for (int nivel = 1; nivel < RODA_NIVEIS; nivel++) {
+            if ((agora & ((1u << (RODA_BITS_NIVEL * nivel)) - 1)) != 0) break;
+            BlocoRoda** posicao = &roda->posicoes[nivel][(agora >> (RODA_BITS_NIVEL * nivel)) & (RODA_POSICOES - 1)];
+            BlocoRoda* bloco = *posicao;
+            *posicao = NULL;
+            while (bloco != NULL) {
+                BlocoRoda* proximo = bloco->proximo;
+                if (proximo != NULL) rodaPrefetch(proximo);
+                for (uint32_t i = 0; i < bloco->quantidade; i++) {
+                    rodaColocar(roda, bloco->expiracao[i], bloco->identificador[i]);
+                }
+                rodaLiberarBlocos(roda, bloco, bloco);
+                bloco = proximo;
+            }
+        }
+
+        BlocoRoda** posicao = &roda->posicoes[0][agora & (RODA_POSICOES - 1)];
+        BlocoRoda* bloco = *posicao;
+        *posicao = NULL;
+        while (bloco != NULL) {
+            BlocoRoda* proximo = bloco->proximo;
+            memcpy(&expirados[quantidade], bloco->identificador, bloco->quantidade * sizeof(uint32_t));
+            quantidade += bloco->quantidade;
+            roda->pendentes -= bloco->quantidade;
+            rodaLiberarBlocos(roda, bloco, bloco);
+            bloco = proximo;
+        }
+    }
+    return quantidade;
+}
+
+#endif /* roda de temporização */
+
+/*----------------- MOVIMENTOS E ESTÁGIOS ------------------*/
+
+/*
+ * Cada aproximação tem três movimentos (seguir reto, virar à direita e virar
+ * à esquerda), 12 por cruzamento, numerados (direção - 1) * 3 + tipo. A
+ * matriz de conflitos é gerada na compilação a partir da geometria: em volta
+ * do cruzamento, no sentido horário a partir do norte, cada perna tem o ponto
+ * de entrada (lado direito de quem chega) e o de saída, e cada movimento é a
+ * corda entre a entrada da sua perna e a saída da perna de destino. Dois
+ * movimentos de aproximações diferentes conflitam se as cordas se cruzam ou
+ * se terminam na mesma saída. As tabelas de estágios também são constantes,
+ * e a ausência de conflito em cada estágio é conferida na compilação.
+ */
+#define MOVIMENTO_RETO     0 // Tipos de movimento de uma aproximação
+#define MOVIMENTO_DIREITA  1
+#define MOVIMENTO_ESQUERDA 2
+#define NUM_MOVIMENTOS 12
+
+#define MOVIMENTO(direcao, tipo) (((direcao) - 1) * 3 + (tipo))
+#define MOV_DIRECAO(m) ((m) / 3 + 1)
+#define MOV_TIPO(m) ((m) % 3)
+
+// Direção de saída de cada tipo de movimento (mão direita: quem vai para o sul vira à direita para oeste)
+#define DIRECAO_DIREITA(d) ((d) == NS ? EW : (d) == SN ? WE : (d) == EW ? SN : NS)
+#define DIRECAO_ESQUERDA(d) ((d) == NS ? WE : (d) == SN ? EW : (d) == EW ? NS : SN)
+#define DIRECAO_OPOSTA(d) ((d) == NS ? SN : (d) == SN ? NS : (d) == EW ? WE : EW)
+#define MOV_SAIDA(m) (MOV_TIPO(m) == MOVIMENTO_RETO ? MOV_DIRECAO(m) : \
+    MOV_TIPO(m) == MOVIMENTO_DIREITA ? DIRECAO_DIREITA(MOV_DIRECAO(m)) : DIRECAO_ESQUERDA(MOV_DIRECAO(m)))
+
+// Pernas no sentido horário (norte 0, leste 1, sul 2, oeste 3): quem vai para o sul chega pelo norte e sai pelo sul
+#define PERNA_CHEGADA(d) ((d) == NS ? 0 : (d) == EW ? 1 : (d) == SN ? 2 : 3)
+#define PERNA_SAIDA(d) ((d) == SN ? 0 : (d) == WE ? 1 : (d) == NS ? 2 : 3)
+#define PONTO_ENTRADA(m) (2 * PERNA_CHEGADA(MOV_DIRECAO(m)))
+#define PONTO_SAIDA(m) (2 * PERNA_SAIDA(MOV_SAIDA(m)) + 1)
+#define CORDA_MENOR(m) (PONTO_ENTRADA(m) < PONTO_SAIDA(m) ? PONTO_ENTRADA(m) : PONTO_SAIDA(m))
+#define CORDA_MAIOR(m) (PONTO_ENTRADA(m) < PONTO_SAIDA(m) ? PONTO_SAIDA(m) : PONTO_ENTRADA(m))
+#define CORDAS_CRUZAM(a, b) \
+    ((CORDA_MENOR(a) < CORDA_MENOR(b) && CORDA_MENOR(b) < CORDA_MAIOR(a) && CORDA_MAIOR(a) < CORDA_MAIOR(b)) || \
+     (CORDA_MENOR(b) < CORDA_MENOR(a) && CORDA_MENOR(a) < CORDA_MAIOR(b) && CORDA_MAIOR(b) < CORDA_MAIOR(a)))
+#define MOVIMENTOS_CONFLITAM(a, b) \
+    (MOV_DIRECAO(a) != MOV_DIRECAO(b) && (PONTO_SAIDA(a) == PONTO_SAIDA(b) || CORDAS_CRUZAM(a, b)))
+
+// Máscara (12 bits) dos movimentos que conflitam com `m`
+#define CONFLITO_BIT(m, j) (MOVIMENTOS_CONFLITAM(m, j) ? 1u << (j) : 0u)
+#define CONFLITOS(m) (CONFLITO_BIT(m, 0) | CONFLITO_BIT(m, 1) | CONFLITO_BIT(m, 2) | CONFLITO_BIT(m, 3) | \
+    CONFLITO_BIT(m, 4) | CONFLITO_BIT(m, 5) | CONFLITO_BIT(m, 6) | CONFLITO_BIT(m, 7) | CONFLITO_BIT(m, 8) | \
+    CONFLITO_BIT(m, 9) | CONFLITO_BIT(m, 10) | CONFLITO_BIT(m, 11))
+
+// Um conjunto de movimentos é legal se nenhum deles conflita com outro do conjunto
+#define CONFLITO_EM(mov, m) ((((mov) >> (m)) & 1u) ? CONFLITOS(m) & (mov) : 0u)
+#define MOVIMENTOS_LEGAIS(mov) ((CONFLITO_EM(mov, 0) | CONFLITO_EM(mov, 1) | CONFLITO_EM(mov, 2) | \
+    CONFLITO_EM(mov, 3) | CONFLITO_EM(mov, 4) | CONFLITO_EM(mov, 5) | CONFLITO_EM(mov, 6) | CONFLITO_EM(mov, 7) | \
+    CONFLITO_EM(mov, 8) | CONFLITO_EM(mov, 9) | CONFLITO_EM(mov, 10) | CONFLITO_EM(mov, 11)) == 0)
+
+#define MOVS_APROXIMACAO(d, tipos) ((uint32_t)(tipos) << MOVIMENTO(d, 0)) // `tipos`: bit 0 reto, 1 direita, 2 esquerda
+#define MOVS_EIXO(d1, d2, tipos) (MOVS_APROXIMACAO(d1, tipos) | MOVS_APROXIMACAO(d2, tipos))
+#define MOVS_VERTICAL_RETO_DIREITA MOVS_EIXO(NS, SN, 3u)
+#define MOVS_VERTICAL_ESQUERDA MOVS_EIXO(NS, SN, 4u)
+#define MOVS_HORIZONTAL_RETO_DIREITA MOVS_EIXO(EW, WE, 3u)
+#define MOVS_HORIZONTAL_ESQUERDA MOVS_EIXO(EW, WE, 4u)
+
+// A geometria tem que produzir os conflitos clássicos, e os estágios protegidos, nenhum
+typedef char verificarConflitoRetoCruzado[MOVIMENTOS_CONFLITAM(MOVIMENTO(NS, MOVIMENTO_RETO), MOVIMENTO(EW, MOVIMENTO_RETO)) ? 1 : -1];
+typedef char verificarConflitoEsquerdaOposta[MOVIMENTOS_CONFLITAM(MOVIMENTO(NS, MOVIMENTO_ESQUERDA), MOVIMENTO(SN, MOVIMENTO_RETO)) ? 1 : -1];
+typedef char verificarConflitoMesmaSaida[MOVIMENTOS_CONFLITAM(MOVIMENTO(NS, MOVIMENTO_DIREITA), MOVIMENTO(EW, MOVIMENTO_RETO)) ? 1 : -1];
+typedef char verificarRetosOpostos[!MOVIMENTOS_CONFLITAM(MOVIMENTO(NS, MOVIMENTO_RETO), MOVIMENTO(SN, MOVIMENTO_RETO)) ? 1 : -1];
+typedef char verificarEstagioVerticalRetoDireita[MOVIMENTOS_LEGAIS(MOVS_VERTICAL_RETO_DIREITA) ? 1 : -1];
+typedef char verificarEstagioVerticalEsquerda[MOVIMENTOS_LEGAIS(MOVS_VERTICAL_ESQUERDA) ? 1 : -1];
+typedef char verificarEstagioHorizontalRetoDireita[MOVIMENTOS_LEGAIS(MOVS_HORIZONTAL_RETO_DIREITA) ? 1 : -1];
+typedef char verificarEstagioHorizontalEsquerda[MOVIMENTOS_LEGAIS(MOVS_HORIZONTAL_ESQUERDA) ? 1 : -1];
+
+/**
+ * @brief Movimentos que conflitam com cada movimento, gerados na compilação.
+ */
+static const uint16_t conflitosMovimento[NUM_MOVIMENTOS] = {
+    CONFLITOS(0), CONFLITOS(1), CONFLITOS(2), CONFLITOS(3), CONFLITOS(4), CONFLITOS(5),
+    CONFLITOS(6), CONFLITOS(7), CONFLITOS(8), CONFLITOS(9), CONFLITOS(10), CONFLITOS(11)
+};
+
+/**
+ * @brief Tipo do movimento de quem chega na direção `chegada` e sai na direção `saida`.
+ *
+ * O retorno (sair na direção oposta) é feito como uma conversão à esquerda.
+ */
+static inline int movimentoTipo(int chegada, int saida) {
+    if (saida == chegada) return MOVIMENTO_RETO;
+    return (saida == DIRECAO_DIREITA(chegada)) ? MOVIMENTO_DIREITA : MOVIMENTO_ESQUERDA;
+}
+
+/**
+ * @brief Retorna 1 se nenhum movimento de `movimentos` (12 bits) conflita com outro do conjunto.
+ */
+static inline int movimentosLegais(uint32_t movimentos) {
+    uint32_t conflitos = 0;
+    for (uint32_t resto = movimentos; resto != 0; resto &= resto - 1) {
+        int m = 0;
+        while (!((resto >> m) & 1u)) m++;
+        conflitos |= conflitosMovimento[m];
+    }
+    return (conflitos & movimentos) == 0;
+}
+
+/*----------------- ESTADO DOS SEMÁFOROS ------------------*/
+
+/*
+ * O estado dos semáforos de um cruzamento é publicado em uma única palavra de
+ * 32 bits: os bits 0 a 3 indicam as aproximações com algum movimento aberto,
+ * os bits 4 a 15 os movimentos abertos, os bits 16 a 17 o estágio do plano, o
+ * bit 18 o plano protegido e os bits 20 a 31 contam as trocas. Uma troca de
+ * fase é uma única escrita atômica e um leitor nunca enxerga NS e EW abertos
+ * ao mesmo tempo; "este movimento pode seguir?" é um único AND.
+ *
+ * O plano permissivo tem dois estágios, um por eixo, com todos os movimentos
+ * do eixo (quem vira à esquerda cruza o fluxo oposto). O protegido tem quatro:
+ * reto e direita de um eixo, as esquerdas dele, e o mesmo no outro eixo, todos
+ * sem conflito. Sem conversões (modo mesoscópico ou VIAGENS_OD = 0) só há
+ * movimentos retos, que nunca conflitam no plano permissivo, e ele é usado.
+ */
+#define FASE_ABERTO(direcao) (1u << ((direcao) - 1))            // Bit da direção na palavra de fase
+#define FASE_VERTICAL (FASE_ABERTO(NS) | FASE_ABERTO(SN))        // Norte-sul aberto
+#define FASE_HORIZONTAL (FASE_ABERTO(EW) | FASE_ABERTO(WE))      // Leste-oeste aberto
+#define FASE_DIRECOES (FASE_VERTICAL | FASE_HORIZONTAL)          // Máscara dos bits de direção
+#define FASE_MOVIMENTO(m) (1u << (4 + (m)))                      // Bit do movimento na palavra de fase
+#define FASE_MOVIMENTOS(mov) ((uint32_t)(mov) << 4)              // Máscara de movimentos (12 bits) na palavra de fase
+#define FASE_ESTAGIO(fase) (((fase) >> 16) & 3u)                 // Estágio do plano
+#define FASE_PROTEGIDA 0x40000u                                  // Plano protegido (quatro estágios)
+#define FASE_TROCA 0x100000u                                     // Incremento do contador de trocas
+
+/**
+ * @brief Palavra (sem contador) de cada estágio dos planos permissivo e protegido.
+ */
+static const uint32_t estagiosPermissivos[2] = {
+    FASE_VERTICAL | FASE_MOVIMENTOS(MOVS_VERTICAL_RETO_DIREITA | MOVS_VERTICAL_ESQUERDA),
+    (1u << 16) | FASE_HORIZONTAL | FASE_MOVIMENTOS(MOVS_HORIZONTAL_RETO_DIREITA | MOVS_HORIZONTAL_ESQUERDA)
+};
+static const uint32_t estagiosProtegidos[4] = {
+    FASE_PROTEGIDA | FASE_VERTICAL | FASE_MOVIMENTOS(MOVS_VERTICAL_RETO_DIREITA),
+    FASE_PROTEGIDA | (1u << 16) | FASE_VERTICAL | FASE_MOVIMENTOS(MOVS_VERTICAL_ESQUERDA),
+    FASE_PROTEGIDA | (2u << 16) | FASE_HORIZONTAL | FASE_MOVIMENTOS(MOVS_HORIZONTAL_RETO_DIREITA),
+    FASE_PROTEGIDA | (3u << 16) | FASE_HORIZONTAL | FASE_MOVIMENTOS(MOVS_HORIZONTAL_ESQUERDA)
+};
+
+/**
+ * @brief Calcula a palavra de fase do estágio seguinte do mesmo plano.
+ */
+static inline uint32_t faseAlternar(uint32_t fase) {
+    uint32_t troca = (fase & ~(FASE_TROCA - 1)) + FASE_TROCA;
+    if (fase & FASE_PROTEGIDA) return troca | estagiosProtegidos[(FASE_ESTAGIO(fase) + 1) & 3];
+    return troca | estagiosPermissivos[(FASE_ESTAGIO(fase) + 1) & 1];
+}
+
+/**
+ * @brief Retorna 1 se a direção estiver aberta na palavra de fase publicada em `fase`.
+ */
+static inline int faseAberta(volatile uint32_t* fase, int direcao) {
+    if (direcao < NS || direcao > WE) {
+        return 0; // Direção inválida
+    }
+
+    return (atomicoLer32(fase) & FASE_ABERTO(direcao)) ? 1 : 0;
+}
+
+/**
+ * @brief Retorna 1 se a palavra de fase é um estágio do seu plano e o plano protegido não abre movimentos em conflito.
+ *
+ * Usada para validar palavras de fase que vêm de fora (checkpoints).
+ */
+static inline int faseLegal(uint32_t fase) {
+    uint32_t estado = fase & (FASE_TROCA - 1);
+    if (!(fase & FASE_PROTEGIDA)) return FASE_ESTAGIO(fase) < 2 && estado == estagiosPermissivos[FASE_ESTAGIO(fase)];
+    return estado == estagiosProtegidos[FASE_ESTAGIO(fase)] && movimentosLegais((fase >> 4) & 0xFFFu);
+}
+
+/**
+ * @brief Retorna 1 se quem chega na direção `chegada` e sai na direção `saida` pode seguir na fase `fase`.
+ */
+static inline int faseLibera(uint32_t fase, int chegada, int saida) {
+    return (fase & FASE_MOVIMENTO(MOVIMENTO(chegada, movimentoTipo(chegada, saida)))) != 0;
+}
+
+/**
+ * @brief Palavra de fase inicial de um cruzamento: os pares começam com norte-sul aberto.
+ *
+ * No plano protegido começam pelas esquerdas do eixo, de modo que a primeira
+ * troca abre o outro eixo, como no permissivo.
+ *
+ * @param protegida 1 para o plano protegido, 0 para o permissivo.
+ */
+static inline uint32_t faseInicial(int indice, int protegida) {
+    if (protegida) return estagiosProtegidos[(indice % 2 == 0) ? 1 : 3];
+    return estagiosPermissivos[(indice % 2 == 0) ? 0 : 1];
+}
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) || ( MODO_SIMULACAO == MODO_BENCH_SEMAFORO )
+
+/*
+ * Mapa de sinais da rede: o estado de todas as aproximações fica separado
+ * dos dados frios dos cruzamentos, em 2 bits por aproximação, um byte por
+ * cruzamento e 8 cruzamentos por palavra de 64 bits, num vetor alinhado à
+ * linha de cache. O bit menor do par indica verde e o maior, veículos
+ * parados na aproximação. Uma troca de fase é uma única troca atômica numa
+ * palavra (uma linha de cache), e as consultas à rede inteira percorrem 32
+ * aproximações por palavra sem desvios.
+ */
+#define SINAL_VERDE 1u                               // Bit menor do par: aproximação com verde
+#define SINAL_FILA  2u                               // Bit maior do par: veículos parados na aproximação
+#define SINAIS_PARES 0x5555555555555555ull           // Bit menor de todos os pares da palavra
+#define SINAIS_CRUZAMENTO(c) (8u * ((unsigned)(c) & 7u)) // Deslocamento do byte do cruzamento na palavra
+
+// Consultas à rede inteira (ver sinaisContar)
+#define SINAIS_VERDES             0 // Aproximações com verde
+#define SINAIS_VERMELHOS          1 // Aproximações com vermelho
+#define SINAIS_VERMELHOS_COM_FILA 2 // Aproximações com vermelho e veículos parados
+
+/**
+ * @brief Estado dos sinais de todos os cruzamentos da rede.
+ */
+typedef struct {
+    volatile uint64_t* palavras; /**< Byte c % 8 da palavra c / 8: os pares das direções NS, SN, EW e WE do cruzamento c. */
+    void* bloco;                 /**< Memória alocada; `palavras` é a sua parte alinhada a 64 bytes. */
+    int numCruzamentos;          /**< Cruzamentos da rede. */
+    int numPalavras;             /**< Palavras do vetor, em linhas de cache inteiras. */
+} MapaSinais;
+
+/**
+ * @brief Aloca o mapa de `numCruzamentos` cruzamentos com todos os sinais vermelhos e sem filas.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int sinaisCriar(MapaSinais* mapa, int numCruzamentos) {
+    *mapa = (MapaSinais){ 0 };
+    mapa->numCruzamentos = numCruzamentos;
+    mapa->numPalavras = ((numCruzamentos + 63) / 64) * 8;
+    mapa->bloco = calloc((size_t)mapa->numPalavras * sizeof(uint64_t) + 64, 1);
+    if (mapa->bloco == NULL) return 0;
+
+    mapa->palavras = (volatile uint64_t*)(((uintptr_t)mapa->bloco + 63) & ~(uintptr_t)63);
+    return 1;
+}
+
+#if ( MODO_SIMULACAO == MODO_BENCH_SEMAFORO )
+static void sinaisLiberar(MapaSinais* mapa) {
+    free(mapa->bloco);
+    *mapa = (MapaSinais){ 0 };
+}
+#endif
+
+/**
+ * @brief Troca atomicamente os bits `mascara` do byte do cruzamento `c` por `valor`.
+ *
+ * Cada cruzamento tem um só escritor por vez, mas a palavra é dividida com
+ * outros sete, então a escrita é uma troca condicional que preserva os vizinhos.
+ */
+static inline void sinaisGravar(MapaSinais* mapa, int c, uint32_t mascara, uint32_t valor) {
+    volatile uint64_t* palavra = &mapa->palavras[c >> 3];
+    uint64_t m = (uint64_t)mascara << SINAIS_CRUZAMENTO(c);
+    uint64_t v = (uint64_t)valor << SINAIS_CRUZAMENTO(c);
+    uint64_t atual;
+
+    do {
+        atual = atomicoLerRelaxado64(palavra);
+    } while ((atual & m) != v && !atomicoTrocarSeIgual64(palavra, atual, (atual & ~m) | v));
+}
+
+/**
+ * @brief Publica no mapa as direções abertas da palavra de fase `fase` do cruzamento `c`.
+ *
+ * As quatro direções mudam na mesma escrita: um leitor nunca vê NS e EW abertos juntos.
+ */
+static inline void sinaisPublicarFase(MapaSinais* mapa, int c, uint32_t fase) {
+    uint32_t verdes = 0;
+    for (int d = NS; d <= WE; d++) {
+        if (fase & FASE_ABERTO(d)) verdes |= SINAL_VERDE << (2 * (d - 1));
+    }
+    sinaisGravar(mapa, c, (uint32_t)(SINAIS_PARES & 0xFF), verdes);
+}
+
+/**
+ * @brief Marca se há veículos parados na aproximação `direcao` do cruzamento `c`.
+ */
+static inline void sinaisMarcarFila(MapaSinais* mapa, int c, int direcao, int parados) {
+    sinaisGravar(mapa, c, SINAL_FILA << (2 * (direcao - 1)), parados ? SINAL_FILA << (2 * (direcao - 1)) : 0);
+}
+
+/**
+ * @brief Retorna 1 se a aproximação `direcao` do cruzamento `c` estiver com verde.
+ */
+static inline int sinaisVerde(const MapaSinais* mapa, int c, int direcao) {
+    if (direcao < NS || direcao > WE) return 0; // Direção inválida
+
+    uint64_t palavra = atomicoLerRelaxado64(&mapa->palavras[c >> 3]);
+    return (int)(palavra >> (SINAIS_CRUZAMENTO(c) + 2 * (direcao - 1))) & 1;
+}
+
+/**
+ * @brief Pares que atendem à consulta, um bit no bit menor de cada par.
+ */
+static inline uint64_t sinaisSelecionar(uint64_t palavra, int consulta) {
+    switch (consulta) {
+    case SINAIS_VERDES: return palavra & SINAIS_PARES;
+    case SINAIS_VERMELHOS_COM_FILA: return (palavra >> 1) & ~palavra & SINAIS_PARES;
+    default: return ~palavra & SINAIS_PARES;
+    }
+}
+
+/**
+ * @brief Conta as aproximações da rede que atendem à consulta (SINAIS_VERDES...).
+ *
+ * Cada palavra vale 32 aproximações: a seleção e a contagem de bits são
+ * operações de palavra, sem desvio por aproximação, e o compilador vetoriza
+ * o laço. As palavras são lidas uma a uma, então a contagem é uma fotografia
+ * de cada grupo de 8 cruzamentos, não da rede num mesmo instante.
+ */
+static int sinaisContar(const MapaSinais* mapa, int consulta) {
+    int selecao = (consulta == SINAIS_VERMELHOS) ? SINAIS_VERDES : consulta;
+    uint64_t total = 0;
+
+    for (int i = 0; i < mapa->numPalavras; i++) {
+        // Contagem de bits de pares: soma em campos de 4, 8 e depois 64 bits
+        uint64_t x = sinaisSelecionar(atomicoLerRelaxado64(&mapa->palavras[i]), selecao);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        total += (x * 0x0101010101010101ull) >> 56;
+    }
+
+    // Os cruzamentos de preenchimento do fim do vetor não têm verde nem fila
+    int contadas = (int)total;
+    return (consulta == SINAIS_VERMELHOS) ? NUM_DIRECOES * mapa->numCruzamentos - contadas : contadas;
+}
+
+#if ( MODO_SIMULACAO == MODO_BENCH_SEMAFORO )
+/**
+ * @brief Posição do bit menos significativo ligado de `x` (diferente de zero).
+ */
+static inline int bitMenor64(uint64_t x) {
+#if defined( _MSC_VER )
+    // Em duas metades, porque _BitScanForward64 não existe no x86 de 32 bits
+    unsigned long posicao;
+    if (_BitScanForward(&posicao, (unsigned long)x)) return (int)posicao;
+    _BitScanForward(&posicao, (unsigned long)(x >> 32));
+    return (int)posicao + 32;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+/**
+ * @brief Lista as aproximações que atendem à consulta, como cruzamento * NUM_DIRECOES + direção - 1.
+ *
+ * Palavras sem nenhuma aproximação selecionada são puladas de uma vez, e
+ * nas demais só os bits ligados são visitados.
+ *
+ * @return Quantidade de aproximações gravadas em `saida` (no máximo `maximo`).
+ */
+static int sinaisListar(const MapaSinais* mapa, int consulta, int* saida, int maximo) {
+    int n = 0;
+
+    for (int i = 0; i < mapa->numPalavras && n < maximo; i++) {
+        uint64_t x = sinaisSelecionar(atomicoLerRelaxado64(&mapa->palavras[i]), consulta);
+        for (; x != 0 && n < maximo; x &= x - 1) {
+            int aproximacao = i * 32 + bitMenor64(x) / 2;
+            if (aproximacao >= NUM_DIRECOES * mapa->numCruzamentos) break; // Preenchimento do fim do vetor
+            saida[n++] = aproximacao;
+        }
+    }
+    return n;
+}
+#endif
+
+#endif /* MODO_SIMULACAO == MODO_TEMPO_REAL || MODO_SIMULACAO == MODO_BENCH_SEMAFORO */
+
+/*----------------- REDE VIÁRIA ------------------*/
+
+/**
+ * @brief Plano semafórico de um cruzamento.
+ *
+ * As duas fases se alternam: norte-sul aberto por `verdeMs[0]` e leste-oeste
+ * aberto por `verdeMs[1]`. A primeira troca acontece em `defasagemMs`, o que
+ * permite coordenar cruzamentos vizinhos (onda verde).
+ */
+typedef struct {
+    uint32_t verdeMs[2];  /**< Duração do verde norte-sul e leste-oeste, em ms. */
+    uint32_t defasagemMs; /**< Instante da primeira troca de fase, em ms. */
+} PlanoSemaforico;
+
+// Perfis de demanda de uma entrada
+#define PERFIL_CONSTANTE 0 // Taxa de chegada constante ao longo do dia
+#define PERFIL_HORARIO   1 // Taxa multiplicada pela curva horária (picos da manhã e do fim da tarde)
+
+/**
+ * @brief Demanda própria de uma entrada (cruzamento onde veículos entram na rede).
+ *
+ * As chegadas formam um processo de Poisson com a taxa média informada,
+ * constante ou modulada pela hora do dia simulada.
+ */
+typedef struct {
+    uint32_t veiculosPorHora; /**< Taxa média de chegada (0: a entrada não tem demanda própria). */
+    uint32_t perfil;          /**< PERFIL_CONSTANTE ou PERFIL_HORARIO. */
+} DemandaEntrada;
+
+/**
+ * @brief Tabela de rotas: direção do próximo salto de cada cruzamento até cada saída da rede.
+ *
+ * Montada por `rotasCriar` junto com a rede (ver a seção de rotas). O
+ * próximo salto depende também da direção em que o veículo chegou, para
+ * que a rota nunca mande fazer o retorno. Os
+ * vetores `distancia` e `heap` são a área de trabalho do recálculo de uma
+ * coluna, reaproveitada quando uma via é fechada.
+ */
+typedef struct {
+    int numSaidas;            /**< Saídas da rede: direções de um cruzamento sem via (colunas da tabela). */
+    int* saidas;              /**< Saída de cada coluna, como cruzamento * NUM_DIRECOES + direção - 1. */
+    int* colunaSaida;         /**< Coluna de cada cruzamento * NUM_DIRECOES + direção - 1 (-1 se não for saída). */
+    size_t bytesColuna;       /**< Bytes de uma coluna: 4 bits por estado (ROTAS_ESTADOS por cruzamento). */
+    uint8_t* proximo;         /**< Próximo salto (NS..WE; 0 sem caminho), coluna após coluna. */
+    uint8_t* viaFechada;      /**< 1 para as vias fechadas, que as rotas evitam. */
+    int* entradaInicio;       /**< Início das vias que chegam a cada cruzamento em `entradaVia` [numCruzamentos + 1]. */
+    int* entradaVia;          /**< Vias agrupadas pelo cruzamento de destino. */
+    uint32_t* distancia;      /**< Área de trabalho: tempo até a saída de cada chegada, em ms. */
+    uint64_t* heap;           /**< Área de trabalho: fila de prioridade do recálculo. */
+    uint64_t colunasRefeitas; /**< Colunas recalculadas por fechamentos de via. */
+} TabelaRotas;
+
+/**
+ * @brief Rede viária: cruzamentos e vias (links) dirigidas em vetores contíguos.
+ *
+ * As vias que saem do cruzamento `i` ocupam as posições `adjInicio[i]` até
+ * `adjInicio[i + 1] - 1` dos vetores `link*` (adjacência no formato CSR), de
+ * modo que percorrer a rede não segue ponteiros entre blocos alocados
+ * separadamente. A rede é montada por `redeIniciar`, `redeAdicionarLink` e
+ * `redeFinalizar`, ou diretamente por `redeCriarGrade`.
+ */
+typedef struct {
+    int numCruzamentos;          /**< Quantidade de cruzamentos. */
+    int numLinks;                /**< Quantidade de vias já finalizadas. */
+    int capacidadeLinks;         /**< Capacidade dos vetores de vias. */
+    int linhas;                  /**< Linhas da grade (0 se a rede não for uma grade). */
+    int colunas;                 /**< Colunas da grade (0 se a rede não for uma grade). */
+    int* adjInicio;              /**< Início das vias de saída de cada cruzamento [numCruzamentos + 1]. */
+    int* linkOrigem;             /**< Cruzamento de origem de cada via. */
+    int* linkDestino;            /**< Cruzamento de destino de cada via. */
+    uint8_t* linkDirecao;        /**< Direção de deslocamento na via (NS, SN, EW, WE). */
+    uint8_t* linkVelocidadeMax;  /**< Velocidade máxima permitida na via, em km/h. */
+    uint32_t* linkComprimento;   /**< Comprimento da via, em metros. */
+    char (*nome)[16];            /**< Nome de cada cruzamento ("A".."Z" ou "L<linha>C<coluna>"). */
+    PlanoSemaforico* plano;      /**< Plano semafórico de cada cruzamento. */
+    DemandaEntrada* demanda;     /**< Demanda própria de cada cruzamento (toda zerada: geração única da rede). */
+    TabelaRotas* rotas;          /**< Rotas até as saídas da rede (NULL: os veículos seguem reto). */
+} Rede;
+
+/**
+ * @brief Libera a tabela de rotas da rede, se houver.
+ */
+static void rotasLiberar(Rede* rede) {
+    TabelaRotas* rotas = rede->rotas;
+    if (rotas == NULL) return;
+
+    free(rotas->saidas);
+    free(rotas->colunaSaida);
+    free(rotas->proximo);
+    free(rotas->viaFechada);
+    free(rotas->entradaInicio);
+    free(rotas->entradaVia);
+    free(rotas->distancia);
+    free(rotas->heap);
+    free(rotas);
+    rede->rotas = NULL;
+}
+
+/**
+ * @brief Libera a memória de uma rede.
+ */
+static void redeLiberar(Rede* rede) {
+    free(rede->adjInicio);
+    free(rede->linkOrigem);
+    free(rede->linkDestino);
+    free(rede->linkDirecao);
+    free(rede->linkVelocidadeMax);
+    free(rede->linkComprimento);
+    free(rede->nome);
+    free(rede->plano);
+    free(rede->demanda);
+    rotasLiberar(rede);
+    *rede = (Rede){ 0 };
+}
+
+/**
+ * @brief Prepara uma rede vazia com `numCruzamentos` cruzamentos.
+ *
+ * @param capacidadeLinks Estimativa de vias; os vetores crescem se for excedida.
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int redeIniciar(Rede* rede, int numCruzamentos, int capacidadeLinks) {
+    *rede = (Rede){ 0 };
+    rede->numCruzamentos = numCruzamentos;
+    rede->adjInicio = (int*)calloc((size_t)numCruzamentos + 1, sizeof(int));
+    rede->nome = (char(*)[16])calloc((size_t)numCruzamentos, sizeof(*rede->nome));
+    rede->plano = (PlanoSemaforico*)malloc((size_t)numCruzamentos * sizeof(PlanoSemaforico));
+    rede->demanda = (DemandaEntrada*)calloc((size_t)numCruzamentos, sizeof(DemandaEntrada));
+    if (rede->adjInicio == NULL || rede->nome == NULL || rede->plano == NULL || rede->demanda == NULL) {
+        redeLiberar(rede);
+        return 0;
+    }
+
+    for (int i = 0; i < numCruzamentos; i++) {
+        rede->plano[i] = (PlanoSemaforico){ { TEMPO_CICLO * 1000, TEMPO_CICLO * 1000 }, 0 };
+        if (numCruzamentos <= 26) {
+            rede->nome[i][0] = (char)('A' + i);
+        }
+        else {
+            snprintf(rede->nome[i], sizeof(rede->nome[i]), "%d", i);
+        }
+    }
+
+    if (capacidadeLinks < 4) capacidadeLinks = 4;
+    rede->capacidadeLinks = capacidadeLinks;
+    rede->linkOrigem = (int*)malloc((size_t)capacidadeLinks * sizeof(int));
+    rede->linkDestino = (int*)malloc((size_t)capacidadeLinks * sizeof(int));
+    rede->linkDirecao = (uint8_t*)malloc((size_t)capacidadeLinks);
+    rede->linkVelocidadeMax = (uint8_t*)malloc((size_t)capacidadeLinks);
+    rede->linkComprimento = (uint32_t*)malloc((size_t)capacidadeLinks * sizeof(uint32_t));
+    if (!rede->linkOrigem || !rede->linkDestino || !rede->linkDirecao || !rede->linkVelocidadeMax || !rede->linkComprimento) {
+        redeLiberar(rede);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Acrescenta uma via dirigida à rede em construção.
+ *
+ * As vias podem ser adicionadas em qualquer ordem; `redeFinalizar` as agrupa
+ * por cruzamento de origem.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória ou a via for inválida.
+ */
+static int redeAdicionarLink(Rede* rede, int origem, int destino, int direcao, uint32_t comprimento, int velocidadeMax) {
+    if (origem < 0 || origem >= rede->numCruzamentos || destino < 0 || destino >= rede->numCruzamentos ||
+        direcao < NS || direcao > WE) {
+        return 0;
+    }
+
+    if (rede->numLinks == rede->capacidadeLinks) {
+        int capacidade = rede->capacidadeLinks * 2;
+        int* o = (int*)realloc(rede->linkOrigem, (size_t)capacidade * sizeof(int));
+        if (o) rede->linkOrigem = o;
+        int* d = (int*)realloc(rede->linkDestino, (size_t)capacidade * sizeof(int));
+        if (d) rede->linkDestino = d;
+        uint8_t* dir = (uint8_t*)realloc(rede->linkDirecao, (size_t)capacidade);
+        if (dir) rede->linkDirecao = dir;
+        uint8_t* v = (uint8_t*)realloc(rede->linkVelocidadeMax, (size_t)capacidade);
+        if (v) rede->linkVelocidadeMax = v;
+        uint32_t* c = (uint32_t*)realloc(rede->linkComprimento, (size_t)capacidade * sizeof(uint32_t));
+        if (c) rede->linkComprimento = c;
+        if (!o || !d || !dir || !v || !c) return 0;
+        rede->capacidadeLinks = capacidade;
+    }
+
+    int l = rede->numLinks++;
+    rede->linkOrigem[l] = origem;
+    rede->linkDestino[l] = destino;
+    rede->linkDirecao[l] = (uint8_t)direcao;
+    rede->linkVelocidadeMax[l] = (uint8_t)velocidadeMax;
+    rede->linkComprimento[l] = comprimento;
+    rede->adjInicio[origem + 1]++; // Contagem provisória de vias por origem
+    return 1;
+}
+
+/**
+ * @brief Ordena as vias por origem (ordenação por contagem) e monta a adjacência CSR.
+ *
+ * Custo O(cruzamentos + vias). Dentro de cada cruzamento a ordem de inserção é mantida.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int redeFinalizar(Rede* rede) {
+    int n = rede->numCruzamentos;
+    int l = rede->numLinks;
+
+    for (int i = 0; i < n; i++) {
+        rede->adjInicio[i + 1] += rede->adjInicio[i];
+    }
+
+    int* posicao = (int*)malloc((size_t)n * sizeof(int));
+    int* ordem = (int*)malloc((size_t)(l ? l : 1) * sizeof(int));
+    if (posicao == NULL || ordem == NULL) {
+        free(posicao);
+        free(ordem);
+        return 0;
+    }
+    memcpy(posicao, rede->adjInicio, (size_t)n * sizeof(int));
+    for (int k = 0; k < l; k++) {
+        ordem[posicao[rede->linkOrigem[k]]++] = k;
+    }
+
+    // Aplica a permutação em cada vetor usando um buffer temporário
+    void* temporario = malloc((size_t)(l ? l : 1) * sizeof(uint32_t));
+    if (temporario == NULL) {
+        free(posicao);
+        free(ordem);
+        return 0;
+    }
+#define REDE_PERMUTAR(vetor, tipo)                                              \
+    do {                                                                        \
+        tipo* t = (tipo*)temporario;                                            \
+        for (int k = 0; k < l; k++) t[k] = rede->vetor[ordem[k]];               \
+        memcpy(rede->vetor, t, (size_t)l * sizeof(tipo));                       \
+    } while (0)
+    REDE_PERMUTAR(linkOrigem, int);
+    REDE_PERMUTAR(linkDestino, int);
+    REDE_PERMUTAR(linkDirecao, uint8_t);
+    REDE_PERMUTAR(linkVelocidadeMax, uint8_t);
+    REDE_PERMUTAR(linkComprimento, uint32_t);
+#undef REDE_PERMUTAR
+
+    free(temporario);
+    free(posicao);
+    free(ordem);
+    return 1;
+}
+
+/**
+ * @brief Indica se as dimensões de grade lidas de um arquivo combinam com a quantidade de cruzamentos.
+ *
+ * Uma rede que não é grade tem as duas dimensões 0; uma grade tem linhas x
+ * colunas = cruzamentos, conferido em 64 bits para que o produto não estoure.
+ */
+static inline int redeGradeValida(int32_t linhas, int32_t colunas, int32_t numCruzamentos) {
+    if (linhas == 0 && colunas == 0) return 1;
+    return linhas > 0 && colunas > 0 && (uint64_t)linhas * (uint64_t)colunas == (uint64_t)numCruzamentos;
+}
+
+/**
+ * @brief Indica se um plano semafórico lido de um arquivo respeita os limites do cenário em texto.
+ *
+ * Os dois verdes ficam entre 1 ms e REDE_MAX_VERDE_S, então o ciclo (a soma
+ * deles) é positivo e cabe em 32 bits, e a defasagem não passa do mesmo limite.
+ */
+static inline int redePlanoValido(const PlanoSemaforico* plano) {
+    return plano->verdeMs[0] > 0 && plano->verdeMs[0] <= REDE_MAX_VERDE_S * 1000u && plano->verdeMs[1] > 0 &&
+        plano->verdeMs[1] <= REDE_MAX_VERDE_S * 1000u && plano->defasagemMs <= REDE_MAX_VERDE_S * 1000u;
+}
+
+/**
+ * @brief Cria uma grade de `linhas` x `colunas` cruzamentos ligados aos vizinhos nas quatro direções.
+ *
+ * O cruzamento da linha `r` e coluna `c` tem índice `r * colunas + c`. Com
+ * 2x2 reproduz a rede A B / C D do README.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static inline int redeCriarGrade(Rede* rede, int linhas, int colunas) {
+    int n = linhas * colunas;
+    int links = 2 * (linhas * (colunas - 1) + colunas * (linhas - 1));
+
+    if (linhas <= 0 || colunas <= 0 || !redeIniciar(rede, n, links)) return 0;
+    rede->linhas = linhas;
+    rede->colunas = colunas;
+
+    for (int r = 0; r < linhas; r++) {
+        for (int c = 0; c < colunas; c++) {
+            int i = r * colunas + c;
+            if (n > 26) snprintf(rede->nome[i], sizeof(rede->nome[i]), "L%huC%hu", (unsigned short)r, (unsigned short)c);
+
+            // Ordem de inserção NS, SN, EW, WE, já agrupada por origem
+            if (r + 1 < linhas) redeAdicionarLink(rede, i, i + colunas, NS, REDE_COMPRIMENTO_M, VELOCIDADE_MAX_NS);
+            if (r > 0) redeAdicionarLink(rede, i, i - colunas, SN, REDE_COMPRIMENTO_M, VELOCIDADE_MAX_NS);
+            if (c > 0) redeAdicionarLink(rede, i, i - 1, EW, REDE_COMPRIMENTO_M, VELOCIDADE_MAX_EW);
+            if (c + 1 < colunas) redeAdicionarLink(rede, i, i + 1, WE, REDE_COMPRIMENTO_M, VELOCIDADE_MAX_EW);
+        }
+    }
+    return redeFinalizar(rede);
+}
+
+/**
+ * @brief Duração do verde aberto pela fase `fase` no cruzamento `c`, em ms.
+ *
+ * No plano protegido o verde do eixo é dividido entre o estágio de reto e
+ * direita e o das esquerdas (FASES_ESQUERDA_PCT), e o ciclo não muda.
+ */
+static inline uint32_t redeVerdeMs(const Rede* rede, int c, uint32_t fase) {
+    uint32_t verde = rede->plano[c].verdeMs[(fase & FASE_VERTICAL) ? 0 : 1];
+    if (!(fase & FASE_PROTEGIDA)) return verde;
+
+    uint32_t esquerda = (uint32_t)((uint64_t)verde * FASES_ESQUERDA_PCT / 100);
+    return (FASE_ESTAGIO(fase) & 1u) ? esquerda : verde - esquerda;
+}
+
+/**
+ * @brief Tempo para percorrer a via `link`, em segundos inteiros.
+ *
+ * O veículo anda na própria velocidade, limitada pela máxima da via. Sem via
+ * (`link` = -1) ele percorre a distância padrão até sair da rede.
+ */
+static inline int redeTempoPercurso(const Rede* rede, int link, int velocidade) {
+    uint32_t comprimento = REDE_COMPRIMENTO_M;
+
+    if (link >= 0) {
+        comprimento = rede->linkComprimento[link];
+        if (velocidade > rede->linkVelocidadeMax[link]) velocidade = rede->linkVelocidadeMax[link];
+    }
+    return (int)round(comprimento / (velocidade * 0.27778));
+}
+
+/**
+ * @brief Indica se alguma entrada tem demanda própria; caso contrário a rede usa a geração única.
+ */
+static inline int redeDemandaPorEntrada(const Rede* rede) {
+    for (int c = 0; c < rede->numCruzamentos; c++) {
+        if (rede->demanda[c].veiculosPorHora > 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Quantos veículos cabem parados na via `link` (pelo menos um).
+ */
+static inline uint32_t redeCapacidadeVia(const Rede* rede, int link) {
+    uint32_t capacidade = (uint32_t)((uint64_t)rede->linkComprimento[link] * 100 / ESPACAMENTO_VEICULO_CM);
+    return capacidade > 0 ? capacidade : 1;
+}
+
+/**
+ * @brief Tempo para a vaga deixada por quem sai da via `link` chegar à entrada dela, em ms.
+ *
+ * A vaga volta pela fila como uma onda, mais devagar que os veículos andam.
+ * No modo paralelo esse atraso é o que avisa a região de origem de uma via
+ * de fronteira sobre as vagas antes de ela precisar delas.
+ */
+static inline uint64_t redeAtrasoVaga(const Rede* rede, int link) {
+    return (uint64_t)rede->linkComprimento[link] * 3600 / VELOCIDADE_ONDA_VAGA_KMH;
+}
+
+/**
+ * @brief Retorna a via que sai do cruzamento na direção dada, ou -1 se o veículo sair da rede.
+ */
+static inline int redeLinkNaDirecao(const Rede* rede, int cruzamento, int direcao) {
+    for (int l = rede->adjInicio[cruzamento]; l < rede->adjInicio[cruzamento + 1]; l++) {
+        if (rede->linkDirecao[l] == direcao) return l;
+    }
+    return -1;
+}
+
+/*----------------- ROTAS ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) || ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) || \
+    ( MODO_SIMULACAO == MODO_PARALELO ) || ( MODO_SIMULACAO == MODO_BENCH_SIMULADOR ) || \
+    ( MODO_SIMULACAO == MODO_MESOSCOPICO ) || ( MODO_SIMULACAO == MODO_CONJUNTO )
+
+#define ROTAS_TENTATIVAS_DESTINO 8 // Sorteios de saída até achar uma alcançável a partir da entrada
+#define ROTAS_ESTADOS (NUM_DIRECOES + 1) // Estados por cruzamento: a entrada na rede (0) e a chegada em cada direção
+
+/**
+ * @brief Direção do próximo salto no cruzamento `c` até a saída da coluna `coluna` (0: sem caminho).
+ *
+ * @param chegada Direção em que o veículo chegou ao cruzamento (NS..WE), ou 0 ao entrar na rede por ele.
+ */
+static inline int rotasSalto(const TabelaRotas* rotas, int c, int chegada, int coluna) {
+    size_t estado = (size_t)c * ROTAS_ESTADOS + (size_t)chegada;
+    uint8_t par = rotas->proximo[(size_t)coluna * rotas->bytesColuna + (estado >> 1)];
+    return (estado & 1) ? par >> 4 : par & 0x0F;
+}
+
+/**
+ * @brief Direção em que o veículo deixa o cruzamento `c` rumo à saída `destino`.
+ *
+ * `direcao` é a direção em que ele chegou (0 ao entrar na rede por `c`);
+ * a direção devolvida nunca é a oposta a ela. No cruzamento da saída é a
+ * direção que deixa a rede, a menos que ela seja o retorno. Sem viagem
+ * (`destino` = -1), sem tabela ou sem caminho (vias fechadas) o veículo
+ * segue na direção em que chegou, como antes das rotas.
+ */
+static inline int rotasProximaDirecao(const Rede* rede, int c, int direcao, int destino) {
+    const TabelaRotas* rotas = rede->rotas;
+    if (rotas == NULL || destino < 0) return direcao;
+
+    int salto = rotasSalto(rotas, c, direcao, rotas->colunaSaida[destino]);
+    return salto ? salto : direcao;
+}
+
+/**
+ * @brief Sorteia uma saída da rede alcançável a partir do cruzamento `origem`.
+ *
+ * @return A saída (cruzamento * NUM_DIRECOES + direção - 1), ou -1 sem tabela
+ *         ou se nenhuma saída sorteada for alcançável (o veículo segue reto).
+ */
+static inline int rotasSortearDestino(const Rede* rede, int origem, GeradorAleatorio* fluxo) {
+    const TabelaRotas* rotas = rede->rotas;
+    if (rotas == NULL || rotas->numSaidas == 0) return -1;
+
+    for (int t = 0; t < ROTAS_TENTATIVAS_DESTINO; t++) {
+        int coluna = (int)geradorIntervalo(fluxo, (uint32_t)rotas->numSaidas);
+        if (rotasSalto(rotas, origem, 0, coluna) != 0) return rotas->saidas[coluna];
+    }
+    return -1;
+}
+
+// O modelo mesoscópico segue em linha reta, como o modelo microscópico com que é validado, e não monta a tabela
+#if ( MODO_SIMULACAO != MODO_MESOSCOPICO ) && ( VIAGENS_OD == 1 )
+
+static inline void rotasHeapInserir(uint64_t* heap, int* tamanho, uint64_t item) {
+    int i = (*tamanho)++;
+    while (i > 0 && heap[(i - 1) / 2] > item) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = item;
+}
+
+static inline uint64_t rotasHeapRemover(uint64_t* heap, int* tamanho) {
+    uint64_t topo = heap[0];
+    uint64_t ultimo = heap[--(*tamanho)];
+    int i = 0;
+    for (;;) {
+        int filho = 2 * i + 1;
+        if (filho >= *tamanho) break;
+        if (filho + 1 < *tamanho && heap[filho + 1] < heap[filho]) filho++;
+        if (heap[filho] >= ultimo) break;
+        heap[i] = heap[filho];
+        i = filho;
+    }
+    if (*tamanho > 0) heap[i] = ultimo;
+    return topo;
+}
+
+static inline void rotasDefinirSalto(uint8_t* proximo, size_t estado, int direcao) {
+    proximo[estado >> 1] = (uint8_t)((estado & 1) ? (proximo[estado >> 1] & 0x0F) | (direcao << 4)
+                                                 : (proximo[estado >> 1] & 0xF0) | direcao);
+}
+
+/**
+ * @brief Recalcula a coluna `coluna`: o próximo salto de cada estado até a saída dela.
+ *
+ * Dijkstra a partir da saída pelas vias invertidas (`entradaInicio`), com o
+ * tempo de percurso na velocidade máxima como custo e as vias fechadas
+ * ignoradas. Os estados são (cruzamento, direção de chegada): quem chega
+ * em `a` não pode sair na direção oposta, então o retorno nunca entra na
+ * rota, nem mesmo no cruzamento da saída. Em empates o veículo segue reto.
+ * Os itens do heap são (distância << 32) | estado, então empates saem
+ * sempre na mesma ordem e a tabela é determinística. A entrada na rede
+ * (estado 0) aponta para a chegada mais próxima da saída que segue reto,
+ * de modo que o veículo criado já na direção do primeiro trecho não vira.
+ */
+static void rotasCalcularColuna(TabelaRotas* rotas, const Rede* rede, int coluna) {
+    uint8_t* proximo = rotas->proximo + (size_t)coluna * rotas->bytesColuna;
+    uint32_t* distancia = rotas->distancia;
+    int n = rede->numCruzamentos;
+    int tamanho = 0;
+
+    memset(proximo, 0, rotas->bytesColuna);
+    for (size_t e = 0; e < (size_t)n * NUM_DIRECOES; e++) distancia[e] = UINT32_MAX;
+
+    // Quem chega à saída em qualquer direção que não seja a oposta a ela deixa a rede
+    int saida = rotas->saidas[coluna];
+    int alvo = saida / NUM_DIRECOES, direcaoSaida = saida % NUM_DIRECOES + 1;
+    for (int a = NS; a <= WE; a++) {
+        if (a == DIRECAO_OPOSTA(direcaoSaida)) continue;
+        uint32_t estado = (uint32_t)alvo * NUM_DIRECOES + (uint32_t)(a - 1);
+        distancia[estado] = 0;
+        rotasDefinirSalto(proximo, (size_t)alvo * ROTAS_ESTADOS + (size_t)a, direcaoSaida);
+        rotasHeapInserir(rotas->heap, &tamanho, (uint64_t)estado);
+    }
+    while (tamanho > 0) {
+        uint64_t item = rotasHeapRemover(rotas->heap, &tamanho);
+        uint32_t estado = (uint32_t)item;
+        if ((uint32_t)(item >> 32) != distancia[estado]) continue; // Item antigo de um estado já resolvido
+
+        // Quem sai de `c` na direção `b` chega a ele pelas vias de entrada nessa direção
+        int c = (int)(estado / NUM_DIRECOES), b = (int)(estado % NUM_DIRECOES) + 1;
+        for (int k = rotas->entradaInicio[c]; k < rotas->entradaInicio[c + 1]; k++) {
+            int link = rotas->entradaVia[k];
+            if (rotas->viaFechada[link] || rede->linkDirecao[link] != b) continue;
+
+            int origem = rede->linkOrigem[link];
+            uint64_t custo = distancia[estado] + (uint64_t)rede->linkComprimento[link] * 3600u / rede->linkVelocidadeMax[link];
+            for (int a = NS; a <= WE; a++) {
+                if (a == DIRECAO_OPOSTA(b)) continue;
+                uint32_t anterior = (uint32_t)origem * NUM_DIRECOES + (uint32_t)(a - 1);
+                if (custo > distancia[anterior] || (custo == distancia[anterior] && a != b)) continue;
+                rotasDefinirSalto(proximo, (size_t)origem * ROTAS_ESTADOS + (size_t)a, b);
+                if (custo == distancia[anterior]) continue; // Empate: só troca a conversão por seguir reto
+                distancia[anterior] = (uint32_t)custo;
+                rotasHeapInserir(rotas->heap, &tamanho, (custo << 32) | anterior);
+            }
+        }
+    }
+
+    for (int c = 0; c < n; c++) {
+        uint32_t melhor = UINT32_MAX;
+        int entrada = 0;
+        for (int a = NS; a <= WE; a++) {
+            uint32_t d = distancia[(size_t)c * NUM_DIRECOES + (size_t)(a - 1)];
+            if (d < melhor && rotasSalto(rotas, c, a, coluna) == a) {
+                melhor = d;
+                entrada = a;
+            }
+        }
+        rotasDefinirSalto(proximo, (size_t)c * ROTAS_ESTADOS, entrada);
+    }
+}
+
+/**
+ * @brief Monta a tabela de rotas da rede já finalizada.
+ *
+ * Os destinos das viagens são as saídas da rede: cada direção de um
+ * cruzamento sem via nessa direção. A tabela tem uma coluna por saída e
+ * guarda, em 4 bits, a direção do próximo salto de cada cruzamento para
+ * cada direção de chegada e para a entrada na rede; na grade 100x100 são
+ * 400 colunas de 25000 bytes. Decidir a direção em um cruzamento é uma
+ * leitura, sem busca por veículo.
+ *
+ * @param fechadas Vias fechadas desde o início (NULL: todas abertas).
+ * @param proximo Tabela já calculada, copiada em vez de refeita se tiver
+ *                `bytesProximo` bytes, como na restauração de um checkpoint (NULL: calcular).
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int rotasCriar(Rede* rede, const uint8_t* fechadas, const uint8_t* proximo, size_t bytesProximo) {
+    int n = rede->numCruzamentos;
+    TabelaRotas* rotas = (TabelaRotas*)calloc(1, sizeof(TabelaRotas));
+    if (rotas == NULL) return 0;
+    rede->rotas = rotas;
+
+    rotas->saidas = (int*)malloc((size_t)n * NUM_DIRECOES * sizeof(int));
+    rotas->colunaSaida = (int*)malloc((size_t)n * NUM_DIRECOES * sizeof(int));
+    rotas->entradaInicio = (int*)calloc((size_t)n + 1, sizeof(int));
+    rotas->entradaVia = (int*)malloc((size_t)(rede->numLinks ? rede->numLinks : 1) * sizeof(int));
+    rotas->viaFechada = (uint8_t*)calloc((size_t)(rede->numLinks ? rede->numLinks : 1), 1);
+    rotas->distancia = (uint32_t*)malloc((size_t)n * NUM_DIRECOES * sizeof(uint32_t));
+    // Cada via, ao sair do heap a sua chegada, melhora no máximo as três chegadas à origem que não são o retorno
+    rotas->heap = (uint64_t*)malloc(((size_t)rede->numLinks * 3 + NUM_DIRECOES) * sizeof(uint64_t));
+    if (!rotas->saidas || !rotas->colunaSaida || !rotas->entradaInicio || !rotas->entradaVia ||
+        !rotas->viaFechada || !rotas->distancia || !rotas->heap) {
+        rotasLiberar(rede);
+        return 0;
+    }
+    if (fechadas != NULL) memcpy(rotas->viaFechada, fechadas, (size_t)rede->numLinks);
+
+    for (int c = 0; c < n; c++) {
+        for (int d = NS; d <= WE; d++) {
+            int saida = c * NUM_DIRECOES + d - 1;
+            rotas->colunaSaida[saida] = -1;
+            if (redeLinkNaDirecao(rede, c, d) >= 0) continue;
+            rotas->colunaSaida[saida] = rotas->numSaidas;
+            rotas->saidas[rotas->numSaidas++] = saida;
+        }
+    }
+
+    // Vias invertidas em CSR, agrupadas pelo cruzamento de destino (contagem como em redeFinalizar)
+    for (int l = 0; l < rede->numLinks; l++) rotas->entradaInicio[rede->linkDestino[l] + 1]++;
+    for (int c = 0; c < n; c++) rotas->entradaInicio[c + 1] += rotas->entradaInicio[c];
+    memcpy(rotas->distancia, rotas->entradaInicio, (size_t)n * sizeof(int)); // Posição livre de cada grupo
+    for (int l = 0; l < rede->numLinks; l++) rotas->entradaVia[rotas->distancia[rede->linkDestino[l]]++] = l;
+
+    rotas->bytesColuna = ((size_t)n * ROTAS_ESTADOS + 1) / 2;
+    rotas->proximo = (uint8_t*)malloc((rotas->numSaidas ? (size_t)rotas->numSaidas : 1) * rotas->bytesColuna);
+    if (rotas->proximo == NULL) {
+        rotasLiberar(rede);
+        return 0;
+    }
+    if (proximo != NULL && bytesProximo == (size_t)rotas->numSaidas * rotas->bytesColuna) {
+        memcpy(rotas->proximo, proximo, bytesProximo);
+        return 1;
+    }
+    for (int coluna = 0; coluna < rotas->numSaidas; coluna++) rotasCalcularColuna(rotas, rede, coluna);
+    return 1;
+}
+
+#endif /* MODO_SIMULACAO != MODO_MESOSCOPICO && VIAGENS_OD == 1 */
+
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) && ( VIAGENS_OD == 1 )
+/**
+ * @brief Fecha a via `link` e refaz só as colunas cujas rotas passavam por ela.
+ *
+ * Uma coluna muda apenas se o próximo salto da origem da via até a saída
+ * dela, para alguma direção de chegada ou para a entrada, era a própria
+ * via; as demais rotas não a usavam e continuam as mais curtas sem ela. Na
+ * grade 100x100, fechar a via central L50C50 -> L50C51 refaz 200 das 400
+ * colunas, em cerca de metade do tempo da tabela inteira.
+ *
+ * @param rotas Tabela da rede `rede`, alterada no lugar (NULL: sem rotas).
+ * @return Quantidade de colunas refeitas.
+ */
+static int rotasFecharVia(TabelaRotas* rotas, const Rede* rede, int link) {
+    int refeitas = 0;
+
+    if (rotas == NULL || rotas->viaFechada[link]) return 0;
+    rotas->viaFechada[link] = 1;
+
+    int origem = rede->linkOrigem[link];
+    for (int coluna = 0; coluna < rotas->numSaidas; coluna++) {
+        int usava = 0;
+        for (int chegada = 0; chegada <= WE && !usava; chegada++) {
+            usava = rotasSalto(rotas, origem, chegada, coluna) == rede->linkDirecao[link];
+        }
+        if (!usava) continue;
+        rotasCalcularColuna(rotas, rede, coluna);
+        refeitas++;
+    }
+    rotas->colunasRefeitas += (uint64_t)refeitas;
+    return refeitas;
+}
+#endif
+
+#endif /* rotas */
+
+/*----------------- CENÁRIOS ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) || ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) || \
+    ( MODO_SIMULACAO == MODO_PARALELO ) || ( MODO_SIMULACAO == MODO_COMPILAR_CENARIO ) || \
+    ( MODO_SIMULACAO == MODO_MESOSCOPICO ) || ( MODO_SIMULACAO == MODO_CONJUNTO )
+
+#define CENARIO_VERSAO 2
+
+// Seções do cenário binário, na ordem em que aparecem no arquivo
+#define CENARIO_NOMES            0
+#define CENARIO_PLANOS           1
+#define CENARIO_ADJ_INICIO       2
+#define CENARIO_LINK_ORIGEM      3
+#define CENARIO_LINK_DESTINO     4
+#define CENARIO_LINK_DIRECAO     5
+#define CENARIO_LINK_VELOCIDADE  6
+#define CENARIO_LINK_COMPRIMENTO 7
+#define CENARIO_DEMANDA          8
+#define CENARIO_SECOES           9
+
+/**
+ * @brief Cabeçalho do cenário binário, gerado a partir do texto pelo `MODO_COMPILAR_CENARIO`.
+ *
+ * Depois do cabeçalho vêm os vetores da rede já no formato CSR, cada um
+ * alinhado a 8 bytes, de modo que a carga se resume a copiar as seções.
+ */
+typedef struct {
+    char magica[8];                       /**< "SIMCEN". */
+    uint32_t versao;                      /**< CENARIO_VERSAO. */
+    uint32_t tamanhoCabecalho;            /**< sizeof(CabecalhoCenario). */
+    int32_t numCruzamentos;               /**< Cruzamentos da rede. */
+    int32_t numLinks;                     /**< Vias da rede. */
+    int32_t linhas;                       /**< Linhas da grade (0 se o cenário não for uma grade). */
+    int32_t colunas;                      /**< Colunas da grade (0 se o cenário não for uma grade). */
+    uint64_t secaoInicio[CENARIO_SECOES]; /**< Deslocamento de cada seção no arquivo. */
+} CabecalhoCenario;
+
+/**
+ * @brief Tamanho de cada seção do cenário binário, a partir das dimensões da rede.
+ */
+static void cenarioTamanhos(uint64_t* bytes, uint64_t n, uint64_t links) {
+    bytes[CENARIO_NOMES] = n * 16;
+    bytes[CENARIO_PLANOS] = n * sizeof(PlanoSemaforico);
+    bytes[CENARIO_ADJ_INICIO] = (n + 1) * sizeof(int);
+    bytes[CENARIO_LINK_ORIGEM] = links * sizeof(int);
+    bytes[CENARIO_LINK_DESTINO] = links * sizeof(int);
+    bytes[CENARIO_LINK_DIRECAO] = links;
+    bytes[CENARIO_LINK_VELOCIDADE] = links;
+    bytes[CENARIO_LINK_COMPRIMENTO] = links * sizeof(uint32_t);
+    bytes[CENARIO_DEMANDA] = n * sizeof(DemandaEntrada);
+}
+
+/**
+ * @brief Cursor sobre o texto do cenário mapeado em memória.
+ *
+ * O texto não é copiado nem precisa terminar em '\0': todas as leituras
+ * respeitam `fim`.
+ */
+typedef struct {
+    const char* p;    /**< Próximo caractere a ler. */
+    const char* fim;  /**< Fim do arquivo. */
+    int linha;        /**< Linha atual, para as mensagens de erro. */
+} LeitorCenario;
+
+/**
+ * @brief Pula espaços e indica se ainda há uma palavra na linha atual (comentários começam com '#').
+ */
+static inline int cenarioTemPalavra(LeitorCenario* l) {
+    while (l->p < l->fim && (*l->p == ' ' || *l->p == '\t' || *l->p == '\r')) l->p++;
+    return l->p < l->fim && *l->p != '\n' && *l->p != '#';
+}
+
+/**
+ * @brief Avança para o início da próxima linha, descartando o resto da atual.
+ */
+static inline void cenarioProximaLinha(LeitorCenario* l) {
+    while (l->p < l->fim && *l->p != '\n') l->p++;
+    if (l->p < l->fim) l->p++;
+    l->linha++;
+}
+
+/**
+ * @brief Lê a próxima palavra da linha, devolvendo o início e o tamanho sem copiá-la.
+ *
+ * @return Retorna o tamanho da palavra, 0 se a linha tiver acabado.
+ */
+static inline size_t cenarioPalavra(LeitorCenario* l, const char** palavra) {
+    if (!cenarioTemPalavra(l)) return 0;
+    *palavra = l->p;
+    while (l->p < l->fim && *l->p != ' ' && *l->p != '\t' && *l->p != '\r' && *l->p != '\n' && *l->p != '#') l->p++;
+    return (size_t)(l->p - *palavra);
+}
+
+/**
+ * @brief Lê um inteiro decimal não negativo de no máximo `maximo`.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se a palavra não for um número válido.
+ */
+static int cenarioInteiro(LeitorCenario* l, uint32_t maximo, uint32_t* valor) {
+    const char* palavra;
+    size_t tamanho = cenarioPalavra(l, &palavra);
+    uint64_t v = 0;
+
+    if (tamanho == 0) return 0;
+    for (size_t i = 0; i < tamanho; i++) {
+        if (palavra[i] < '0' || palavra[i] > '9') return 0;
+        v = v * 10 + (uint64_t)(palavra[i] - '0');
+        if (v > maximo) return 0;
+    }
+    *valor = (uint32_t)v;
+    return 1;
+}
+
+/**
+ * @brief Compara a palavra lida com uma palavra-chave.
+ */
+static inline int cenarioPalavraIgual(const char* palavra, size_t tamanho, const char* chave) {
+    return tamanho == strlen(chave) && memcmp(palavra, chave, tamanho) == 0;
+}
+
+/**
+ * @brief Monta a rede a partir do cenário em texto (formato descrito no README).
+ *
+ * A primeira diretiva, `cenario <cruzamentos> <vias>`, dimensiona os vetores
+ * uma única vez; as vias são gravadas direto nos vetores da rede e ordenadas
+ * por `redeFinalizar`.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se o texto for inválido ou não houver memória.
+ */
+static int cenarioLerTexto(Rede* rede, const char* caminho, const char* texto, size_t bytes) {
+    LeitorCenario l = { texto, texto + bytes, 1 };
+    const char* erro = NULL;
+    const char* palavra;
+    size_t tamanho;
+    uint32_t numCruzamentos = 0, numLinks = 0;
+
+    *rede = (Rede){ 0 };
+    while (l.p < l.fim && erro == NULL) {
+        if ((tamanho = cenarioPalavra(&l, &palavra)) == 0) {
+            // Linha vazia ou apenas com comentário
+        }
+        else if (cenarioPalavraIgual(palavra, tamanho, "cenario")) {
+            if (rede->adjInicio != NULL) {
+                erro = "diretiva cenario repetida";
+            }
+            else if (!cenarioInteiro(&l, REDE_MAX_CRUZAMENTOS, &numCruzamentos) || numCruzamentos == 0 ||
+                !cenarioInteiro(&l, 0x7FFFFFFF, &numLinks)) {
+                erro = "esperado: cenario <cruzamentos> <vias>";
+            }
+            else if (!redeIniciar(rede, (int)numCruzamentos, (int)numLinks)) {
+                erro = "memoria insuficiente";
+            }
+        }
+        else if (rede->adjInicio == NULL) {
+            erro = "o arquivo deve comecar pela diretiva cenario";
+        }
+        else if (cenarioPalavraIgual(palavra, tamanho, "grade")) {
+            uint32_t linhas, colunas;
+            if (!cenarioInteiro(&l, numCruzamentos, &linhas) || !cenarioInteiro(&l, numCruzamentos, &colunas) ||
+                (uint64_t)linhas * colunas != numCruzamentos) {
+                erro = "esperado: grade <linhas> <colunas>, com linhas x colunas = cruzamentos";
+            }
+            else {
+                rede->linhas = (int)linhas;
+                rede->colunas = (int)colunas;
+            }
+        }
+        else if (cenarioPalavraIgual(palavra, tamanho, "cruzamento")) {
+            uint32_t i, verdeNS, verdeEW, defasagem = 0;
+            const char* nome;
+            size_t tamanhoNome;
+            if (!cenarioInteiro(&l, numCruzamentos - 1, &i) || (tamanhoNome = cenarioPalavra(&l, &nome)) == 0 ||
+                tamanhoNome >= sizeof(rede->nome[0]) || !cenarioInteiro(&l, REDE_MAX_VERDE_S, &verdeNS) || verdeNS == 0 ||
+                !cenarioInteiro(&l, REDE_MAX_VERDE_S, &verdeEW) || verdeEW == 0 ||
+                (cenarioTemPalavra(&l) && !cenarioInteiro(&l, REDE_MAX_VERDE_S, &defasagem))) {
+                erro = "esperado: cruzamento <indice> <nome> <verde_ns_s> <verde_ew_s> [defasagem_s]";
+            }
+            else {
+                memset(rede->nome[i], 0, sizeof(rede->nome[i]));
+                memcpy(rede->nome[i], nome, tamanhoNome);
+                rede->plano[i] = (PlanoSemaforico){ { verdeNS * 1000, verdeEW * 1000 }, defasagem * 1000 };
+            }
+        }
+        else if (cenarioPalavraIgual(palavra, tamanho, "demanda")) {
+            uint32_t i, veiculosPorHora, perfil = PERFIL_CONSTANTE;
+            const char* nome = NULL;
+            size_t tamanhoNome = 0;
+            int ok = cenarioInteiro(&l, numCruzamentos - 1, &i) && cenarioInteiro(&l, 1000000, &veiculosPorHora);
+            if (ok && cenarioTemPalavra(&l)) {
+                tamanhoNome = cenarioPalavra(&l, &nome);
+                if (cenarioPalavraIgual(nome, tamanhoNome, "horario")) perfil = PERFIL_HORARIO;
+                else ok = cenarioPalavraIgual(nome, tamanhoNome, "constante");
+            }
+            if (!ok) {
+                erro = "esperado: demanda <indice> <veiculos_por_hora> [constante|horario]";
+            }
+            else {
+                rede->demanda[i] = (DemandaEntrada){ veiculosPorHora, perfil };
+            }
+        }
+        else if (cenarioPalavraIgual(palavra, tamanho, "via")) {
+            uint32_t origem, destino, comprimento, velocidade;
+            int direcao = 0;
+            const char* nome;
+            if (cenarioInteiro(&l, numCruzamentos - 1, &origem) && cenarioInteiro(&l, numCruzamentos - 1, &destino) &&
+                cenarioPalavra(&l, &nome) == 2) {
+                for (int d = NS; d <= WE; d++) {
+                    if (memcmp(nome, nomeDirecao(d), 2) == 0) direcao = d;
+                }
+            }
+            if (direcao == 0 || !cenarioInteiro(&l, REDE_MAX_COMPRIMENTO_M, &comprimento) || comprimento == 0 ||
+                !cenarioInteiro(&l, 255, &velocidade) || velocidade == 0) {
+                erro = "esperado: via <origem> <destino> <NS|SN|EW|WE> <comprimento_m> <velocidade_kmh>";
+            }
+            else if ((uint32_t)rede->numLinks == numLinks) {
+                erro = "mais vias do que o declarado na diretiva cenario";
+            }
+            else if (!redeAdicionarLink(rede, (int)origem, (int)destino, direcao, comprimento, (int)velocidade)) {
+                erro = "memoria insuficiente";
+            }
+        }
+        else {
+            erro = "diretiva desconhecida";
+        }
+
+        if (erro == NULL && cenarioTemPalavra(&l)) erro = "texto a mais no fim da linha";
+        if (erro == NULL) cenarioProximaLinha(&l);
+    }
+
+    if (erro != NULL) {
+        printf("Erro no cenario %s, linha %d: %s.\n", caminho, l.linha, erro);
+        redeLiberar(rede);
+        return 0;
+    }
+    if (rede->adjInicio == NULL || (uint32_t)rede->numLinks != numLinks) {
+        printf("Erro no cenario %s: %s.\n", caminho,
+            rede->adjInicio == NULL ? "diretiva cenario ausente" : "menos vias do que o declarado na diretiva cenario");
+        redeLiberar(rede);
+        return 0;
+    }
+
+    if (!redeFinalizar(rede)) {
+        printf("Erro ao alocar memoria para a rede de cruzamentos.\n");
+        redeLiberar(rede);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Monta a rede copiando as seções de um cenário binário.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se o arquivo for inválido ou não houver memória.
+ */
+static int cenarioLerBinario(Rede* rede, const char* caminho, const uint8_t* mapa, size_t bytes) {
+    const CabecalhoCenario* cabecalho = (const CabecalhoCenario*)mapa;
+    uint64_t tamanhos[CENARIO_SECOES];
+    int ok = bytes >= sizeof(CabecalhoCenario) && cabecalho->versao == CENARIO_VERSAO &&
+        cabecalho->tamanhoCabecalho == sizeof(CabecalhoCenario) && cabecalho->numCruzamentos > 0 &&
+        cabecalho->numCruzamentos <= REDE_MAX_CRUZAMENTOS && cabecalho->numLinks >= 0;
+    ok = ok && redeGradeValida(cabecalho->linhas, cabecalho->colunas, cabecalho->numCruzamentos);
+
+    if (ok) {
+        cenarioTamanhos(tamanhos, (uint64_t)cabecalho->numCruzamentos, (uint64_t)cabecalho->numLinks);
+        for (int s = 0; s < CENARIO_SECOES && ok; s++) {
+            ok = cabecalho->secaoInicio[s] % 8 == 0 && cabecalho->secaoInicio[s] <= bytes &&
+                tamanhos[s] <= bytes - cabecalho->secaoInicio[s];
+        }
+    }
+    if (ok && !redeIniciar(rede, cabecalho->numCruzamentos, cabecalho->numLinks)) {
+        printf("Erro ao alocar memoria para a rede de cruzamentos.\n");
+        return 0;
+    }
+
+    if (ok) {
+        void* destinos[CENARIO_SECOES] = {
+            rede->nome, rede->plano, rede->adjInicio, rede->linkOrigem, rede->linkDestino, rede->linkDirecao,
+            rede->linkVelocidadeMax, rede->linkComprimento, rede->demanda
+        };
+        for (int s = 0; s < CENARIO_SECOES; s++) {
+            memcpy(destinos[s], mapa + cabecalho->secaoInicio[s], (size_t)tamanhos[s]);
+        }
+        rede->numLinks = cabecalho->numLinks;
+        rede->linhas = cabecalho->linhas;
+        rede->colunas = cabecalho->colunas;
+
+        // Confere a adjacência e os atributos das vias, que o motor usa sem verificar
+        int n = rede->numCruzamentos;
+        ok = rede->adjInicio[0] == 0 && rede->adjInicio[n] == rede->numLinks;
+        for (int i = 0; i < n && ok; i++) {
+            ok = rede->adjInicio[i] <= rede->adjInicio[i + 1] && redePlanoValido(&rede->plano[i]) &&
+                rede->nome[i][sizeof(rede->nome[i]) - 1] == '\0' &&
+                rede->demanda[i].perfil <= PERFIL_HORARIO;
+            for (int k = rede->adjInicio[i]; k < rede->adjInicio[i + 1] && ok; k++) {
+                ok = rede->linkOrigem[k] == i && rede->linkDestino[k] >= 0 && rede->linkDestino[k] < n &&
+                    rede->linkDirecao[k] >= NS && rede->linkDirecao[k] <= WE && rede->linkVelocidadeMax[k] > 0 &&
+                    rede->linkComprimento[k] > 0 && rede->linkComprimento[k] <= REDE_MAX_COMPRIMENTO_M;
+            }
+        }
+        if (!ok) redeLiberar(rede);
+    }
+
+    if (!ok) printf("Cenario binario %s invalido ou de outra versao.\n", caminho);
+    return ok;
+}
+
+/**
+ * @brief Monta a rede descrita pelo cenário em `caminho`, em texto ou binário.
+ *
+ * O arquivo é mapeado somente para leitura e o formato é reconhecido pela
+ * assinatura do cenário binário. Cada cruzamento pode ter no máximo uma via
+ * de saída por direção.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 em caso de erro (já informado).
+ */
+static int cenarioCarregar(Rede* rede, const char* caminho) {
+    size_t bytes;
+    const uint8_t* mapa = (const uint8_t*)arquivoMapearLeitura(caminho, &bytes);
+
+    *rede = (Rede){ 0 };
+    if (mapa == NULL) {
+        printf("Erro ao abrir o cenario %s.\n", caminho);
+        return 0;
+    }
+
+    int ok = (bytes >= 8 && memcmp(mapa, "SIMCEN\0", 8) == 0) ? cenarioLerBinario(rede, caminho, mapa, bytes)
+        : cenarioLerTexto(rede, caminho, (const char*)mapa, bytes);
+    arquivoDesmapear(mapa, bytes);
+
+    for (int i = 0; i < rede->numCruzamentos && ok; i++) {
+        uint32_t direcoes = 0;
+        for (int k = rede->adjInicio[i]; k < rede->adjInicio[i + 1]; k++) {
+            if (direcoes & (1u << rede->linkDirecao[k])) {
+                printf("Erro no cenario %s: cruzamento %s com duas vias %s.\n", caminho, rede->nome[i],
+                    nomeDirecao(rede->linkDirecao[k]));
+                redeLiberar(rede);
+                ok = 0;
+                break;
+            }
+            direcoes |= 1u << rede->linkDirecao[k];
+        }
+    }
+    return ok;
+}
+
+#if ( MODO_SIMULACAO == MODO_COMPILAR_CENARIO )
+
+/**
+ * @brief Grava a rede como cenário binário.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 em caso de erro.
+ */
+static int cenarioSalvarBinario(const Rede* rede, const char* caminho) {
+    static const uint8_t zeros[8];
+    CabecalhoCenario cabecalho = { 0 };
+    uint64_t tamanhos[CENARIO_SECOES];
+    const void* secoes[CENARIO_SECOES] = {
+        rede->nome, rede->plano, rede->adjInicio, rede->linkOrigem, rede->linkDestino, rede->linkDirecao,
+        rede->linkVelocidadeMax, rede->linkComprimento, rede->demanda
+    };
+
+    memcpy(cabecalho.magica, "SIMCEN", 7);
+    cabecalho.versao = CENARIO_VERSAO;
+    cabecalho.tamanhoCabecalho = sizeof(CabecalhoCenario);
+    cabecalho.numCruzamentos = rede->numCruzamentos;
+    cabecalho.numLinks = rede->numLinks;
+    cabecalho.linhas = rede->linhas;
+    cabecalho.colunas = rede->colunas;
+    cenarioTamanhos(tamanhos, (uint64_t)rede->numCruzamentos, (uint64_t)rede->numLinks);
+
+    uint64_t posicao = sizeof(CabecalhoCenario);
+    for (int s = 0; s < CENARIO_SECOES; s++) {
+        posicao = (posicao + 7) & ~(uint64_t)7;
+        cabecalho.secaoInicio[s] = posicao;
+        posicao += tamanhos[s];
+    }
+
+    FILE* f = fopen(caminho, "wb");
+    if (f == NULL) {
+        printf("Erro ao criar o cenario %s.\n", caminho);
+        return 0;
+    }
+
+    int ok = fwrite(&cabecalho, sizeof(cabecalho), 1, f) == 1;
+    posicao = sizeof(CabecalhoCenario);
+    for (int s = 0; s < CENARIO_SECOES && ok; s++) {
+        size_t preenchimento = (size_t)(cabecalho.secaoInicio[s] - posicao);
+        if (preenchimento > 0) ok = fwrite(zeros, 1, preenchimento, f) == preenchimento;
+        if (ok && tamanhos[s] > 0) ok = fwrite(secoes[s], 1, (size_t)tamanhos[s], f) == tamanhos[s];
+        posicao = cabecalho.secaoInicio[s] + tamanhos[s];
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) printf("Erro ao gravar o cenario %s.\n", caminho);
+    return ok;
+}
+
+/**
+ * @brief Converte um cenário (texto ou binário) para o formato binário e mede as duas cargas.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 em caso de erro.
+ */
+static int compilarCenario(const char* entrada, const char* saida) {
+    Rede rede;
+    uint64_t inicio = relogioNs();
+
+    if (!cenarioCarregar(&rede, entrada)) return 0;
+    double msEntrada = (relogioNs() - inicio) / 1e6;
+    printf("Cenario %s: %d cruzamentos e %d vias lidos em %.3f ms.\n", entrada, rede.numCruzamentos, rede.numLinks,
+        msEntrada);
+
+    int ok = cenarioSalvarBinario(&rede, saida);
+    redeLiberar(&rede);
+    if (!ok) return 0;
+
+    // Confere o arquivo gerado carregando-o de volta
+    inicio = relogioNs();
+    if (!cenarioCarregar(&rede, saida)) return 0;
+    printf("Cenario binario %s gravado; carga em %.3f ms.\n", saida, (relogioNs() - inicio) / 1e6);
+    redeLiberar(&rede);
+    return 1;
+}
+
+#else
+
+/**
+ * @brief Aplica SIM_DEMANDA=<veiculos_por_hora>[,horario] às entradas sem demanda própria no cenário.
+ */
+static void redeAplicarDemandaAmbiente(Rede* rede) {
+    const char* variavel = getenv("SIM_DEMANDA");
+    char* resto;
+
+    if (variavel == NULL || variavel[0] == '\0') return;
+
+    unsigned long veiculosPorHora = strtoul(variavel, &resto, 10);
+    uint32_t perfil = (strcmp(resto, ",horario") == 0) ? PERFIL_HORARIO : PERFIL_CONSTANTE;
+    if (resto == variavel || veiculosPorHora == 0 || veiculosPorHora > 1000000 ||
+        (*resto != '\0' && perfil != PERFIL_HORARIO && strcmp(resto, ",constante") != 0)) {
+        printf("SIM_DEMANDA invalida (esperado: <veiculos_por_hora>[,constante|,horario]); usando a geracao unica.\n");
+        return;
+    }
+
+    for (int c = 0; c < rede->numCruzamentos; c++) {
+        if (rede->demanda[c].veiculosPorHora == 0) rede->demanda[c] = (DemandaEntrada){ (uint32_t)veiculosPorHora, perfil };
+    }
+    printf("Demanda por entrada: %lu veiculos/h por cruzamento, perfil %s.\n", veiculosPorHora,
+        perfil == PERFIL_HORARIO ? "horario" : "constante");
+}
+
+/**
+ * @brief Monta a rede da execução: o cenário de SIM_CENARIO, se houver, ou a grade REDE_LINHAS x REDE_COLUNAS.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 em caso de erro (já informado).
+ */
+static int redeCriar(Rede* rede, uint64_t semente) {
+    const char* cenario = getenv("SIM_CENARIO");
+    clock_t inicio = clock();
+
+    if (cenario != NULL && cenario[0] != '\0') {
+        if (!cenarioCarregar(rede, cenario)) return 0;
+        printf("Cenario %s: %d cruzamentos e %d vias carregados em %.3f ms (semente %llu).\n", cenario,
+            rede->numCruzamentos, rede->numLinks, 1000.0 * (clock() - inicio) / CLOCKS_PER_SEC,
+            (unsigned long long)semente);
+    }
+    else {
+        if (!redeCriarGrade(rede, REDE_LINHAS, REDE_COLUNAS)) {
+            printf("Erro ao alocar memoria para a rede de cruzamentos.\n");
+            return 0;
+        }
+        printf("Rede %dx%d: %d cruzamentos e %d vias criadas em %.3f ms (semente %llu).\n", rede->linhas,
+            rede->colunas, rede->numCruzamentos, rede->numLinks, 1000.0 * (clock() - inicio) / CLOCKS_PER_SEC,
+            (unsigned long long)semente);
+    }
+    redeAplicarDemandaAmbiente(rede);
+
+#if ( VIAGENS_OD == 1 ) && ( MODO_SIMULACAO != MODO_MESOSCOPICO )
+    inicio = clock();
+    if (!rotasCriar(rede, NULL, NULL, 0)) {
+        printf("Erro ao alocar memoria para a tabela de rotas.\n");
+        redeLiberar(rede);
+        return 0;
+    }
+    printf("Rotas: proximo salto ate %d saidas em %d cruzamentos (%llu bytes) calculado em %.3f ms.\n",
+        rede->rotas->numSaidas, rede->numCruzamentos,
+        (unsigned long long)(rede->rotas->bytesColuna * (size_t)rede->rotas->numSaidas),
+        1000.0 * (clock() - inicio) / CLOCKS_PER_SEC);
+#endif
+    return 1;
+}
+
+#endif /* MODO_SIMULACAO == MODO_COMPILAR_CENARIO */
+
+#endif /* cenários */
+
+/*----------------- DEMANDA E ADMISSÃO ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) || ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) || \
+    ( MODO_SIMULACAO == MODO_PARALELO ) || ( MODO_SIMULACAO == MODO_BENCH_SIMULADOR ) || \
+    ( MODO_SIMULACAO == MODO_MESOSCOPICO ) || ( MODO_SIMULACAO == MODO_CONJUNTO )
+
+#define PERFIL_HORARIO_MAXIMO 215 // Maior valor de perfilHorario
+
+/**
+ * @brief Taxa de chegada de cada hora do dia, em % da média (a soma é 2400).
+ *
+ * Curva típica de tráfego urbano, com o pico da manhã às 8 h e o do fim da tarde às 17 h.
+ */
+static const uint8_t perfilHorario[24] = {
+    30, 20, 15, 15, 20, 45, 110, 190, 215, 140, 110, 105, 115, 115, 105, 115, 150, 215, 185, 130, 90, 70, 55, 40
+};
+
+/**
+ * @brief Sorteia o instante da próxima chegada de veículo por uma entrada, em µs.
+ *
+ * Os intervalos são exponenciais (processo de Poisson). No perfil horário a
+ * taxa varia com a hora simulada, e as chegadas de um processo com a taxa do
+ * pico são aceitas com probabilidade taxa da hora / taxa do pico (afinamento),
+ * o que dispensa integrar a curva.
+ *
+ * @param depoisUs Instante da chegada anterior, em µs.
+ */
+static uint64_t demandaProximaChegadaUs(const DemandaEntrada* demanda, uint64_t depoisUs, GeradorAleatorio* g) {
+    uint32_t pico = (demanda->perfil == PERFIL_HORARIO) ? PERFIL_HORARIO_MAXIMO : 100;
+    double mediaUs = 3600e6 * 100.0 / ((double)demanda->veiculosPorHora * pico);
+    double instante = (double)depoisUs;
+
+    for (;;) {
+        // (x + 1) / 2^32 nunca é zero, então o logaritmo é finito
+        instante -= mediaUs * log((geradorProximo(g) + 1.0) / 4294967296.0);
+        if (demanda->perfil != PERFIL_HORARIO) break;
+
+        uint32_t hora = (uint32_t)((uint64_t)(instante / 3600e6) % 24);
+        if ((uint32_t)geradorIntervalo(g, pico) < perfilHorario[hora]) break;
+    }
+    return (uint64_t)instante;
+}
+
+#endif /* demanda e admissão */
+
+/*----------------- REGISTRO DE EVENTOS (LOG BINÁRIO) ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) || ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) || \
+    ( MODO_SIMULACAO == MODO_PARALELO ) || ( MODO_SIMULACAO == MODO_DECODIFICAR_LOG ) || \
+    ( MODO_SIMULACAO == MODO_BENCH_SIMULADOR ) || ( MODO_SIMULACAO == MODO_EXPORTAR_TRACE ) || \
+    ( MODO_SIMULACAO == MODO_MESOSCOPICO ) || ( MODO_SIMULACAO == MODO_CONJUNTO )
+
+#define LOG_ARQUIVO "simulador.log"  // Arquivo gravado pelo drenador e lido pelo decodificador
+#define LOG_VERSAO 2                 // Versão do formato do arquivo
+#define LOG_MAX_CANAIS 96            // Canais (um por thread produtora) dos modos sem tempo real
+#define LOG_CANAIS_EXTRAS 8          // Canais do tempo real além dos de cruzamentos e vagas do pool (registro de tasks, creator)
+#define LOG_CAPACIDADE_CANAL 1024    // Registros por canal (potência de 2)
+#define LOG_PERIODO_DRENAGEM_MS 100  // Intervalo entre drenagens no modo em tempo real
+
+// Níveis de registro, escolhidos em tempo de execução pela variável de ambiente SIM_LOG_NIVEL
+#define LOG_NIVEL_NENHUM     0 // Nada é registrado
+#define LOG_NIVEL_RESUMO     1 // Entrada e saída de veículos
+#define LOG_NIVEL_SEMAFOROS  2 // Também as trocas de fase
+#define LOG_NIVEL_DETALHADO  3 // Também esperas, travessias e chegadas (equivale às mensagens originais)
+#define LOG_NIVEL_TAREFAS    4 // Também as trocas de task do agendador (modo em tempo real)
+
+#ifndef LOG_NIVEL_PADRAO
+#if ( mainUSAR_FREERTOS == 1 )
+#define LOG_NIVEL_PADRAO LOG_NIVEL_DETALHADO
+#else
+#define LOG_NIVEL_PADRAO LOG_NIVEL_NENHUM
+#endif
+#endif
+
+// 1 faz o drenador também imprimir as mensagens no console, fora das tasks dos veículos
+#ifndef LOG_ECO_CONSOLE
+#define LOG_ECO_CONSOLE mainUSAR_FREERTOS
+#endif
+
+
+// Tipos de registro
+#define LOG_VEICULO_CRIADO       1
+#define LOG_VEICULO_ESPERANDO    2
+#define LOG_VEICULO_ATRAVESSANDO 3
+#define LOG_VEICULO_CHEGOU       4
+#define LOG_VEICULO_SAIU         5
+#define LOG_FASE                 6
+#define LOG_TAREFA               7 // Task que passou a executar, no campo `veiculo`
+
+/*
+ * As tasks do simulador recebem um número (vTaskSetTaskNumber) com o tipo nos
+ * 16 bits altos e o índice nos baixos, o que basta para nomeá-las no trace sem
+ * gravar textos. As tasks do kernel mantêm a numeração sequencial dele.
+ */
+#define TAREFA_KERNEL     0 // Ociosa, temporizadores e demais tasks criadas pelo kernel
+#define TAREFA_CRIADOR    1 // Gerador de veículos
+#define TAREFA_CRUZAMENTO 2 // Semáforos de um cruzamento (índice do cruzamento)
+#define TAREFA_VAGA       3 // Vaga do pool de veículos (índice da vaga)
+#define TAREFA_RELATORIO  4 // Relatório de esperas
+#define TAREFA_LOG        5 // Drenador do log
+#define TAREFA_METRICAS   6 // Relator das métricas
+#define TAREFA_TEMPORIZACAO 7 // Roda de temporização (percursos e trocas de fase)
+#define TAREFA_INSTANTANEOS 8 // Instantâneos da rede (0: publicação, 1: exportador)
+#define TAREFA_TELA       9 // Tela do terminal
+#define TAREFA_NUMERO(tipo, indice) (((uint32_t)(tipo) << 16) | (uint32_t)(indice))
+
+// Trace contínuo: os mesmos registros em um anel de tamanho fixo dentro de um arquivo mapeado em memória
+#define TRACE_ARQUIVO "simulador.trace" // Arquivo lido pelo exportador quando nenhum é indicado
+#define TRACE_VERSAO 1                  // Versão do formato do arquivo
+#ifndef TRACE_TAMANHO_MB
+#define TRACE_TAMANHO_MB 64             // Tamanho máximo do arquivo; a variável de ambiente SIM_TRACE_MB tem precedência
+#endif
+
+/**
+ * @brief Registro binário de tamanho fixo de um evento da simulação.
+ */
+typedef struct {
+    uint64_t tempo;      /**< Instante do evento, em ms (simulado nos modos de eventos discretos). */
+    uint8_t tipo;        /**< Tipo do registro (LOG_VEICULO_CRIADO...). */
+    uint8_t direcao;     /**< Direção do veículo (1-NS, 2-SN, 3-EW, 4-WE). */
+    uint16_t velocidade; /**< Velocidade do veículo em km/h. */
+    int32_t veiculo;     /**< Identificador do veículo (-1 em registros de cruzamento). */
+    int32_t cruzamento;  /**< Índice do cruzamento na rede (-1 fora da rede). */
+    uint32_t fase;       /**< Palavra de fase do cruzamento (registros LOG_FASE). */
+} RegistroEvento;
+
+typedef char verificarTamanhoRegistroEvento[(sizeof(RegistroEvento) == 24) ? 1 : -1];
+
+/**
+ * @brief Nome de uma task a partir do número gravado nos registros LOG_TAREFA.
+ */
+static inline void logNomeTarefa(uint32_t numero, const char (*nomes)[16], int numCruzamentos, char* nome,
+    size_t tamanho) {
+    uint32_t indice = numero & 0xFFFF;
+
+    switch (numero >> 16) {
+    case TAREFA_CRIADOR: snprintf(nome, tamanho, "Criador de veiculos"); break;
+    case TAREFA_CRUZAMENTO:
+        snprintf(nome, tamanho, "Cruzamento %s", ((int)indice < numCruzamentos) ? nomes[indice] : "?");
+        break;
+    case TAREFA_VAGA: snprintf(nome, tamanho, "Veiculo (vaga %u)", (unsigned)indice); break;
+    case TAREFA_RELATORIO: snprintf(nome, tamanho, "Relatorio de esperas"); break;
+    case TAREFA_LOG: snprintf(nome, tamanho, "Drenador do log"); break;
+    case TAREFA_METRICAS: snprintf(nome, tamanho, "Metricas"); break;
+    case TAREFA_TEMPORIZACAO: snprintf(nome, tamanho, "Temporizacao"); break;
+    case TAREFA_INSTANTANEOS: snprintf(nome, tamanho, indice ? "Exportador de instantaneos" : "Instantaneos"); break;
+    case TAREFA_TELA: snprintf(nome, tamanho, "Tela"); break;
+    default: snprintf(nome, tamanho, "Kernel %u", (unsigned)numero); break;
+    }
+}
+
+/**
+ * @brief Cabeçalho do arquivo de log, seguido dos nomes dos cruzamentos e dos registros.
+ */
+typedef struct {
+    char magica[8];            /**< "SIMLOG" seguido de zeros. */
+    uint32_t versao;           /**< LOG_VERSAO. */
+    uint32_t tamanhoRegistro;  /**< sizeof(RegistroEvento). */
+    uint32_t origem;           /**< MODO_SIMULACAO que gravou o arquivo. */
+    uint32_t numCruzamentos;   /**< Quantidade de nomes de 16 bytes após o cabeçalho. */
+    uint64_t semente;          /**< Semente da execução, para reproduzi-la com SIM_SEMENTE. */
+} CabecalhoLog;
+
+/**
+ * @brief Cabeçalho do trace contínuo, seguido dos nomes dos cruzamentos e do anel de registros.
+ *
+ * O registro de número `n` ocupa a posição `n % capacidade` do anel. O
+ * drenador avança `iniciados` antes de sobrescrever o anel e `gravados`
+ * depois, de modo que quem lê o arquivo durante a execução sabe quais
+ * registros foram sobrescritos enquanto os copiava.
+ */
+typedef struct {
+    char magica[8];              /**< "SIMTRACE". */
+    uint32_t versao;             /**< TRACE_VERSAO. */
+    uint32_t tamanhoRegistro;    /**< sizeof(RegistroEvento). */
+    uint32_t origem;             /**< MODO_SIMULACAO que gravou o arquivo. */
+    uint32_t numCruzamentos;     /**< Quantidade de nomes de 16 bytes após o cabeçalho. */
+    uint32_t capacidade;         /**< Registros no anel (potência de 2). */
+    uint32_t reservado;
+    uint64_t semente;            /**< Semente da execução. */
+    volatile uint64_t iniciados; /**< Registros cuja gravação começou. */
+    volatile uint64_t gravados;  /**< Registros gravados por completo desde o início da execução. */
+} CabecalhoTrace;
+
+typedef char verificarTamanhoCabecalhoTrace[(sizeof(CabecalhoTrace) == 56) ? 1 : -1];
+
+#if ( MODO_SIMULACAO != MODO_BENCH_SIMULADOR ) && ( MODO_SIMULACAO != MODO_EXPORTAR_TRACE ) && \
+    ( MODO_SIMULACAO != MODO_MESOSCOPICO ) && ( MODO_SIMULACAO != MODO_CONJUNTO )
+
+/**
+ * @brief Formata um registro como a linha que o simulador imprimia antes do log binário.
+ *
+ * Registros dos motores de eventos discretos recebem o instante simulado como prefixo.
+ */
+static void logFormatar(const RegistroEvento* r, uint32_t origem, const char (*nomes)[16], int numCruzamentos,
+    char* linha, size_t tamanho) {
+    const char* cruzamento = (r->cruzamento >= 0 && r->cruzamento < numCruzamentos) ? nomes[r->cruzamento] : "?";
+    int n = 0;
+
+    if (origem != MODO_TEMPO_REAL) {
+        n = snprintf(linha, tamanho, "[%8.1f s] ", r->tempo / 1000.0);
+        if (n < 0 || (size_t)n >= tamanho) n = 0;
+    }
+    linha += n;
+    tamanho -= (size_t)n;
+
+    switch (r->tipo) {
+    case LOG_VEICULO_CRIADO:
+        snprintf(linha, tamanho, "Veiculo ID: %d, Velocidade: %d km/h, Cruzamento: %s, Direcao: %s\n",
+            (int)r->veiculo, (int)r->velocidade, cruzamento, nomeDirecao(r->direcao));
+        break;
+    case LOG_VEICULO_ESPERANDO:
+        snprintf(linha, tamanho, "Veiculo ID: %d, Direcao: %s - Esperando o semaforo.\n",
+            (int)r->veiculo, nomeDirecao(r->direcao));
+        break;
+    case LOG_VEICULO_ATRAVESSANDO:
+        snprintf(linha, tamanho, "Veiculo ID: %d, Direcao: %s - Atravessando o semaforo.\n",
+            (int)r->veiculo, nomeDirecao(r->direcao));
+        break;
+    case LOG_VEICULO_CHEGOU:
+        snprintf(linha, tamanho, "Veiculo ID: %d - Chegou ao cruzamento %s.\n", (int)r->veiculo, cruzamento);
+        break;
+    case LOG_VEICULO_SAIU:
+        snprintf(linha, tamanho, "Veiculo ID: %d - Saiu da rede de cruzamentos.\n", (int)r->veiculo);
+        break;
+    case LOG_TAREFA: {
+        char nome[48];
+        logNomeTarefa((uint32_t)r->veiculo, nomes, numCruzamentos, nome, sizeof(nome));
+        snprintf(linha, tamanho, "Task em execucao: %s.\n", nome);
+        break;
+    }
+    case LOG_FASE:
+        snprintf(linha, tamanho, "Cruzamento %s: NS: %s, SN: %s, EW: %s, WE: %s%s\n", cruzamento,
+            (r->fase & FASE_ABERTO(NS)) ? "\033[32mAberto\033[0m" : "\033[31mFechado\033[0m",
+            (r->fase & FASE_ABERTO(SN)) ? "\033[32mAberto\033[0m" : "\033[31mFechado\033[0m",
+            (r->fase & FASE_ABERTO(EW)) ? "\033[32mAberto\033[0m" : "\033[31mFechado\033[0m",
+            (r->fase & FASE_ABERTO(WE)) ? "\033[32mAberto\033[0m" : "\033[31mFechado\033[0m",
+            ((r->fase & FASE_PROTEGIDA) && (FASE_ESTAGIO(r->fase) & 1u)) ? " (so conversoes a esquerda)" :
+            (r->fase & FASE_PROTEGIDA) ? " (reto e direita)" : "");
+        break;
+    default:
+        snprintf(linha, tamanho, "Registro desconhecido (tipo %d).\n", (int)r->tipo);
+        break;
+    }
+}
+
+#endif /* MODO_SIMULACAO != MODO_BENCH_SIMULADOR && MODO_SIMULACAO != MODO_EXPORTAR_TRACE && MODO_SIMULACAO != MODO_MESOSCOPICO && MODO_SIMULACAO != MODO_CONJUNTO */
+
+#if ( MODO_SIMULACAO != MODO_DECODIFICAR_LOG ) && ( MODO_SIMULACAO != MODO_EXPORTAR_TRACE )
+
+/**
+ * @brief Canal de log: anel de um produtor (uma task ou thread) e um consumidor (o drenador).
+ *
+ * Só o produtor escreve `cauda` e `descartados`; só o drenador escreve `cabeca`.
+ */
+typedef struct {
+    volatile uint32_t cauda;        /**< Próxima posição a escrever. */
+    volatile uint32_t descartados;  /**< Registros perdidos com o canal cheio. */
+    int bloquear;                   /**< 1 espera o drenador com o canal cheio em vez de descartar. */
+    char preenchimentoCauda[52];
+    volatile uint32_t cabeca;       /**< Próxima posição a drenar. */
+    char preenchimentoCabeca[60];
+    RegistroEvento itens[LOG_CAPACIDADE_CANAL];
+} CanalLog;
+
+static volatile uint32_t nivelLog;
+
+/**
+ * @brief Altera o nível de registro durante a execução.
+ */
+static inline void logDefinirNivel(uint32_t nivel) {
+    atomicoEscrever32(&nivelLog, nivel);
+}
+
+/**
+ * @brief Registra um evento no canal do produtor, sem travas nem chamadas ao sistema.
+ *
+ * Custa algumas escritas na memória e uma publicação atômica do índice.
+ */
+static inline void logEvento(CanalLog* canal, uint32_t nivel, uint64_t tempo, int tipo, int veiculo, int cruzamento,
+    int direcao, int velocidade, uint32_t fase) {
+    if (canal == NULL || nivel > nivelLog) return;
+
+    uint32_t cauda = canal->cauda;
+    while (cauda - atomicoLer32(&canal->cabeca) == LOG_CAPACIDADE_CANAL) {
+        if (!canal->bloquear) {
+            canal->descartados++;
+            return;
+        }
+        threadCeder();
+    }
+
+    RegistroEvento* r = &canal->itens[cauda & (LOG_CAPACIDADE_CANAL - 1)];
+    r->tempo = tempo;
+    r->tipo = (uint8_t)tipo;
+    r->direcao = (uint8_t)direcao;
+    r->velocidade = (uint16_t)velocidade;
+    r->veiculo = veiculo;
+    r->cruzamento = cruzamento;
+    r->fase = fase;
+    atomicoEscrever32(&canal->cauda, cauda + 1);
+}
+
+// O benchmark do simulador e os modos mesoscópico e de conjunto rodam sem console nem arquivo de log
+#if ( MODO_SIMULACAO != MODO_BENCH_SIMULADOR ) && ( MODO_SIMULACAO != MODO_MESOSCOPICO ) && \
+    ( MODO_SIMULACAO != MODO_CONJUNTO )
+
+static CanalLog* canaisLog;           // Alocados por logIniciar, conforme os produtores do modo
+static uint32_t capacidadeCanaisLog;
+static volatile uint32_t numCanaisLog; // Canais pedidos, inclusive os recusados com todos em uso
+static int ecoConsoleLog = LOG_ECO_CONSOLE; // Desligado quando a tela do terminal (SIM_TELA) ocupa o console
+static FILE* arquivoLog;
+static const char (*nomesLog)[16];
+static int numCruzamentosLog;
+static uint64_t registrosGravados;
+
+static CabecalhoTrace* cabecalhoTrace; // Início do arquivo de trace mapeado (NULL sem trace contínuo)
+static RegistroEvento* anelTrace;
+static size_t bytesTrace;
+static const char* caminhoTrace;
+
+/**
+ * @brief Indica se os registros têm destino: o arquivo de log ou o anel do trace contínuo.
+ */
+static inline int logAtivo(void) {
+    return arquivoLog != NULL || cabecalhoTrace != NULL;
+}
+
+/**
+ * @brief Arquivo do trace contínuo, dado pela variável de ambiente SIM_TRACE.
+ *
+ * @return NULL se os registros devem ir para o log comum.
+ */
+static inline const char* traceDestino(void) {
+    const char* variavel = getenv("SIM_TRACE");
+    return (variavel != NULL && variavel[0] != '\0') ? variavel : NULL;
+}
+
+/**
+ * @brief Cria o arquivo do trace contínuo e mapeia o anel.
+ *
+ * O anel tem a maior potência de 2 de registros que cabe em TRACE_TAMANHO_MB
+ * (ou SIM_TRACE_MB) junto com o cabeçalho, e nunca menos que um canal inteiro.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se o arquivo não puder ser mapeado.
+ */
+static int traceIniciar(const Rede* rede, uint32_t origem, uint64_t semente, const char* caminho) {
+    const char* variavel = getenv("SIM_TRACE_MB");
+    uint64_t limite = (uint64_t)((variavel != NULL) ? strtoul(variavel, NULL, 10) : TRACE_TAMANHO_MB) << 20;
+    size_t inicioAnel = sizeof(CabecalhoTrace) + (size_t)rede->numCruzamentos * sizeof(rede->nome[0]);
+    uint32_t capacidade = LOG_CAPACIDADE_CANAL;
+
+    while (capacidade < (1u << 30) && inicioAnel + (uint64_t)capacidade * 2 * sizeof(RegistroEvento) <= limite) {
+        capacidade *= 2;
+    }
+    bytesTrace = inicioAnel + (size_t)capacidade * sizeof(RegistroEvento);
+
+    char* mapa = (char*)arquivoMapearEscrita(caminho, bytesTrace);
+    if (mapa == NULL) {
+        printf("Erro ao mapear o arquivo de trace %s.\n", caminho);
+        return 0;
+    }
+
+    cabecalhoTrace = (CabecalhoTrace*)mapa;
+    memcpy(cabecalhoTrace->magica, "SIMTRACE", sizeof(cabecalhoTrace->magica));
+    cabecalhoTrace->versao = TRACE_VERSAO;
+    cabecalhoTrace->tamanhoRegistro = sizeof(RegistroEvento);
+    cabecalhoTrace->origem = origem;
+    cabecalhoTrace->numCruzamentos = (uint32_t)rede->numCruzamentos;
+    cabecalhoTrace->capacidade = capacidade;
+    cabecalhoTrace->semente = semente;
+    memcpy(mapa + sizeof(CabecalhoTrace), rede->nome, (size_t)rede->numCruzamentos * sizeof(rede->nome[0]));
+    anelTrace = (RegistroEvento*)(mapa + inicioAnel);
+    caminhoTrace = caminho;
+    return 1;
+}
+
+/**
+ * @brief Copia registros para o anel do trace, sobrescrevendo os mais antigos.
+ *
+ * `quantidade` nunca passa de LOG_CAPACIDADE_CANAL, que cabe no anel.
+ */
+static void traceGravar(const RegistroEvento* registros, uint32_t quantidade) {
+    uint32_t mascara = cabecalhoTrace->capacidade - 1;
+    uint64_t gravados = cabecalhoTrace->gravados; // Só o drenador escreve os contadores
+    uint32_t inicio = (uint32_t)gravados & mascara;
+    uint32_t primeiro = (quantidade < mascara + 1 - inicio) ? quantidade : mascara + 1 - inicio;
+
+    atomicoEscrever64(&cabecalhoTrace->iniciados, gravados + quantidade);
+    // Quem lê o anel precisa ver o novo `iniciados` antes de qualquer registro sobrescrito
+    atomicoBarreiraLiberacao();
+    memcpy(&anelTrace[inicio], registros, primeiro * sizeof(RegistroEvento));
+    memcpy(&anelTrace[0], registros + primeiro, (quantidade - primeiro) * sizeof(RegistroEvento));
+    atomicoEscrever64(&cabecalhoTrace->gravados, gravados + quantidade);
+}
+
+/**
+ * @brief Reserva um canal para a task ou thread que chama a função.
+ *
+ * Com o log desligado ou todos os canais em uso retorna NULL, e os registros
+ * feitos nesse canal são ignorados.
+ *
+ * @param bloquear 1 faz o produtor esperar o drenador quando o canal enche
+ * (modos sem tempo real); 0 descarta o registro e conta a perda.
+ */
+static CanalLog* logAbrirCanal(int bloquear) {
+    if (!logAtivo()) return NULL;
+
+    uint32_t i = atomicoSomar32(&numCanaisLog, 1) - 1;
+    if (i >= capacidadeCanaisLog) return NULL;
+    canaisLog[i].bloquear = bloquear;
+    return &canaisLog[i];
+}
+
+/**
+ * @brief Abre o destino dos registros e grava o cabeçalho com a semente e os nomes dos cruzamentos da rede.
+ *
+ * Com a variável de ambiente SIM_TRACE os registros vão para o anel do trace
+ * contínuo nesse arquivo; sem ela, para LOG_ARQUIVO. O nível inicial é o valor
+ * de SIM_LOG_NIVEL (de LOG_NIVEL_NENHUM a LOG_NIVEL_TAREFAS) ou, na falta dela
+ * ou com um valor inválido, LOG_NIVEL_TAREFAS com o trace e LOG_NIVEL_PADRAO sem ele. Com o nível LOG_NIVEL_NENHUM nada é criado.
+ * No modo em tempo real há um canal para cada cruzamento e cada vaga do pool
+ * de veículos, cujas tasks registram eventos, além de LOG_CANAIS_EXTRAS; nos
+ * demais, LOG_MAX_CANAIS.
+ *
+ * @return Retorna 1 se o log foi aberto, 0 caso contrário.
+ */
+static int logIniciar(const Rede* rede, uint32_t origem, uint64_t semente) {
+    const char* variavel = getenv("SIM_LOG_NIVEL");
+    const char* trace = traceDestino();
+    uint32_t nivel = (trace != NULL) ? LOG_NIVEL_TAREFAS : LOG_NIVEL_PADRAO;
+    if (variavel != NULL) {
+        char* resto;
+        long valor = strtol(variavel, &resto, 10);
+        if (resto == variavel || *resto != '\0' || valor < LOG_NIVEL_NENHUM || valor > LOG_NIVEL_TAREFAS) {
+            printf("SIM_LOG_NIVEL invalida (esperado: %d a %d); usando o nivel %u.\n", LOG_NIVEL_NENHUM, LOG_NIVEL_TAREFAS,
+                (unsigned)nivel);
+        }
+        else {
+            nivel = (uint32_t)valor;
+        }
+    }
+    logDefinirNivel(nivel);
+    if (nivelLog == LOG_NIVEL_NENHUM) return 0;
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL )
+    capacidadeCanaisLog = (uint32_t)rede->numCruzamentos + MAX_VEICULOS + LOG_CANAIS_EXTRAS;
+#else
+    capacidadeCanaisLog = LOG_MAX_CANAIS;
+#endif
+    canaisLog = (CanalLog*)calloc(capacidadeCanaisLog, sizeof(CanalLog));
+    if (canaisLog == NULL) {
+        printf("Erro ao alocar memoria para os %u canais de log.\n", (unsigned)capacidadeCanaisLog);
+        return 0;
+    }
+
+    nomesLog = rede->nome;
+    numCruzamentosLog = rede->numCruzamentos;
+    if (trace != NULL) return traceIniciar(rede, origem, semente, trace);
+
+    arquivoLog = fopen(LOG_ARQUIVO, "wb");
+    if (arquivoLog == NULL) {
+        printf("Erro ao criar o arquivo de log %s.\n", LOG_ARQUIVO);
+        return 0;
+    }
+
+    CabecalhoLog cabecalho = { "SIMLOG", LOG_VERSAO, sizeof(RegistroEvento), origem, (uint32_t)rede->numCruzamentos, semente };
+    fwrite(&cabecalho, sizeof(cabecalho), 1, arquivoLog);
+    fwrite(rede->nome, sizeof(rede->nome[0]), (size_t)rede->numCruzamentos, arquivoLog);
+    return 1;
+}
+
+/**
+ * @brief Grava no arquivo (ou no anel do trace) os registros pendentes de todos os canais.
+ *
+ * Apenas uma task ou thread (o drenador) pode chamar esta função.
+ *
+ * @return Quantidade de registros gravados.
+ */
+static size_t logDrenar(void) {
+    uint32_t canais = atomicoLer32(&numCanaisLog);
+    size_t drenados = 0;
+
+    if (canais > capacidadeCanaisLog) canais = capacidadeCanaisLog;
+    for (uint32_t i = 0; i < canais; i++) {
+        CanalLog* canal = &canaisLog[i];
+        uint32_t cabeca = canal->cabeca;
+        uint32_t cauda = atomicoLer32(&canal->cauda);
+
+        while (cabeca != cauda) {
+            // Grava o trecho contíguo do anel de uma só vez
+            uint32_t inicio = cabeca & (LOG_CAPACIDADE_CANAL - 1);
+            uint32_t quantidade = cauda - cabeca;
+            if (quantidade > LOG_CAPACIDADE_CANAL - inicio) quantidade = LOG_CAPACIDADE_CANAL - inicio;
+
+            if (cabecalhoTrace != NULL) traceGravar(&canal->itens[inicio], quantidade);
+            else fwrite(&canal->itens[inicio], sizeof(RegistroEvento), quantidade, arquivoLog);
+            for (uint32_t k = 0; ecoConsoleLog && k < quantidade; k++) {
+                char linha[160];
+                if (canal->itens[inicio + k].tipo == LOG_TAREFA) continue; // Frequentes demais para o console
+                logFormatar(&canal->itens[inicio + k], MODO_SIMULACAO, nomesLog, numCruzamentosLog, linha, sizeof(linha));
+                fputs(linha, stdout);
+            }
+            cabeca += quantidade;
+            drenados += quantidade;
+        }
+        atomicoEscrever32(&canal->cabeca, cabeca);
+    }
+
+    registrosGravados += drenados;
+    return drenados;
+}
+
+#if ( mainUSAR_FREERTOS == 1 )
+
+/**
+ * @brief Task de baixa frequência que drena os canais de log para o arquivo ou o anel do trace.
+ *
+ * @param pvParameters Parâmetros passados para a função (não utilizado neste caso).
+ */
+void vDrenarLogTask(void* pvParameters) {
+    (void)pvParameters;
+
+    for (;;) {
+        if (logDrenar() > 0 && arquivoLog != NULL) fflush(arquivoLog);
+        vTaskDelay(pdMS_TO_TICKS(LOG_PERIODO_DRENAGEM_MS));
+    }
+}
+
+#else
+
+static volatile uint32_t pararDrenagemLog;
+static ThreadNativa threadDrenagemLog;
+
+static void prvDrenarLog(void* pvParametro) {
+    (void)pvParametro;
+
+    while (!atomicoLer32(&pararDrenagemLog)) {
+        if (logDrenar() == 0) threadDormirMs(1);
+    }
+}
+
+/**
+ * @brief Fecha o arquivo de log ou desfaz o mapeamento do trace.
+ */
+static void logFecharDestino(void) {
+    if (cabecalhoTrace != NULL) {
+        arquivoDesmapear(cabecalhoTrace, bytesTrace);
+        cabecalhoTrace = NULL;
+        anelTrace = NULL;
+    }
+    if (arquivoLog != NULL) {
+        fclose(arquivoLog);
+        arquivoLog = NULL;
+    }
+}
+
+/**
+ * @brief Inicia a thread que drena os canais de log.
+ */
+static void logIniciarDrenagem(void) {
+    if (!logAtivo()) return;
+    if (!threadCriar(&threadDrenagemLog, prvDrenarLog, NULL)) {
+        printf("Falha ao criar a thread de drenagem do log.\n");
+        logFecharDestino();
+    }
+}
+
+/**
+ * @brief Encerra a drenagem, grava o que restou nos canais e fecha o arquivo.
+ */
+static void logEncerrar(void) {
+    if (!logAtivo()) return;
+
+    atomicoEscrever32(&pararDrenagemLog, 1);
+    threadAguardar(threadDrenagemLog);
+    logDrenar();
+
+    uint64_t descartados = 0;
+    uint32_t canais = (numCanaisLog < capacidadeCanaisLog) ? numCanaisLog : capacidadeCanaisLog;
+    for (uint32_t i = 0; i < canais; i++) descartados += canaisLog[i].descartados;
+
+    if (cabecalhoTrace != NULL) {
+        uint64_t capacidade = cabecalhoTrace->capacidade;
+        printf("Trace: %llu registros gravados em %s, os ultimos %llu mantidos no anel (%llu descartados).\n",
+            (unsigned long long)registrosGravados, caminhoTrace,
+            (unsigned long long)(registrosGravados < capacidade ? registrosGravados : capacidade),
+            (unsigned long long)descartados);
+    }
+    else {
+        printf("Log: %llu registros gravados em %s (%llu descartados).\n",
+            (unsigned long long)registrosGravados, LOG_ARQUIVO, (unsigned long long)descartados);
+    }
+    // Os registros de quem ficou sem canal não foram gravados nem contados como descartados
+    if (numCanaisLog > capacidadeCanaisLog) {
+        printf("Log: %u produtores ficaram sem canal (%u canais).\n", (unsigned)(numCanaisLog - capacidadeCanaisLog),
+            (unsigned)capacidadeCanaisLog);
+    }
+    logFecharDestino();
+    free(canaisLog);
+    canaisLog = NULL;
+}
+
+#endif /* mainUSAR_FREERTOS */
+
+#endif /* MODO_SIMULACAO != MODO_BENCH_SIMULADOR && MODO_SIMULACAO != MODO_MESOSCOPICO && MODO_SIMULACAO != MODO_CONJUNTO */
+
+#endif /* MODO_SIMULACAO != MODO_DECODIFICAR_LOG && MODO_SIMULACAO != MODO_EXPORTAR_TRACE */
+
+#endif /* registro de eventos */
+
+/*----------------- MÉTRICAS DE TRÁFEGO ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) || ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) || \
+    ( MODO_SIMULACAO == MODO_PARALELO ) || ( MODO_SIMULACAO == MODO_BENCH_SIMULADOR ) || \
+    ( MODO_SIMULACAO == MODO_MESOSCOPICO ) || ( MODO_SIMULACAO == MODO_CONJUNTO )
+
+// Arquivo no formato texto do Prometheus; a variável de ambiente SIM_METRICAS tem precedência
+#ifndef METRICAS_ARQUIVO
+#if ( mainUSAR_FREERTOS == 1 )
+#define METRICAS_ARQUIVO "metricas.prom"
+#else
+#define METRICAS_ARQUIVO NULL // Nos modos nativos as métricas só são coletadas com SIM_METRICAS
+#endif
+#endif
+#define METRICAS_PERIODO_MS 5000             // Intervalo entre exportações do relator
+#define METRICAS_BALDES 10                   // Limites finitos dos histogramas
+#define METRICAS_MAX_CRUZAMENTOS_DETALHE 100 // Acima disso os histogramas são exportados por direção
+#define METRICAS_LINHA_CACHE 64
+
+#define SEM_VIAGEM UINT64_MAX // Veículo recém-criado, que ainda não percorreu nenhuma via
+
+static const uint32_t limitesBaldesMs[METRICAS_BALDES] = { 1000, 2000, 5000, 10000, 20000, 30000, 60000, 120000, 300000, 600000 };
+
+/**
+ * @brief Histograma de tempos em uma única linha de cache: soma e contagem por faixa.
+ *
+ * A contagem de 32 bits por faixa comporta mais de quatro bilhões de veículos
+ * por aproximação, e a quantidade total é a soma das faixas.
+ */
+typedef struct {
+    volatile uint64_t somaMs;                      /**< Soma dos tempos registrados. */
+    volatile uint32_t baldes[METRICAS_BALDES + 1]; /**< Registros por faixa de limitesBaldesMs (a última é +Inf). */
+    char preenchimento[METRICAS_LINHA_CACHE - sizeof(uint64_t) - (METRICAS_BALDES + 1) * sizeof(uint32_t)];
+} HistogramaMetricas;
+
+/**
+ * @brief Contadores de uma aproximação (cruzamento e direção), em duas linhas de cache vizinhas.
+ *
+ * Cada aproximação recebe uma única via, então o tempo de viagem dessa via
+ * também é contado aqui. Os dois histogramas são escritos juntos, na
+ * travessia, por quem simula o cruzamento.
+ */
+typedef struct {
+    HistogramaMetricas espera; /**< Esperas entre a chegada e a travessia. */
+    HistogramaMetricas viagem; /**< Tempos de viagem pela via que chega à aproximação. */
+} MetricasAproximacao;
+
+typedef char verificarTamanhoMetricasAproximacao[(sizeof(MetricasAproximacao) == 2 * METRICAS_LINHA_CACHE) ? 1 : -1];
+
+/**
+ * @brief Contadores de um escritor (a task geradora ou a thread de uma região), em uma linha de cache própria.
+ */
+typedef struct {
+    volatile uint64_t criados;     /**< Veículos criados. */
+    volatile uint64_t sairam;      /**< Veículos que deixaram a rede. */
+    volatile uint64_t adiados;     /**< Entradas adiadas pelo controle de admissão. */
+    volatile uint64_t descartados; /**< Entradas descartadas pelo controle de admissão. */
+    char preenchimento[METRICAS_LINHA_CACHE - 4 * sizeof(uint64_t)];
+} FragmentoMetricas;
+
+/*
+ * No modo em tempo real várias tasks preemptíveis escrevem no mesmo
+ * cruzamento e a soma precisa ser indivisível; nos modos de eventos
+ * discretos cada cruzamento pertence a uma única thread.
+ */
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL )
+#define metricaSomar(contador, valor) atomicoSomarRelaxado64(&(contador), (valor))
+#define metricaContar(contador) ((void)atomicoSomar32(&(contador), 1))
+#else
+#define metricaSomar(contador, valor) atomicoAcumular64(&(contador), (valor))
+#define metricaContar(contador) atomicoAcumular32(&(contador), 1)
+#endif
+
+static void* blocoMetricas;
+static MetricasAproximacao* metricasAproximacoes;
+static FragmentoMetricas* fragmentosMetricas;
+static int numFragmentosMetricas;
+
+// No modo de conjunto várias threads simulam os mesmos cruzamentos, então as métricas ficam sempre desligadas
+#if ( MODO_SIMULACAO != MODO_CONJUNTO )
+static const char* caminhoMetricas;
+static const Rede* redeMetricas;
+static uint32_t exportacoesMetricas;
+#endif
+
+/**
+ * @brief Arquivo de destino das métricas: a variável de ambiente SIM_METRICAS ou METRICAS_ARQUIVO.
+ *
+ * @return NULL se as métricas não devem ser coletadas.
+ */
+static inline const char* metricasDestino(void) {
+    const char* variavel = getenv("SIM_METRICAS");
+    return (variavel != NULL && variavel[0] != '\0') ? variavel : METRICAS_ARQUIVO;
+}
+
+#if ( MODO_SIMULACAO != MODO_CONJUNTO )
+/**
+ * @brief Aloca os contadores de `rede` para `numFragmentos` escritores, zerados.
+ *
+ * @param caminho Arquivo exportado pelo relator (NULL apenas coleta, para medições).
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int metricasIniciar(const Rede* rede, int numFragmentos, const char* caminho) {
+    caminhoMetricas = caminho;
+
+    size_t bytesAproximacoes = (size_t)rede->numCruzamentos * NUM_DIRECOES * sizeof(MetricasAproximacao);
+    blocoMetricas = calloc(1, bytesAproximacoes + (size_t)numFragmentos * sizeof(FragmentoMetricas) + METRICAS_LINHA_CACHE);
+    if (blocoMetricas == NULL) {
+        printf("Erro ao alocar memoria para as metricas.\n");
+        return 0;
+    }
+
+    // Alinha o início dos contadores à linha de cache
+    uintptr_t inicio = ((uintptr_t)blocoMetricas + METRICAS_LINHA_CACHE - 1) & ~(uintptr_t)(METRICAS_LINHA_CACHE - 1);
+    metricasAproximacoes = (MetricasAproximacao*)inicio;
+    fragmentosMetricas = (FragmentoMetricas*)(inicio + bytesAproximacoes);
+    numFragmentosMetricas = numFragmentos;
+    redeMetricas = rede;
+    exportacoesMetricas = 0;
+    return 1;
+}
+#endif
+
+/**
+ * @brief Contadores do escritor `indice`, ou NULL com as métricas desligadas.
+ */
+static inline FragmentoMetricas* metricasFragmento(int indice) {
+    return (blocoMetricas != NULL && indice < numFragmentosMetricas) ? &fragmentosMetricas[indice] : NULL;
+}
+
+static inline MetricasAproximacao* metricasAproximacao(int cruzamento, int direcao) {
+    return &metricasAproximacoes[cruzamento * NUM_DIRECOES + direcao - 1];
+}
+
+/**
+ * @brief Faixa do histograma de `ms`, sem desvios (os tempos variam demais para o preditor).
+ */
+static inline int metricasBalde(uint64_t ms) {
+    int b = 0;
+    for (int i = 0; i < METRICAS_BALDES; i++) b += (ms > limitesBaldesMs[i]);
+    return b;
+}
+
+static inline void metricasRegistrarHistograma(HistogramaMetricas* h, uint64_t ms) {
+    metricaSomar(h->somaMs, ms);
+    metricaContar(h->baldes[metricasBalde(ms)]);
+}
+
+/**
+ * @brief Conta um veículo que atravessou a aproximação depois de esperar `esperaMs`.
+ *
+ * @param viagemMs Duração da viagem pela via até a chegada, ou SEM_VIAGEM se o veículo nasceu no cruzamento.
+ */
+static inline void metricasRegistrarTravessia(int cruzamento, int direcao, uint64_t esperaMs, uint64_t viagemMs) {
+    MetricasAproximacao* a = metricasAproximacao(cruzamento, direcao);
+    metricasRegistrarHistograma(&a->espera, esperaMs);
+    if (viagemMs != SEM_VIAGEM) metricasRegistrarHistograma(&a->viagem, viagemMs);
+}
+
+// No modo em tempo real os contadores vivem até o fim do programa
+#if ( mainUSAR_FREERTOS != 1 ) && ( MODO_SIMULACAO != MODO_CONJUNTO )
+/**
+ * @brief Libera os contadores; depois disso `metricasFragmento` retorna NULL.
+ */
+static void metricasLiberar(void) {
+    free(blocoMetricas);
+    blocoMetricas = NULL;
+    metricasAproximacoes = NULL;
+    fragmentosMetricas = NULL;
+    numFragmentosMetricas = 0;
+}
+#endif
+
+// O benchmark do simulador só mede o custo da coleta, sem exportar, e a validação mesoscópica só lê os contadores
+#if ( MODO_SIMULACAO != MODO_BENCH_SIMULADOR ) && ( MODO_SIMULACAO != MODO_MESOSCOPICO ) && \
+    ( MODO_SIMULACAO != MODO_CONJUNTO )
+
+/**
+ * @brief Soma os baldes de um histograma.
+ */
+static uint64_t metricasTotal(HistogramaMetricas* h) {
+    uint64_t total = 0;
+    for (int b = 0; b <= METRICAS_BALDES; b++) total += atomicoLer32(&h->baldes[b]);
+    return total;
+}
+
+/**
+ * @brief Escreve as linhas de um histograma a partir de baldes já somados.
+ */
+static void metricasEscreverHistograma(FILE* f, const char* nome, const char* rotulos, const uint64_t* baldes,
+    uint64_t somaMs) {
+    uint64_t acumulado = 0;
+
+    for (int b = 0; b <= METRICAS_BALDES; b++) {
+        acumulado += baldes[b];
+        if (b < METRICAS_BALDES) {
+            fprintf(f, "%s_bucket{%s%sle=\"%g\"} %llu\n", nome, rotulos, rotulos[0] ? "," : "",
+                limitesBaldesMs[b] / 1000.0, (unsigned long long)acumulado);
+        }
+        else {
+            fprintf(f, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", nome, rotulos, rotulos[0] ? "," : "",
+                (unsigned long long)acumulado);
+        }
+    }
+    fprintf(f, "%s_sum{%s} %.3f\n", nome, rotulos, somaMs / 1000.0);
+    fprintf(f, "%s_count{%s} %llu\n", nome, rotulos, (unsigned long long)acumulado);
+}
+
+/**
+ * @brief Soma os contadores de todos os escritores e grava o arquivo do Prometheus.
+ *
+ * O arquivo é escrito com outro nome e renomeado, para que um coletor nunca
+ * leia uma exportação pela metade. Os contadores são lidos sem travas, então
+ * uma exportação pode não incluir os eventos que ocorrem durante a leitura.
+ */
+static void metricasExportar(void) {
+    char temporario[512];
+    const Rede* rede = redeMetricas;
+    int detalhar = rede->numCruzamentos <= METRICAS_MAX_CRUZAMENTOS_DETALHE;
+    uint64_t criados = 0, sairam = 0, adiados = 0, descartados = 0;
+
+    snprintf(temporario, sizeof(temporario), "%s.tmp", caminhoMetricas);
+    FILE* f = fopen(temporario, "w");
+    if (f == NULL) return;
+
+    for (int i = 0; i < numFragmentosMetricas; i++) {
+        criados += atomicoLerRelaxado64(&fragmentosMetricas[i].criados);
+        sairam += atomicoLerRelaxado64(&fragmentosMetricas[i].sairam);
+        adiados += atomicoLerRelaxado64(&fragmentosMetricas[i].adiados);
+        descartados += atomicoLerRelaxado64(&fragmentosMetricas[i].descartados);
+    }
+    fprintf(f, "# HELP simulador_veiculos_criados_total Veiculos criados.\n");
+    fprintf(f, "# TYPE simulador_veiculos_criados_total counter\n");
+    fprintf(f, "simulador_veiculos_criados_total %llu\n", (unsigned long long)criados);
+    fprintf(f, "# HELP simulador_veiculos_na_rede Veiculos atualmente na rede.\n");
+    fprintf(f, "# TYPE simulador_veiculos_na_rede gauge\n");
+    fprintf(f, "simulador_veiculos_na_rede %lld\n", (long long)(criados - sairam));
+    fprintf(f, "# HELP simulador_entradas_adiadas_total Veiculos cuja entrada na rede foi adiada por congestionamento ou falta de memoria.\n");
+    fprintf(f, "# TYPE simulador_entradas_adiadas_total counter\n");
+    fprintf(f, "simulador_entradas_adiadas_total %llu\n", (unsigned long long)adiados);
+    fprintf(f, "# HELP simulador_entradas_descartadas_total Veiculos que desistiram de entrar na rede.\n");
+    fprintf(f, "# TYPE simulador_entradas_descartadas_total counter\n");
+    fprintf(f, "simulador_entradas_descartadas_total %llu\n", (unsigned long long)descartados);
+
+    fprintf(f, "# HELP simulador_veiculos_atendidos_total Veiculos que atravessaram a aproximacao.\n");
+    fprintf(f, "# TYPE simulador_veiculos_atendidos_total counter\n");
+    for (int c = 0; c < rede->numCruzamentos; c++) {
+        for (int d = 1; d <= NUM_DIRECOES; d++) {
+            fprintf(f, "simulador_veiculos_atendidos_total{cruzamento=\"%s\",direcao=\"%s\"} %llu\n", rede->nome[c],
+                nomeDirecao(d), (unsigned long long)metricasTotal(&metricasAproximacao(c, d)->espera));
+        }
+    }
+
+    // Histogramas por aproximação nas redes pequenas; nas grandes, por direção e tempos médios por via
+    for (int tipo = 0; tipo < 2; tipo++) {
+        const char* nome = tipo == 0 ? "simulador_espera_segundos" : "simulador_viagem_segundos";
+        uint64_t baldes[NUM_DIRECOES][METRICAS_BALDES + 1] = { { 0 } };
+        uint64_t somas[NUM_DIRECOES] = { 0 };
+
+        fprintf(f, "# HELP %s %s\n", nome, tipo == 0 ? "Espera entre a chegada a faixa de retencao e a travessia." :
+            "Tempo de viagem pela via que chega a aproximacao.");
+        fprintf(f, "# TYPE %s histogram\n", nome);
+        for (int c = 0; c < rede->numCruzamentos; c++) {
+            for (int d = 1; d <= NUM_DIRECOES; d++) {
+                MetricasAproximacao* a = metricasAproximacao(c, d);
+                HistogramaMetricas* h = tipo == 0 ? &a->espera : &a->viagem;
+                uint64_t lidos[METRICAS_BALDES + 1];
+                uint64_t soma = atomicoLerRelaxado64(&h->somaMs);
+
+                for (int b = 0; b <= METRICAS_BALDES; b++) {
+                    lidos[b] = atomicoLer32(&h->baldes[b]);
+                    baldes[d - 1][b] += lidos[b];
+                }
+                somas[d - 1] += soma;
+                if (detalhar) {
+                    char rotulos[64];
+                    snprintf(rotulos, sizeof(rotulos), "cruzamento=\"%s\",direcao=\"%s\"", rede->nome[c], nomeDirecao(d));
+                    metricasEscreverHistograma(f, nome, rotulos, lidos, soma);
+                }
+            }
+        }
+        if (!detalhar) {
+            for (int d = 1; d <= NUM_DIRECOES; d++) {
+                char rotulos[32];
+                snprintf(rotulos, sizeof(rotulos), "direcao=\"%s\"", nomeDirecao(d));
+                metricasEscreverHistograma(f, nome, rotulos, baldes[d - 1], somas[d - 1]);
+            }
+        }
+    }
+
+    if (!detalhar) {
+        fprintf(f, "# HELP simulador_viagem_media_segundos Tempo medio de viagem pela via que chega a aproximacao.\n");
+        fprintf(f, "# TYPE simulador_viagem_media_segundos gauge\n");
+        for (int c = 0; c < rede->numCruzamentos; c++) {
+            for (int d = 1; d <= NUM_DIRECOES; d++) {
+                MetricasAproximacao* a = metricasAproximacao(c, d);
+                uint64_t viagens = metricasTotal(&a->viagem);
+                if (viagens == 0) continue;
+                fprintf(f, "simulador_viagem_media_segundos{cruzamento=\"%s\",direcao=\"%s\"} %.3f\n", rede->nome[c],
+                    nomeDirecao(d), atomicoLerRelaxado64(&a->viagem.somaMs) / 1000.0 / viagens);
+            }
+        }
+    }
+
+    fclose(f);
+#if defined( _WIN32 )
+    remove(caminhoMetricas); // No Windows rename não substitui um arquivo existente
+#endif
+    rename(temporario, caminhoMetricas);
+    exportacoesMetricas++;
+}
+
+#if ( mainUSAR_FREERTOS == 1 )
+
+/**
+ * @brief Task de baixa frequência que exporta as métricas periodicamente.
+ *
+ * @param pvParameters Parâmetros passados para a função (não utilizado neste caso).
+ */
+void vMetricasTask(void* pvParameters) {
+    (void)pvParameters;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(METRICAS_PERIODO_MS));
+        metricasExportar();
+    }
+}
+
+#else
+
+static volatile uint32_t pararRelatorMetricas;
+static ThreadNativa threadRelatorMetricas;
+
+static void prvRelatarMetricas(void* pvParametro) {
+    (void)pvParametro;
+
+    for (;;) {
+        // Dorme em passos curtos para encerrar logo ao fim da simulação
+        for (uint32_t ms = 0; ms < METRICAS_PERIODO_MS; ms += 10) {
+            if (atomicoLer32(&pararRelatorMetricas)) return;
+            threadDormirMs(10);
+        }
+        metricasExportar();
+    }
+}
+
+/**
+ * @brief Inicia a thread que exporta as métricas periodicamente.
+ */
+static void metricasIniciarRelator(void) {
+    if (blocoMetricas == NULL) return;
+    atomicoEscrever32(&pararRelatorMetricas, 0);
+    if (!threadCriar(&threadRelatorMetricas, prvRelatarMetricas, NULL)) {
+        printf("Falha ao criar a thread do relator de metricas; apenas a exportacao final sera feita.\n");
+        atomicoEscrever32(&pararRelatorMetricas, 1);
+    }
+}
+
+/**
+ * @brief Para o relator, faz a exportação final e libera os contadores.
+ */
+static void metricasEncerrar(void) {
+    if (blocoMetricas == NULL) return;
+
+    if (!atomicoLer32(&pararRelatorMetricas)) {
+        atomicoEscrever32(&pararRelatorMetricas, 1);
+        threadAguardar(threadRelatorMetricas);
+    }
+    metricasExportar();
+    printf("Metricas: %u exportacoes para %s.\n", (unsigned)exportacoesMetricas, caminhoMetricas);
+    metricasLiberar();
+}
+
+#endif /* mainUSAR_FREERTOS */
+
+#endif /* MODO_SIMULACAO != MODO_BENCH_SIMULADOR && MODO_SIMULACAO != MODO_MESOSCOPICO && MODO_SIMULACAO != MODO_CONJUNTO */
+
+#endif /* métricas de tráfego */
+
+/*----------------- INSTANTÂNEOS DA REDE ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) || ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+
+/*
+ * Visões imutáveis e versionadas da rede inteira (a fase de cada cruzamento,
+ * a ocupação de cada via e a posição de cada veículo) para leitores de fora
+ * da simulação: painéis, exportadores e controladores. A simulação monta cada
+ * instantâneo num buffer que nenhum leitor está usando e o publica com uma
+ * única troca atômica; o leitor obtém o publicado com uma única soma atômica
+ * e o devolve ao terminar. Nenhum lado espera pelo outro: se todos os
+ * buffers estiverem presos por leitores lentos, a publicação é pulada.
+ *
+ * A palavra `publicado` guarda o buffer atual (mais 1) nos 32 bits altos e,
+ * nos baixos, quantos leitores o obtiveram. Ao publicar outro, a simulação
+ * anota essa contagem no buffer que saiu, e ele volta a ficar livre quando
+ * as devoluções dos leitores a alcançam (contagem de referências dividida).
+ */
+#define INSTANTANEOS_BUFFERS 3        // Um publicado, um preso por leitores atrasados e um sendo montado
+#ifndef INSTANTANEOS_ARQUIVO
+#define INSTANTANEOS_ARQUIVO NULL     // Instantâneos só com SIM_INSTANTANEOS=<arquivo JSON>
+#endif
+#define INSTANTANEOS_PERIODO_MS 1000  // Intervalo padrão entre publicações, em tempo simulado (SIM_INSTANTANEOS_MS)
+#define INSTANTANEOS_EXPORTAR_MS 1000 // Intervalo entre gravações do exportador de exemplo, em tempo real
+#define INSTANTANEO_PARADO 0xFFFFu    // Progresso de quem está parado no fim da via (faixa de retenção)
+
+/**
+ * @brief Posição de um veículo em um instantâneo.
+ */
+typedef struct {
+    int32_t id;         /**< Identificador do veículo. */
+    int32_t cruzamento; /**< Cruzamento para onde o veículo vai ou onde está parado. */
+    int32_t via;        /**< Via em que o veículo está (-1: ainda na entrada da rede). */
+    uint16_t progresso; /**< Fração percorrida da via, em 1/65535 (INSTANTANEO_PARADO na faixa de retenção). */
+    uint8_t direcao;    /**< Direção de chegada ao cruzamento. */
+    uint8_t reservado;
+} PosicaoVeiculo;
+
+/**
+ * @brief Visão da rede em um instante. Depois de publicada, não muda até voltar a ficar livre.
+ */
+typedef struct {
+    uint64_t versao;              /**< Número da publicação, a partir de 1. */
+    uint64_t instanteMs;          /**< Instante simulado da visão, em ms. */
+    int numCruzamentos;           /**< Entradas de `fases`. */
+    int numVias;                  /**< Entradas de `ocupacao`. */
+    int numVeiculos;              /**< Entradas de `veiculos`. */
+    int capacidadeVeiculos;       /**< Capacidade alocada de `veiculos` (ajustada pela simulação). */
+    uint32_t* fases;              /**< Palavra de fase de cada cruzamento (ver FASE_ABERTO e FASE_MOVIMENTO). */
+    uint32_t* ocupacao;           /**< Veículos em cada via, andando ou parados no fim dela. */
+    PosicaoVeiculo* veiculos;     /**< Veículos na rede. */
+    volatile uint32_t devolucoes; /**< Leitores que já devolveram o buffer. */
+    uint32_t obtencoes;           /**< Leitores que o obtiveram enquanto publicado (anotado pela simulação). */
+} InstantaneoRede;
+
+/**
+ * @brief Buffers e contadores dos instantâneos. Só a simulação monta e publica.
+ */
+typedef struct Instantaneos {
+    InstantaneoRede buffers[INSTANTANEOS_BUFFERS];
+    volatile uint64_t publicado; /**< Buffer publicado mais 1 (32 bits altos) e leitores que o obtiveram (baixos). */
+    uint64_t periodoMs;          /**< Intervalo entre publicações, em ms simulados. */
+    int* viaChegada;             /**< Via que chega a cada aproximação (cruzamento * NUM_DIRECOES + direção - 1), ou -1. */
+    uint64_t publicados;         /**< Instantâneos publicados (a versão do último). */
+    uint64_t pulados;            /**< Publicações puladas sem buffer livre. */
+    volatile uint64_t leituras;  /**< Instantâneos obtidos por leitores. */
+} Instantaneos;
+
+/**
+ * @brief Aloca os buffers para a rede e o período de SIM_INSTANTANEOS_MS.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int instantaneosIniciar(Instantaneos* inst, const Rede* rede) {
+    const char* periodo = getenv("SIM_INSTANTANEOS_MS");
+    int ok = 1;
+
+    *inst = (Instantaneos){ 0 };
+    inst->periodoMs = (periodo != NULL && strtoull(periodo, NULL, 10) > 0) ? strtoull(periodo, NULL, 10) : INSTANTANEOS_PERIODO_MS;
+    inst->viaChegada = (int*)malloc((size_t)rede->numCruzamentos * NUM_DIRECOES * sizeof(int));
+    ok = inst->viaChegada != NULL;
+    for (int i = 0; ok && i < rede->numCruzamentos * NUM_DIRECOES; i++) inst->viaChegada[i] = -1;
+    for (int l = 0; ok && l < rede->numLinks; l++) {
+        inst->viaChegada[rede->linkDestino[l] * NUM_DIRECOES + rede->linkDirecao[l] - 1] = l;
+    }
+    for (int b = 0; ok && b < INSTANTANEOS_BUFFERS; b++) {
+        InstantaneoRede* v = &inst->buffers[b];
+        v->numCruzamentos = rede->numCruzamentos;
+        v->numVias = rede->numLinks;
+        v->fases = (uint32_t*)malloc((size_t)rede->numCruzamentos * sizeof(uint32_t));
+        v->ocupacao = (uint32_t*)malloc((size_t)(rede->numLinks ? rede->numLinks : 1) * sizeof(uint32_t));
+        ok = v->fases != NULL && v->ocupacao != NULL;
+    }
+    if (!ok) printf("Erro ao alocar memoria para os instantaneos da rede.\n");
+    return ok;
+}
+
+#if ( mainUSAR_FREERTOS == 0 )
+/**
+ * @brief Libera os buffers. Nenhum leitor pode estar com um instantâneo obtido.
+ */
+static void instantaneosLiberar(Instantaneos* inst) {
+    for (int b = 0; b < INSTANTANEOS_BUFFERS; b++) {
+        free(inst->buffers[b].fases);
+        free(inst->buffers[b].ocupacao);
+        free(inst->buffers[b].veiculos);
+    }
+    free(inst->viaChegada);
+    *inst = (Instantaneos){ 0 };
+}
+#endif
+
+/**
+ * @brief Obtém o instantâneo publicado mais recente, sem travar nem esperar.
+ *
+ * Pode ser chamada de qualquer thread ou task, a qualquer frequência. O
+ * instantâneo não muda até ser devolvido com `instantaneoDevolver`.
+ *
+ * @return O instantâneo, ou NULL se nenhum foi publicado ainda (não devolver).
+ */
+static const InstantaneoRede* instantaneoObter(Instantaneos* inst) {
+    uint64_t publicado = atomicoSomar64(&inst->publicado, 1) - 1;
+    uint32_t indice = (uint32_t)(publicado >> 32);
+
+    if (indice == 0) return NULL;
+    atomicoSomarRelaxado64(&inst->leituras, 1);
+    return &inst->buffers[indice - 1];
+}
+
+/**
+ * @brief Devolve um instantâneo obtido com `instantaneoObter`.
+ */
+static void instantaneoDevolver(const InstantaneoRede* v) {
+    atomicoSomar32(&((InstantaneoRede*)v)->devolucoes, 1);
+}
+
+/**
+ * @brief Retorna um buffer livre para a simulação montar o próximo instantâneo.
+ *
+ * @param veiculos Veículos que o instantâneo pode precisar guardar.
+ * @return O buffer, ou NULL se todos estiverem presos por leitores (a publicação é pulada) ou faltar memória.
+ */
+static InstantaneoRede* instantaneoMontar(Instantaneos* inst, int veiculos) {
+    uint32_t atual = (uint32_t)(atomicoLerRelaxado64(&inst->publicado) >> 32);
+
+    for (uint32_t b = 0; b < INSTANTANEOS_BUFFERS; b++) {
+        InstantaneoRede* v = &inst->buffers[b];
+        if (b + 1 == atual || atomicoLer32(&v->devolucoes) != v->obtencoes) continue;
+
+        // Nenhum leitor pode mais alcançar este buffer: os contadores voltam a zero
+        v->devolucoes = 0;
+        v->obtencoes = 0;
+        if (veiculos > v->capacidadeVeiculos) {
+            int capacidade = veiculos + veiculos / 2 + 16;
+            PosicaoVeiculo* novos = (PosicaoVeiculo*)realloc(v->veiculos, (size_t)capacidade * sizeof(PosicaoVeiculo));
+            if (novos == NULL) return NULL;
+            v->veiculos = novos;
+            v->capacidadeVeiculos = capacidade;
+        }
+        return v;
+    }
+    inst->pulados++;
+    return NULL;
+}
+
+/**
+ * @brief Publica o buffer montado; o anterior fica com os leitores que já o obtiveram.
+ */
+static void instantaneoPublicar(Instantaneos* inst, InstantaneoRede* v) {
+    v->versao = ++inst->publicados;
+    uint64_t anterior = atomicoTrocar64(&inst->publicado, (uint64_t)(v - inst->buffers + 1) << 32);
+    uint32_t indice = (uint32_t)(anterior >> 32);
+    if (indice != 0) inst->buffers[indice - 1].obtencoes = (uint32_t)anterior;
+}
+
+/**
+ * @brief Progresso na via de quem entrou nela em `inicioMs` e leva `duracaoMs` para percorrê-la.
+ */
+static inline uint16_t instantaneoProgresso(uint64_t agoraMs, uint64_t inicioMs, uint64_t duracaoMs) {
+    if (agoraMs <= inicioMs) return 0;
+    if (agoraMs - inicioMs >= duracaoMs) return INSTANTANEO_PARADO;
+    return (uint16_t)((agoraMs - inicioMs) * (INSTANTANEO_PARADO - 1) / duracaoMs);
+}
+
+/**
+ * @brief Grava o instantâneo mais recente em JSON no arquivo `caminho` (exemplo de leitor externo).
+ *
+ * O arquivo é escrito com outro nome e renomeado, como as métricas, de modo
+ * que quem o lê nunca vê uma gravação pela metade.
+ *
+ * @return Retorna 1 se algum instantâneo foi gravado.
+ */
+static int instantaneosExportar(Instantaneos* inst, const char* caminho) {
+    char temporario[512];
+    const InstantaneoRede* v = instantaneoObter(inst);
+
+    if (v == NULL) return 0;
+    snprintf(temporario, sizeof(temporario), "%s.tmp", caminho);
+    FILE* f = fopen(temporario, "w");
+    if (f == NULL) {
+        instantaneoDevolver(v);
+        return 0;
+    }
+
+    fprintf(f, "{\"versao\":%llu,\"instante_ms\":%llu,\"fases\":[", (unsigned long long)v->versao,
+        (unsigned long long)v->instanteMs);
+    for (int c = 0; c < v->numCruzamentos; c++) fprintf(f, "%s%u", c ? "," : "", (unsigned)v->fases[c]);
+    fprintf(f, "],\"ocupacao\":[");
+    for (int l = 0; l < v->numVias; l++) fprintf(f, "%s%u", l ? "," : "", (unsigned)v->ocupacao[l]);
+    fprintf(f, "],\"veiculos\":[");
+    for (int i = 0; i < v->numVeiculos; i++) {
+        const PosicaoVeiculo* p = &v->veiculos[i];
+        fprintf(f, "%s[%d,%d,%d,%u,%u]", i ? "," : "", (int)p->id, (int)p->cruzamento, (int)p->via,
+            (unsigned)p->progresso, (unsigned)p->direcao);
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+    instantaneoDevolver(v);
+
+#if defined( _WIN32 )
+    remove(caminho); // No Windows rename não substitui um arquivo existente
+#endif
+    rename(temporario, caminho);
+    return 1;
+}
+
+/**
+ * @brief Arquivo do exportador de instantâneos: SIM_INSTANTANEOS ou INSTANTANEOS_ARQUIVO (NULL: desligado).
+ */
+static inline const char* instantaneosDestino(void) {
+    const char* variavel = getenv("SIM_INSTANTANEOS");
+    return (variavel != NULL && variavel[0] != '\0') ? variavel : INSTANTANEOS_ARQUIVO;
+}
+
+#if ( mainUSAR_FREERTOS == 0 )
+
+/**
+ * @brief Exportador de exemplo, numa thread própria que só lê os instantâneos publicados.
+ */
+typedef struct {
+    Instantaneos* instantaneos;
+    const char* caminho;
+    volatile uint32_t parar;
+    uint32_t gravacoes;
+    ThreadNativa thread;
+} ExportadorInstantaneos;
+
+static void prvExportarInstantaneos(void* pvParametro) {
+    ExportadorInstantaneos* exportador = (ExportadorInstantaneos*)pvParametro;
+
+    for (;;) {
+        // Dorme em passos curtos para encerrar logo ao fim da simulação
+        for (uint32_t ms = 0; ms < INSTANTANEOS_EXPORTAR_MS; ms += 10) {
+            if (atomicoLer32(&exportador->parar)) return;
+            threadDormirMs(10);
+        }
+        exportador->gravacoes += (uint32_t)instantaneosExportar(exportador->instantaneos, exportador->caminho);
+    }
+}
+
+/**
+ * @brief Inicia a thread do exportador.
+ */
+static void instantaneosIniciarExportador(ExportadorInstantaneos* exportador, Instantaneos* inst, const char* caminho) {
+    *exportador = (ExportadorInstantaneos){ 0 };
+    exportador->instantaneos = inst;
+    exportador->caminho = caminho;
+    if (!threadCriar(&exportador->thread, prvExportarInstantaneos, exportador)) {
+        printf("Falha ao criar a thread do exportador de instantaneos; apenas a gravacao final sera feita.\n");
+        exportador->parar = 1;
+    }
+}
+
+/**
+ * @brief Para o exportador e grava o último instantâneo publicado.
+ */
+static void instantaneosEncerrarExportador(ExportadorInstantaneos* exportador) {
+    if (!atomicoLer32(&exportador->parar)) {
+        atomicoEscrever32(&exportador->parar, 1);
+        threadAguardar(exportador->thread);
+    }
+    exportador->gravacoes += (uint32_t)instantaneosExportar(exportador->instantaneos, exportador->caminho);
+}
+
+#endif /* mainUSAR_FREERTOS == 0 */
+
+#endif /* instantâneos da rede */
+
+/*----------------- TELA DO TERMINAL ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_TEMPO_REAL ) || ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+
+/*
+ * Desenho da grade no terminal, como o diagrama do README, com os sinais de
+ * cada aproximação, os veículos em cada via e as filas paradas. A tela lê os
+ * instantâneos da rede num ritmo fixo (TELA_QUADROS_POR_S), de modo que o
+ * custo não depende de quantos eventos a simulação trata, e só reescreve as
+ * células que mudaram desde o quadro anterior, com o cursor posicionado por
+ * sequências ANSI e uma única escrita por quadro. As linhas abaixo da grade
+ * formam uma região de rolagem para as demais mensagens do programa.
+ *
+ * Cada cruzamento ocupa um bloco de TELA_LARGURA_CRUZAMENTO x
+ * TELA_ALTURA_CRUZAMENTO caracteres:
+ *
+ *         |  ooo       ooo: veículos na via que chega do norte
+ *   fff   v  fff       fff: fila parada (em amarelo) na aproximação ao lado
+ *   -ooo->+<-ooo-      v ^ > <: sinal de quem chega por aquele lado
+ *     fff ^  fff
+ *     ooo |
+ */
+#define TELA_QUADROS_POR_S 10       // Quadros desenhados por segundo (tempo real)
+#define TELA_MAX_LINHAS_GRADE 8     // Cruzamentos mostrados na vertical; redes maiores mostram o canto superior esquerdo
+#define TELA_MAX_COLUNAS_GRADE 8    // Cruzamentos mostrados na horizontal
+#define TELA_LARGURA_CRUZAMENTO 16
+#define TELA_ALTURA_CRUZAMENTO 5
+
+// Cores das células (códigos SGR do ANSI)
+#define TELA_COR_PADRAO   0
+#define TELA_COR_VERMELHO 31
+#define TELA_COR_VERDE    32
+#define TELA_COR_AMARELO  33
+
+/**
+ * @brief Caractere e cor de uma posição da tela.
+ */
+typedef struct {
+    char caractere;
+    uint8_t cor;
+} CelulaTela;
+
+/**
+ * @brief Estado da tela: o quadro sendo composto, o último desenhado e o buffer de saída.
+ */
+typedef struct {
+    const Rede* rede;
+    Instantaneos* instantaneos;
+    int linhasGrade;      /**< Linhas de cruzamentos mostradas. */
+    int colunasGrade;     /**< Colunas de cruzamentos mostradas. */
+    int colunasRede;      /**< Cruzamentos por linha na rede (na ordem dos índices, se ela não for uma grade). */
+    int largura;          /**< Colunas do quadro, em caracteres. */
+    int altura;           /**< Linhas do quadro, com o cabeçalho. */
+    CelulaTela* atual;    /**< Quadro sendo composto. */
+    CelulaTela* anterior; /**< Quadro que está no terminal. */
+    uint32_t* parados;    /**< Veículos parados em cada aproximação do quadro atual. */
+    char* saida;          /**< Sequências ANSI do quadro, escritas de uma vez. */
+    size_t capacidadeSaida;
+    uint64_t ultimaVersao; /**< Versão do último instantâneo desenhado. */
+    uint32_t quadros;      /**< Quadros desenhados. */
+    uint64_t bytes;        /**< Bytes escritos no terminal. */
+} Tela;
+
+/**
+ * @brief Indica se a tela foi pedida com SIM_TELA (qualquer valor diferente de 0).
+ */
+static inline int telaPedida(void) {
+    const char* variavel = getenv("SIM_TELA");
+    return variavel != NULL && variavel[0] != '\0' && strcmp(variavel, "0") != 0;
+}
+
+/**
+ * @brief Prepara a tela para a rede; os quadros vêm de `inst`.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int telaIniciar(Tela* tela, const Rede* rede, Instantaneos* inst) {
+    *tela = (Tela){ 0 };
+    tela->rede = rede;
+    tela->instantaneos = inst;
+    tela->colunasRede = (rede->linhas * rede->colunas == rede->numCruzamentos) ? rede->colunas :
+        (int)ceil(sqrt((double)rede->numCruzamentos));
+    if (tela->colunasRede < 1) tela->colunasRede = 1;
+    tela->colunasGrade = tela->colunasRede < TELA_MAX_COLUNAS_GRADE ? tela->colunasRede : TELA_MAX_COLUNAS_GRADE;
+    int linhasRede = (rede->numCruzamentos + tela->colunasRede - 1) / tela->colunasRede;
+    tela->linhasGrade = linhasRede < TELA_MAX_LINHAS_GRADE ? linhasRede : TELA_MAX_LINHAS_GRADE;
+    tela->largura = tela->colunasGrade * TELA_LARGURA_CRUZAMENTO;
+    if (tela->largura < 80) tela->largura = 80; // Espaço para o cabeçalho
+    tela->altura = 1 + tela->linhasGrade * TELA_ALTURA_CRUZAMENTO;
+
+    size_t celulas = (size_t)tela->largura * (size_t)tela->altura;
+    tela->capacidadeSaida = celulas * 16 + 256; // Pior caso: cursor e cor em todas as células
+    tela->atual = (CelulaTela*)malloc(celulas * sizeof(CelulaTela));
+    tela->anterior = (CelulaTela*)malloc(celulas * sizeof(CelulaTela));
+    tela->parados = (uint32_t*)malloc((size_t)rede->numCruzamentos * NUM_DIRECOES * sizeof(uint32_t));
+    tela->saida = (char*)malloc(tela->capacidadeSaida);
+    if (tela->atual == NULL || tela->anterior == NULL || tela->parados == NULL || tela->saida == NULL) {
+        printf("Erro ao alocar memoria para a tela do terminal.\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Escreve `texto` no quadro a partir da coluna `x` da linha `y`, cortando o que sair dele.
+ */
+static void telaTexto(Tela* tela, int x, int y, const char* texto, uint8_t cor) {
+    for (; *texto != '\0' && x < tela->largura; texto++, x++) {
+        if (x < 0 || y < 0 || y >= tela->altura) continue;
+        tela->atual[y * tela->largura + x] = (CelulaTela){ *texto, cor };
+    }
+}
+
+/**
+ * @brief Escreve um contador em 3 colunas, alinhado à direita (em branco quando zero).
+ */
+static void telaContador(Tela* tela, int x, int y, uint32_t valor, uint8_t cor) {
+    char texto[4];
+    if (valor == 0) return;
+    snprintf(texto, sizeof(texto), "%3u", (unsigned)(valor > 999 ? 999 : valor));
+    telaTexto(tela, x, y, texto, cor);
+}
+
+/**
+ * @brief Cor do sinal de quem chega na direção `direcao`: verde com o movimento reto aberto,
+ *        amarelo com só as conversões abertas e vermelho fechado.
+ */
+static inline uint8_t telaCorSinal(uint32_t fase, int direcao) {
+    if (fase & FASE_MOVIMENTO(MOVIMENTO(direcao, MOVIMENTO_RETO))) return TELA_COR_VERDE;
+    return (fase & FASE_ABERTO(direcao)) ? TELA_COR_AMARELO : TELA_COR_VERMELHO;
+}
+
+/**
+ * @brief Compõe o quadro do instantâneo `v`.
+ */
+static void telaCompor(Tela* tela, const InstantaneoRede* v) {
+    const Rede* rede = tela->rede;
+    const int* viaChegada = tela->instantaneos->viaChegada;
+    char texto[160];
+
+    for (int i = 0; i < tela->largura * tela->altura; i++) tela->atual[i] = (CelulaTela){ ' ', TELA_COR_PADRAO };
+    memset(tela->parados, 0, (size_t)rede->numCruzamentos * NUM_DIRECOES * sizeof(uint32_t));
+    for (int i = 0; i < v->numVeiculos; i++) {
+        const PosicaoVeiculo* p = &v->veiculos[i];
+        if (p->progresso == INSTANTANEO_PARADO) tela->parados[p->cruzamento * NUM_DIRECOES + p->direcao - 1]++;
+    }
+
+    int n = snprintf(texto, sizeof(texto), "Instante %.1f s | instantaneo %llu | %d veiculos", v->instanteMs / 1000.0,
+        (unsigned long long)v->versao, v->numVeiculos);
+    if (n > 0 && (size_t)n < sizeof(texto) && tela->linhasGrade * tela->colunasGrade < rede->numCruzamentos) {
+        snprintf(texto + n, sizeof(texto) - (size_t)n, " | %d de %d cruzamentos", tela->linhasGrade * tela->colunasGrade,
+            rede->numCruzamentos);
+    }
+    telaTexto(tela, 0, 0, texto, TELA_COR_PADRAO);
+
+    for (int linha = 0; linha < tela->linhasGrade; linha++) {
+        for (int coluna = 0; coluna < tela->colunasGrade; coluna++) {
+            int c = linha * tela->colunasRede + coluna;
+            if (c >= rede->numCruzamentos) continue;
+
+            int x = coluna * TELA_LARGURA_CRUZAMENTO;
+            int y = 1 + linha * TELA_ALTURA_CRUZAMENTO;
+            uint32_t fase = v->fases[c];
+            const int* vias = &viaChegada[c * NUM_DIRECOES];
+            const uint32_t* parados = &tela->parados[c * NUM_DIRECOES];
+            char nome[2] = { rede->nome[c][1] == '\0' ? rede->nome[c][0] : '+', '\0' };
+
+            telaTexto(tela, x + 8, y, "|", TELA_COR_PADRAO);
+            telaTexto(tela, x + 8, y + 4, "|", TELA_COR_PADRAO);
+            telaTexto(tela, x, y + 2, "------", TELA_COR_PADRAO);
+            telaTexto(tela, x + 11, y + 2, "-----", TELA_COR_PADRAO);
+            telaTexto(tela, x + 8, y + 2, nome, TELA_COR_PADRAO);
+
+            telaTexto(tela, x + 8, y + 1, "v", telaCorSinal(fase, NS));
+            telaTexto(tela, x + 8, y + 3, "^", telaCorSinal(fase, SN));
+            telaTexto(tela, x + 6, y + 2, ">", telaCorSinal(fase, WE));
+            telaTexto(tela, x + 10, y + 2, "<", telaCorSinal(fase, EW));
+
+            if (vias[NS - 1] >= 0) telaContador(tela, x + 10, y, v->ocupacao[vias[NS - 1]], TELA_COR_PADRAO);
+            if (vias[SN - 1] >= 0) telaContador(tela, x + 4, y + 4, v->ocupacao[vias[SN - 1]], TELA_COR_PADRAO);
+            if (vias[WE - 1] >= 0) telaContador(tela, x + 1, y + 2, v->ocupacao[vias[WE - 1]], TELA_COR_PADRAO);
+            if (vias[EW - 1] >= 0) telaContador(tela, x + 12, y + 2, v->ocupacao[vias[EW - 1]], TELA_COR_PADRAO);
+
+            telaContador(tela, x + 10, y + 1, parados[NS - 1], TELA_COR_AMARELO);
+            telaContador(tela, x + 4, y + 3, parados[SN - 1], TELA_COR_AMARELO);
+            telaContador(tela, x + 2, y + 1, parados[WE - 1], TELA_COR_AMARELO);
+            telaContador(tela, x + 12, y + 3, parados[EW - 1], TELA_COR_AMARELO);
+        }
+    }
+}
+
+/**
+ * @brief Escreve no terminal só as células que mudaram, numa única escrita.
+ *
+ * O cursor é salvo e restaurado em volta do quadro, de modo que as mensagens
+ * impressas na região de rolagem continuam de onde estavam. No primeiro
+ * quadro a tela é limpa e a região de rolagem fica abaixo da grade.
+ */
+static void telaDesenhar(Tela* tela) {
+    char* saida = tela->saida;
+    size_t n = 0;
+    int cursorX = -1, cursorY = -1, cor = -1;
+
+    if (tela->quadros == 0) {
+        n += (size_t)snprintf(saida + n, tela->capacidadeSaida - n, "\033[2J\033[?25l\033[%d;r\033[%d;1H",
+            tela->altura + 2, tela->altura + 2);
+        for (int i = 0; i < tela->largura * tela->altura; i++) tela->anterior[i] = (CelulaTela){ ' ', TELA_COR_PADRAO };
+    }
+    size_t inicio = n;
+    n += (size_t)snprintf(saida + n, tela->capacidadeSaida - n, "\0337");
+    size_t vazio = n;
+
+    for (int y = 0; y < tela->altura; y++) {
+        for (int x = 0; x < tela->largura; x++) {
+            int i = y * tela->largura + x;
+            CelulaTela celula = tela->atual[i];
+            if (celula.caractere == tela->anterior[i].caractere && celula.cor == tela->anterior[i].cor) continue;
+
+            if (x != cursorX || y != cursorY) n += (size_t)snprintf(saida + n, tela->capacidadeSaida - n, "\033[%d;%dH", y + 1, x + 1);
+            if (celula.cor != cor) n += (size_t)snprintf(saida + n, tela->capacidadeSaida - n, "\033[%um", (unsigned)celula.cor);
+            saida[n++] = celula.caractere;
+            cursorX = x + 1;
+            cursorY = y;
+            cor = celula.cor;
+            tela->anterior[i] = celula;
+        }
+    }
+    if (n == vazio) n = inicio; // Nada mudou: só a preparação do primeiro quadro, se houver
+    else n += (size_t)snprintf(saida + n, tela->capacidadeSaida - n, "\033[0m\0338");
+
+    if (n > 0) {
+        fwrite(saida, 1, n, stdout);
+        fflush(stdout);
+        tela->bytes += n;
+    }
+    tela->quadros++;
+}
+
+/**
+ * @brief Desenha um quadro com o instantâneo mais recente, se ele for novo.
+ */
+static void telaQuadro(Tela* tela) {
+    const InstantaneoRede* v = instantaneoObter(tela->instantaneos);
+    if (v == NULL) return;
+    if (v->versao == tela->ultimaVersao) {
+        instantaneoDevolver(v);
+        return;
+    }
+    tela->ultimaVersao = v->versao;
+    telaCompor(tela, v);
+    instantaneoDevolver(v);
+    telaDesenhar(tela);
+}
+
+#if ( mainUSAR_FREERTOS == 0 )
+
+static volatile uint32_t pararTela;
+static ThreadNativa threadTela;
+
+static void prvDesenharTela(void* pvParametro) {
+    Tela* tela = (Tela*)pvParametro;
+
+    while (!atomicoLer32(&pararTela)) {
+        telaQuadro(tela);
+        threadDormirMs(1000 / TELA_QUADROS_POR_S);
+    }
+}
+
+/**
+ * @brief Inicia a thread que desenha a tela.
+ */
+static void telaIniciarThread(Tela* tela) {
+    atomicoEscrever32(&pararTela, 0);
+    if (!threadCriar(&threadTela, prvDesenharTela, tela)) {
+        printf("Falha ao criar a thread da tela; apenas o quadro final sera desenhado.\n");
+        atomicoEscrever32(&pararTela, 1);
+    }
+}
+
+/**
+ * @brief Para a thread, desenha o último quadro e devolve o terminal ao normal.
+ */
+static void telaEncerrar(Tela* tela) {
+    if (!atomicoLer32(&pararTela)) {
+        atomicoEscrever32(&pararTela, 1);
+        threadAguardar(threadTela);
+    }
+    telaQuadro(tela);
+    printf("\033[r\033[?25h\033[%d;1H\n", tela->altura + 1);
+    printf("Tela: %u quadros, %.1f KB escritos no terminal (%.0f bytes por quadro).\n", (unsigned)tela->quadros,
+        tela->bytes / 1024.0, tela->quadros ? (double)tela->bytes / tela->quadros : 0.0);
+    free(tela->atual);
+    free(tela->anterior);
+    free(tela->parados);
+    free(tela->saida);
+}
+
+#endif /* mainUSAR_FREERTOS == 0 */
+
+#endif /* tela do terminal */
+
+#if ( mainUSAR_FREERTOS == 1 )
+
+/**
+ * @brief Fila FIFO de veículos parados em uma aproximação de um cruzamento.
+ *
+ * Protegida pelo mutex de filas do cruzamento.
+ */
+typedef struct {
+    TaskHandle_t tasks[MAX_FILA_ESPERA]; /**< Tasks dos veículos esperando, em ordem de chegada. */
+    int inicio;                          /**< Posição do primeiro veículo da fila. */
+    int quantidade;                      /**< Quantidade de veículos na fila. */
+    TickType_t inicioVerde;              /**< Instante em que o sinal abriu pela última vez. */
+    TickType_t fimVerde;                 /**< Instante em que o verde atual termina. */
+    TickType_t proximaLiberacao;         /**< Primeiro instante livre para um veículo cruzar (intervalo de saturação). */
+} FilaEspera;
+
+/**
+ * @brief Estrutura que representa um cruzamento de trânsito.
+ *
+ * A estrutura contém informações sobre o estado dos semáforos do cruzamento.
+ * Os cruzamentos adjacentes são obtidos da rede viária pelo índice. O estado
+ * dos semáforos é lido sem bloqueio no mapa de sinais da rede (`mapaSinais`),
+ * fora desta estrutura, que fica só com os dados da task do cruzamento.
+ */
+typedef struct Cruzamento {
+    const char* id;               /**< Nome do cruzamento (A, B, C, D...), guardado na rede. */
+    int indice;                   /**< Índice do cruzamento na rede viária. */
+    uint32_t fase;                /**< Palavra de fase com o contador de trocas, usada pela task e pelo log (ver FASE_ABERTO). */
+    SemaphoreHandle_t mutexFilas; /**< Mutex das filas de espera e das escritas no mapa de sinais; a leitura não o utiliza. */
+    FilaEspera espera[NUM_DIRECOES]; /**< Veículos parados em cada aproximação, indexados por direção - 1. */
+    CanalLog* log;                /**< Canal de log da task do cruzamento (NULL com o log desligado). */
+    GeradorAleatorio gerador;     /**< Fluxo dos atributos dos veículos criados aqui (usado só por vVeiculoCreator). */
+    TickType_t proximaTroca;      /**< Tick da próxima troca de fase (com TEMPORIZACAO_POR_RODA = 1). */
+} Cruzamento;
+
+/**
+ * @brief Estrutura que representa um veículo.
+ *
+ * A estrutura contém informações sobre o veículo, como velocidade,
+ * direção, tempo de deslocamento e referência ao cruzamento atual.
+ */
+typedef struct {
+    int id;                        /**< Identificador do veículo. */
+    int velocidade;                /**< Velocidade do veículo em km/h. */
+    int direcao;                   /**< Direção em que o veículo chegou ao cruzamento atual (1-NS, 2-SN, 3-EW, 4-WE). */
+    int tempoDeslocamento;         /**< Tempo necessário para atravessar o cruzamento. */
+    Cruzamento* cruzamento;        /**< Cruzamento atual onde o veículo está. */
+    int destino;                   /**< Saída da viagem (ver `rotasSortearDestino`), ou -1 para seguir reto. */
+    int via;                       /**< Via em que o veículo está ou pela qual chegou ao cruzamento atual (-1 ao sair da rede). */
+    uint64_t inicioTrecho;         /**< Instante em que entrou em `via`, em ms (SEM_VIAGEM na entrada da rede). */
+    CanalLog* log;                 /**< Canal de log da task que conduz o veículo. */
+    int vaga;                      /**< Vaga do pool cuja task conduz o veículo. */
+} Veiculo;
+
+// Rede viária e vetor contíguo de cruzamentos, na mesma ordem dos índices da rede
+Rede rede;
+Cruzamento* cruzamentos;
+MapaSinais mapaSinais; // Estado dos sinais e das filas de todas as aproximações, separado dos cruzamentos
+
+#if ( FILAS_POR_VIA == 1 )
+// Vagas livres de cada via (semáforo contador com a capacidade da via), criadas junto com os cruzamentos
+static SemaphoreHandle_t* vagasVias;
+#endif
+
+/**
+ * @brief Vaga do pool de veículos: registro, task, TCB e pilha alocados estaticamente.
+ *
+ * A task de uma vaga é criada na primeira vez que a vaga é usada e, quando o
+ * veículo sai da rede, devolve a vaga ao pool e dorme até receber o próximo
+ * veículo, em vez de ser apagada. Assim nenhum veículo passa pelo heap.
+ */
+typedef struct {
+    Veiculo veiculo;                               /**< Veículo atualmente conduzido pela vaga. */
+    TaskHandle_t task;                             /**< Task da vaga (NULL até o primeiro uso). */
+    StaticTask_t tcb;                              /**< TCB estático da task. */
+    StackType_t pilha[configMINIMAL_STACK_SIZE];   /**< Pilha estática da task. */
+    CanalLog* log;                                 /**< Canal de log da task. */
+    int proximaLivre;                              /**< Próxima vaga livre (-1 encerra a lista). */
+} VagaVeiculo;
+
+/**
+ * @brief Pool de capacidade fixa das vagas de veículos, com lista de livres em pilha.
+ *
+ * Obter e devolver uma vaga custam O(1) e ocorrem em seção crítica. Os
+ * contadores permitem acompanhar a ocupação e o pico (marca d'água) do pool.
+ */
+typedef struct {
+    VagaVeiculo vagas[MAX_VEICULOS];
+    int livre;           /**< Topo da lista de vagas livres (-1 se o pool estiver cheio). */
+    int emUso;           /**< Vagas ocupadas no momento. */
+    int pico;            /**< Maior ocupação já observada. */
+    uint32_t obtidas;    /**< Total de vagas entregues ao gerador de veículos. */
+    uint32_t recusas;    /**< Veículos não gerados por falta de vaga. */
+} PoolVeiculos;
+
+static PoolVeiculos poolVeiculos;
+
+/**
+ * @brief Encadeia todas as vagas na lista de livres. Deve ser chamada antes do agendador.
+ */
+void poolVeiculosIniciar(void) {
+    for (int i = 0; i < MAX_VEICULOS; i++) {
+        poolVeiculos.vagas[i].task = NULL;
+        poolVeiculos.vagas[i].log = NULL;
+        poolVeiculos.vagas[i].proximaLivre = (i + 1 < MAX_VEICULOS) ? i + 1 : -1;
+    }
+    poolVeiculos.livre = 0;
+    poolVeiculos.emUso = 0;
+    poolVeiculos.pico = 0;
+    poolVeiculos.obtidas = 0;
+    poolVeiculos.recusas = 0;
+}
+
+/**
+ * @brief Retira uma vaga livre do pool.
+ *
+ * @return A vaga obtida, ou NULL se todas estiverem ocupadas.
+ */
+VagaVeiculo* poolVeiculosObter(void) {
+    VagaVeiculo* vaga = NULL;
+
+    taskENTER_CRITICAL();
+    if (poolVeiculos.livre >= 0) {
+        vaga = &poolVeiculos.vagas[poolVeiculos.livre];
+        poolVeiculos.livre = vaga->proximaLivre;
+        poolVeiculos.obtidas++;
+        if (++poolVeiculos.emUso > poolVeiculos.pico) {
+            poolVeiculos.pico = poolVeiculos.emUso;
+        }
+    }
+    else {
+        poolVeiculos.recusas++;
+    }
+    taskEXIT_CRITICAL();
+
+    return vaga;
+}
+
+/**
+ * @brief Devolve ao pool a vaga de um veículo que saiu da rede.
+ *
+ * @param vaga Vaga a devolver.
+ */
+void poolVeiculosDevolver(VagaVeiculo* vaga) {
+    taskENTER_CRITICAL();
+    vaga->proximaLivre = poolVeiculos.livre;
+    poolVeiculos.livre = (int)(vaga - poolVeiculos.vagas);
+    poolVeiculos.emUso--;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Contadores usados para comparar a espera por notificação com a consulta periódica.
+ */
+typedef struct {
+    uint32_t esperas;            /**< Paradas em sinal vermelho. */
+    uint32_t despertares;        /**< Vezes em que a task de um veículo parado foi acordada. */
+    uint64_t latenciaTotal;      /**< Soma dos atrasos entre a abertura do sinal e a retomada do veículo, em ticks. */
+    uint32_t despertaresPolling; /**< Despertares estimados caso o veículo consultasse o sinal a cada 1 s. */
+    uint64_t latenciaPolling;    /**< Latência total estimada com consulta a cada 1 s, em ticks. */
+} EstatisticasEspera;
+
+static EstatisticasEspera estatisticasEspera;
+
+/**
+ * @brief Contadores do controle de admissão do modo em tempo real (escritos só por `vVeiculoCreator`).
+ */
+typedef struct {
+    uint32_t adiados;    /**< Entradas adiadas por pressão. */
+    uint32_t descartados; /**< Entradas descartadas com a fila de adiados cheia. */
+    uint32_t pendentes;  /**< Veículos adiados esperando para entrar, em todas as entradas. */
+} EstatisticasAdmissao;
+
+static EstatisticasAdmissao estatisticasAdmissao;
+
+/**
+ * @brief Acorda, em ordem de chegada, os veículos parados em uma aproximação que acabou de abrir.
+ *
+ * Cada veículo recebe por notificação quantos ticks ainda deve aguardar, de
+ * forma que os veículos partam separados pelo intervalo de saturação. Os que
+ * não cabem no tempo de verde continuam na fila para o próximo ciclo. Deve ser
+ * chamada com o mutex de filas do cruzamento obtido.
+ *
+ * @param fila Fila de espera da aproximação.
+ * @param verde Duração do verde, em ticks.
+ */
+static void liberarFilaEspera(FilaEspera* fila, TickType_t verde) {
+    TickType_t agora = xTaskGetTickCount();
+    TickType_t saida = agora;
+
+    fila->inicioVerde = agora;
+    fila->fimVerde = agora + verde;
+    while (fila->quantidade > 0 && (int32_t)(fila->fimVerde - saida) > 0) {
+        xTaskNotify(fila->tasks[fila->inicio], saida - agora, eSetValueWithOverwrite);
+        fila->inicio = (fila->inicio + 1) % MAX_FILA_ESPERA;
+        fila->quantidade--;
+        saida += pdMS_TO_TICKS(INTERVALO_SATURACAO_MS);
+    }
+    fila->proximaLiberacao = saida;
+}
+
+/**
+ * @brief Instante atual do agendador, em ms, usado nos registros de log.
+ */
+static inline uint64_t tempoLog(void) {
+    return (uint64_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/**
+ * @brief Atribui à task o número que a identifica no trace (ver TAREFA_NUMERO).
+ */
+static void tarefaNumerar(TaskHandle_t tarefa, uint32_t numero) {
+#if ( configUSE_TRACE_FACILITY == 1 )
+    if (tarefa != NULL) vTaskSetTaskNumber(tarefa, (UBaseType_t)numero);
+#else
+    (void)tarefa;
+    (void)numero;
+#endif
+}
+
+static CanalLog* canalTarefas; // Canal das trocas de task, escrito apenas pelo tick hook
+
+/**
+ * @brief Registra a task em execução sempre que ela muda de um tick para o outro.
+ *
+ * A troca de contexto acontece dentro do kernel, cuja configuração fica fora
+ * deste arquivo, então as trocas são amostradas pelo tick hook, com a
+ * resolução de um tick. Roda em contexto de interrupção.
+ */
+static void traceAmostrarTarefa(void) {
+#if ( configUSE_TRACE_FACILITY == 1 )
+    static TaskHandle_t anterior;
+    TaskHandle_t atual = xTaskGetCurrentTaskHandle();
+
+    if (canalTarefas == NULL || atual == anterior) return;
+    anterior = atual;
+    logEvento(canalTarefas, LOG_NIVEL_TAREFAS, (uint64_t)xTaskGetTickCountFromISR() * portTICK_PERIOD_MS, LOG_TAREFA,
+        (int)uxTaskGetTaskNumber(atual), -1, 0, 0, 0);
+#endif
+}
+
+/**
+ * @brief Troca a fase de um cruzamento e acorda os veículos das direções que abriram.
+ *
+ * @return Duração do verde que começou, em ticks.
+ */
+static TickType_t trocarFase(Cruzamento* cruzamento) {
+    // Alterna o estado dos semáforos publicando a nova fase em uma única escrita no mapa
+    xSemaphoreTake(cruzamento->mutexFilas, portMAX_DELAY);
+    uint32_t fase = faseAlternar(cruzamento->fase);
+    TickType_t verde = pdMS_TO_TICKS(redeVerdeMs(&rede, cruzamento->indice, fase));
+    cruzamento->fase = fase;
+    sinaisPublicarFase(&mapaSinais, cruzamento->indice, fase);
+
+    // Acorda os veículos das direções que abriram; a fila só continua marcada se o verde não bastou
+    for (int direcao = NS; direcao <= WE; direcao++) {
+        if (!(fase & FASE_ABERTO(direcao))) continue;
+        liberarFilaEspera(&cruzamento->espera[direcao - 1], verde);
+        if (cruzamento->espera[direcao - 1].quantidade == 0) sinaisMarcarFila(&mapaSinais, cruzamento->indice, direcao, 0);
+    }
+    xSemaphoreGive(cruzamento->mutexFilas);
+
+    // Registra o estado atual do cruzamento
+    logEvento(cruzamento->log, LOG_NIVEL_SEMAFOROS, tempoLog(), LOG_FASE, -1, cruzamento->indice, 0, 0, fase);
+    return verde;
+}
+
+/**
+ * @brief Função que simula o comportamento de um cruzamento (com TEMPORIZACAO_POR_RODA = 0).
+ *
+ * A função alterna o estado dos semáforos conforme o plano do cruzamento,
+ * abrindo e fechando cada direção de acordo com o tempo de verde da fase.
+ *
+ * @param pvParameters Ponteiro para os parâmetros da função (deve ser um `Cruzamento*`).
+ */
+void vCruzamentoTask(void* pvParameters) {
+    Cruzamento* cruzamento = (Cruzamento*)pvParameters;
+
+    // A primeira troca de fase espera a defasagem do plano
+    if (rede.plano[cruzamento->indice].defasagemMs > 0) {
+        vTaskDelay(pdMS_TO_TICKS(rede.plano[cruzamento->indice].defasagemMs));
+    }
+
+    for (;;) {
+        // Aguarda o fim do verde
+        vTaskDelay(trocarFase(cruzamento));
+    }
+}
+
+#if ( TEMPORIZACAO_POR_RODA == 1 )
+
+// Temporizadores da roda do modo em tempo real
+#define TEMPORIZADOR_VAGA 0 // Fim de uma espera da task de uma vaga (índice da vaga)
+#define TEMPORIZADOR_FASE 1 // Troca de fase de um cruzamento (índice do cruzamento)
+#define TEMPORIZADOR(tipo, indice) (((uint32_t)(tipo) << 24) | (uint32_t)(indice))
+
+static RodaTemporizacao rodaTemporizacao; // Protegida por seção crítica: as vagas registram, vTemporizacaoTask avança
+static uint32_t* expiradosRoda;           // Lote expirado, usado só por vTemporizacaoTask
+
+/**
+ * @brief Prepara a roda para as vagas e os cruzamentos. Deve ser chamada antes do agendador.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int temporizacaoIniciar(int numCruzamentos) {
+    uint32_t capacidade = (uint32_t)(MAX_VEICULOS + numCruzamentos);
+    void* area = pvPortMalloc(RODA_BYTES(capacidade));
+
+    expiradosRoda = (uint32_t*)pvPortMalloc(capacidade * sizeof(uint32_t));
+    if (area == NULL || expiradosRoda == NULL) {
+        printf("Erro ao alocar memoria para a roda de temporizacao.\n");
+        return 0;
+    }
+    rodaIniciar(&rodaTemporizacao, (uint32_t)xTaskGetTickCount(), area, capacidade);
+    return 1;
+}
+
+/**
+ * @brief Registra na roda a troca de fase do cruzamento no tick `proximaTroca`.
+ *
+ * A roda tem um temporizador para cada cruzamento e cada vaga, então só um
+ * erro de contagem a enche. Ao contrário de um veículo, que dorme com
+ * vTaskDelay, o cruzamento não tem task própria e deixaria de trocar de fase
+ * para sempre, por isso a falha interrompe a simulação.
+ */
+static void temporizacaoAgendarTroca(Cruzamento* cruzamento) {
+    taskENTER_CRITICAL();
+    int registrado = rodaInserir(&rodaTemporizacao, (uint32_t)cruzamento->proximaTroca,
+        TEMPORIZADOR(TEMPORIZADOR_FASE, cruzamento->indice));
+    taskEXIT_CRITICAL();
+
+    if (!registrado) {
+        printf("Roda de temporizacao cheia: o cruzamento %s ficaria sem troca de fase.\n", rede.nome[cruzamento->indice]);
+        configASSERT(registrado);
+    }
+}
+
+/**
+ * @brief Agenda a primeira troca de fase do cruzamento, na defasagem do plano.
+ */
+static void temporizacaoAgendarCruzamento(Cruzamento* cruzamento) {
+    cruzamento->proximaTroca = xTaskGetTickCount() + pdMS_TO_TICKS(rede.plano[cruzamento->indice].defasagemMs);
+    temporizacaoAgendarTroca(cruzamento);
+}
+
+/**
+ * @brief Task única de temporização: a cada tick expira a roda e trata o lote.
+ *
+ * Veículos cujo percurso ou vez na fila terminou são acordados por
+ * notificação, e os cruzamentos cujo verde acabou trocam de fase aqui
+ * mesmo, sem uma task por cruzamento. Registrar e expirar custam O(1),
+ * enquanto a lista de tasks atrasadas do kernel é ordenada por inserção.
+ *
+ * @param pvParameters Parâmetros passados para a função (não utilizado neste caso).
+ */
+void vTemporizacaoTask(void* pvParameters) {
+    (void)pvParameters;
+    TickType_t ultimo = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelayUntil(&ultimo, 1);
+
+        taskENTER_CRITICAL();
+        size_t quantidade = rodaAvancar(&rodaTemporizacao, (uint32_t)xTaskGetTickCount(), expiradosRoda);
+        taskEXIT_CRITICAL();
+
+        for (size_t k = 0; k < quantidade; k++) {
+            uint32_t indice = expiradosRoda[k] & 0xFFFFFFu;
+
+            if ((expiradosRoda[k] >> 24) == TEMPORIZADOR_VAGA) {
+                xTaskNotify(poolVeiculos.vagas[indice].task, 0, eNoAction);
+                continue;
+            }
+
+            // O próximo prazo parte do anterior, para que o ciclo não acumule atraso
+            Cruzamento* cruzamento = &cruzamentos[indice];
+            cruzamento->proximaTroca += trocarFase(cruzamento);
+            temporizacaoAgendarTroca(cruzamento);
+        }
+    }
+}
+
+#endif /* TEMPORIZACAO_POR_RODA == 1 */
+
+/**
+ * @brief Suspende a task do veículo por `ticks`.
+ *
+ * Com TEMPORIZACAO_POR_RODA = 1 o prazo é registrado em O(1) na roda e a
+ * task dorme até ser notificada por `vTemporizacaoTask`, em vez de entrar na
+ * lista de tasks atrasadas do kernel.
+ */
+static void veiculoAguardar(Veiculo* veiculo, TickType_t ticks) {
+    if (ticks == 0) return;
+#if ( TEMPORIZACAO_POR_RODA == 1 )
+    taskENTER_CRITICAL();
+    int registrado = rodaInserir(&rodaTemporizacao, (uint32_t)(xTaskGetTickCount() + ticks),
+        TEMPORIZADOR(TEMPORIZADOR_VAGA, veiculo->vaga));
+    taskEXIT_CRITICAL();
+
+    if (registrado) {
+        xTaskNotifyWait(0, UINT32_MAX, NULL, portMAX_DELAY);
+        return;
+    }
+#else
+    (void)veiculo;
+#endif
+    vTaskDelay(ticks);
+}
+
+/**
+ * @brief Verifica se um semáforo está aberto para a direção especificada.
+ *
+ * A leitura é feita sem bloqueio no mapa de sinais, onde `vCruzamentoTask`
+ * publica cada troca de fase com uma única escrita atômica.
+ *
+ * @param cruzamento Ponteiro para o cruzamento onde o semáforo será verificado.
+ * @param direcao Direção do semáforo a ser verificado (NS, SN, EW, WE).
+ * @return Retorna 1 se o semáforo estiver aberto, 0 caso contrário.
+ */
+int verificarSemaforoAberto(Cruzamento* cruzamento, int direcao) {
+    return sinaisVerde(&mapaSinais, cruzamento->indice, direcao);
+}
+
+/**
+ * @brief Bloqueia o veículo até que ele possa atravessar o cruzamento atual.
+ *
+ * Com ESPERA_POR_NOTIFICACAO = 1 o veículo entra na fila da sua aproximação e
+ * dorme até ser notificado por `vCruzamentoTask` quando o sinal abrir, sem
+ * consultas periódicas. Veículos que chegam com o sinal aberto também respeitam
+ * a ordem da fila e o intervalo de saturação. Com ESPERA_POR_NOTIFICACAO = 0 é
+ * mantida a consulta ao semáforo a cada segundo.
+ *
+ * @param veiculo Veículo que deseja atravessar.
+ */
+static void aguardarSinalVerde(Veiculo* veiculo) {
+    Cruzamento* cruzamento = veiculo->cruzamento;
+    FilaEspera* fila = &cruzamento->espera[veiculo->direcao - 1];
+
+#if ( ESPERA_POR_NOTIFICACAO == 1 )
+    SemaphoreHandle_t mutex = cruzamento->mutexFilas;
+
+    for (;;) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+
+        TickType_t agora = xTaskGetTickCount();
+        TickType_t saida = ((int32_t)(fila->proximaLiberacao - agora) > 0) ? fila->proximaLiberacao : agora;
+        bool aberto = verificarSemaforoAberto(cruzamento, veiculo->direcao);
+
+        // Sinal aberto, ninguém na frente e ainda há tempo de verde: reserva a vez e segue
+        if (aberto && fila->quantidade == 0 &&
+            (int32_t)(fila->fimVerde - saida) > 0) {
+            fila->proximaLiberacao = saida + pdMS_TO_TICKS(INTERVALO_SATURACAO_MS);
+            xSemaphoreGive(mutex);
+            veiculoAguardar(veiculo, saida - agora);
+            return;
+        }
+
+        if (fila->quantidade == MAX_FILA_ESPERA) {
+            // Fila cheia: volta a consultar o sinal periodicamente
+            xSemaphoreGive(mutex);
+            logEvento(veiculo->log, LOG_NIVEL_DETALHADO, tempoLog(), LOG_VEICULO_ESPERANDO, veiculo->id,
+                cruzamento->indice, veiculo->direcao, veiculo->velocidade, 0);
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            taskENTER_CRITICAL();
+            estatisticasEspera.despertares++;
+            taskEXIT_CRITICAL();
+            continue;
+        }
+
+        fila->tasks[(fila->inicio + fila->quantidade) % MAX_FILA_ESPERA] = xTaskGetCurrentTaskHandle();
+        if (fila->quantidade++ == 0) sinaisMarcarFila(&mapaSinais, cruzamento->indice, veiculo->direcao, 1);
+        xSemaphoreGive(mutex);
+
+        logEvento(veiculo->log, LOG_NIVEL_DETALHADO, tempoLog(), LOG_VEICULO_ESPERANDO, veiculo->id,
+            cruzamento->indice, veiculo->direcao, veiculo->velocidade, 0);
+
+        uint32_t atraso = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &atraso, portMAX_DELAY);
+
+        // Compara com o que a consulta a cada 1 s teria custado para a mesma espera
+        TickType_t periodo = pdMS_TO_TICKS(1000);
+        TickType_t espera = fila->inicioVerde - agora;
+        TickType_t consultas = (espera + periodo - 1) / periodo;
+
+        taskENTER_CRITICAL();
+        estatisticasEspera.esperas++;
+        estatisticasEspera.despertares += (atraso > 0) ? 2 : 1;
+        estatisticasEspera.latenciaTotal += xTaskGetTickCount() - fila->inicioVerde;
+        estatisticasEspera.despertaresPolling += consultas;
+        estatisticasEspera.latenciaPolling += consultas * periodo - espera;
+        taskEXIT_CRITICAL();
+
+        veiculoAguardar(veiculo, atraso); // Aguarda a vez na descarga da fila
+        return;
+    }
+#else
+    bool esperou = false;
+
+    while (!verificarSemaforoAberto(cruzamento, veiculo->direcao)) {
+        // O semáforo está fechado, o veículo deve esperar
+        logEvento(veiculo->log, LOG_NIVEL_DETALHADO, tempoLog(), LOG_VEICULO_ESPERANDO, veiculo->id,
+            cruzamento->indice, veiculo->direcao, veiculo->velocidade, 0);
+        vTaskDelay(pdMS_TO_TICKS(1000)); // Espera antes de tentar novamente
+        esperou = true;
+        taskENTER_CRITICAL();
+        estatisticasEspera.despertares++;
+        taskEXIT_CRITICAL();
+    }
+
+    if (esperou) {
+        taskENTER_CRITICAL();
+        estatisticasEspera.esperas++;
+        estatisticasEspera.latenciaTotal += xTaskGetTickCount() - fila->inicioVerde;
+        taskEXIT_CRITICAL();
+    }
+#endif
+}
+
+#if ( FILAS_POR_VIA == 1 )
+/**
+ * @brief Ocupa uma vaga na via `link`, à frente do veículo, sem cruzar no vermelho.
+ *
+ * A vaga é pedida com prazo de INTERVALO_SATURACAO_MS, e o sinal é
+ * consultado de novo a cada tentativa e depois de obter a vaga: se ele
+ * fechou enquanto a via estava cheia, a vaga é devolvida e o veículo volta
+ * a aguardar o verde. Assim nenhuma task fica bloqueada indefinidamente numa
+ * via cheia, nem atravessa com o sinal que abriu antes da espera.
+ *
+ * @return Retorna 1 com a vaga ocupada e o sinal aberto, 0 se o sinal fechou.
+ */
+static int ocuparVagaVia(Veiculo* veiculo, int link) {
+    for (;;) {
+        if (xSemaphoreTake(vagasVias[link], pdMS_TO_TICKS(INTERVALO_SATURACAO_MS)) == pdTRUE) {
+            if (verificarSemaforoAberto(veiculo->cruzamento, veiculo->direcao)) return 1;
+            xSemaphoreGive(vagasVias[link]);
+            return 0;
+        }
+        if (!verificarSemaforoAberto(veiculo->cruzamento, veiculo->direcao)) return 0;
+    }
+}
+#endif
+
+/**
+ * @brief Simula o trajeto de um veículo pela rede até ele sair.
+ *
+ * A função controla o movimento do veículo, verificando o estado dos semáforos
+ * e movimentando-o entre cruzamentos adjacentes conforme a direção escolhida.
+ * Com FILAS_POR_VIA = 1 o veículo só cruza quando há vaga na via à frente e
+ * devolve a vaga da via por onde chegou; enquanto espera, quem está atrás
+ * dele na aproximação também espera, e se o sinal fechar antes de abrir a
+ * vaga ele volta a aguardar o verde.
+ *
+ * @param veiculo Veículo a conduzir.
+ */
+void conduzirVeiculo(Veiculo* veiculo) {
+    logEvento(veiculo->log, LOG_NIVEL_RESUMO, tempoLog(), LOG_VEICULO_CRIADO, veiculo->id,
+        veiculo->cruzamento->indice, veiculo->direcao, veiculo->velocidade, 0);
+
+    FragmentoMetricas* metricas = metricasFragmento(0);
+    uint64_t inicioViagem = SEM_VIAGEM;
+#if ( FILAS_POR_VIA == 1 )
+    int viaAtual = -1;
+#endif
+
+    for (;;) {
+        // Aguarda o sinal verde (retorna imediatamente se a aproximação estiver livre)
+        uint64_t chegada = tempoLog();
+        int direcao = rotasProximaDirecao(&rede, veiculo->cruzamento->indice, veiculo->direcao, veiculo->destino);
+        int link = redeLinkNaDirecao(&rede, veiculo->cruzamento->indice, direcao);
+        aguardarSinalVerde(veiculo);
+
+#if ( FILAS_POR_VIA == 1 )
+        // Ocupa uma vaga na via à frente (esperando o sinal de novo se ele fechar antes) e libera a da via atual
+        while (link >= 0 && !ocuparVagaVia(veiculo, link)) aguardarSinalVerde(veiculo);
+        if (viaAtual >= 0) xSemaphoreGive(vagasVias[viaAtual]);
+        viaAtual = link;
+#endif
+
+        // O semáforo está aberto, o veículo pode atravessar
+        uint64_t saida = tempoLog();
+        if (metricas != NULL) {
+            metricasRegistrarTravessia(veiculo->cruzamento->indice, veiculo->direcao, saida - chegada,
+                inicioViagem != SEM_VIAGEM ? chegada - inicioViagem : SEM_VIAGEM);
+        }
+        inicioViagem = saida;
+        logEvento(veiculo->log, LOG_NIVEL_DETALHADO, saida, LOG_VEICULO_ATRAVESSANDO, veiculo->id,
+            veiculo->cruzamento->indice, veiculo->direcao, veiculo->velocidade, 0);
+        veiculo->tempoDeslocamento = redeTempoPercurso(&rede, link, veiculo->velocidade);
+        taskENTER_CRITICAL(); // Via e início do trecho mudam juntos para os instantâneos
+        veiculo->via = link;
+        veiculo->inicioTrecho = saida;
+        taskEXIT_CRITICAL();
+        veiculoAguardar(veiculo, pdMS_TO_TICKS(veiculo->tempoDeslocamento)); // Simula a travessia
+
+        // Move para o próximo cruzamento, verificando se é nulo; ao virar, chega nele pela nova direção
+        veiculo->cruzamento = (link >= 0) ? &cruzamentos[rede.linkDestino[link]] : NULL;
+        veiculo->direcao = direcao;
+
+        if (veiculo->cruzamento == NULL) {
+            if (metricas != NULL) metricaSomar(metricas->sairam, 1);
+            logEvento(veiculo->log, LOG_NIVEL_RESUMO, tempoLog(), LOG_VEICULO_SAIU, veiculo->id, -1,
+                veiculo->direcao, veiculo->velocidade, 0);
+            return;
+        }
+
+        logEvento(veiculo->log, LOG_NIVEL_DETALHADO, tempoLog(), LOG_VEICULO_CHEGOU, veiculo->id,
+            veiculo->cruzamento->indice, veiculo->direcao, veiculo->velocidade, 0);
+    }
+}
+
+/**
+ * @brief Task de uma vaga do pool: conduz um veículo após o outro.
+ *
+ * Quando o veículo sai da rede a vaga volta ao pool e a task dorme até o
+ * gerador entregar o próximo veículo por notificação. A task nunca é apagada,
+ * de modo que TCB, pilha e registro são reaproveitados indefinidamente.
+ *
+ * @param pvParameters Ponteiro para os parâmetros da função (deve ser um `VagaVeiculo*`).
+ */
+void vVeiculoTask(void* pvParameters) {
+    VagaVeiculo* vaga = (VagaVeiculo*)pvParameters;
+
+    for (;;) {
+        conduzirVeiculo(&vaga->veiculo);
+        poolVeiculosDevolver(vaga);
+
+        // Nenhuma fila de espera referencia o veículo que saiu, então a
+        // próxima notificação só pode vir do gerador
+        xTaskNotifyWait(0, UINT32_MAX, NULL, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief Imprime periodicamente os contadores de espera em sinal vermelho.
+ *
+ * Mostra quantas vezes as tasks de veículos parados foram acordadas e a
+ * latência média entre a abertura do sinal e a retomada do veículo. No modo
+ * por notificação também mostra a estimativa para a consulta a cada 1 s,
+ * evidenciando a redução de trocas de contexto e de latência. Em seguida
+ * mostra a ocupação do pool de veículos e o heap livre, que devem ficar
+ * estáveis em execuções longas.
+ *
+ * @param pvParameters Parâmetros passados para a função (não utilizado neste caso).
+ */
+void vRelatorioEsperaTask(void* pvParameters) {
+    (void)pvParameters;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(RELATORIO_ESPERA_S * 1000));
+
+        taskENTER_CRITICAL();
+        EstatisticasEspera e = estatisticasEspera;
+        taskEXIT_CRITICAL();
+
+        double latencia = e.esperas ? (double)e.latenciaTotal * portTICK_PERIOD_MS / e.esperas : 0.0;
+
+#if ( ESPERA_POR_NOTIFICACAO == 1 )
+        double latenciaPolling = e.esperas ? (double)e.latenciaPolling * portTICK_PERIOD_MS / e.esperas : 0.0;
+        printf("Esperas: %lu | despertares: %lu (consulta a cada 1 s: %lu, %.0f%% menos) | "
+            "latencia media: %.1f ms (consulta a cada 1 s: %.1f ms)\n",
+            (unsigned long)e.esperas, (unsigned long)e.despertares, (unsigned long)e.despertaresPolling,
+            e.despertaresPolling ? 100.0 * (1.0 - (double)e.despertares / e.despertaresPolling) : 0.0,
+            latencia, latenciaPolling);
+#else
+        printf("Esperas: %lu | despertares: %lu | latencia media: %.1f ms\n",
+            (unsigned long)e.esperas, (unsigned long)e.despertares, latencia);
+#endif
+
+        taskENTER_CRITICAL();
+        int emUso = poolVeiculos.emUso;
+        int pico = poolVeiculos.pico;
+        uint32_t obtidas = poolVeiculos.obtidas;
+        uint32_t recusas = poolVeiculos.recusas;
+        taskEXIT_CRITICAL();
+
+        printf("Pool de veiculos: %d/%d em uso (pico %d) | gerados: %lu | recusas por pool cheio: %lu | "
+            "heap livre: %lu bytes (minimo %lu)\n",
+            emUso, MAX_VEICULOS, pico, (unsigned long)obtidas, (unsigned long)recusas,
+            (unsigned long)xPortGetFreeHeapSize(), (unsigned long)xPortGetMinimumEverFreeHeapSize());
+
+        // Consultas à rede inteira sobre o mapa de sinais, sem travar nenhum cruzamento
+        printf("Sinais: %d de %d aproximacoes com verde | %d com vermelho e veiculos parados\n",
+            sinaisContar(&mapaSinais, SINAIS_VERDES), NUM_DIRECOES * rede.numCruzamentos,
+            sinaisContar(&mapaSinais, SINAIS_VERMELHOS_COM_FILA));
+
+        EstatisticasAdmissao admissao = estatisticasAdmissao;
+        printf("Admissao: %lu entradas adiadas, %lu descartadas, %lu esperando para entrar\n",
+            (unsigned long)admissao.adiados, (unsigned long)admissao.descartados, (unsigned long)admissao.pendentes);
+    }
+}
+
+static Instantaneos instantaneos;   // Visões da rede para leitores externos
+static int instantaneosAtivos;      // 1 se os instantâneos são publicados (exportador ou tela)
+static const char* destinoInstantaneos; // Arquivo do exportador (NULL: sem exportador)
+static Tela tela;                   // Tela do terminal (com SIM_TELA)
+
+/**
+ * @brief Publica periodicamente a visão da rede para os leitores de instantâneos.
+ *
+ * A cópia é feita numa seção crítica curta, em que nenhuma outra task roda,
+ * de modo que fases, ocupações e posições são do mesmo instante. Os
+ * leitores nunca tomam o mutex de um cruzamento nem param esta task.
+ *
+ * @param pvParameters Parâmetros passados para a função (não utilizado neste caso).
+ */
+void vInstantaneosTask(void* pvParameters) {
+    (void)pvParameters;
+    TickType_t ultimo = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelayUntil(&ultimo, pdMS_TO_TICKS(instantaneos.periodoMs));
+
+        InstantaneoRede* v = instantaneoMontar(&instantaneos, MAX_VEICULOS);
+        if (v == NULL) continue;
+
+        int n = 0;
+        memset(v->ocupacao, 0, (size_t)v->numVias * sizeof(uint32_t));
+        taskENTER_CRITICAL();
+        uint64_t agora = tempoLog();
+        for (int c = 0; c < rede.numCruzamentos; c++) v->fases[c] = cruzamentos[c].fase;
+        for (int i = 0; i < MAX_VEICULOS; i++) {
+            const Veiculo* veiculo = &poolVeiculos.vagas[i].veiculo;
+            if (veiculo->cruzamento == NULL) continue;                        // Vaga livre
+            if (veiculo->via < 0 && veiculo->inicioTrecho != SEM_VIAGEM) continue; // Saindo da rede
+
+            PosicaoVeiculo* p = &v->veiculos[n++];
+            p->id = veiculo->id;
+            p->via = veiculo->via;
+            p->reservado = 0;
+            if (veiculo->via < 0) {
+                p->cruzamento = veiculo->cruzamento->indice;
+                p->direcao = (uint8_t)veiculo->direcao;
+                p->progresso = INSTANTANEO_PARADO;
+                continue;
+            }
+            p->cruzamento = rede.linkDestino[veiculo->via];
+            p->direcao = rede.linkDirecao[veiculo->via];
+            p->progresso = instantaneoProgresso(agora, veiculo->inicioTrecho, (uint64_t)veiculo->tempoDeslocamento);
+            v->ocupacao[veiculo->via]++;
+        }
+        taskEXIT_CRITICAL();
+        v->instanteMs = agora;
+        v->numVeiculos = n;
+        instantaneoPublicar(&instantaneos, v);
+    }
+}
+
+/**
+ * @brief Exportador de exemplo: grava o instantâneo mais recente em JSON, na prioridade mais baixa.
+ *
+ * @param pvParameters Parâmetros passados para a função (não utilizado neste caso).
+ */
+void vExportarInstantaneosTask(void* pvParameters) {
+    (void)pvParameters;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(INSTANTANEOS_EXPORTAR_MS));
+        instantaneosExportar(&instantaneos, destinoInstantaneos);
+    }
+}
+
+/**
+ * @brief Desenha a grade no terminal em ritmo fixo, a partir dos instantâneos.
+ *
+ * @param pvParameters Parâmetros passados para a função (não utilizado neste caso).
+ */
+void vTelaTask(void* pvParameters) {
+    (void)pvParameters;
+    TickType_t ultimo = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelayUntil(&ultimo, pdMS_TO_TICKS(1000 / TELA_QUADROS_POR_S));
+        telaQuadro(&tela);
+    }
+}
+
+/**
+ * @brief Indica se novas entradas pelo cruzamento devem ser seguradas.
+ *
+ * Há pressão com o heap livre abaixo de ADMISSAO_HEAP_MIN_BYTES, com o pool
+ * de veículos ocupado além de ADMISSAO_POOL_MAX_PCT ou com ADMISSAO_FILA_MAX
+ * veículos parados nas aproximações do cruzamento. As filas são lidas sem o
+ * mutex: o valor só orienta a decisão.
+ */
+static int entradaSobPressao(const Cruzamento* cruzamento) {
+    if (xPortGetFreeHeapSize() < ADMISSAO_HEAP_MIN_BYTES) return 1;
+    if (poolVeiculos.emUso * 100 >= MAX_VEICULOS * ADMISSAO_POOL_MAX_PCT) return 1;
+
+    int parados = 0;
+    for (int d = 0; d < NUM_DIRECOES; d++) parados += cruzamento->espera[d].quantidade;
+    return parados >= ADMISSAO_FILA_MAX;
+}
+
+/**
+ * @brief Coloca na rede um veículo que entra pelo cruzamento `cruzamentoIndex`.
+ *
+ * @return Retorna 1 se o veículo foi criado, 0 se não havia vaga no pool.
+ */
+static int criarVeiculo(int cruzamentoIndex, int* veiculoCounter, FragmentoMetricas* metricas) {
+    VagaVeiculo* vaga = poolVeiculosObter();
+    if (vaga == NULL) return 0;
+
+    Veiculo* novoVeiculo = &vaga->veiculo;
+    novoVeiculo->id = (*veiculoCounter)++;
+    novoVeiculo->log = vaga->log;
+    novoVeiculo->vaga = (int)(vaga - poolVeiculos.vagas);
+    if (metricas != NULL) metricaSomar(metricas->criados, 1);
+    novoVeiculo->cruzamento = &cruzamentos[cruzamentoIndex];
+
+    // Saída da viagem (ou direção, sem rotas) e velocidade vêm do fluxo do cruzamento de entrada
+    GeradorAleatorio* fluxo = &novoVeiculo->cruzamento->gerador;
+    novoVeiculo->destino = rotasSortearDestino(&rede, cruzamentoIndex, fluxo);
+    novoVeiculo->direcao = (novoVeiculo->destino >= 0) ?
+        rotasProximaDirecao(&rede, cruzamentoIndex, 0, novoVeiculo->destino) : geradorIntervalo(fluxo, 4) + 1;
+    novoVeiculo->velocidade = (novoVeiculo->direcao > 2) ? geradorIntervalo(fluxo, 31) + 20 : geradorIntervalo(fluxo, 31) + 30;
+    novoVeiculo->tempoDeslocamento = (int)round(500 / (novoVeiculo->velocidade * 0.27778));
+    novoVeiculo->via = -1;
+    novoVeiculo->inicioTrecho = SEM_VIAGEM;
+
+    if (vaga->task == NULL) {
+        // Primeiro uso da vaga: cria a task sobre o TCB e a pilha estáticos, com o seu canal de log
+        vaga->log = novoVeiculo->log = logAbrirCanal(0);
+        vaga->task = xTaskCreateStatic(vVeiculoTask, "VeiculoTask", configMINIMAL_STACK_SIZE,
+            (void*)vaga, 1, vaga->pilha, &vaga->tcb);
+        tarefaNumerar(vaga->task, TAREFA_NUMERO(TAREFA_VAGA, vaga - poolVeiculos.vagas));
+    }
+    else {
+        // A task da vaga está dormindo desde que o veículo anterior saiu
+        xTaskNotify(vaga->task, 0, eNoAction);
+    }
+    return 1;
+}
+
+/**
+ * @brief Gera veículos indefinidamente e atribui-os a cruzamentos.
+ *
+ * Sem demanda própria nas entradas um veículo entra por um cruzamento
+ * sorteado a cada 0 a 2 s; com ela cada entrada segue o seu processo de
+ * Poisson (ver `demandaProximaChegadaUs`), com o relógio em ticks. Cada
+ * chegada passa pelo controle de admissão: sob pressão (ver
+ * `entradaSobPressao`) o veículo espera fora da rede e é tentado de novo a
+ * cada ADMISSAO_ADIAMENTO_MS, e com ADMISSAO_MAX_ADIADOS veículos já
+ * esperando na entrada ele desiste. Assim a sobrecarga nunca esgota o heap.
+ *
+ * @param pvParameters Parâmetros passados para a função (não utilizado neste caso).
+ */
+void vVeiculoCreator(void* pvParameters) {
+    int veiculoCounter = 0;
+    GeradorAleatorio gerador;
+    FragmentoMetricas* metricas = metricasFragmento(0);
+    int n = rede.numCruzamentos;
+    int porEntrada = redeDemandaPorEntrada(&rede);
+
+    // Cruzamento de entrada e intervalo entre veículos vêm do fluxo próprio do gerador
+    geradorIniciar(&gerador, sementeExecucao(), FLUXO_GERACAO(0));
+
+    // Veículos adiados e próxima chegada de cada entrada, alocados uma única vez
+    uint32_t* adiados = (uint32_t*)pvPortMalloc((size_t)n * sizeof(uint32_t));
+    uint64_t* proximaChegadaUs = (uint64_t*)pvPortMalloc((size_t)n * sizeof(uint64_t));
+    if (cruzamentos == NULL || adiados == NULL || proximaChegadaUs == NULL) {
+        printf("Erro: gerador de veiculos sem cruzamentos ou sem memoria.\n");
+        vTaskDelete(NULL);
+        return;
+    }
+    for (int c = 0; c < n; c++) {
+        adiados[c] = 0;
+        proximaChegadaUs[c] = UINT64_MAX;
+        if (porEntrada && rede.demanda[c].veiculosPorHora > 0) {
+            proximaChegadaUs[c] = demandaProximaChegadaUs(&rede.demanda[c], 0, &cruzamentos[c].gerador);
+        }
+    }
+
+    uint64_t proximaGeracaoUs = 0;  // Próxima chegada da geração única
+    TickType_t ultimaTentativa = xTaskGetTickCount();
+
+    while (1) {
+        // Próxima chegada: a da geração única ou a mais cedo entre as entradas
+        int entrada = -1;
+        uint64_t chegadaUs = proximaGeracaoUs;
+        if (porEntrada) {
+            chegadaUs = UINT64_MAX;
+            for (int c = 0; c < n; c++) {
+                if (proximaChegadaUs[c] < chegadaUs) {
+                    chegadaUs = proximaChegadaUs[c];
+                    entrada = c;
+                }
+            }
+        }
+
+        // Dorme até a chegada, acordando antes para tentar de novo os adiados
+        TickType_t agora = xTaskGetTickCount();
+        TickType_t alvo = (chegadaUs == UINT64_MAX) ? agora + pdMS_TO_TICKS(ADMISSAO_ADIAMENTO_MS) : pdMS_TO_TICKS(chegadaUs / 1000);
+        if (estatisticasAdmissao.pendentes > 0 && (int32_t)(alvo - ultimaTentativa - pdMS_TO_TICKS(ADMISSAO_ADIAMENTO_MS)) > 0) {
+            alvo = ultimaTentativa + pdMS_TO_TICKS(ADMISSAO_ADIAMENTO_MS);
+        }
+        if ((int32_t)(alvo - agora) > 0) vTaskDelay(alvo - agora);
+
+        if (estatisticasAdmissao.pendentes > 0 &&
+            (int32_t)(xTaskGetTickCount() - ultimaTentativa) >= (int32_t)pdMS_TO_TICKS(ADMISSAO_ADIAMENTO_MS)) {
+            ultimaTentativa = xTaskGetTickCount();
+            for (int c = 0; c < n; c++) {
+                while (adiados[c] > 0 && !entradaSobPressao(&cruzamentos[c]) &&
+                    criarVeiculo(c, &veiculoCounter, metricas)) {
+                    adiados[c]--;
+                    estatisticasAdmissao.pendentes--;
+                }
+            }
+        }
+        if (chegadaUs == UINT64_MAX || (int32_t)(xTaskGetTickCount() - pdMS_TO_TICKS(chegadaUs / 1000)) < 0) continue;
+
+        if (porEntrada) {
+            proximaChegadaUs[entrada] = demandaProximaChegadaUs(&rede.demanda[entrada], chegadaUs,
+                &cruzamentos[entrada].gerador);
+        }
+        else {
+            entrada = geradorIntervalo(&gerador, (uint32_t)n); // Escolhe um cruzamento aleatório
+        }
+
+        // Controle de admissão: ninguém passa à frente dos adiados da mesma entrada
+        if (adiados[entrada] == 0 && !entradaSobPressao(&cruzamentos[entrada]) &&
+            criarVeiculo(entrada, &veiculoCounter, metricas)) {
+            // Veículo criado
+        }
+        else if (adiados[entrada] == ADMISSAO_MAX_ADIADOS) {
+            estatisticasAdmissao.descartados++;
+            if (metricas != NULL) metricaSomar(metricas->descartados, 1);
+        }
+        else {
+            if (estatisticasAdmissao.pendentes == 0) ultimaTentativa = xTaskGetTickCount();
+            adiados[entrada]++;
+            estatisticasAdmissao.pendentes++;
+            estatisticasAdmissao.adiados++;
+            if (metricas != NULL) metricaSomar(metricas->adiados, 1);
+        }
+
+        // Aguarda antes de criar outro veículo
+        if (!porEntrada) proximaGeracaoUs = chegadaUs + (uint64_t)geradorIntervalo(&gerador, 3) * 1000000;
+    }
+}
+
+/**
+ * @brief Cria os cruzamentos e define as conexões entre eles.
+ *
+ * A função monta a rede (o cenário de SIM_CENARIO ou a grade de REDE_LINHAS x
+ * REDE_COLUNAS cruzamentos), aloca os cruzamentos em um único bloco contíguo
+ * e cria a task de cada um, ou agenda suas trocas de fase na roda de
+ * temporização (TEMPORIZACAO_POR_RODA = 1). Os semáforos começam
+ * alternadamente abertos.
+ */
+void CruzamentoCreator() {
+    uint64_t semente = sementeExecucao();
+
+    if (!redeCriar(&rede, semente)) return;
+
+    cruzamentos = (Cruzamento*)pvPortMalloc((size_t)rede.numCruzamentos * sizeof(Cruzamento));
+    if (cruzamentos == NULL || !sinaisCriar(&mapaSinais, rede.numCruzamentos)) {
+        printf("Erro ao alocar memoria para os cruzamentos.\n");
+        return;
+    }
+
+#if ( TEMPORIZACAO_POR_RODA == 1 )
+    if (!temporizacaoIniciar(rede.numCruzamentos)) return;
+#endif
+
+#if ( FILAS_POR_VIA == 1 )
+    vagasVias = (SemaphoreHandle_t*)pvPortMalloc((size_t)(rede.numLinks ? rede.numLinks : 1) * sizeof(SemaphoreHandle_t));
+    if (vagasVias == NULL) {
+        printf("Erro ao alocar memoria para as vagas das vias.\n");
+        return;
+    }
+    for (int l = 0; l < rede.numLinks; l++) {
+        UBaseType_t capacidade = (UBaseType_t)redeCapacidadeVia(&rede, l);
+        vagasVias[l] = xSemaphoreCreateCounting(capacidade, capacidade);
+        if (vagasVias[l] == NULL) {
+            printf("Erro ao criar as vagas da via %d.\n", l);
+            return;
+        }
+    }
+#endif
+
+    // O cabeçalho do log leva os nomes dos cruzamentos e a semente, então é criado junto com a rede
+    logIniciar(&rede, MODO_TEMPO_REAL, semente);
+
+    // Um único conjunto de contadores: as tasks dividem o mesmo processador
+    const char* destinoMetricas = metricasDestino();
+    if (destinoMetricas != NULL) metricasIniciar(&rede, 1, destinoMetricas);
+
+    // A tela lê os mesmos instantâneos que o exportador e, ligada, ocupa o console no lugar do eco do log
+    destinoInstantaneos = instantaneosDestino();
+    int comTela = telaPedida();
+    if ((destinoInstantaneos != NULL || comTela) && instantaneosIniciar(&instantaneos, &rede)) {
+        instantaneosAtivos = 1;
+        if (comTela && telaIniciar(&tela, &rede, &instantaneos)) ecoConsoleLog = 0;
+    }
+
+    for (int i = 0; i < rede.numCruzamentos; i++) {
+        Cruzamento* cruzamento = &cruzamentos[i];
+
+        cruzamento->id = rede.nome[i];
+        cruzamento->indice = i;
+        cruzamento->fase = faseInicial(i, 0); // Semáforos alternados começam verdes
+        sinaisPublicarFase(&mapaSinais, i, cruzamento->fase);
+        cruzamento->log = logAbrirCanal(0);
+        geradorIniciar(&cruzamento->gerador, semente, FLUXO_CRUZAMENTO(i));
+
+        // Inicializa o mutex das filas de espera
+        cruzamento->mutexFilas = xSemaphoreCreateMutex();
+
+        // Filas de espera começam vazias
+        for (int d = 0; d < NUM_DIRECOES; d++) {
+            cruzamento->espera[d] = (FilaEspera){ 0 };
+        }
+
+#if ( TEMPORIZACAO_POR_RODA == 1 )
+        temporizacaoAgendarCruzamento(cruzamento);
+#else
+        TaskHandle_t tarefa = NULL;
+        if (xTaskCreate(vCruzamentoTask, "CruzamentoTask", configMINIMAL_STACK_SIZE, (void*)cruzamento, 1, &tarefa) != pdPASS) {
+            printf("Falha ao criar o cruzamento %s.\n", cruzamento->id);
+        }
+        tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_CRUZAMENTO, i));
+#endif
+    }
+}
+
+#endif /* mainUSAR_FREERTOS */
+
+/*----------------- CHEGADAS GRAVADAS ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+
+/*
+ * Reprodução de demanda medida (detectores, pesquisas origem-destino) no
+ * lugar da geração sorteada. O arquivo de chegadas é texto, uma chegada por
+ * linha, em ordem de instante:
+ *
+ *     <instante_ms> <cruzamento> <direcao> <velocidade_kmh>
+ *
+ * com o instante em milissegundos desde o início da simulação, o índice do
+ * cruzamento de entrada, a direção (1-NS, 2-SN, 3-EW, 4-WE) e a velocidade
+ * desejada em km/h. Os campos podem ser separados por espaços, tabulações,
+ * vírgulas ou ponto e vírgula; linhas que não começam com um dígito
+ * (cabeçalho, comentários com '#') são puladas.
+ *
+ * O arquivo pode ter vários GB: ele é lido por janelas de CHEGADAS_JANELA_MB
+ * mapeadas em sequência, com a janela seguinte já mapeada e pedida ao
+ * sistema enquanto a atual é interpretada (o equivalente a ler com dois
+ * buffers, sem copiar). As chegadas são interpretadas em lotes de
+ * CHEGADAS_LOTE, e o motor só guarda o lote corrente e um único evento
+ * pendente, no instante da próxima chegada. A memória não depende, assim,
+ * do tamanho do arquivo nem da duração da simulação.
+ */
+#define CHEGADAS_JANELA_MB 16  // Tamanho de cada janela mapeada (duas ficam mapeadas ao mesmo tempo)
+#define CHEGADAS_MAX_LINHA 256 // Linhas maiores são consideradas erro de formato
+#define CHEGADAS_LOTE 4096     // Chegadas interpretadas de cada vez
+#define CHEGADAS_JANELA ((uint64_t)CHEGADAS_JANELA_MB * 1024 * 1024)
+
+typedef char verificarJanelaChegadas[(CHEGADAS_JANELA % ARQUIVO_ALINHAMENTO_JANELA == 0) ? 1 : -1];
+
+/**
+ * @brief Uma chegada lida do arquivo.
+ */
+typedef struct {
+    uint64_t instanteMs; /**< Instante da chegada, em ms simulados. */
+    int cruzamento;      /**< Cruzamento de entrada. */
+    int direcao;         /**< Direção em que o veículo chega (1-NS, 2-SN, 3-EW, 4-WE). */
+    int velocidade;      /**< Velocidade desejada, em km/h. */
+} ChegadaGravada;
+
+/**
+ * @brief Leitor sequencial de um arquivo de chegadas.
+ *
+ * A janela k cobre os bytes [k * CHEGADAS_JANELA, (k + 1) * CHEGADAS_JANELA)
+ * mais CHEGADAS_MAX_LINHA de sobra, para que a linha que começa no fim da
+ * janela termine dentro dela; a janela seguinte continua de onde a anterior
+ * parou.
+ */
+typedef struct LeitorChegadas {
+    ArquivoJanelas arquivo;
+    const char* caminho;
+    uint64_t tamanho;                    /**< Tamanho do arquivo, em bytes. */
+    const char* janelas[2];              /**< Janela atual e a seguinte (NULL depois do fim do arquivo). */
+    size_t bytesJanelas[2];              /**< Bytes mapeados de cada janela. */
+    uint64_t inicioJanelas[2];           /**< Posição de cada janela no arquivo. */
+    uint64_t posicao;                    /**< Posição no arquivo da próxima linha a interpretar. */
+    uint64_t linha;                      /**< Número da próxima linha (para as mensagens de erro). */
+    ChegadaGravada lote[CHEGADAS_LOTE];  /**< Chegadas interpretadas e ainda não entregues. */
+    int quantidade;                      /**< Chegadas no lote. */
+    int proxima;                         /**< Próxima chegada do lote a entregar. */
+    int numCruzamentos;                  /**< Cruzamentos da rede, para validar as linhas. */
+    uint64_t ultimoInstante;             /**< Instante da última chegada entregue. */
+    uint64_t lidas;                      /**< Chegadas válidas interpretadas. */
+    uint64_t ignoradas;                  /**< Linhas com campos inválidos. */
+    uint64_t foraDeOrdem;                /**< Chegadas com instante anterior ao da chegada anterior. */
+    uint64_t nsLeitura;                  /**< Tempo gasto mapeando e interpretando, em ns. */
+    uint32_t janelasLidas;               /**< Janelas mapeadas até agora. */
+} LeitorChegadas;
+
+/**
+ * @brief Mapeia a janela que começa em `inicio` na posição `i` (NULL se `inicio` passou do fim do arquivo).
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se o mapeamento falhar.
+ */
+static int chegadasMapear(LeitorChegadas* leitor, int i, uint64_t inicio) {
+    leitor->janelas[i] = NULL;
+    leitor->inicioJanelas[i] = inicio;
+    leitor->bytesJanelas[i] = 0;
+    if (inicio >= leitor->tamanho) return 1;
+
+    uint64_t fim = inicio + CHEGADAS_JANELA + CHEGADAS_MAX_LINHA;
+    leitor->bytesJanelas[i] = (size_t)((fim < leitor->tamanho ? fim : leitor->tamanho) - inicio);
+    leitor->janelas[i] = (const char*)arquivoMapearJanela(leitor->arquivo, inicio, leitor->bytesJanelas[i]);
+    if (leitor->janelas[i] == NULL) {
+        printf("Erro ao mapear o arquivo de chegadas %s na posicao %llu.\n", leitor->caminho, (unsigned long long)inicio);
+        return 0;
+    }
+    leitor->janelasLidas++;
+    return 1;
+}
+
+/**
+ * @brief Abre o arquivo de chegadas e mapeia as duas primeiras janelas.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 em caso de erro (já informado).
+ */
+static int chegadasAbrir(LeitorChegadas* leitor, const char* caminho, const Rede* rede) {
+    *leitor = (LeitorChegadas){ 0 };
+    leitor->caminho = caminho;
+    leitor->linha = 1;
+    leitor->numCruzamentos = rede->numCruzamentos;
+    if (!arquivoAbrirJanelas(&leitor->arquivo, caminho, &leitor->tamanho)) {
+        printf("Erro ao abrir o arquivo de chegadas %s.\n", caminho);
+        return 0;
+    }
+    return chegadasMapear(leitor, 0, 0) && chegadasMapear(leitor, 1, CHEGADAS_JANELA);
+}
+
+/**
+ * @brief Desmapeia as janelas e fecha o arquivo.
+ */
+static void chegadasFechar(LeitorChegadas* leitor) {
+    for (int i = 0; i < 2; i++) {
+        if (leitor->janelas[i] != NULL) arquivoDesmapearJanela(leitor->janelas[i], leitor->bytesJanelas[i]);
+        leitor->janelas[i] = NULL;
+    }
+    arquivoFecharJanelas(leitor->arquivo);
+}
+
+/**
+ * @brief Lê um número sem sinal depois dos separadores, sem passar de `fim`.
+ *
+ * @return Retorna o caractere seguinte ao número, ou NULL se não houver número.
+ */
+static inline const char* chegadasNumero(const char* p, const char* fim, uint64_t* valor) {
+    while (p < fim && (*p == ' ' || *p == '\t' || *p == ',' || *p == ';')) p++;
+    if (p == fim || (unsigned)(*p - '0') > 9) return NULL;
+
+    uint64_t v = 0;
+    while (p < fim && (unsigned)(*p - '0') <= 9) v = v * 10 + (uint64_t)(*p++ - '0');
+    *valor = v;
+    return p;
+}
+
+/**
+ * @brief Interpreta a linha [p, fim) e a acrescenta ao lote se for uma chegada válida.
+ */
+static inline void chegadasInterpretar(LeitorChegadas* leitor, const char* p, const char* fim) {
+    uint64_t campos[4];
+
+    while (p < fim && (*p == ' ' || *p == '\t')) p++;
+    if (p == fim || (unsigned)(*p - '0') > 9) return; // Linha vazia, cabeçalho ou comentário
+
+    for (int k = 0; k < 4; k++) {
+        p = chegadasNumero(p, fim, &campos[k]);
+        if (p == NULL) break;
+    }
+    while (p != NULL && p < fim && (*p == ' ' || *p == '\t' || *p == '\r' || *p == ',' || *p == ';')) p++;
+    if (p != fim || campos[1] >= (uint64_t)leitor->numCruzamentos || campos[2] < NS || campos[2] > WE ||
+        campos[3] == 0 || campos[3] > 250) {
+        if (leitor->ignoradas++ == 0) {
+            printf("Chegada invalida na linha %llu de %s (esperado: <instante_ms> <cruzamento> <direcao 1-4> <velocidade_kmh>).\n",
+                (unsigned long long)leitor->linha, leitor->caminho);
+        }
+        return;
+    }
+
+    leitor->lote[leitor->quantidade++] = (ChegadaGravada){ campos[0], (int)campos[1], (int)campos[2], (int)campos[3] };
+    leitor->lidas++;
+}
+
+/**
+ * @brief Interpreta o próximo lote de chegadas, trocando de janela quando a atual termina.
+ *
+ * @return Retorna a quantidade de chegadas no lote (0 no fim do arquivo ou em erro).
+ */
+static int chegadasLerLote(LeitorChegadas* leitor) {
+    uint64_t inicio = relogioNs();
+
+    leitor->quantidade = 0;
+    leitor->proxima = 0;
+    while (leitor->quantidade < CHEGADAS_LOTE && leitor->posicao < leitor->tamanho) {
+        if (leitor->posicao >= leitor->inicioJanelas[0] + CHEGADAS_JANELA) {
+            // A janela atual acabou: a seguinte (já carregada) passa a ser a atual e a próxima é pedida
+            arquivoDesmapearJanela(leitor->janelas[0], leitor->bytesJanelas[0]);
+            leitor->janelas[0] = leitor->janelas[1];
+            leitor->bytesJanelas[0] = leitor->bytesJanelas[1];
+            leitor->inicioJanelas[0] = leitor->inicioJanelas[1];
+            if (!chegadasMapear(leitor, 1, leitor->inicioJanelas[0] + CHEGADAS_JANELA)) {
+                leitor->posicao = leitor->tamanho;
+                break;
+            }
+        }
+
+        const char* janela = leitor->janelas[0];
+        const char* p = janela + (leitor->posicao - leitor->inicioJanelas[0]);
+        const char* fimJanela = janela + leitor->bytesJanelas[0];
+        const char* fimLinha = (const char*)memchr(p, '\n', (size_t)(fimJanela - p));
+        if (fimLinha == NULL) {
+            if (leitor->inicioJanelas[0] + leitor->bytesJanelas[0] < leitor->tamanho) {
+                printf("Linha %llu de %s tem mais de %d caracteres; a leitura das chegadas foi interrompida.\n",
+                    (unsigned long long)leitor->linha, leitor->caminho, CHEGADAS_MAX_LINHA);
+                leitor->posicao = leitor->tamanho;
+                break;
+            }
+            fimLinha = fimJanela; // Última linha, sem quebra no fim do arquivo
+        }
+
+        chegadasInterpretar(leitor, p, fimLinha);
+        leitor->posicao += (uint64_t)(fimLinha - p) + 1;
+        leitor->linha++;
+    }
+
+    leitor->nsLeitura += relogioNs() - inicio;
+    return leitor->quantidade;
+}
+
+/**
+ * @brief Retorna a próxima chegada sem consumi-la (NULL no fim do arquivo).
+ */
+static inline const ChegadaGravada* chegadasProxima(LeitorChegadas* leitor) {
+    if (leitor->proxima == leitor->quantidade && chegadasLerLote(leitor) == 0) return NULL;
+    return &leitor->lote[leitor->proxima];
+}
+
+/**
+ * @brief Caminho do arquivo de chegadas de SIM_CHEGADAS, ou NULL para a demanda sorteada.
+ */
+static inline const char* chegadasOrigem(void) {
+    const char* variavel = getenv("SIM_CHEGADAS");
+    return (variavel != NULL && variavel[0] != '\0') ? variavel : NULL;
+}
+
+#endif /* chegadas gravadas */
+
+/*----------------- MOTOR DE EVENTOS DISCRETOS ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) || ( MODO_SIMULACAO == MODO_PARALELO ) || \
+    ( MODO_SIMULACAO == MODO_BENCH_SIMULADOR ) || ( MODO_SIMULACAO == MODO_MESOSCOPICO ) || \
+    ( MODO_SIMULACAO == MODO_CONJUNTO )
+
+#ifndef SIM_PERIODO_GERACAO_US
+#define SIM_PERIODO_GERACAO_US 1000000 // Intervalo médio entre veículos criados na rede inteira, em microssegundos
+#endif
+#if ( MODO_SIMULACAO == MODO_CONJUNTO ) && !defined( SIM_DURACAO_S )
+#define SIM_DURACAO_S 3600        // Cada replicação do conjunto simula uma hora
+#endif
+#ifndef SIM_DURACAO_S
+#define SIM_DURACAO_S (30 * 3600) // Tempo simulado de cada execução, em segundos
+#endif
+
+// Tipos de evento tratados pelo motor
+#define EVENTO_GERACAO 0 // O gerador cria um novo veículo
+#define EVENTO_CHEGADA 1 // Um veículo chega a um cruzamento (ou sai da rede)
+#define EVENTO_FASE    2 // Um cruzamento alterna o estado dos semáforos
+#define EVENTO_VIA_LIVRE 3 // Abriu vaga na via à frente de uma aproximação retida
+#define EVENTO_ADMISSAO  4 // Nova tentativa de admitir os veículos adiados de uma entrada
+#define EVENTO_FECHAR_VIA 5 // Uma via é fechada e as rotas que passavam por ela são refeitas
+#define EVENTO_REPRODUCAO 6 // Chegadas gravadas cujo instante chegou entram na rede
+#define EVENTO_VAGA       7 // A vaga deixada por quem saiu de uma via chega à entrada dela
+
+#ifndef SIM_MAX_VEICULOS_ATIVOS
+#define SIM_MAX_VEICULOS_ATIVOS 4000000 // Veículos na rede a partir dos quais novas entradas são adiadas
+#endif
+
+/**
+ * @brief Evento agendado no motor de eventos discretos.
+ *
+ * Eventos com o mesmo instante são processados na ordem do campo `seq`: os
+ * 24 bits menores identificam o cruzamento que agendou o evento (ou o
+ * gerador, com o índice `numCruzamentos`) e os demais contam os eventos que
+ * ele já agendou. Cada cruzamento trata os seus eventos na mesma ordem em
+ * qualquer divisão em regiões, então a ordem também não depende dela nem do
+ * momento em que um veículo vindo de outra região é recebido.
+ */
+typedef struct {
+    uint64_t tempo;    /**< Instante simulado do evento, em milissegundos. */
+    uint64_t seq;      /**< Número de sequência usado para desempate. */
+    int tipo;          /**< Tipo do evento (EVENTO_GERACAO, EVENTO_CHEGADA, EVENTO_FASE...). */
+    int alvo;          /**< Índice do veículo, do cruzamento, da entrada (-1: geração única) ou da aproximação local afetada. */
+} Evento;
+
+/**
+ * @brief Fila de prioridade (heap binário mínimo) de eventos.
+ */
+typedef struct {
+    Evento* itens;     /**< Vetor que armazena o heap. */
+    size_t tamanho;    /**< Quantidade de eventos pendentes. */
+    size_t capacidade; /**< Capacidade alocada do vetor. */
+} FilaEventos;
+
+/**
+ * @brief Registro de um veículo no motor de eventos discretos.
+ *
+ * Ao contrário do modo em tempo real, o veículo não possui task nem pilha:
+ * todo o seu estado cabe neste registro.
+ */
+typedef struct {
+    int id;                /**< Identificador do veículo. */
+    int velocidade;        /**< Velocidade do veículo em km/h. */
+    int direcao;           /**< Direção em que o veículo chegou ao cruzamento atual (1-NS, 2-SN, 3-EW, 4-WE). */
+    int tempoDeslocamento; /**< Tempo para percorrer a via até o próximo cruzamento, em segundos. */
+    int cruzamento;        /**< Índice do cruzamento atual (ou de destino, durante o deslocamento); -1 fora da rede. */
+    int destino;           /**< Saída da viagem (cruzamento * NUM_DIRECOES + direção - 1), ou -1 para seguir reto. */
+    int proximo;           /**< Próximo veículo na fila de espera ou na lista de registros livres. */
+    int via;               /**< Via em cuja fila o veículo está (-1 se nenhuma). */
+    uint64_t inicioEspera; /**< Instante de chegada à faixa de retenção do cruzamento atual. */
+    uint64_t inicioViagem; /**< Instante em que o veículo entrou na via atual (SEM_VIAGEM logo após ser criado). */
+} RegistroVeiculo;
+
+/**
+ * @brief Estado de uma aproximação (cruzamento e direção) no motor de eventos discretos.
+ */
+typedef struct {
+    int filaInicio;            /**< Primeiro veículo esperando o sinal verde (-1 se vazia). */
+    int filaFim;               /**< Último veículo esperando o sinal verde (-1 se vazia). */
+    uint64_t fimVerde;         /**< Instante em que o verde atual termina. */
+    uint64_t proximaLiberacao; /**< Primeiro instante livre para cruzar (intervalo de saturação). */
+    int retida;                /**< 1 se o primeiro da fila espera vaga na via à frente. */
+} Aproximacao;
+
+/**
+ * @brief Fila FIFO limitada dos veículos em uma via, do cruzamento de origem ao de destino.
+ *
+ * A capacidade é o comprimento da via dividido pelo espaço de um veículo
+ * parado (ver `redeCapacidadeVia`), e as vagas de todas as vias ocupam um
+ * único vetor alocado na inicialização, de modo que entrar e sair de uma via
+ * custa O(1) sem passar pelo heap. Não há ultrapassagem: ninguém chega ao
+ * destino antes de quem entrou na via à sua frente. Uma via com capacidade 0
+ * não é limitada.
+ */
+typedef struct {
+    uint32_t base;          /**< Primeira vaga da via no vetor `vagasVias`. */
+    uint32_t capacidade;    /**< Veículos que cabem na via (0 sem limite). */
+    uint32_t inicio;        /**< Posição do veículo mais próximo do destino. */
+    uint32_t quantidade;    /**< Vagas ocupadas: veículos na via e vagas de quem saiu que ainda não voltaram à entrada. */
+    uint64_t ultimaChegada; /**< Chegada ao destino do último veículo que entrou na via, em ms. */
+} FilaVia;
+
+/**
+ * @brief Estado de uma entrada (cruzamento da região) para a demanda e o controle de admissão.
+ */
+typedef struct {
+    uint64_t proximaChegadaUs; /**< Próxima chegada pela demanda própria da entrada, em µs. */
+    uint32_t adiados;          /**< Veículos esperando para entrar, em ordem de chegada. */
+    uint32_t parados;          /**< Veículos parados nas aproximações do cruzamento. */
+} EntradaSimulada;
+
+struct SimulacaoParalela;
+struct EsbocoQuantis;
+struct Instantaneos;
+struct LeitorChegadas;
+
+/**
+ * @brief Estado completo de uma execução do motor de eventos discretos.
+ *
+ * Não há variáveis globais envolvidas, de modo que várias simulações podem
+ * coexistir no mesmo processo. Uma simulação cuida dos cruzamentos
+ * `primeiroCruzamento` a `primeiroCruzamento + numCruzamentos - 1`: a rede
+ * inteira no modo sequencial ou uma região no modo paralelo.
+ */
+typedef struct {
+    uint64_t agora;                                         /**< Relógio simulado, em milissegundos. */
+    uint64_t* sequencias;                                   /**< Eventos já agendados por cruzamento da região; o último conta os do gerador. */
+    int agente;                                             /**< Cruzamento (ou gerador) que trata o evento atual e agenda os seguintes. */
+    FilaEventos eventos;                                    /**< Eventos pendentes. */
+    const Rede* rede;                                       /**< Rede viária simulada. */
+    int primeiroCruzamento;                                 /**< Primeiro cruzamento da região simulada. */
+    int numCruzamentos;                                     /**< Cruzamentos da região simulada. */
+    int particao;                                           /**< Índice da região (0 no modo sequencial). */
+    int numParticoes;                                       /**< Quantidade de regiões (1 no modo sequencial). */
+    struct SimulacaoParalela* paralelo;                     /**< Estado compartilhado entre as regiões (NULL no modo sequencial). */
+    GeradorAleatorio gerador;                               /**< Fluxo de criação de veículos da região. */
+    GeradorAleatorio* geradores;                            /**< Fluxo de cada cruzamento da região, indexado por cruzamento - primeiroCruzamento. */
+    uint64_t periodoGeracaoUs;                              /**< Intervalo médio entre veículos na rede inteira, em µs (demanda). */
+    uint64_t proximaGeracaoUs;                              /**< Instante da próxima criação de veículo, em µs. */
+    CanalLog* log;                                          /**< Canal de log da região (NULL sem log). */
+    FragmentoMetricas* metricas;                            /**< Contadores da região (NULL sem métricas). */
+    struct EsbocoQuantis* esboco;                           /**< Distribuição das esperas em sinal vermelho (NULL sem esboço; modo de conjunto). */
+    struct Instantaneos* instantaneos;                      /**< Visões publicadas para leitores externos (NULL sem instantâneos). */
+    uint64_t proximoInstantaneo;                            /**< Instante da próxima publicação, em ms. */
+    struct LeitorChegadas* chegadas;                        /**< Demanda gravada reproduzida no lugar da sorteada (NULL sem arquivo). */
+    FILE* gravacaoChegadas;                                 /**< Arquivo em que os veículos criados são gravados como chegadas (NULL sem gravação). */
+    uint32_t* fase;                                         /**< Palavra de fase de cada cruzamento da região (ver FASE_ABERTO). */
+    Aproximacao* aproximacoes;                              /**< Aproximações, indexadas por (cruzamento - primeiroCruzamento) * NUM_DIRECOES + direção - 1. */
+    int primeiroLink;                                       /**< Primeira via que sai da região (as vias de cada região são contíguas). */
+    int numVias;                                            /**< Vias que saem da região. */
+    FilaVia* vias;                                          /**< Fila de cada via que sai da região, indexada por via - primeiroLink. */
+    int* vagasVias;                                         /**< Vagas das filas de todas as vias, em um único bloco. */
+    uint32_t numVagasVias;                                  /**< Total de vagas em `vagasVias`. */
+    EntradaSimulada* entradas;                              /**< Demanda e admissão de cada cruzamento da região. */
+    RegistroVeiculo* veiculos;                              /**< Registros de veículos (reaproveitados após a saída). */
+    int numRegistros;                                       /**< Registros já utilizados no vetor. */
+    int capacidadeRegistros;                                /**< Capacidade alocada do vetor de registros. */
+    int livres;                                             /**< Topo da lista de registros livres (-1 se vazia). */
+    int veiculoCounter;                                     /**< Próximo identificador de veículo. */
+    uint64_t eventosProcessados;                            /**< Total de eventos tratados. */
+    uint64_t veiculosSairam;                                /**< Veículos que deixaram a rede. */
+    uint64_t veiculosTransferidos;                          /**< Veículos entregues a outra região (modo paralelo). */
+    uint64_t aneisCheios;                                   /**< Mensagens que esperaram um anel cheio (modo paralelo). */
+    uint64_t esperas;                                       /**< Quantidade de paradas em sinal vermelho. */
+    uint64_t tempoEsperaTotal;                              /**< Soma do tempo de espera em sinal vermelho, em ms. */
+    uint64_t retencoes;                                     /**< Vezes em que uma aproximação parou por falta de vaga na via à frente. */
+    uint64_t veiculosAdiados;                               /**< Entradas adiadas pelo controle de admissão. */
+    uint64_t veiculosDescartados;                           /**< Entradas descartadas pelo controle de admissão. */
+    int ativos;                                             /**< Veículos atualmente na rede. */
+    int picoAtivos;                                         /**< Maior número de veículos simultâneos na rede. */
+} Simulacao;
+
+/**
+ * @brief Insere na fila de prioridade um evento com número de sequência já definido.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int agendarEventoSeq(Simulacao* sim, uint64_t tempo, uint64_t seq, int tipo, int alvo) {
+    FilaEventos* fila = &sim->eventos;
+
+    if (fila->tamanho == fila->capacidade) {
+        size_t novaCapacidade = fila->capacidade ? fila->capacidade * 2 : 64;
+        Evento* itens = (Evento*)realloc(fila->itens, novaCapacidade * sizeof(Evento));
+        if (itens == NULL) {
+            printf("Erro ao alocar memoria para a fila de eventos.\n");
+            return 0;
+        }
+        fila->itens = itens;
+        fila->capacidade = novaCapacidade;
+    }
+
+    Evento evento = { tempo, seq, tipo, alvo };
+    size_t i = fila->tamanho++;
+
+    // Sobe o evento até a posição correta do heap
+    while (i > 0) {
+        size_t pai = (i - 1) / 2;
+        Evento* p = &fila->itens[pai];
+        if (p->tempo < evento.tempo || (p->tempo == evento.tempo && p->seq < evento.seq)) break;
+        fila->itens[i] = *p;
+        i = pai;
+    }
+    fila->itens[i] = evento;
+    return 1;
+}
+
+/**
+ * @brief Próximo número de sequência do cruzamento `agente` (`rede->numCruzamentos`: o gerador).
+ */
+static inline uint64_t proximaSequencia(Simulacao* sim, int agente) {
+    int local = (agente == sim->rede->numCruzamentos) ? sim->numCruzamentos : agente - sim->primeiroCruzamento;
+    return (sim->sequencias[local]++ << 24) | (uint64_t)agente;
+}
+
+/**
+ * @brief Insere um evento agendado pelo cruzamento `agente`, depois dos que ele já agendou para o mesmo instante.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static inline int agendarEventoAgente(Simulacao* sim, uint64_t tempo, int agente, int tipo, int alvo) {
+    return agendarEventoSeq(sim, tempo, proximaSequencia(sim, agente), tipo, alvo);
+}
+
+/**
+ * @brief Insere um evento agendado pelo agente do evento atual (ver `Simulacao.agente`).
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int agendarEvento(Simulacao* sim, uint64_t tempo, int tipo, int alvo) {
+    return agendarEventoAgente(sim, tempo, sim->agente, tipo, alvo);
+}
+
+/**
+ * @brief Remove o evento mais antigo da fila de prioridade.
+ *
+ * @return Retorna 1 se um evento foi removido, 0 se a fila estiver vazia.
+ */
+static int proximoEvento(Simulacao* sim, Evento* evento) {
+    FilaEventos* fila = &sim->eventos;
+
+    if (fila->tamanho == 0) return 0;
+
+    *evento = fila->itens[0];
+    Evento ultimo = fila->itens[--fila->tamanho];
+    size_t i = 0;
+
+    // Desce o último evento até a posição correta do heap
+    for (;;) {
+        size_t filho = 2 * i + 1;
+        if (filho >= fila->tamanho) break;
+        Evento* f = &fila->itens[filho];
+        if (filho + 1 < fila->tamanho) {
+            Evento* d = &fila->itens[filho + 1];
+            if (d->tempo < f->tempo || (d->tempo == f->tempo && d->seq < f->seq)) {
+                filho++;
+                f = d;
+            }
+        }
+        if (ultimo.tempo < f->tempo || (ultimo.tempo == f->tempo && ultimo.seq < f->seq)) break;
+        fila->itens[i] = *f;
+        i = filho;
+    }
+    if (fila->tamanho > 0) fila->itens[i] = ultimo;
+    return 1;
+}
+
+/**
+ * @brief Obtém um registro de veículo livre, reaproveitando os que já saíram da rede.
+ *
+ * @return Índice do registro, ou -1 se não houver memória.
+ */
+static int alocarRegistroVeiculo(Simulacao* sim) {
+    if (sim->livres >= 0) {
+        int indice = sim->livres;
+        sim->livres = sim->veiculos[indice].proximo;
+        return indice;
+    }
+
+    if (sim->numRegistros == sim->capacidadeRegistros) {
+        int novaCapacidade = sim->capacidadeRegistros ? sim->capacidadeRegistros * 2 : 64;
+        RegistroVeiculo* veiculos = (RegistroVeiculo*)realloc(sim->veiculos, novaCapacidade * sizeof(RegistroVeiculo));
+        if (veiculos == NULL) return -1;
+        sim->veiculos = veiculos;
+        sim->capacidadeRegistros = novaCapacidade;
+    }
+    return sim->numRegistros++;
+}
+
+/**
+ * @brief Indica se o cruzamento `c` pertence à região desta simulação.
+ */
+static inline int cruzamentoLocal(const Simulacao* sim, int c) {
+    return c >= sim->primeiroCruzamento && c < sim->primeiroCruzamento + sim->numCruzamentos;
+}
+
+static inline Aproximacao* aproximacaoLocal(Simulacao* sim, int c, int direcao) {
+    return &sim->aproximacoes[(c - sim->primeiroCruzamento) * NUM_DIRECOES + direcao - 1];
+}
+
+static inline FilaVia* viaLocal(Simulacao* sim, int link) {
+    return &sim->vias[link - sim->primeiroLink];
+}
+
+/**
+ * @brief Via por onde o veículo deixa o cruzamento atual, seguindo a rota da viagem (-1: sai da rede).
+ */
+static inline int viaDoVeiculo(const Simulacao* sim, const RegistroVeiculo* veiculo) {
+    return redeLinkNaDirecao(sim->rede, veiculo->cruzamento,
+        rotasProximaDirecao(sim->rede, veiculo->cruzamento, veiculo->direcao, veiculo->destino));
+}
+
+/**
+ * @brief Indica se a fase atual do cruzamento libera o movimento que o veículo fará nele.
+ */
+static inline int faseLiberaVeiculo(const Simulacao* sim, const RegistroVeiculo* veiculo) {
+    return faseLibera(sim->fase[veiculo->cruzamento - sim->primeiroCruzamento], veiculo->direcao,
+        rotasProximaDirecao(sim->rede, veiculo->cruzamento, veiculo->direcao, veiculo->destino));
+}
+
+/**
+ * @brief Indica se o veículo deve esperar na faixa de retenção porque a via à frente está cheia.
+ */
+static inline int viaRetem(Simulacao* sim, const RegistroVeiculo* veiculo) {
+    int link = viaDoVeiculo(sim, veiculo);
+    if (link < 0) return 0;
+
+    FilaVia* via = viaLocal(sim, link);
+    return via->capacidade > 0 && via->quantidade == via->capacidade;
+}
+
+#if ( MODO_SIMULACAO == MODO_PARALELO )
+static void enviarVeiculo(Simulacao* sim, int indice, uint64_t chegada);
+static void enviarVaga(Simulacao* sim, int link, uint64_t instante);
+#endif
+
+/**
+ * @brief Registra a saída da via `link` do veículo que acabou de cruzar o destino dela.
+ *
+ * A vaga só chega à entrada da via `redeAtrasoVaga` depois de `saida`, pelo
+ * evento EVENTO_VAGA. Se a via começa em outra região a vaga segue pelo anel
+ * da região de origem, que é a dona da fila.
+ */
+static void viaSair(Simulacao* sim, int link, uint64_t saida) {
+    uint64_t instante = saida + redeAtrasoVaga(sim->rede, link);
+
+#if ( MODO_SIMULACAO == MODO_PARALELO )
+    if (!cruzamentoLocal(sim, sim->rede->linkOrigem[link])) {
+        enviarVaga(sim, link, instante);
+        return;
+    }
+#endif
+    agendarEvento(sim, instante, EVENTO_VAGA, link);
+}
+
+/**
+ * @brief Retira da fila da via `link` o veículo cuja vaga chegou à entrada dela.
+ *
+ * Os veículos da via chegam e cruzam na ordem em que entraram, então quem sai
+ * é sempre o primeiro da fila. As aproximações da origem retidas porque o
+ * primeiro da fila quer entrar nesta via são acordadas por um evento, e não
+ * aqui, para que uma cadeia de vias liberadas não descarregue filas de forma
+ * recursiva.
+ */
+static void tratarVaga(Simulacao* sim, int link) {
+    FilaVia* via = viaLocal(sim, link);
+
+    via->inicio = (via->inicio + 1 == via->capacidade) ? 0 : via->inicio + 1;
+    via->quantidade--;
+
+    // A fila pertence à região da origem da via, então as aproximações que a alimentam são locais
+    int origem = sim->rede->linkOrigem[link] - sim->primeiroCruzamento;
+    for (int d = 0; d < NUM_DIRECOES; d++) {
+        int alvo = origem * NUM_DIRECOES + d;
+        Aproximacao* a = &sim->aproximacoes[alvo];
+        if (!a->retida || viaDoVeiculo(sim, &sim->veiculos[a->filaInicio]) != link) continue;
+        a->retida = 0;
+        agendarEvento(sim, sim->agora, EVENTO_VIA_LIVRE, alvo);
+    }
+}
+
+/**
+ * @brief Faz o veículo atravessar o cruzamento atual em direção ao próximo.
+ *
+ * A chegada ao próximo cruzamento (ou a saída da rede) é agendada para
+ * depois do tempo de deslocamento do veículo, contado a partir de `saida`.
+ * O veículo deixa a fila da via por onde chegou e entra no fim da fila da
+ * próxima, sem chegar antes de quem entrou nela à sua frente.
+ *
+ * @param saida Instante em que o veículo cruza a faixa de retenção, em ms.
+ */
+static void atravessarCruzamento(Simulacao* sim, int indice, uint64_t saida) {
+    RegistroVeiculo* veiculo = &sim->veiculos[indice];
+    int direcao = rotasProximaDirecao(sim->rede, veiculo->cruzamento, veiculo->direcao, veiculo->destino);
+    int link = redeLinkNaDirecao(sim->rede, veiculo->cruzamento, direcao);
+
+    if (veiculo->via >= 0) {
+        // No modo paralelo a vaga pode esperar um anel cheio recebendo veículos, o que realoca o vetor de registros
+        viaSair(sim, veiculo->via, saida);
+        veiculo = &sim->veiculos[indice];
+    }
+
+    logEvento(sim->log, LOG_NIVEL_DETALHADO, saida, LOG_VEICULO_ATRAVESSANDO, veiculo->id, veiculo->cruzamento,
+        veiculo->direcao, veiculo->velocidade, 0);
+    if (sim->metricas != NULL) {
+        metricasRegistrarTravessia(veiculo->cruzamento, veiculo->direcao, saida - veiculo->inicioEspera,
+            veiculo->inicioViagem != SEM_VIAGEM ? veiculo->inicioEspera - veiculo->inicioViagem : SEM_VIAGEM);
+    }
+    veiculo->inicioViagem = saida;
+    veiculo->direcao = direcao; // Ao virar, a nova direção é a da aproximação do próximo cruzamento
+
+    // Sem via na direção o veículo deixa a rede depois de percorrer a distância padrão
+    veiculo->tempoDeslocamento = redeTempoPercurso(sim->rede, link, veiculo->velocidade);
+    veiculo->cruzamento = (link >= 0) ? sim->rede->linkDestino[link] : -1;
+
+    uint64_t chegada = saida + (uint64_t)veiculo->tempoDeslocamento * 1000;
+    veiculo->via = -1;
+    if (link >= 0 && viaLocal(sim, link)->capacidade > 0) {
+        FilaVia* via = viaLocal(sim, link);
+        uint32_t fim = via->inicio + via->quantidade;
+        sim->vagasVias[via->base + (fim >= via->capacidade ? fim - via->capacidade : fim)] = indice;
+        // Sem ultrapassagem: quem alcança o veículo da frente chega um intervalo de saturação depois dele
+        if (via->quantidade > 0 && chegada < via->ultimaChegada + INTERVALO_SATURACAO_MS) {
+            chegada = via->ultimaChegada + INTERVALO_SATURACAO_MS;
+        }
+        via->quantidade++;
+        via->ultimaChegada = chegada;
+        veiculo->via = link;
+    }
+#if ( MODO_SIMULACAO == MODO_PARALELO )
+    if (veiculo->cruzamento >= 0 && !cruzamentoLocal(sim, veiculo->cruzamento)) {
+        // O próximo cruzamento pertence a outra região: o veículo segue para a thread dela
+        enviarVeiculo(sim, indice, chegada);
+        return;
+    }
+#endif
+    agendarEvento(sim, chegada, EVENTO_CHEGADA, indice);
+}
+
+
+/**
+ * @brief Cria um veículo no cruzamento local `local`, equivalente a uma iteração de `vVeiculoCreator`.
+ *
+ * Com `direcao` 0 a viagem, a direção e a velocidade são sorteadas; caso
+ * contrário o veículo é uma chegada gravada, segue reto na direção dada e
+ * tem a velocidade dada.
+ */
+static void criarVeiculo(Simulacao* sim, int local, int direcao, int velocidade) {
+    int indice = alocarRegistroVeiculo(sim);
+
+    if (indice < 0) {
+        // Sem memória para o registro o veículo desiste de entrar, em vez de interromper a simulação
+        sim->veiculosDescartados++;
+        if (sim->metricas != NULL) metricaSomar(sim->metricas->descartados, 1);
+        return;
+    }
+
+    RegistroVeiculo* veiculo = &sim->veiculos[indice];
+    GeradorAleatorio* fluxo = &sim->geradores[local];
+
+    // Saída da viagem (ou direção, sem rotas) e velocidade vêm do fluxo do cruzamento de entrada
+    veiculo->id = sim->veiculoCounter++ * sim->numParticoes + sim->particao;
+    veiculo->cruzamento = sim->primeiroCruzamento + local;
+    veiculo->inicioViagem = SEM_VIAGEM;
+    if (direcao != 0) {
+        veiculo->destino = -1;
+        veiculo->direcao = direcao;
+        veiculo->velocidade = velocidade;
+    }
+    else {
+        veiculo->destino = rotasSortearDestino(sim->rede, veiculo->cruzamento, fluxo);
+        // Com viagem, o veículo chega ao cruzamento de entrada já na direção do primeiro trecho da rota
+        veiculo->direcao = (veiculo->destino >= 0) ?
+            rotasProximaDirecao(sim->rede, veiculo->cruzamento, 0, veiculo->destino) : geradorIntervalo(fluxo, 4) + 1;
+        veiculo->velocidade = (veiculo->direcao > 2) ? geradorIntervalo(fluxo, 31) + 20 : geradorIntervalo(fluxo, 31) + 30;
+    }
+    veiculo->tempoDeslocamento = (int)round(REDE_COMPRIMENTO_M / (veiculo->velocidade * 0.27778));
+    veiculo->proximo = -1;
+    veiculo->via = -1;
+
+    sim->ativos++;
+    if (sim->ativos > sim->picoAtivos) sim->picoAtivos = sim->ativos;
+    if (sim->metricas != NULL) metricaSomar(sim->metricas->criados, 1);
+
+    logEvento(sim->log, LOG_NIVEL_RESUMO, sim->agora, LOG_VEICULO_CRIADO, veiculo->id, veiculo->cruzamento,
+        veiculo->direcao, veiculo->velocidade, 0);
+    if (sim->gravacaoChegadas != NULL) {
+        fprintf(sim->gravacaoChegadas, "%llu %d %d %d\n", (unsigned long long)sim->agora, veiculo->cruzamento,
+            veiculo->direcao, veiculo->velocidade);
+    }
+
+    // O veículo verifica o semáforo assim que é criado
+    agendarEventoAgente(sim, sim->agora, veiculo->cruzamento, EVENTO_CHEGADA, indice);
+}
+
+/**
+ * @brief Indica se a entrada `local` deve segurar novos veículos.
+ *
+ * Há pressão com ADMISSAO_FILA_MAX veículos parados no cruzamento ou com
+ * SIM_MAX_VEICULOS_ATIVOS veículos na rede, o que limita a memória dos registros.
+ */
+static inline int entradaSobPressao(const Simulacao* sim, int local) {
+    return sim->ativos >= SIM_MAX_VEICULOS_ATIVOS || sim->entradas[local].parados >= ADMISSAO_FILA_MAX;
+}
+
+/**
+ * @brief Controle de admissão de um veículo que chega pela entrada `local`.
+ *
+ * Sem pressão e sem ninguém adiado à frente o veículo é criado. Caso
+ * contrário ele espera do lado de fora da rede e a entrada é tentada de novo
+ * a cada ADMISSAO_ADIAMENTO_MS, na ordem de chegada; com ADMISSAO_MAX_ADIADOS
+ * veículos já esperando ele desiste. Adiados e descartados são contados.
+ */
+static void admitirVeiculo(Simulacao* sim, int local) {
+    EntradaSimulada* entrada = &sim->entradas[local];
+
+    if (entrada->adiados == 0 && !entradaSobPressao(sim, local)) {
+        criarVeiculo(sim, local, 0, 0);
+        return;
+    }
+
+    if (entrada->adiados == ADMISSAO_MAX_ADIADOS) {
+        sim->veiculosDescartados++;
+        if (sim->metricas != NULL) metricaSomar(sim->metricas->descartados, 1);
+        return;
+    }
+
+    if (entrada->adiados++ == 0) {
+        agendarEventoAgente(sim, sim->agora + ADMISSAO_ADIAMENTO_MS, sim->primeiroCruzamento + local, EVENTO_ADMISSAO, local);
+    }
+    sim->veiculosAdiados++;
+    if (sim->metricas != NULL) metricaSomar(sim->metricas->adiados, 1);
+}
+
+/**
+ * @brief Admite os veículos adiados da entrada `local` enquanto a pressão permitir.
+ */
+static void tratarAdmissao(Simulacao* sim, int local) {
+    EntradaSimulada* entrada = &sim->entradas[local];
+
+    while (entrada->adiados > 0 && !entradaSobPressao(sim, local)) {
+        entrada->adiados--;
+        criarVeiculo(sim, local, 0, 0);
+    }
+    if (entrada->adiados > 0) agendarEvento(sim, sim->agora + ADMISSAO_ADIAMENTO_MS, EVENTO_ADMISSAO, local);
+}
+
+/**
+ * @brief Trata a chegada de um veículo à entrada `alvo` (-1: geração única da rede).
+ *
+ * Com demanda própria cada entrada tem o seu processo de chegadas, sorteado
+ * no fluxo do cruzamento, de modo que o resultado não depende da divisão em
+ * regiões. Na geração única todas as regiões sorteiam a mesma sequência de
+ * entradas da rede inteira e cada uma cria só os veículos das suas, o que
+ * também deixa o resultado independente da divisão.
+ */
+static void tratarGeracao(Simulacao* sim, int alvo) {
+    if (sim->chegadas != NULL) return; // A demanda vem do arquivo de chegadas: a geração sorteada para
+
+    if (alvo >= 0) {
+        EntradaSimulada* entrada = &sim->entradas[alvo];
+
+        admitirVeiculo(sim, alvo);
+        entrada->proximaChegadaUs = demandaProximaChegadaUs(&sim->rede->demanda[sim->primeiroCruzamento + alvo],
+            entrada->proximaChegadaUs, &sim->geradores[alvo]);
+        agendarEvento(sim, entrada->proximaChegadaUs / 1000, EVENTO_GERACAO, alvo);
+        return;
+    }
+
+    int c = (int)geradorIntervalo(&sim->gerador, (uint32_t)sim->rede->numCruzamentos);
+    if (cruzamentoLocal(sim, c)) admitirVeiculo(sim, c - sim->primeiroCruzamento);
+
+    // O instante é acumulado em µs para que demandas altas não percam precisão no arredondamento para ms
+    sim->proximaGeracaoUs += (uint64_t)geradorIntervalo(&sim->gerador, 3) * sim->periodoGeracaoUs;
+    agendarEvento(sim, sim->proximaGeracaoUs / 1000, EVENTO_GERACAO, -1);
+}
+
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+/**
+ * @brief Cria os veículos das chegadas gravadas até o instante atual e agenda a próxima.
+ *
+ * As chegadas gravadas já aconteceram, então não passam pelo controle de
+ * admissão: o veículo entra no instante registrado, e só é descartado se a
+ * rede já tiver SIM_MAX_VEICULOS_ATIVOS veículos. Uma chegada com instante
+ * anterior ao da anterior entra no instante atual e é contada.
+ */
+static void tratarReproducao(Simulacao* sim) {
+    LeitorChegadas* leitor = sim->chegadas;
+    const ChegadaGravada* chegada;
+
+    if (leitor == NULL) return;
+    while ((chegada = chegadasProxima(leitor)) != NULL && chegada->instanteMs <= sim->agora) {
+        if (chegada->instanteMs < leitor->ultimoInstante) leitor->foraDeOrdem++;
+        else leitor->ultimoInstante = chegada->instanteMs;
+
+        if (sim->ativos >= SIM_MAX_VEICULOS_ATIVOS) {
+            sim->veiculosDescartados++;
+            if (sim->metricas != NULL) metricaSomar(sim->metricas->descartados, 1);
+        }
+        else {
+            criarVeiculo(sim, chegada->cruzamento - sim->primeiroCruzamento, chegada->direcao, chegada->velocidade);
+        }
+        leitor->proxima++;
+    }
+    if (chegada != NULL) agendarEvento(sim, chegada->instanteMs, EVENTO_REPRODUCAO, -1);
+}
+#endif
+
+/**
+ * @brief Trata a chegada de um veículo a um cruzamento.
+ *
+ * Com o sinal aberto, a fila vazia e vaga na via à frente o veículo atravessa
+ * assim que o intervalo de saturação permitir; caso contrário ele entra no
+ * fim da fila da aproximação e só é liberado pela troca de fase ou, se a via
+ * à frente estava cheia, quando abrir vaga nela.
+ */
+static void tratarChegada(Simulacao* sim, int indice) {
+    RegistroVeiculo* veiculo = &sim->veiculos[indice];
+    int c = veiculo->cruzamento;
+
+    if (c < 0) {
+        logEvento(sim->log, LOG_NIVEL_RESUMO, sim->agora, LOG_VEICULO_SAIU, veiculo->id, -1, veiculo->direcao,
+            veiculo->velocidade, 0);
+        if (sim->metricas != NULL) metricaSomar(sim->metricas->sairam, 1);
+        sim->veiculosSairam++;
+        sim->ativos--;
+        veiculo->proximo = sim->livres;
+        sim->livres = indice;
+        return;
+    }
+
+    veiculo->inicioEspera = sim->agora;
+
+    Aproximacao* a = aproximacaoLocal(sim, c, veiculo->direcao);
+    uint64_t saida = (a->proximaLiberacao > sim->agora) ? a->proximaLiberacao : sim->agora;
+    int aberto = a->filaInicio < 0 && saida < a->fimVerde && faseLiberaVeiculo(sim, veiculo);
+    if (aberto && !viaRetem(sim, veiculo)) {
+        a->proximaLiberacao = saida + INTERVALO_SATURACAO_MS;
+        atravessarCruzamento(sim, indice, saida);
+        return;
+    }
+    if (aberto) {
+        a->retida = 1;
+        sim->retencoes++;
+    }
+
+    logEvento(sim->log, LOG_NIVEL_DETALHADO, sim->agora, LOG_VEICULO_ESPERANDO, veiculo->id, c, veiculo->direcao,
+        veiculo->velocidade, 0);
+
+    veiculo->proximo = -1;
+    sim->entradas[c - sim->primeiroCruzamento].parados++;
+    if (a->filaFim >= 0) {
+        sim->veiculos[a->filaFim].proximo = indice;
+    }
+    else {
+        a->filaInicio = indice;
+    }
+    a->filaFim = indice;
+    sim->esperas++;
+}
+
+#if ( MODO_SIMULACAO == MODO_CONJUNTO )
+static void esbocoRegistrar(struct EsbocoQuantis* esboco, uint64_t valor);
+#endif
+
+/**
+ * @brief Libera, a partir de `saida`, os veículos parados em uma aproximação aberta.
+ *
+ * Os veículos saem na ordem de chegada, separados pelo intervalo de
+ * saturação. Os que não cabem no tempo de verde continuam na fila para o
+ * próximo ciclo; se a via à frente enche, a aproximação fica retida até
+ * abrir vaga nela (EVENTO_VIA_LIVRE).
+ */
+static void descarregarAproximacao(Simulacao* sim, Aproximacao* a, uint64_t saida) {
+    int indice = a->filaInicio;
+
+    while (indice >= 0 && saida < a->fimVerde) {
+        // A aproximação tem uma faixa: quem vai fazer um movimento fechado segura a fila até o seu estágio
+        if (!faseLiberaVeiculo(sim, &sim->veiculos[indice])) break;
+        if (viaRetem(sim, &sim->veiculos[indice])) {
+            a->retida = 1;
+            sim->retencoes++;
+            break;
+        }
+        int proximo = sim->veiculos[indice].proximo;
+        sim->entradas[sim->veiculos[indice].cruzamento - sim->primeiroCruzamento].parados--;
+        sim->tempoEsperaTotal += saida - sim->veiculos[indice].inicioEspera;
+#if ( MODO_SIMULACAO == MODO_CONJUNTO )
+        if (sim->esboco != NULL) esbocoRegistrar(sim->esboco, saida - sim->veiculos[indice].inicioEspera);
+#endif
+        atravessarCruzamento(sim, indice, saida);
+        saida += INTERVALO_SATURACAO_MS;
+        indice = proximo;
+    }
+    a->filaInicio = indice;
+    if (indice < 0) a->filaFim = -1;
+    a->proximaLiberacao = saida;
+}
+
+/**
+ * @brief Trata a troca de fase de um cruzamento, equivalente a uma iteração de `vCruzamentoTask`.
+ *
+ * As aproximações que abriram descarregam as suas filas durante o verde.
+ */
+static void tratarFase(Simulacao* sim, int c) {
+    uint32_t* fase = &sim->fase[c - sim->primeiroCruzamento];
+    *fase = faseAlternar(*fase);
+    uint64_t verde = redeVerdeMs(sim->rede, c, *fase);
+
+    for (int d = 0; d < NUM_DIRECOES; d++) {
+        if (!(*fase & FASE_ABERTO(d + 1))) continue;
+
+        Aproximacao* a = aproximacaoLocal(sim, c, d + 1);
+        a->fimVerde = sim->agora + verde;
+        descarregarAproximacao(sim, a, sim->agora);
+    }
+
+    logEvento(sim->log, LOG_NIVEL_SEMAFOROS, sim->agora, LOG_FASE, -1, c, 0, 0, *fase);
+
+    agendarEvento(sim, sim->agora + verde, EVENTO_FASE, c);
+}
+
+/**
+ * @brief Trata a vaga aberta na via à frente da aproximação local `alvo`, que estava retida.
+ *
+ * Com o sinal ainda aberto a fila volta a ser descarregada; com ele fechado,
+ * a próxima troca de fase cuida disso.
+ */
+static void tratarViaLivre(Simulacao* sim, int alvo) {
+    Aproximacao* a = &sim->aproximacoes[alvo];
+
+    if (!(sim->fase[alvo / NUM_DIRECOES] & FASE_ABERTO(alvo % NUM_DIRECOES + 1))) return;
+    descarregarAproximacao(sim, a, (a->proximaLiberacao > sim->agora) ? a->proximaLiberacao : sim->agora);
+}
+
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) && ( VIAGENS_OD == 1 )
+/**
+ * @brief Fecha a via `link` às rotas; os veículos que já estão nela seguem até o fim.
+ *
+ * O primeiro veículo de uma aproximação retida pode ter ganhado uma rota por
+ * outra via, que talvez nunca libere vaga, então todas as retidas tentam de
+ * novo no instante atual.
+ */
+static void tratarFecharVia(Simulacao* sim, int link) {
+    if (rotasFecharVia(sim->rede->rotas, sim->rede, link) == 0) return;
+
+    for (int alvo = 0; alvo < sim->numCruzamentos * NUM_DIRECOES; alvo++) {
+        if (!sim->aproximacoes[alvo].retida) continue;
+        sim->aproximacoes[alvo].retida = 0;
+        agendarEvento(sim, sim->agora, EVENTO_VIA_LIVRE, alvo);
+    }
+}
+#endif
+
+/**
+ * @brief Inicializa a simulação dos cruzamentos `primeiro` a `primeiro + quantidade - 1` de `rede`.
+ *
+ * Os semáforos começam alternadamente abertos, como em `CruzamentoCreator`, e
+ * trocam de fase conforme o plano de cada cruzamento. As filas das vias que
+ * saem da região, inclusive as que terminam em outra, pertencem a ela e
+ * recebem todas as suas vagas aqui.
+ * Se alguma entrada da rede tiver demanda própria, cada entrada da região
+ * agenda a sua primeira chegada; caso contrário a região usa a geração única.
+ * A rede deve permanecer válida enquanto a simulação for usada. Os fluxos
+ * aleatórios dependem apenas da semente, da região e dos cruzamentos.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int simulacaoIniciarRegiao(Simulacao* sim, const Rede* rede, int primeiro, int quantidade,
+    int particao, int numParticoes, uint64_t semente) {
+    int n = quantidade;
+
+    *sim = (Simulacao){ 0 };
+    if (rede->numCruzamentos > REDE_MAX_CRUZAMENTOS) {
+        printf("A rede tem cruzamentos demais para os numeros de sequencia dos eventos.\n");
+        return 0;
+    }
+    sim->rede = rede;
+    sim->primeiroCruzamento = primeiro;
+    sim->numCruzamentos = quantidade;
+    sim->particao = particao;
+    sim->numParticoes = numParticoes;
+    sim->livres = -1;
+    sim->periodoGeracaoUs = SIM_PERIODO_GERACAO_US;
+    sim->fase = (uint32_t*)malloc((size_t)n * sizeof(uint32_t));
+    sim->aproximacoes = (Aproximacao*)malloc((size_t)n * NUM_DIRECOES * sizeof(Aproximacao));
+    sim->geradores = (GeradorAleatorio*)malloc((size_t)n * sizeof(GeradorAleatorio));
+    sim->sequencias = (uint64_t*)calloc((size_t)n + 1, sizeof(uint64_t));
+    sim->agente = rede->numCruzamentos;
+    sim->primeiroLink = rede->adjInicio[primeiro];
+    sim->numVias = rede->adjInicio[primeiro + n] - sim->primeiroLink;
+    sim->vias = (FilaVia*)malloc((size_t)(sim->numVias ? sim->numVias : 1) * sizeof(FilaVia));
+    if (sim->fase == NULL || sim->aproximacoes == NULL || sim->geradores == NULL || sim->sequencias == NULL ||
+        sim->vias == NULL) {
+        printf("Erro ao alocar memoria para os cruzamentos da simulacao.\n");
+        return 0;
+    }
+
+    for (int k = 0; k < sim->numVias; k++) {
+        uint32_t capacidade = 0;
+#if ( FILAS_POR_VIA == 1 )
+        capacidade = redeCapacidadeVia(rede, sim->primeiroLink + k);
+#endif
+        sim->vias[k] = (FilaVia){ sim->numVagasVias, capacidade, 0, 0, 0 };
+        sim->numVagasVias += capacidade;
+    }
+    sim->vagasVias = (int*)malloc((size_t)(sim->numVagasVias ? sim->numVagasVias : 1) * sizeof(int));
+    sim->entradas = (EntradaSimulada*)calloc((size_t)n, sizeof(EntradaSimulada));
+    if (sim->vagasVias == NULL || sim->entradas == NULL) {
+        printf("Erro ao alocar memoria para as vias e entradas da simulacao.\n");
+        return 0;
+    }
+
+    geradorIniciar(&sim->gerador, semente, FLUXO_GERACAO(0));
+    for (int c = 0; c < n; c++) {
+        geradorIniciar(&sim->geradores[c], semente, FLUXO_CRUZAMENTO(primeiro + c));
+        sim->fase[c] = faseInicial(primeiro + c, FASES_PROTEGIDAS == 1 && rede->rotas != NULL);
+        for (int d = 0; d < NUM_DIRECOES; d++) {
+            sim->aproximacoes[c * NUM_DIRECOES + d] = (Aproximacao){ -1, -1, 0, 0, 0 };
+        }
+        // Assim como vCruzamentoTask, a primeira alternância ocorre na defasagem do plano
+        agendarEventoAgente(sim, rede->plano[primeiro + c].defasagemMs, primeiro + c, EVENTO_FASE, primeiro + c);
+    }
+
+    if (!redeDemandaPorEntrada(rede)) {
+        agendarEvento(sim, 0, EVENTO_GERACAO, -1);
+        return 1;
+    }
+    for (int c = 0; c < n; c++) {
+        const DemandaEntrada* demanda = &rede->demanda[primeiro + c];
+        if (demanda->veiculosPorHora == 0) continue;
+        sim->entradas[c].proximaChegadaUs = demandaProximaChegadaUs(demanda, 0, &sim->geradores[c]);
+        agendarEventoAgente(sim, sim->entradas[c].proximaChegadaUs / 1000, primeiro + c, EVENTO_GERACAO, c);
+    }
+    return 1;
+}
+
+/**
+ * @brief Inicializa uma simulação sobre a rede inteira e agenda os primeiros eventos.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static inline int simulacaoIniciar(Simulacao* sim, const Rede* rede, uint64_t semente) {
+    return simulacaoIniciarRegiao(sim, rede, 0, rede->numCruzamentos, 0, 1, semente);
+}
+
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+/**
+ * @brief Publica a visão da rede no instante `proximoInstantaneo`, entre dois eventos.
+ *
+ * Nada muda entre o último evento tratado e o próximo, então a visão é a do
+ * estado atual, com o progresso dos veículos em movimento calculado para o
+ * instante da publicação. Sem buffer livre a publicação é pulada. A próxima
+ * fica para o primeiro múltiplo do período depois do próximo evento, para
+ * que intervalos sem eventos não gerem visões repetidas.
+ */
+static void simulacaoPublicarInstantaneo(Simulacao* sim) {
+    Instantaneos* inst = sim->instantaneos;
+    uint64_t instante = sim->proximoInstantaneo;
+    uint64_t proximo = sim->eventos.itens[0].tempo;
+
+    sim->proximoInstantaneo = proximo - proximo % inst->periodoMs + inst->periodoMs;
+
+    InstantaneoRede* v = instantaneoMontar(inst, sim->ativos);
+    if (v == NULL) return;
+
+    v->instanteMs = instante;
+    memcpy(v->fases, sim->fase, (size_t)sim->numCruzamentos * sizeof(uint32_t));
+    memset(v->ocupacao, 0, (size_t)v->numVias * sizeof(uint32_t));
+    int n = 0;
+    for (int i = 0; i < sim->numRegistros && n < v->capacidadeVeiculos; i++) {
+        const RegistroVeiculo* veiculo = &sim->veiculos[i];
+        if (veiculo->cruzamento < 0) continue; // Registro livre ou veículo deixando a rede
+
+        PosicaoVeiculo* p = &v->veiculos[n++];
+        p->id = veiculo->id;
+        p->cruzamento = veiculo->cruzamento;
+        p->direcao = (uint8_t)veiculo->direcao;
+        p->reservado = 0;
+        if (veiculo->inicioViagem == SEM_VIAGEM) {
+            // Recém-criado: parado na entrada, ainda fora de qualquer via
+            p->via = -1;
+            p->progresso = INSTANTANEO_PARADO;
+            continue;
+        }
+        p->via = inst->viaChegada[veiculo->cruzamento * NUM_DIRECOES + veiculo->direcao - 1];
+        p->progresso = (veiculo->inicioEspera > veiculo->inicioViagem) ? INSTANTANEO_PARADO :
+            instantaneoProgresso(instante, veiculo->inicioViagem, (uint64_t)veiculo->tempoDeslocamento * 1000);
+        if (p->via >= 0) v->ocupacao[p->via]++;
+    }
+    v->numVeiculos = n;
+    instantaneoPublicar(inst, v);
+}
+#endif
+
+/**
+ * @brief Cruzamento que trata o evento (`rede->numCruzamentos`: o gerador) e numera os que ele agendar.
+ */
+static int agenteDoEvento(const Simulacao* sim, const Evento* evento) {
+    const Rede* rede = sim->rede;
+
+    switch (evento->tipo) {
+    case EVENTO_GERACAO:
+        return evento->alvo >= 0 ? sim->primeiroCruzamento + evento->alvo : rede->numCruzamentos;
+    case EVENTO_CHEGADA: {
+        int c = sim->veiculos[evento->alvo].cruzamento;
+        return c >= 0 ? c : rede->numCruzamentos;
+    }
+    case EVENTO_FASE:      return evento->alvo;
+    case EVENTO_VIA_LIVRE: return sim->primeiroCruzamento + evento->alvo / NUM_DIRECOES;
+    case EVENTO_ADMISSAO:  return sim->primeiroCruzamento + evento->alvo;
+    case EVENTO_VAGA:      return rede->linkOrigem[evento->alvo];
+    default:               return rede->numCruzamentos;
+    }
+}
+
+/**
+ * @brief Processa eventos até que o relógio simulado ultrapasse `duracaoMs`.
+ */
+static void simulacaoExecutar(Simulacao* sim, uint64_t duracaoMs) {
+    Evento evento = { 0 };
+
+    // O próximo evento só é retirado se estiver dentro do prazo, para que a simulação possa ser continuada
+    while (sim->eventos.tamanho > 0 && sim->eventos.itens[0].tempo <= duracaoMs) {
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+        if (sim->instantaneos != NULL && sim->eventos.itens[0].tempo >= sim->proximoInstantaneo) simulacaoPublicarInstantaneo(sim);
+#endif
+        proximoEvento(sim, &evento);
+        sim->agora = evento.tempo;
+        sim->agente = agenteDoEvento(sim, &evento);
+        sim->eventosProcessados++;
+
+        switch (evento.tipo) {
+        case EVENTO_GERACAO: tratarGeracao(sim, evento.alvo); break;
+        case EVENTO_CHEGADA: tratarChegada(sim, evento.alvo); break;
+        case EVENTO_FASE:    tratarFase(sim, evento.alvo); break;
+        case EVENTO_VIA_LIVRE: tratarViaLivre(sim, evento.alvo); break;
+        case EVENTO_ADMISSAO: tratarAdmissao(sim, evento.alvo); break;
+        case EVENTO_VAGA:     tratarVaga(sim, evento.alvo); break;
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS ) && ( VIAGENS_OD == 1 )
+        case EVENTO_FECHAR_VIA: tratarFecharVia(sim, evento.alvo); break;
+#endif
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+        case EVENTO_REPRODUCAO: tratarReproducao(sim); break;
+#endif
+        }
+    }
+}
+
+/**
+ * @brief Libera a memória alocada por uma simulação.
+ */
+static void simulacaoLiberar(Simulacao* sim) {
+    free(sim->eventos.itens);
+    free(sim->veiculos);
+    free(sim->fase);
+    free(sim->aproximacoes);
+    free(sim->geradores);
+    free(sim->sequencias);
+    free(sim->vias);
+    free(sim->vagasVias);
+    free(sim->entradas);
+    *sim = (Simulacao){ 0 };
+}
+
+#if ( MODO_SIMULACAO == MODO_BENCH_SIMULADOR ) || ( MODO_SIMULACAO == MODO_MESOSCOPICO )
+/**
+ * @brief Bytes alocados pela simulação; os vetores só crescem, então é também o pico.
+ */
+static size_t simulacaoBytes(const Simulacao* sim) {
+    size_t porCruzamento = sizeof(uint32_t) + NUM_DIRECOES * sizeof(Aproximacao) + sizeof(GeradorAleatorio) +
+        sizeof(EntradaSimulada) + sizeof(uint64_t);
+    return sim->eventos.capacidade * sizeof(Evento) + (size_t)sim->capacidadeRegistros * sizeof(RegistroVeiculo) +
+        (size_t)sim->numCruzamentos * porCruzamento + (size_t)sim->numVias * sizeof(FilaVia) +
+        (size_t)sim->numVagasVias * sizeof(int);
+}
+#endif
+
+/*----------------- CHECKPOINT DA SIMULAÇÃO ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+
+#define CHECKPOINT_VERSAO 8
+#define CHECKPOINT_ALINHAMENTO 64 // Cada seção começa numa linha de cache do arquivo
+
+// Seções da imagem, na ordem em que aparecem no arquivo
+#define CHECKPOINT_ADJ_INICIO       0
+#define CHECKPOINT_LINK_ORIGEM      1
+#define CHECKPOINT_LINK_DESTINO     2
+#define CHECKPOINT_LINK_DIRECAO     3
+#define CHECKPOINT_LINK_VELOCIDADE  4
+#define CHECKPOINT_LINK_COMPRIMENTO 5
+#define CHECKPOINT_NOMES            6
+#define CHECKPOINT_PLANOS           7
+#define CHECKPOINT_FASES            8
+#define CHECKPOINT_APROXIMACOES     9
+#define CHECKPOINT_GERADORES        10
+#define CHECKPOINT_VEICULOS         11
+#define CHECKPOINT_EVENTOS          12
+#define CHECKPOINT_VIAS             13
+#define CHECKPOINT_VAGAS_VIAS       14
+#define CHECKPOINT_DEMANDA          15
+#define CHECKPOINT_ENTRADAS         16
+#define CHECKPOINT_VIAS_FECHADAS    17 // Vazia sem VIAGENS_OD, como a seguinte
+#define CHECKPOINT_ROTAS            18
+#define CHECKPOINT_SEQUENCIAS       19
+#define CHECKPOINT_SECOES           20
+
+/**
+ * @brief Cabeçalho da imagem de checkpoint da simulação por eventos discretos.
+ *
+ * A imagem guarda a rede, com os planos semafóricos e a demanda, e todo o
+ * estado de `Simulacao`: relógio, contadores, semáforos, filas das
+ * aproximações e das vias, entradas adiadas, registros de veículos, heap de eventos e os fluxos aleatórios, além
+ * das vias fechadas, da tabela de rotas e dos contadores de sequência. Os vetores são gravados como estão na memória, em
+ * seções alinhadas, e o tamanho de cada estrutura é conferido na leitura para
+ * recusar imagens de outra versão ou plataforma.
+ */
+typedef struct {
+    char magica[8];                          /**< "SIMCKPT". */
+    uint32_t versao;                         /**< CHECKPOINT_VERSAO. */
+    uint32_t tamanhoCabecalho;               /**< sizeof(CabecalhoCheckpoint). */
+    uint32_t tamanhoVeiculo;                 /**< sizeof(RegistroVeiculo). */
+    uint32_t tamanhoEvento;                  /**< sizeof(Evento). */
+    uint32_t tamanhoAproximacao;             /**< sizeof(Aproximacao). */
+    uint32_t tamanhoVia;                     /**< sizeof(FilaVia). */
+    uint32_t numVagasVias;                   /**< Vagas das filas das vias. */
+    int32_t linhas;                          /**< Linhas da grade (0 se não for uma grade). */
+    int32_t colunas;                         /**< Colunas da grade. */
+    int32_t numCruzamentos;                  /**< Cruzamentos da rede. */
+    int32_t numLinks;                        /**< Vias da rede. */
+    int32_t numRegistros;                    /**< Registros de veículos em uso no vetor. */
+    int32_t livres;                          /**< Topo da lista de registros livres. */
+    int32_t veiculoCounter;                  /**< Próximo identificador de veículo. */
+    int32_t ativos;                          /**< Veículos na rede. */
+    int32_t picoAtivos;                      /**< Pico de veículos na rede. */
+    int32_t numColunasRotas;                 /**< Colunas da tabela de rotas (0 sem VIAGENS_OD). */
+    uint64_t semente;                        /**< Semente da execução que gerou a imagem. */
+    uint64_t agora;                          /**< Relógio simulado, em ms. */
+    uint64_t periodoGeracaoUs;               /**< Intervalo médio entre veículos, em µs. */
+    uint64_t proximaGeracaoUs;               /**< Instante da próxima criação de veículo, em µs. */
+    uint64_t eventosProcessados;             /**< Eventos já tratados. */
+    uint64_t veiculosSairam;                 /**< Veículos que deixaram a rede. */
+    uint64_t esperas;                        /**< Paradas em sinal vermelho. */
+    uint64_t tempoEsperaTotal;               /**< Soma das esperas, em ms. */
+    uint64_t retencoes;                      /**< Retenções por via cheia. */
+    uint64_t veiculosAdiados;                /**< Entradas adiadas. */
+    uint64_t veiculosDescartados;            /**< Entradas descartadas. */
+    uint64_t numEventos;                     /**< Eventos pendentes no heap. */
+    GeradorAleatorio gerador;                /**< Fluxo de criação de veículos. */
+    uint64_t secaoInicio[CHECKPOINT_SECOES]; /**< Deslocamento de cada seção no arquivo. */
+    uint64_t secaoBytes[CHECKPOINT_SECOES];  /**< Tamanho de cada seção, em bytes. */
+    uint64_t resumo;                         /**< Resumo das seções (ver checkpointResumo). */
+} CabecalhoCheckpoint;
+
+/**
+ * @brief Resumo de 64 bits de um bloco, processado em palavras de 8 bytes (variação do FNV-1a).
+ *
+ * Detecta imagens truncadas ou corrompidas sem custar mais que uma leitura sequencial.
+ */
+static uint64_t checkpointResumo(uint64_t resumo, const void* dados, size_t bytes) {
+    const uint8_t* p = (const uint8_t*)dados;
+
+    for (; bytes >= 8; bytes -= 8, p += 8) {
+        uint64_t palavra;
+        memcpy(&palavra, p, 8);
+        resumo = (resumo ^ palavra) * 0x100000001B3ull;
+    }
+    for (; bytes > 0; bytes--, p++) {
+        resumo = (resumo ^ *p) * 0x100000001B3ull;
+    }
+    return resumo;
+}
+
+/**
+ * @brief Preenche os tamanhos esperados de cada seção a partir das dimensões da rede e da simulação.
+ */
+static void checkpointTamanhos(uint64_t* bytes, uint64_t n, uint64_t links, uint64_t registros, uint64_t eventos,
+    uint64_t vagas, uint64_t colunasRotas) {
+    bytes[CHECKPOINT_ADJ_INICIO] = (n + 1) * sizeof(int);
+    bytes[CHECKPOINT_LINK_ORIGEM] = links * sizeof(int);
+    bytes[CHECKPOINT_LINK_DESTINO] = links * sizeof(int);
+    bytes[CHECKPOINT_LINK_DIRECAO] = links;
+    bytes[CHECKPOINT_LINK_VELOCIDADE] = links;
+    bytes[CHECKPOINT_LINK_COMPRIMENTO] = links * sizeof(uint32_t);
+    bytes[CHECKPOINT_NOMES] = n * 16;
+    bytes[CHECKPOINT_PLANOS] = n * sizeof(PlanoSemaforico);
+    bytes[CHECKPOINT_FASES] = n * sizeof(uint32_t);
+    bytes[CHECKPOINT_APROXIMACOES] = n * NUM_DIRECOES * sizeof(Aproximacao);
+    bytes[CHECKPOINT_GERADORES] = n * sizeof(GeradorAleatorio);
+    bytes[CHECKPOINT_VEICULOS] = registros * sizeof(RegistroVeiculo);
+    bytes[CHECKPOINT_EVENTOS] = eventos * sizeof(Evento);
+    bytes[CHECKPOINT_VIAS] = links * sizeof(FilaVia);
+    bytes[CHECKPOINT_VAGAS_VIAS] = vagas * sizeof(int);
+    bytes[CHECKPOINT_DEMANDA] = n * sizeof(DemandaEntrada);
+    bytes[CHECKPOINT_ENTRADAS] = n * sizeof(EntradaSimulada);
+    bytes[CHECKPOINT_VIAS_FECHADAS] = (VIAGENS_OD == 1) ? links : 0;
+    bytes[CHECKPOINT_ROTAS] = colunasRotas * ((n * ROTAS_ESTADOS + 1) / 2);
+    bytes[CHECKPOINT_SEQUENCIAS] = (n + 1) * sizeof(uint64_t);
+}
+
+/**
+ * @brief Grava em `caminho` uma imagem completa da simulação sequencial.
+ *
+ * A simulação pode continuar normalmente depois da gravação.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 em caso de erro.
+ */
+static int checkpointSalvar(const Simulacao* sim, const char* caminho, uint64_t semente) {
+    static const uint8_t zeros[CHECKPOINT_ALINHAMENTO];
+    const Rede* rede = sim->rede;
+    uint64_t inicio = relogioNs();
+    CabecalhoCheckpoint cabecalho = { 0 };
+
+    memcpy(cabecalho.magica, "SIMCKPT", 8);
+    cabecalho.versao = CHECKPOINT_VERSAO;
+    cabecalho.tamanhoCabecalho = sizeof(CabecalhoCheckpoint);
+    cabecalho.tamanhoVeiculo = sizeof(RegistroVeiculo);
+    cabecalho.tamanhoEvento = sizeof(Evento);
+    cabecalho.tamanhoAproximacao = sizeof(Aproximacao);
+    cabecalho.tamanhoVia = sizeof(FilaVia);
+    cabecalho.numVagasVias = sim->numVagasVias;
+    cabecalho.linhas = rede->linhas;
+    cabecalho.colunas = rede->colunas;
+    cabecalho.numCruzamentos = rede->numCruzamentos;
+    cabecalho.numLinks = rede->numLinks;
+    cabecalho.numRegistros = sim->numRegistros;
+    cabecalho.livres = sim->livres;
+    cabecalho.veiculoCounter = sim->veiculoCounter;
+    cabecalho.ativos = sim->ativos;
+    cabecalho.picoAtivos = sim->picoAtivos;
+    cabecalho.numColunasRotas = rede->rotas ? rede->rotas->numSaidas : 0;
+    cabecalho.semente = semente;
+    cabecalho.agora = sim->agora;
+    cabecalho.periodoGeracaoUs = sim->periodoGeracaoUs;
+    cabecalho.proximaGeracaoUs = sim->proximaGeracaoUs;
+    cabecalho.eventosProcessados = sim->eventosProcessados;
+    cabecalho.veiculosSairam = sim->veiculosSairam;
+    cabecalho.esperas = sim->esperas;
+    cabecalho.tempoEsperaTotal = sim->tempoEsperaTotal;
+    cabecalho.retencoes = sim->retencoes;
+    cabecalho.veiculosAdiados = sim->veiculosAdiados;
+    cabecalho.veiculosDescartados = sim->veiculosDescartados;
+    cabecalho.numEventos = sim->eventos.tamanho;
+    cabecalho.gerador = sim->gerador;
+
+    const void* secoes[CHECKPOINT_SECOES] = {
+        rede->adjInicio, rede->linkOrigem, rede->linkDestino, rede->linkDirecao, rede->linkVelocidadeMax,
+        rede->linkComprimento, rede->nome, rede->plano, sim->fase, sim->aproximacoes, sim->geradores, sim->veiculos,
+        sim->eventos.itens, sim->vias, sim->vagasVias, rede->demanda, sim->entradas,
+        rede->rotas ? rede->rotas->viaFechada : NULL, rede->rotas ? rede->rotas->proximo : NULL, sim->sequencias
+    };
+    checkpointTamanhos(cabecalho.secaoBytes, (uint64_t)rede->numCruzamentos, (uint64_t)rede->numLinks,
+        (uint64_t)sim->numRegistros, (uint64_t)sim->eventos.tamanho, sim->numVagasVias, (uint64_t)cabecalho.numColunasRotas);
+
+    uint64_t posicao = sizeof(CabecalhoCheckpoint);
+    cabecalho.resumo = 0xCBF29CE484222325ull;
+    for (int s = 0; s < CHECKPOINT_SECOES; s++) {
+        posicao = (posicao + CHECKPOINT_ALINHAMENTO - 1) & ~(uint64_t)(CHECKPOINT_ALINHAMENTO - 1);
+        cabecalho.secaoInicio[s] = posicao;
+        posicao += cabecalho.secaoBytes[s];
+        cabecalho.resumo = checkpointResumo(cabecalho.resumo, secoes[s], (size_t)cabecalho.secaoBytes[s]);
+    }
+
+    FILE* f = fopen(caminho, "wb");
+    if (f == NULL) {
+        printf("Erro ao criar o checkpoint %s.\n", caminho);
+        return 0;
+    }
+
+    int ok = fwrite(&cabecalho, sizeof(cabecalho), 1, f) == 1;
+    posicao = sizeof(CabecalhoCheckpoint);
+    for (int s = 0; s < CHECKPOINT_SECOES && ok; s++) {
+        size_t preenchimento = (size_t)(cabecalho.secaoInicio[s] - posicao);
+        if (preenchimento > 0) ok = fwrite(zeros, 1, preenchimento, f) == preenchimento;
+        size_t bytes = (size_t)cabecalho.secaoBytes[s];
+        if (ok && bytes > 0) ok = fwrite(secoes[s], 1, bytes, f) == bytes;
+        posicao = cabecalho.secaoInicio[s] + cabecalho.secaoBytes[s];
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) {
+        printf("Erro ao gravar o checkpoint %s.\n", caminho);
+        return 0;
+    }
+
+    printf("Checkpoint gravado em %s no instante %.1f h: %.1f MB em %.3f ms.\n", caminho, sim->agora / 3600000.0,
+        posicao / 1048576.0, (relogioNs() - inicio) / 1e6);
+    return 1;
+}
+
+/**
+ * @brief Confere se os índices da simulação restaurada apontam para dentro dos seus vetores.
+ *
+ * O resumo só detecta corrupção acidental; uma imagem montada à mão pode ter
+ * o resumo certo e índices que o motor usaria sem conferir. Vias,
+ * registros de veículos, filas e alvos de eventos são conferidos contra as
+ * dimensões da imagem, e os saltos da tabela de rotas, que viram direções,
+ * contra as direções existentes. Cada via tem no máximo uma devolução de
+ * vaga pendente por veículo na fila, e os planos semafóricos têm que ter
+ * verdes e ciclo válidos.
+ *
+ * @return Retorna 1 se o estado é coerente, 0 caso contrário.
+ */
+static int checkpointEstadoValido(const Simulacao* sim, const Rede* rede) {
+    int n = rede->numCruzamentos;
+    int links = rede->numLinks;
+    int registros = sim->numRegistros;
+
+    if (rede->adjInicio[0] != 0 || rede->adjInicio[n] != links) return 0;
+    for (int c = 0; c < n; c++) {
+        if (rede->adjInicio[c] > rede->adjInicio[c + 1] || !redePlanoValido(&rede->plano[c])) return 0;
+    }
+    for (int l = 0; l < links; l++) {
+        if (rede->linkOrigem[l] < 0 || rede->linkOrigem[l] >= n || rede->linkDestino[l] < 0 ||
+            rede->linkDestino[l] >= n || rede->linkDirecao[l] < 1 || rede->linkDirecao[l] > NUM_DIRECOES ||
+            rede->linkVelocidadeMax[l] == 0 || rede->linkComprimento[l] == 0 ||
+            rede->linkComprimento[l] > REDE_MAX_COMPRIMENTO_M) return 0;
+    }
+
+    if (rede->rotas != NULL) {
+        const TabelaRotas* rotas = rede->rotas;
+        size_t bytes = (size_t)rotas->numSaidas * rotas->bytesColuna;
+        for (size_t b = 0; b < bytes; b++) {
+            if ((rotas->proximo[b] & 0x0F) > WE || (rotas->proximo[b] >> 4) > WE) return 0;
+        }
+    }
+
+    if (sim->livres < -1 || sim->livres >= registros) return 0;
+    for (int i = 0; i < registros; i++) {
+        const RegistroVeiculo* v = &sim->veiculos[i];
+        if (v->direcao < 1 || v->direcao > NUM_DIRECOES || v->cruzamento < -1 || v->cruzamento >= n ||
+            v->destino < -1 || v->destino >= n * NUM_DIRECOES || v->proximo < -1 || v->proximo >= registros ||
+            v->via < -1 || v->via >= links) return 0;
+        if (v->destino >= 0 && (rede->rotas == NULL || rede->rotas->colunaSaida[v->destino] < 0)) return 0;
+    }
+    for (int a = 0; a < n * NUM_DIRECOES; a++) {
+        const Aproximacao* ap = &sim->aproximacoes[a];
+        if (ap->filaInicio < -1 || ap->filaInicio >= registros || ap->filaFim < -1 || ap->filaFim >= registros ||
+            (ap->filaInicio < 0) != (ap->filaFim < 0)) return 0;
+    }
+
+    // As vias ocupam faixas consecutivas de `vagasVias`, e só as vagas ocupadas guardam veículos
+    uint32_t base = 0;
+    for (int l = 0; l < links; l++) {
+        const FilaVia* via = &sim->vias[l];
+        if (via->base != base || via->capacidade > sim->numVagasVias - base || via->quantidade > via->capacidade ||
+            (via->capacidade > 0 && via->inicio >= via->capacidade) || (via->capacidade == 0 && via->inicio != 0)) return 0;
+        for (uint32_t q = 0; q < via->quantidade; q++) {
+            uint32_t posicao = via->inicio + q;
+            int indice = sim->vagasVias[base + (posicao >= via->capacidade ? posicao - via->capacidade : posicao)];
+            if (indice < 0 || indice >= registros) return 0;
+        }
+        base += via->capacidade;
+    }
+    if (base != sim->numVagasVias) return 0;
+
+    // Cada EVENTO_VAGA tira um veículo da fila da via, então não pode haver mais deles do que veículos nela
+    uint32_t* vagasPendentes = (uint32_t*)calloc((size_t)(links ? links : 1), sizeof(uint32_t));
+    if (vagasPendentes == NULL) return 0;
+    int valido = 1;
+    for (size_t e = 0; e < sim->eventos.tamanho && valido; e++) {
+        const Evento* evento = &sim->eventos.itens[e];
+        int alvo = evento->alvo;
+        switch (evento->tipo) {
+        case EVENTO_GERACAO:    valido = alvo >= -1 && alvo < n; break;
+        case EVENTO_CHEGADA:    valido = alvo >= 0 && alvo < registros; break;
+        case EVENTO_FASE:       valido = alvo >= 0 && alvo < n; break;
+        case EVENTO_VIA_LIVRE:  valido = alvo >= 0 && alvo < n * NUM_DIRECOES; break;
+        case EVENTO_ADMISSAO:   valido = alvo >= 0 && alvo < n; break;
+        case EVENTO_FECHAR_VIA: valido = alvo >= 0 && alvo < links && VIAGENS_OD == 1; break;
+        case EVENTO_REPRODUCAO: valido = alvo == -1; break;
+        case EVENTO_VAGA:
+            valido = alvo >= 0 && alvo < links && ++vagasPendentes[alvo] <= sim->vias[alvo].quantidade;
+            break;
+        default:                valido = 0; break;
+        }
+    }
+    free(vagasPendentes);
+    return valido;
+}
+
+/**
+ * @brief Reconstrói a rede e a simulação a partir da imagem gravada em `caminho`.
+ *
+ * O arquivo é mapeado somente para leitura e cada seção é copiada de uma vez
+ * para os vetores da simulação, sem montar a grade nem repetir o aquecimento.
+ * Se `*semente` vier de SIM_SEMENTE e diferir da semente da imagem, todos os
+ * fluxos aleatórios são reiniciados com ela, o que permite ramificar vários
+ * experimentos a partir do mesmo estado; caso contrário, `*semente` recebe a
+ * semente da imagem.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se a imagem for inválida ou não houver memória.
+ */
+static int checkpointRestaurar(Simulacao* sim, Rede* rede, const char* caminho, uint64_t* semente) {
+    uint64_t inicio = relogioNs();
+    size_t tamanho;
+    const uint8_t* mapa = (const uint8_t*)arquivoMapearLeitura(caminho, &tamanho);
+
+    if (mapa == NULL) {
+        printf("Erro ao abrir o checkpoint %s.\n", caminho);
+        return 0;
+    }
+
+    const CabecalhoCheckpoint* cabecalho = (const CabecalhoCheckpoint*)mapa;
+    uint64_t esperados[CHECKPOINT_SECOES];
+    int ok = tamanho >= sizeof(CabecalhoCheckpoint) && memcmp(cabecalho->magica, "SIMCKPT", 8) == 0 &&
+        cabecalho->versao == CHECKPOINT_VERSAO && cabecalho->tamanhoCabecalho == sizeof(CabecalhoCheckpoint) &&
+        cabecalho->tamanhoVeiculo == sizeof(RegistroVeiculo) && cabecalho->tamanhoEvento == sizeof(Evento) &&
+        cabecalho->tamanhoAproximacao == sizeof(Aproximacao) && cabecalho->tamanhoVia == sizeof(FilaVia) &&
+        cabecalho->numCruzamentos > 0 && cabecalho->numCruzamentos <= REDE_MAX_CRUZAMENTOS &&
+        redeGradeValida(cabecalho->linhas, cabecalho->colunas, cabecalho->numCruzamentos) &&
+        cabecalho->numLinks >= 0 && cabecalho->numRegistros >= 0 && cabecalho->numColunasRotas >= 0;
+
+    // As seções precisam ter o tamanho que as dimensões indicam e caber no arquivo
+    if (ok) {
+        uint64_t resumo = 0xCBF29CE484222325ull;
+        checkpointTamanhos(esperados, (uint64_t)cabecalho->numCruzamentos, (uint64_t)cabecalho->numLinks,
+            (uint64_t)cabecalho->numRegistros, cabecalho->numEventos, cabecalho->numVagasVias,
+            (uint64_t)cabecalho->numColunasRotas);
+        for (int s = 0; s < CHECKPOINT_SECOES && ok; s++) {
+            ok = cabecalho->secaoBytes[s] == esperados[s] && cabecalho->secaoInicio[s] <= tamanho &&
+                esperados[s] <= tamanho - cabecalho->secaoInicio[s];
+            if (ok) resumo = checkpointResumo(resumo, mapa + cabecalho->secaoInicio[s], (size_t)esperados[s]);
+        }
+        ok = ok && resumo == cabecalho->resumo;
+    }
+    if (!ok) {
+        printf("Checkpoint %s invalido, corrompido ou de outra versao.\n", caminho);
+        arquivoDesmapear(mapa, tamanho);
+        return 0;
+    }
+
+    int n = cabecalho->numCruzamentos;
+    const uint8_t* secao[CHECKPOINT_SECOES];
+    for (int s = 0; s < CHECKPOINT_SECOES; s++) {
+        secao[s] = mapa + cabecalho->secaoInicio[s];
+    }
+
+    // Rede: os vetores são alocados por redeIniciar e preenchidos diretamente com as seções
+    if (!redeIniciar(rede, n, cabecalho->numLinks)) {
+        printf("Erro ao alocar memoria para a rede de cruzamentos.\n");
+        arquivoDesmapear(mapa, tamanho);
+        return 0;
+    }
+    rede->numLinks = cabecalho->numLinks;
+    rede->linhas = cabecalho->linhas;
+    rede->colunas = cabecalho->colunas;
+    memcpy(rede->adjInicio, secao[CHECKPOINT_ADJ_INICIO], (size_t)esperados[CHECKPOINT_ADJ_INICIO]);
+    memcpy(rede->linkOrigem, secao[CHECKPOINT_LINK_ORIGEM], (size_t)esperados[CHECKPOINT_LINK_ORIGEM]);
+    memcpy(rede->linkDestino, secao[CHECKPOINT_LINK_DESTINO], (size_t)esperados[CHECKPOINT_LINK_DESTINO]);
+    memcpy(rede->linkDirecao, secao[CHECKPOINT_LINK_DIRECAO], (size_t)esperados[CHECKPOINT_LINK_DIRECAO]);
+    memcpy(rede->linkVelocidadeMax, secao[CHECKPOINT_LINK_VELOCIDADE], (size_t)esperados[CHECKPOINT_LINK_VELOCIDADE]);
+    memcpy(rede->linkComprimento, secao[CHECKPOINT_LINK_COMPRIMENTO], (size_t)esperados[CHECKPOINT_LINK_COMPRIMENTO]);
+    memcpy(rede->nome, secao[CHECKPOINT_NOMES], (size_t)esperados[CHECKPOINT_NOMES]);
+    memcpy(rede->plano, secao[CHECKPOINT_PLANOS], (size_t)esperados[CHECKPOINT_PLANOS]);
+    memcpy(rede->demanda, secao[CHECKPOINT_DEMANDA], (size_t)esperados[CHECKPOINT_DEMANDA]);
+#if ( VIAGENS_OD == 1 )
+    // A tabela de rotas é copiada da imagem, sem refazer as buscas de caminho
+    if (!rotasCriar(rede, secao[CHECKPOINT_VIAS_FECHADAS], secao[CHECKPOINT_ROTAS], (size_t)esperados[CHECKPOINT_ROTAS])) {
+        printf("Erro ao alocar memoria para a tabela de rotas.\n");
+        arquivoDesmapear(mapa, tamanho);
+        redeLiberar(rede);
+        return 0;
+    }
+#endif
+    // Sem a mesma quantidade de colunas a tabela gravada não é a desta rede (rotasCriar a refaria)
+    int colunasRotas = rede->rotas ? rede->rotas->numSaidas : 0;
+    if (cabecalho->numColunasRotas != colunasRotas) {
+        printf("Checkpoint %s com %d colunas de rotas, mas a rede tem %d saidas.\n", caminho,
+            (int)cabecalho->numColunasRotas, colunasRotas);
+        arquivoDesmapear(mapa, tamanho);
+        redeLiberar(rede);
+        return 0;
+    }
+
+    // Simulação: mesma forma que simulacaoIniciar deixaria, com os vetores já no estado gravado
+    *sim = (Simulacao){ 0 };
+    sim->rede = rede;
+    sim->numCruzamentos = n;
+    sim->numParticoes = 1;
+    sim->agora = cabecalho->agora;
+    sim->agente = n;
+    sim->periodoGeracaoUs = cabecalho->periodoGeracaoUs;
+    sim->proximaGeracaoUs = cabecalho->proximaGeracaoUs;
+    sim->gerador = cabecalho->gerador;
+    sim->numRegistros = cabecalho->numRegistros;
+    sim->capacidadeRegistros = cabecalho->numRegistros;
+    sim->livres = cabecalho->livres;
+    sim->veiculoCounter = cabecalho->veiculoCounter;
+    sim->eventosProcessados = cabecalho->eventosProcessados;
+    sim->veiculosSairam = cabecalho->veiculosSairam;
+    sim->esperas = cabecalho->esperas;
+    sim->tempoEsperaTotal = cabecalho->tempoEsperaTotal;
+    sim->retencoes = cabecalho->retencoes;
+    sim->veiculosAdiados = cabecalho->veiculosAdiados;
+    sim->veiculosDescartados = cabecalho->veiculosDescartados;
+    sim->numVias = cabecalho->numLinks;
+    sim->numVagasVias = cabecalho->numVagasVias;
+    sim->ativos = cabecalho->ativos;
+    sim->picoAtivos = cabecalho->picoAtivos;
+    sim->eventos.tamanho = (size_t)cabecalho->numEventos;
+    sim->eventos.capacidade = sim->eventos.tamanho > 64 ? sim->eventos.tamanho : 64;
+
+    sim->fase = (uint32_t*)malloc((size_t)esperados[CHECKPOINT_FASES]);
+    sim->aproximacoes = (Aproximacao*)malloc((size_t)esperados[CHECKPOINT_APROXIMACOES]);
+    sim->geradores = (GeradorAleatorio*)malloc((size_t)esperados[CHECKPOINT_GERADORES]);
+    sim->sequencias = (uint64_t*)malloc((size_t)esperados[CHECKPOINT_SEQUENCIAS]);
+    sim->veiculos = (RegistroVeiculo*)malloc((size_t)(sim->numRegistros ? sim->numRegistros : 1) * sizeof(RegistroVeiculo));
+    sim->eventos.itens = (Evento*)malloc(sim->eventos.capacidade * sizeof(Evento));
+    sim->vias = (FilaVia*)malloc((size_t)(sim->numVias ? sim->numVias : 1) * sizeof(FilaVia));
+    sim->vagasVias = (int*)malloc((size_t)(sim->numVagasVias ? sim->numVagasVias : 1) * sizeof(int));
+    sim->entradas = (EntradaSimulada*)malloc((size_t)esperados[CHECKPOINT_ENTRADAS]);
+    if (!sim->fase || !sim->aproximacoes || !sim->geradores || !sim->sequencias || !sim->veiculos || !sim->eventos.itens || !sim->vias ||
+        !sim->vagasVias || !sim->entradas) {
+        printf("Erro ao alocar memoria para a simulacao restaurada.\n");
+        arquivoDesmapear(mapa, tamanho);
+        simulacaoLiberar(sim);
+        redeLiberar(rede);
+        return 0;
+    }
+    memcpy(sim->fase, secao[CHECKPOINT_FASES], (size_t)esperados[CHECKPOINT_FASES]);
+    for (int c = 0; c < n; c++) {
+        if (!faseLegal(sim->fase[c])) {
+            printf("Checkpoint %s com fase invalida no cruzamento %d.\n", caminho, c);
+            arquivoDesmapear(mapa, tamanho);
+            simulacaoLiberar(sim);
+            redeLiberar(rede);
+            return 0;
+        }
+    }
+    memcpy(sim->aproximacoes, secao[CHECKPOINT_APROXIMACOES], (size_t)esperados[CHECKPOINT_APROXIMACOES]);
+    memcpy(sim->geradores, secao[CHECKPOINT_GERADORES], (size_t)esperados[CHECKPOINT_GERADORES]);
+    memcpy(sim->sequencias, secao[CHECKPOINT_SEQUENCIAS], (size_t)esperados[CHECKPOINT_SEQUENCIAS]);
+    memcpy(sim->veiculos, secao[CHECKPOINT_VEICULOS], (size_t)esperados[CHECKPOINT_VEICULOS]);
+    memcpy(sim->eventos.itens, secao[CHECKPOINT_EVENTOS], (size_t)esperados[CHECKPOINT_EVENTOS]);
+    memcpy(sim->vias, secao[CHECKPOINT_VIAS], (size_t)esperados[CHECKPOINT_VIAS]);
+    memcpy(sim->vagasVias, secao[CHECKPOINT_VAGAS_VIAS], (size_t)esperados[CHECKPOINT_VAGAS_VIAS]);
+    memcpy(sim->entradas, secao[CHECKPOINT_ENTRADAS], (size_t)esperados[CHECKPOINT_ENTRADAS]);
+    if (!checkpointEstadoValido(sim, rede)) {
+        printf("Checkpoint %s com estado incoerente (indices, rotas, vagas ou planos).\n", caminho);
+        arquivoDesmapear(mapa, tamanho);
+        simulacaoLiberar(sim);
+        redeLiberar(rede);
+        return 0;
+    }
+
+    uint64_t sementeImagem = cabecalho->semente;
+    arquivoDesmapear(mapa, tamanho);
+
+    const char* ramificacao = "";
+    if (getenv("SIM_SEMENTE") != NULL && *semente != sementeImagem) {
+        // Ramificação: mesmo estado, fluxos aleatórios novos a partir deste instante
+        geradorIniciar(&sim->gerador, *semente, FLUXO_GERACAO(0));
+        for (int c = 0; c < n; c++) {
+            geradorIniciar(&sim->geradores[c], *semente, FLUXO_CRUZAMENTO(c));
+        }
+        ramificacao = ", ramificado com nova semente";
+    }
+    else {
+        *semente = sementeImagem;
+    }
+
+    printf("Checkpoint %s restaurado em %.3f ms: %d cruzamentos, instante %.1f h, %d veiculos, %llu eventos pendentes%s.\n",
+        caminho, (relogioNs() - inicio) / 1e6, rede->numCruzamentos, sim->agora / 3600000.0, sim->ativos,
+        (unsigned long long)sim->eventos.tamanho, ramificacao);
+    return 1;
+}
+
+#endif /* MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS */
+
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+
+/**
+ * @brief Agenda os fechamentos de SIM_FECHAR_VIA=<origem>,<destino>[,<segundos>][;...].
+ *
+ * Origem e destino são índices de cruzamento ligados por uma via; sem o
+ * instante, a via fecha no início da execução (ou no instante do checkpoint).
+ */
+static void agendarFechamentos(Simulacao* sim) {
+    const char* variavel = getenv("SIM_FECHAR_VIA");
+    const Rede* rede = sim->rede;
+
+    if (variavel == NULL || variavel[0] == '\0') return;
+    if (rede->rotas == NULL) {
+        printf("SIM_FECHAR_VIA ignorada: a rede nao tem tabela de rotas (VIAGENS_OD 0).\n");
+        return;
+    }
+
+    const char* p = variavel;
+    while (*p != '\0') {
+        char* fim;
+        unsigned long origem = strtoul(p, &fim, 10), destino = 0, segundos = 0;
+        int ok = (fim != p && *fim == ',');
+        if (ok) {
+            p = fim + 1;
+            destino = strtoul(p, &fim, 10);
+            ok = (fim != p);
+        }
+        if (ok && *fim == ',') {
+            p = fim + 1;
+            segundos = strtoul(p, &fim, 10);
+            ok = (fim != p);
+        }
+        ok = ok && (*fim == ';' || *fim == '\0') && origem < (unsigned long)rede->numCruzamentos;
+
+        int link = -1;
+        for (int l = ok ? rede->adjInicio[origem] : 0; ok && l < rede->adjInicio[origem + 1]; l++) {
+            if ((unsigned long)rede->linkDestino[l] == destino) link = l;
+        }
+        if (link < 0) {
+            printf("SIM_FECHAR_VIA invalida (esperado: <origem>,<destino>[,<segundos>][;...] com uma via de origem a destino).\n");
+            return;
+        }
+
+        uint64_t instante = (uint64_t)segundos * 1000;
+        agendarEvento(sim, instante > sim->agora ? instante : sim->agora, EVENTO_FECHAR_VIA, link);
+        p = (*fim == ';') ? fim + 1 : fim;
+    }
+}
+
+/**
+ * @brief Executa o motor de eventos discretos e imprime um resumo da execução.
+ */
+static void executarEventosDiscretos(void) {
+    static Simulacao sim;
+    Rede rede;
+    uint64_t semente = sementeExecucao();
+    const char* imagem = getenv("SIM_CHECKPOINT");
+
+    if (imagem != NULL && imagem[0] != '\0') {
+        // Continua a partir de um checkpoint, sem montar a rede nem repetir o aquecimento
+        if (!checkpointRestaurar(&sim, &rede, imagem, &semente)) return;
+    }
+    else {
+        if (!redeCriar(&rede, semente)) return;
+
+        if (!simulacaoIniciar(&sim, &rede, semente)) {
+            simulacaoLiberar(&sim);
+            redeLiberar(&rede);
+            return;
+        }
+    }
+
+    // O drenador grava o log em outra thread; o motor apenas copia registros para o canal
+    logIniciar(&rede, MODO_EVENTOS_DISCRETOS, semente);
+    logIniciarDrenagem();
+    sim.log = logAbrirCanal(1);
+
+    // Métricas: um conjunto de contadores para a única thread, exportado pelo relator
+    const char* destinoMetricas = metricasDestino();
+    if (destinoMetricas != NULL && metricasIniciar(&rede, 1, destinoMetricas)) {
+        sim.metricas = metricasFragmento(0);
+        // Os veículos restaurados contam como criados, para que os que ainda estão na rede fechem a conta
+        metricaSomar(sim.metricas->criados, (uint64_t)sim.ativos);
+        metricasIniciarRelator();
+    }
+
+    agendarFechamentos(&sim);
+
+    // Demanda gravada: substitui a geração sorteada a partir do instante atual
+    static LeitorChegadas leitorChegadas;
+    const char* origemChegadas = chegadasOrigem();
+    if (origemChegadas != NULL && imagem != NULL && imagem[0] != '\0') {
+        printf("SIM_CHEGADAS ignorada: o checkpoint nao guarda a posicao no arquivo de chegadas.\n");
+    }
+    else if (origemChegadas != NULL && chegadasAbrir(&leitorChegadas, origemChegadas, &rede)) {
+        sim.chegadas = &leitorChegadas;
+        agendarEvento(&sim, sim.agora, EVENTO_REPRODUCAO, -1);
+    }
+    const char* destinoChegadas = getenv("SIM_CHEGADAS_GRAVAR");
+    if (destinoChegadas != NULL && destinoChegadas[0] != '\0') {
+        sim.gravacaoChegadas = fopen(destinoChegadas, "w");
+        if (sim.gravacaoChegadas == NULL) printf("Erro ao criar o arquivo de chegadas %s.\n", destinoChegadas);
+        else fprintf(sim.gravacaoChegadas, "# instante_ms cruzamento direcao velocidade_kmh\n");
+    }
+
+    // Instantâneos: a simulação publica, o exportador e a tela (outras threads) só leem, e ninguém espera
+    static Instantaneos instantaneos;
+    static Tela tela;
+    ExportadorInstantaneos exportador = { 0 };
+    const char* destinoInstantaneos = instantaneosDestino();
+    int comTela = telaPedida();
+    if ((destinoInstantaneos != NULL || comTela) && instantaneosIniciar(&instantaneos, &rede)) {
+        sim.instantaneos = &instantaneos;
+        sim.proximoInstantaneo = sim.agora;
+        if (destinoInstantaneos != NULL) instantaneosIniciarExportador(&exportador, &instantaneos, destinoInstantaneos);
+        if (comTela && telaIniciar(&tela, &rede, &instantaneos)) telaIniciarThread(&tela);
+    }
+
+    // Checkpoint opcional no instante SIM_CHECKPOINT_INSTANTE_S (padrão: fim da execução)
+    uint64_t duracao = (uint64_t)SIM_DURACAO_S * 1000;
+    uint64_t instanteCheckpoint = duracao;
+    const char* destinoCheckpoint = getenv("SIM_CHECKPOINT_SALVAR");
+    const char* instante = getenv("SIM_CHECKPOINT_INSTANTE_S");
+    if (sim.chegadas != NULL && destinoCheckpoint != NULL && destinoCheckpoint[0] != '\0') {
+        printf("SIM_CHECKPOINT_SALVAR ignorada: o checkpoint nao guarda a posicao no arquivo de chegadas.\n");
+        destinoCheckpoint = NULL;
+    }
+    if (instante != NULL && (uint64_t)strtoull(instante, NULL, 10) * 1000 < duracao) {
+        instanteCheckpoint = (uint64_t)strtoull(instante, NULL, 10) * 1000;
+    }
+
+    uint64_t agoraInicial = sim.agora;
+    uint64_t eventosIniciais = sim.eventosProcessados;
+    clock_t inicio = clock();
+    if (destinoCheckpoint != NULL && destinoCheckpoint[0] != '\0') {
+        simulacaoExecutar(&sim, instanteCheckpoint);
+        clock_t inicioGravacao = clock();
+        checkpointSalvar(&sim, destinoCheckpoint, semente);
+        inicio += clock() - inicioGravacao;
+    }
+    simulacaoExecutar(&sim, duracao);
+    double segundos = (double)(clock() - inicio) / CLOCKS_PER_SEC;
+    if (tela.atual != NULL) telaEncerrar(&tela); // Último quadro antes do resumo, que vai para a região de rolagem
+
+    printf("Simulacao por eventos discretos concluida.\n");
+    printf("  Tempo simulado: %.1f h em %.3f s (%.0fx o tempo real)\n",
+        sim.agora / 3600000.0, segundos, segundos > 0 ? ((sim.agora - agoraInicial) / 1000.0) / segundos : 0.0);
+    printf("  Eventos processados: %llu (%.0f eventos/s)\n",
+        (unsigned long long)sim.eventosProcessados, segundos > 0 ? (sim.eventosProcessados - eventosIniciais) / segundos : 0.0);
+    printf("  Veiculos criados: %d, sairam da rede: %llu, ainda na rede: %d (pico %d)\n",
+        sim.veiculoCounter, (unsigned long long)sim.veiculosSairam, sim.ativos, sim.picoAtivos);
+    printf("  Paradas em sinal vermelho: %llu, espera media: %.2f s\n",
+        (unsigned long long)sim.esperas, sim.esperas ? sim.tempoEsperaTotal / 1000.0 / sim.esperas : 0.0);
+    printf("  Retencoes por via cheia: %llu\n", (unsigned long long)sim.retencoes);
+    printf("  Entradas adiadas: %llu, descartadas: %llu\n", (unsigned long long)sim.veiculosAdiados,
+        (unsigned long long)sim.veiculosDescartados);
+    int fechadas = 0;
+    for (int l = 0; rede.rotas != NULL && l < rede.numLinks; l++) fechadas += rede.rotas->viaFechada[l];
+    if (fechadas > 0) {
+        printf("  Vias fechadas: %d, colunas de rotas refeitas: %llu\n", fechadas,
+            (unsigned long long)rede.rotas->colunasRefeitas);
+    }
+    if (sim.instantaneos != NULL) {
+        if (destinoInstantaneos != NULL) instantaneosEncerrarExportador(&exportador);
+        printf("  Instantaneos: %llu publicados a cada %llu ms, %llu pulados sem buffer livre, %llu lidos",
+            (unsigned long long)instantaneos.publicados, (unsigned long long)instantaneos.periodoMs,
+            (unsigned long long)instantaneos.pulados, (unsigned long long)atomicoLerRelaxado64(&instantaneos.leituras));
+        if (destinoInstantaneos != NULL) printf(", %u gravados em %s", (unsigned)exportador.gravacoes, destinoInstantaneos);
+        printf("\n");
+        instantaneosLiberar(&instantaneos);
+    }
+    if (sim.chegadas != NULL) {
+        double segundosLeitura = leitorChegadas.nsLeitura / 1e9;
+        printf("  Chegadas gravadas: %llu lidas de %s (%.1f MB em %u janelas de %d MB), %llu linhas invalidas, %llu fora de ordem\n",
+            (unsigned long long)leitorChegadas.lidas, origemChegadas, leitorChegadas.posicao / 1048576.0,
+            (unsigned)leitorChegadas.janelasLidas, CHEGADAS_JANELA_MB, (unsigned long long)leitorChegadas.ignoradas,
+            (unsigned long long)leitorChegadas.foraDeOrdem);
+        printf("  Leitura das chegadas: %.3f s (%.1f milhoes de chegadas/s)\n", segundosLeitura,
+            segundosLeitura > 0 ? leitorChegadas.lidas / segundosLeitura / 1e6 : 0.0);
+        chegadasFechar(&leitorChegadas);
+    }
+    if (sim.gravacaoChegadas != NULL) {
+        fclose(sim.gravacaoChegadas);
+        printf("  Veiculos criados gravados como chegadas em %s\n", destinoChegadas);
+    }
+
+    metricasEncerrar();
+    logEncerrar();
+    simulacaoLiberar(&sim);
+    redeLiberar(&rede);
+}
+
+#endif /* MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS */
+
+/*----------------- SIMULAÇÃO PARALELA POR REGIÕES ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_PARALELO )
+
+#ifndef PARALELO_THREADS
+#define PARALELO_THREADS 16           // Maior quantidade de regiões (uma thread cada) medida
+#endif
+#ifndef PARALELO_CAPACIDADE_ANEL
+#define PARALELO_CAPACIDADE_ANEL 1024 // Veículos e vagas em trânsito entre duas regiões (potência de 2)
+#endif
+
+typedef char verificarCapacidadeAnel[(PARALELO_CAPACIDADE_ANEL > 0 &&
+    (PARALELO_CAPACIDADE_ANEL & (PARALELO_CAPACIDADE_ANEL - 1)) == 0) ? 1 : -1];
+
+/**
+ * @brief Veículo que atravessou a fronteira entre duas regiões, ou vaga que volta por ela.
+ *
+ * Uma vaga tem `cruzamento` -1 e vai da região de destino da via `via` para
+ * a de origem, que é a dona da fila da via.
+ */
+typedef struct {
+    uint64_t tempo;        /**< Instante de chegada ao cruzamento de destino (ou da vaga à entrada da via), em ms. */
+    uint64_t seq;          /**< Número de sequência do evento, atribuído pela região que envia. */
+    uint64_t inicioViagem; /**< Instante em que o veículo entrou na via que cruza a fronteira. */
+    int id;                /**< Identificador do veículo. */
+    int velocidade;        /**< Velocidade do veículo em km/h. */
+    int direcao;           /**< Direção do veículo (1-NS, 2-SN, 3-EW, 4-WE). */
+    int cruzamento;        /**< Cruzamento de destino, pertencente à região que recebe o veículo (-1: vaga). */
+    int destino;           /**< Saída da viagem, ou -1 para seguir reto. */
+    int via;               /**< Via de fronteira em cuja fila o veículo está, ou cuja vaga voltou. */
+} MensagemVeiculo;
+
+/**
+ * @brief Anel limitado de um produtor e um consumidor, sem travas.
+ *
+ * Só a região de origem escreve `cauda` e só a de destino escreve `cabeca`;
+ * os dois índices ficam em linhas de cache distintas.
+ */
+typedef struct {
+    volatile uint32_t cauda;        /**< Próxima posição a escrever (produtor). */
+    char preenchimentoCauda[60];
+    volatile uint32_t cabeca;       /**< Próxima posição a ler (consumidor). */
+    char preenchimentoCabeca[60];
+    MensagemVeiculo itens[PARALELO_CAPACIDADE_ANEL];
+} AnelVeiculos;
+
+/**
+ * @brief Estado compartilhado pelas threads de uma simulação paralela.
+ *
+ * A rede é dividida em faixas contíguas de cruzamentos (faixas de linhas,
+ * em uma grade). As regiões avançam em janelas de `janelaMs`, o menor tempo
+ * de percurso de uma via ou de volta de uma vaga: um veículo ou uma vaga que
+ * deixa uma região durante uma janela só chega à outra depois do fim dela,
+ * então basta sincronizar as threads em uma barreira ao fim de cada janela.
+ */
+typedef struct SimulacaoParalela {
+    int numParticoes;            /**< Quantidade de regiões (e de threads). */
+    int* particaoDe;             /**< Região de cada cruzamento. */
+    AnelVeiculos** aneis;        /**< Anel de cada par [origem * numParticoes + destino]; NULL se não há vias entre eles. */
+    uint64_t janelaMs;           /**< Janela de sincronização (lookahead), em ms. */
+    uint64_t duracaoMs;          /**< Tempo simulado total, em ms. */
+    volatile uint32_t chegaram;  /**< Threads que chegaram à barreira atual. */
+    char preenchimento[60];
+    volatile uint32_t geracao;   /**< Incrementada quando todas as threads chegam à barreira. */
+} SimulacaoParalela;
+
+/**
+ * @brief Simulação de uma região, isolada em sua própria linha de cache.
+ */
+typedef struct {
+    Simulacao sim;
+    char preenchimento[64];
+} RegiaoSimulada;
+
+static int anelEnviar(AnelVeiculos* anel, const MensagemVeiculo* mensagem) {
+    uint32_t cauda = anel->cauda;
+
+    if (cauda - atomicoLer32(&anel->cabeca) == PARALELO_CAPACIDADE_ANEL) return 0;
+    anel->itens[cauda & (PARALELO_CAPACIDADE_ANEL - 1)] = *mensagem;
+    atomicoEscrever32(&anel->cauda, cauda + 1);
+    return 1;
+}
+
+static int anelReceber(AnelVeiculos* anel, MensagemVeiculo* mensagem) {
+    uint32_t cabeca = anel->cabeca;
+
+    if (cabeca == atomicoLer32(&anel->cauda)) return 0;
+    *mensagem = anel->itens[cabeca & (PARALELO_CAPACIDADE_ANEL - 1)];
+    atomicoEscrever32(&anel->cabeca, cabeca + 1);
+    return 1;
+}
+
+/**
+ * @brief Recebe os veículos e as vagas enviados por outras regiões e agenda suas chegadas.
+ *
+ * Pode ser chamada a qualquer momento: toda chegada recebida é posterior ao
+ * fim da janela atual e mantém o número de sequência atribuído na origem,
+ * então o resultado não depende de quando a mensagem é retirada do anel.
+ */
+static void receberVeiculos(Simulacao* sim) {
+    SimulacaoParalela* paralelo = sim->paralelo;
+    MensagemVeiculo mensagem;
+
+    for (int origem = 0; origem < paralelo->numParticoes; origem++) {
+        AnelVeiculos* anel = paralelo->aneis[origem * paralelo->numParticoes + sim->particao];
+        if (anel == NULL) continue;
+
+        while (anelReceber(anel, &mensagem)) {
+            if (mensagem.cruzamento < 0) {
+                agendarEventoSeq(sim, mensagem.tempo, mensagem.seq, EVENTO_VAGA, mensagem.via);
+                continue;
+            }
+
+            int indice = alocarRegistroVeiculo(sim);
+            if (indice < 0) {
+                printf("Erro ao alocar memoria para um veiculo recebido de outra regiao.\n");
+                continue;
+            }
+
+            RegistroVeiculo* veiculo = &sim->veiculos[indice];
+            veiculo->id = mensagem.id;
+            veiculo->velocidade = mensagem.velocidade;
+            veiculo->direcao = mensagem.direcao;
+            veiculo->tempoDeslocamento = 0;
+            veiculo->cruzamento = mensagem.cruzamento;
+            veiculo->destino = mensagem.destino;
+            veiculo->inicioViagem = mensagem.inicioViagem;
+            veiculo->proximo = -1;
+            veiculo->via = mensagem.via;
+
+            sim->ativos++;
+            if (sim->ativos > sim->picoAtivos) sim->picoAtivos = sim->ativos;
+            agendarEventoSeq(sim, mensagem.tempo, mensagem.seq, EVENTO_CHEGADA, indice);
+        }
+    }
+}
+
+/**
+ * @brief Coloca a mensagem no anel para a região `destino`.
+ *
+ * Com o anel cheio a thread recebe as mensagens destinadas a ela enquanto
+ * espera, o que impede que duas regiões fiquem esperando uma pela outra.
+ */
+static void enviarMensagem(Simulacao* sim, int destino, const MensagemVeiculo* mensagem) {
+    SimulacaoParalela* paralelo = sim->paralelo;
+    AnelVeiculos* anel = paralelo->aneis[sim->particao * paralelo->numParticoes + destino];
+
+    if (anelEnviar(anel, mensagem)) return;
+
+    sim->aneisCheios++;
+    do {
+        receberVeiculos(sim);
+        threadCeder();
+    } while (!anelEnviar(anel, mensagem));
+}
+
+/**
+ * @brief Entrega à região do próximo cruzamento um veículo que acabou de atravessar.
+ *
+ * A chegada é numerada pelo cruzamento que o veículo atravessou, como seria
+ * com a rede inteira em uma região.
+ */
+static void enviarVeiculo(Simulacao* sim, int indice, uint64_t chegada) {
+    RegistroVeiculo* veiculo = &sim->veiculos[indice];
+    MensagemVeiculo mensagem = { chegada, proximaSequencia(sim, sim->agente), veiculo->inicioViagem,
+        veiculo->id, veiculo->velocidade, veiculo->direcao, veiculo->cruzamento, veiculo->destino, veiculo->via };
+
+    // O registro é liberado antes da espera, que pode receber veículos e realocar o vetor
+    veiculo->proximo = sim->livres;
+    sim->livres = indice;
+    sim->ativos--;
+    sim->veiculosTransferidos++;
+
+    enviarMensagem(sim, sim->paralelo->particaoDe[veiculo->cruzamento], &mensagem);
+}
+
+/**
+ * @brief Devolve à região de origem da via de fronteira `link` a vaga de quem acabou de sair dela.
+ */
+static void enviarVaga(Simulacao* sim, int link, uint64_t instante) {
+    MensagemVeiculo mensagem = { instante, proximaSequencia(sim, sim->agente), 0, -1, 0, 0, -1, -1, link };
+
+    enviarMensagem(sim, sim->paralelo->particaoDe[sim->rede->linkOrigem[link]], &mensagem);
+}
+
+/**
+ * @brief Espera todas as regiões terminarem a janela atual.
+ *
+ * Enquanto espera, a thread continua recebendo veículos, liberando espaço
+ * nos anéis das regiões que ainda estão enviando.
+ */
+static void barreiraAguardar(Simulacao* sim) {
+    SimulacaoParalela* paralelo = sim->paralelo;
+    uint32_t geracao = atomicoLer32(&paralelo->geracao);
+
+    if (atomicoSomar32(&paralelo->chegaram, 1) == (uint32_t)paralelo->numParticoes) {
+        atomicoEscrever32(&paralelo->chegaram, 0);
+        atomicoEscrever32(&paralelo->geracao, geracao + 1);
+        return;
+    }
+    while (atomicoLer32(&paralelo->geracao) == geracao) {
+        receberVeiculos(sim);
+        threadCeder();
+    }
+}
+
+/**
+ * @brief Thread de uma região: processa janela por janela até o fim da simulação.
+ */
+static void prvSimularRegiao(void* pvParametro) {
+    Simulacao* sim = (Simulacao*)pvParametro;
+    SimulacaoParalela* paralelo = sim->paralelo;
+
+    for (uint64_t inicio = 0; inicio <= paralelo->duracaoMs; inicio += paralelo->janelaMs) {
+        uint64_t fim = inicio + paralelo->janelaMs - 1;
+        simulacaoExecutar(sim, (fim < paralelo->duracaoMs) ? fim : paralelo->duracaoMs);
+
+        // Depois da barreira todos os veículos enviados nesta janela já estão nos anéis
+        barreiraAguardar(sim);
+        receberVeiculos(sim);
+    }
+}
+
+/**
+ * @brief Menor tempo que um veículo ou uma vaga pode levar entre dois cruzamentos, em ms.
+ *
+ * Considera a via mais curta da rede percorrida na maior velocidade que um
+ * veículo pode sortear, e a volta da vaga por ela. Serve de janela de
+ * sincronização entre as regiões.
+ */
+static uint64_t calcularJanelaParalela(const Rede* rede) {
+    uint32_t menorVia = REDE_COMPRIMENTO_M;
+    int velocidadeMax = (VELOCIDADE_MAX_NS > VELOCIDADE_MAX_EW) ? VELOCIDADE_MAX_NS : VELOCIDADE_MAX_EW;
+
+    for (int l = 0; l < rede->numLinks; l++) {
+        if (rede->linkComprimento[l] < menorVia) menorVia = rede->linkComprimento[l];
+    }
+
+    // O tempo de deslocamento é arredondado para segundos inteiros, como em atravessarCruzamento
+    uint64_t janela = (uint64_t)round(menorVia / (velocidadeMax * 0.27778)) * 1000;
+#if ( FILAS_POR_VIA == 1 )
+    uint64_t atrasoVaga = (uint64_t)menorVia * 3600 / VELOCIDADE_ONDA_VAGA_KMH;
+    if (atrasoVaga < janela) janela = atrasoVaga;
+#endif
+    return janela > 0 ? janela : 1;
+}
+
+/**
+ * @brief Executa uma simulação dividida em `numParticoes` regiões, uma thread por região.
+ *
+ * Os totais das regiões são somados em `total`, cujo campo `agora` recebe o
+ * tempo simulado. Cada região sorteia apenas nos próprios fluxos (uma cópia
+ * do de criação e os dos seus cruzamentos), então as threads não disputam o
+ * gerador e, para a mesma semente, o resultado é o mesmo com qualquer
+ * quantidade de regiões. Só os eventos da geração única, tratados por todas
+ * as regiões, crescem com ela.
+ *
+ * @param registrar 1 abre um canal de log e um conjunto de métricas para cada região.
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória ou threads.
+ */
+static int simulacaoParalelaExecutar(const Rede* rede, int numParticoes, uint64_t duracaoMs, uint64_t semente,
+    int registrar, Simulacao* total) {
+    int n = rede->numCruzamentos;
+    SimulacaoParalela paralelo = { 0 };
+    RegiaoSimulada* regioes = (RegiaoSimulada*)calloc((size_t)numParticoes, sizeof(RegiaoSimulada));
+    ThreadNativa* threads = (ThreadNativa*)malloc((size_t)numParticoes * sizeof(ThreadNativa));
+    int iniciadas = 0;
+    int sucesso = 0;
+
+    paralelo.numParticoes = numParticoes;
+    paralelo.janelaMs = calcularJanelaParalela(rede);
+    paralelo.duracaoMs = duracaoMs;
+    paralelo.particaoDe = (int*)malloc((size_t)n * sizeof(int));
+    paralelo.aneis = (AnelVeiculos**)calloc((size_t)numParticoes * numParticoes, sizeof(AnelVeiculos*));
+    if (regioes == NULL || threads == NULL || paralelo.particaoDe == NULL || paralelo.aneis == NULL) goto fim;
+
+    // Faixas contíguas de cruzamentos, de tamanhos que diferem em no máximo um
+    for (int p = 0; p < numParticoes; p++) {
+        int primeiro = (int)((int64_t)n * p / numParticoes);
+        int ultimo = (int)((int64_t)n * (p + 1) / numParticoes);
+        for (int c = primeiro; c < ultimo; c++) paralelo.particaoDe[c] = p;
+
+        if (!simulacaoIniciarRegiao(&regioes[p].sim, rede, primeiro, ultimo - primeiro, p, numParticoes, semente)) goto fim;
+        regioes[p].sim.paralelo = &paralelo;
+        if (registrar) {
+            regioes[p].sim.log = logAbrirCanal(1);
+            regioes[p].sim.metricas = metricasFragmento(p);
+        }
+    }
+
+    // Um anel em cada sentido para cada par de regiões ligadas por alguma via: veículos vão, vagas voltam
+    for (int l = 0; l < rede->numLinks; l++) {
+        int origem = paralelo.particaoDe[rede->linkOrigem[l]];
+        int destino = paralelo.particaoDe[rede->linkDestino[l]];
+        if (origem == destino) continue;
+        for (int sentido = 0; sentido < 2; sentido++) {
+            AnelVeiculos** anel = &paralelo.aneis[sentido ? destino * numParticoes + origem : origem * numParticoes + destino];
+            if (*anel == NULL) *anel = (AnelVeiculos*)calloc(1, sizeof(AnelVeiculos));
+            if (*anel == NULL) goto fim;
+        }
+    }
+
+    for (; iniciadas < numParticoes; iniciadas++) {
+        if (!threadCriar(&threads[iniciadas], prvSimularRegiao, &regioes[iniciadas].sim)) {
+            // Sem todas as threads a barreira nunca seria liberada
+            printf("Falha ao criar a thread da regiao %d.\n", iniciadas);
+            exit(1);
+        }
+    }
+    for (int p = 0; p < numParticoes; p++) threadAguardar(threads[p]);
+
+    *total = (Simulacao){ 0 };
+    total->agora = duracaoMs;
+    for (int p = 0; p < numParticoes; p++) {
+        Simulacao* sim = &regioes[p].sim;
+        total->eventosProcessados += sim->eventosProcessados;
+        total->veiculoCounter += sim->veiculoCounter;
+        total->veiculosSairam += sim->veiculosSairam;
+        total->veiculosTransferidos += sim->veiculosTransferidos;
+        total->aneisCheios += sim->aneisCheios;
+        total->esperas += sim->esperas;
+        total->tempoEsperaTotal += sim->tempoEsperaTotal;
+        total->ativos += sim->ativos;
+    }
+    sucesso = 1;
+
+fim:
+    if (!sucesso) printf("Erro ao alocar memoria para a simulacao paralela.\n");
+    if (regioes != NULL) {
+        for (int p = 0; p < numParticoes; p++) simulacaoLiberar(&regioes[p].sim);
+    }
+    if (paralelo.aneis != NULL) {
+        for (int i = 0; i < numParticoes * numParticoes; i++) free(paralelo.aneis[i]);
+    }
+    free(paralelo.aneis);
+    free(paralelo.particaoDe);
+    free(threads);
+    free(regioes);
+    return sucesso;
+}
+
+/**
+ * @brief Executa a simulação paralela com 1, 2, 4... até PARALELO_THREADS regiões e compara os tempos.
+ *
+ * Os resultados têm que ser os mesmos com qualquer quantidade de regiões;
+ * uma diferença em relação à execução com uma região é informada no fim.
+ */
+static void executarParalelo(void) {
+    Rede rede;
+    double tempoUmaRegiao = 0.0;
+    uint64_t semente = sementeExecucao();
+    Simulacao referencia = { 0 };
+    uint64_t aneisCheios = 0;
+    int divergentes = 0;
+
+    if (!redeCriar(&rede, semente)) return;
+
+    printf("Simulacao paralela: %d cruzamentos, %.1f h simuladas, janela de sincronizacao de %.1f s\n",
+        rede.numCruzamentos, SIM_DURACAO_S / 3600.0, calcularJanelaParalela(&rede) / 1000.0);
+    printf("%8s | %10s | %12s | %11s | %13s | %9s | %9s | %12s\n", "regioes", "tempo (s)", "eventos/s",
+        "aceleracao", "transferidos", "criados", "paradas", "espera media");
+
+    // Apenas a execução com mais regiões é registrada no log e nas métricas
+    int limite = (PARALELO_THREADS < rede.numCruzamentos) ? PARALELO_THREADS : rede.numCruzamentos;
+    logIniciar(&rede, MODO_PARALELO, semente);
+    logIniciarDrenagem();
+    const char* destinoMetricas = metricasDestino();
+    if (destinoMetricas != NULL && metricasIniciar(&rede, limite, destinoMetricas)) metricasIniciarRelator();
+
+    for (int regioes = 1; regioes <= limite; regioes *= 2) {
+        Simulacao total;
+        uint64_t inicio = relogioNs();
+        if (!simulacaoParalelaExecutar(&rede, regioes, (uint64_t)SIM_DURACAO_S * 1000, semente, regioes * 2 > limite,
+            &total)) break;
+        double segundos = (relogioNs() - inicio) / 1e9;
+        if (regioes == 1) {
+            tempoUmaRegiao = segundos;
+            referencia = total;
+        }
+        else if (total.veiculoCounter != referencia.veiculoCounter || total.veiculosSairam != referencia.veiculosSairam ||
+            total.esperas != referencia.esperas || total.tempoEsperaTotal != referencia.tempoEsperaTotal) {
+            divergentes++;
+        }
+        aneisCheios += total.aneisCheios;
+
+        printf("%8d | %10.3f | %12.0f | %10.2fx | %13llu | %9d | %9llu | %10.2f s\n",
+            regioes, segundos, segundos > 0 ? total.eventosProcessados / segundos : 0.0,
+            segundos > 0 ? tempoUmaRegiao / segundos : 0.0, (unsigned long long)total.veiculosTransferidos,
+            total.veiculoCounter, (unsigned long long)total.esperas,
+            total.esperas ? total.tempoEsperaTotal / 1000.0 / total.esperas : 0.0);
+    }
+    printf("Mensagens que esperaram um anel cheio (%d posicoes): %llu\n", PARALELO_CAPACIDADE_ANEL,
+        (unsigned long long)aneisCheios);
+    if (divergentes > 0) printf("Resultados diferentes dos de 1 regiao em %d execucoes.\n", divergentes);
+
+    metricasEncerrar();
+    logEncerrar();
+    redeLiberar(&rede);
+}
+
+#endif /* MODO_SIMULACAO == MODO_PARALELO */
+
+/*----------------- BENCHMARK DO SIMULADOR ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_BENCH_SIMULADOR )
+
+#define BENCH_SIMULADOR_AMOSTRAS 20000 // Amostras de latência da consulta ao semáforo por cenário
+#define BENCH_SIMULADOR_LOTE 64        // Consultas cronometradas juntas em cada amostra
+#define BENCH_SIMULADOR_REPETICOES 3   // Execuções com e sem métricas, alternadas, por cenário
+
+/**
+ * @brief Cenário do benchmark: uma grade e uma demanda, como fração da capacidade estimada da rede.
+ */
+typedef struct {
+    int linhas;               /**< Linhas da grade. */
+    int colunas;              /**< Colunas da grade. */
+    uint32_t duracaoS;        /**< Tempo simulado, em segundos. */
+    const char* demanda;      /**< Nome da demanda ("baixa", "media" ou "saturada"). */
+    double fracaoCapacidade;  /**< Veículos criados por segundo como fração de `capacidadeEstimada`. */
+} CenarioBench;
+
+/**
+ * @brief Estima quantos veículos por segundo a rede escoa com todos os semáforos saturados.
+ *
+ * Cada aproximação libera um veículo a cada INTERVALO_SATURACAO_MS durante o
+ * verde (metade do ciclo), e um veículo segue reto da entrada até a borda,
+ * atravessando em média (linhas + colunas + 2) / 4 cruzamentos.
+ */
+static double capacidadeEstimada(const Rede* rede) {
+    double porVerde = ceil(TEMPO_CICLO * 1000.0 / INTERVALO_SATURACAO_MS);
+    double porAproximacao = porVerde / (2.0 * TEMPO_CICLO);
+    double percurso = (rede->linhas + rede->colunas + 2) / 4.0;
+    return rede->numCruzamentos * NUM_DIRECOES * porAproximacao / percurso;
+}
+
+/**
+ * @brief Bytes alocados pela rede.
+ */
+static size_t redeBytes(const Rede* rede) {
+    return ((size_t)rede->numCruzamentos + 1) * sizeof(int) +
+        (size_t)rede->numCruzamentos * (sizeof(rede->nome[0]) + sizeof(PlanoSemaforico) + sizeof(DemandaEntrada)) +
+        (size_t)rede->capacidadeLinks * (2 * sizeof(int) + 2 * sizeof(uint8_t) + sizeof(uint32_t));
+}
+
+static int compararAmostras(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Mede a latência de `faseAberta` (o corpo de `verificarSemaforoAberto`) sobre o estado final da simulação.
+ *
+ * Cada amostra cronometra BENCH_SIMULADOR_LOTE consultas a cruzamentos e
+ * direções sorteados, já que uma consulta isolada é menor que a resolução do
+ * relógio. Retorna os percentis 50 e 99 do tempo por consulta, em ns.
+ */
+static int medirConsultaSemaforo(Simulacao* sim, GeradorAleatorio* gerador, double* p50, double* p99) {
+    uint64_t* amostras = (uint64_t*)malloc(BENCH_SIMULADOR_AMOSTRAS * sizeof(uint64_t));
+    int cruzamento[BENCH_SIMULADOR_LOTE];
+    int direcao[BENCH_SIMULADOR_LOTE];
+    volatile int abertos = 0;
+
+    if (amostras == NULL) return 0;
+
+    for (int a = 0; a < BENCH_SIMULADOR_AMOSTRAS; a++) {
+        for (int k = 0; k < BENCH_SIMULADOR_LOTE; k++) {
+            cruzamento[k] = geradorIntervalo(gerador, (uint32_t)sim->numCruzamentos);
+            direcao[k] = geradorIntervalo(gerador, NUM_DIRECOES) + 1;
+        }
+
+        int soma = 0;
+        uint64_t inicio = relogioNs();
+        for (int k = 0; k < BENCH_SIMULADOR_LOTE; k++) {
+            soma += faseAberta(&sim->fase[cruzamento[k]], direcao[k]);
+        }
+        amostras[a] = relogioNs() - inicio;
+        abertos += soma;
+    }
+
+    qsort(amostras, BENCH_SIMULADOR_AMOSTRAS, sizeof(uint64_t), compararAmostras);
+    *p50 = (double)amostras[BENCH_SIMULADOR_AMOSTRAS / 2] / BENCH_SIMULADOR_LOTE;
+    *p99 = (double)amostras[(size_t)BENCH_SIMULADOR_AMOSTRAS * 99 / 100] / BENCH_SIMULADOR_LOTE;
+    free(amostras);
+    return 1;
+}
+
+/**
+ * @brief Simula o cenário uma vez e retorna o tempo de relógio, em segundos (negativo sem memória).
+ *
+ * @param coletarMetricas 1 liga a coleta das métricas de tráfego, sem exportá-las.
+ */
+static double simularCenarioBench(Simulacao* sim, const Rede* rede, const CenarioBench* cenario, uint64_t semente,
+    double veiculosPorSegundo, int coletarMetricas) {
+    if (!simulacaoIniciar(sim, rede, semente)) return -1.0;
+    if (coletarMetricas) {
+        if (!metricasIniciar(rede, 1, NULL)) return -1.0;
+        sim->metricas = metricasFragmento(0);
+    }
+    sim->periodoGeracaoUs = (uint64_t)(1e6 / veiculosPorSegundo + 0.5);
+
+    uint64_t inicio = relogioNs();
+    simulacaoExecutar(sim, (uint64_t)cenario->duracaoS * 1000);
+    double segundos = (relogioNs() - inicio) / 1e9;
+
+    metricasLiberar();
+    sim->metricas = NULL;
+    return segundos;
+}
+
+/**
+ * @brief Executa um cenário sem log nem mensagens e imprime o seu objeto JSON.
+ *
+ * O cenário é simulado BENCH_SIMULADOR_REPETICOES vezes com as métricas de
+ * tráfego ligadas e outras tantas sem, alternadamente, e o custo da coleta
+ * compara os menores tempos de cada grupo, o que descarta a interferência
+ * de outros processos. Uma diferença negativa é ruído e sai como 0; o ruído
+ * é informado à parte, como a distância entre o maior e o menor tempo sem
+ * métricas, e um custo abaixo dele não se distingue de zero. Os demais
+ * números são da última execução, sem métricas.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int executarCenarioBench(const CenarioBench* cenario, uint64_t semente, int primeiro) {
+    static Simulacao sim;
+    Rede rede;
+    GeradorAleatorio gerador;
+    double p50 = 0.0, p99 = 0.0;
+
+    if (!redeCriarGrade(&rede, cenario->linhas, cenario->colunas)) {
+        fprintf(stderr, "Erro ao alocar memoria para a rede de cruzamentos.\n");
+        return 0;
+    }
+#if ( VIAGENS_OD == 1 )
+    if (!rotasCriar(&rede, NULL, NULL, 0)) {
+        fprintf(stderr, "Erro ao alocar memoria para a tabela de rotas.\n");
+        redeLiberar(&rede);
+        return 0;
+    }
+#endif
+
+    double veiculosPorSegundo = cenario->fracaoCapacidade * capacidadeEstimada(&rede);
+    fprintf(stderr, "Rede %dx%d, demanda %s (%.1f veiculos/s), %u s simulados...\n",
+        cenario->linhas, cenario->colunas, cenario->demanda, veiculosPorSegundo, cenario->duracaoS);
+
+    double segundos = -1.0, segundosMetricas = -1.0, maiorSegundos = 0.0;
+    for (int r = 0; r < BENCH_SIMULADOR_REPETICOES; r++) {
+        double comMetricas = simularCenarioBench(&sim, &rede, cenario, semente, veiculosPorSegundo, 1);
+        simulacaoLiberar(&sim);
+        double semMetricas = simularCenarioBench(&sim, &rede, cenario, semente, veiculosPorSegundo, 0);
+        if (comMetricas < 0 || semMetricas < 0) {
+            segundos = -1.0;
+            break;
+        }
+        if (r == 0 || comMetricas < segundosMetricas) segundosMetricas = comMetricas;
+        if (r == 0 || semMetricas < segundos) segundos = semMetricas;
+        if (semMetricas > maiorSegundos) maiorSegundos = semMetricas;
+        if (r + 1 < BENCH_SIMULADOR_REPETICOES) simulacaoLiberar(&sim);
+    }
+    if (segundos < 0) {
+        fprintf(stderr, "Erro ao alocar memoria para a simulacao.\n");
+        simulacaoLiberar(&sim);
+        redeLiberar(&rede);
+        return 0;
+    }
+
+    geradorIniciar(&gerador, semente, FLUXO_BENCH);
+    medirConsultaSemaforo(&sim, &gerador, &p50, &p99);
+
+    size_t heap = redeBytes(&rede) + simulacaoBytes(&sim);
+    double sobrecarga = (segundos > 0 && segundosMetricas > segundos) ? 100.0 * (segundosMetricas - segundos) / segundos : 0.0;
+    double ruido = (segundos > 0) ? 100.0 * (maiorSegundos - segundos) / segundos : 0.0;
+    printf("%s    {\"rede\": \"%dx%d\", \"demanda\": \"%s\", \"veiculos_por_s\": %.3f, \"segundos_simulados\": %u, "
+        "\"tempo_s\": %.6f, \"segundos_simulados_por_s\": %.1f, \"eventos\": %llu, \"eventos_por_s\": %.0f, "
+        "\"veiculos_criados\": %d, \"pico_veiculos\": %d, \"espera_media_s\": %.3f, "
+        "\"entradas_adiadas\": %llu, \"entradas_descartadas\": %llu, "
+        "\"verificar_semaforo_p50_ns\": %.2f, \"verificar_semaforo_p99_ns\": %.2f, "
+        "\"heap_pico_bytes\": %llu, \"bytes_por_veiculo\": %.1f, \"sobrecarga_metricas_pct\": %.2f, "
+        "\"ruido_tempo_pct\": %.2f}",
+        primeiro ? "" : ",\n", cenario->linhas, cenario->colunas, cenario->demanda, veiculosPorSegundo,
+        cenario->duracaoS, segundos, segundos > 0 ? cenario->duracaoS / segundos : 0.0,
+        (unsigned long long)sim.eventosProcessados, segundos > 0 ? sim.eventosProcessados / segundos : 0.0,
+        sim.veiculoCounter, sim.picoAtivos, sim.esperas ? sim.tempoEsperaTotal / 1000.0 / sim.esperas : 0.0,
+        (unsigned long long)sim.veiculosAdiados, (unsigned long long)sim.veiculosDescartados, p50, p99, (unsigned long long)heap, sim.picoAtivos ? (double)heap / sim.picoAtivos : 0.0,
+        sobrecarga, ruido);
+    fflush(stdout);
+
+    simulacaoLiberar(&sim);
+    redeLiberar(&rede);
+    return 1;
+}
+
+/**
+ * @brief Executa os cenários do benchmark e imprime os resultados em JSON na saída padrão.
+ *
+ * As mensagens de progresso vão para a saída de erro, de modo que a saída
+ * padrão pode ser gravada diretamente em um arquivo para comparar versões.
+ */
+static void executarBenchSimulador(void) {
+    static const struct { int lado; uint32_t duracaoS; } grades[] = {
+        { 2, 6 * 3600 }, { 10, 2 * 3600 }, { 100, 1800 }
+    };
+    static const struct { const char* nome; double fracao; } demandas[] = {
+        { "baixa", 0.1 }, { "media", 0.5 }, { "saturada", 1.0 }
+    };
+    uint64_t semente = sementeExecucao();
+    int primeiro = 1;
+
+    printf("{\n  \"benchmark\": \"simulador\",\n  \"versao\": 1,\n  \"semente\": %llu,\n  \"cenarios\": [\n",
+        (unsigned long long)semente);
+
+    for (size_t g = 0; g < sizeof(grades) / sizeof(grades[0]); g++) {
+        for (size_t d = 0; d < sizeof(demandas) / sizeof(demandas[0]); d++) {
+            CenarioBench cenario = { grades[g].lado, grades[g].lado, grades[g].duracaoS, demandas[d].nome, demandas[d].fracao };
+            if (executarCenarioBench(&cenario, semente, primeiro)) primeiro = 0;
+        }
+    }
+
+    printf("\n  ]\n}\n");
+}
+
+#endif /* MODO_SIMULACAO == MODO_BENCH_SIMULADOR */
+
+/*----------------- CONJUNTO DE REPLICAÇÕES (MONTE CARLO) ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_CONJUNTO )
+
+#ifndef CONJUNTO_REPLICACOES
+#define CONJUNTO_REPLICACOES 1000 // Replicações do conjunto (a variável de ambiente SIM_REPLICACOES tem precedência)
+#endif
+#define CONJUNTO_MAX_THREADS 256      // Maior quantidade de threads (SIM_THREADS; o padrão é um por processador)
+#define CONJUNTO_PROGRESSO_MS 1000    // Intervalo entre as mensagens de progresso
+#define CONJUNTO_Z_95 1.959964        // Quantil da normal para o intervalo de confiança de 95%
+
+#define ESBOCO_PRECISAO 0.01  // Erro relativo máximo dos quantis do esboço
+#define ESBOCO_BALDES 1024    // Faixas do esboço: cobrem até ESBOCO_GAMA^1023 ms (cerca de 200 h)
+#define ESBOCO_GAMA ((1.0 + ESBOCO_PRECISAO) / (1.0 - ESBOCO_PRECISAO))
+
+// Indicadores de cada replicação resumidos pelo conjunto
+#define INDICADOR_ESPERA_MEDIA 0 // Espera média por parada em sinal vermelho, em s
+#define INDICADOR_SAIDAS_HORA  1 // Veículos que deixaram a rede por hora simulada
+#define INDICADOR_PARADAS      2 // Paradas em sinal vermelho por veículo criado
+#define INDICADOR_PICO         3 // Maior número de veículos simultâneos na rede
+#define INDICADOR_DESCARTADOS  4 // Entradas descartadas pelo controle de admissão
+#define NUM_INDICADORES        5
+
+static const char* const nomesIndicadores[NUM_INDICADORES] = {
+    "espera media por parada (s)", "saidas da rede por hora", "paradas por veiculo", "pico de veiculos na rede",
+    "entradas descartadas"
+};
+
+/**
+ * @brief Esboço de quantis com erro relativo limitado, em faixas logarítmicas.
+ *
+ * A faixa i guarda os valores em (ESBOCO_GAMA^(i-1), ESBOCO_GAMA^i] ms, e o
+ * valor devolvido por um quantil fica a no máximo ESBOCO_PRECISAO do valor
+ * exato. O tamanho é fixo e dois esboços se combinam somando as faixas, então
+ * cada thread mantém o seu sem travas e sem guardar as amostras.
+ */
+typedef struct EsbocoQuantis {
+    uint64_t quantidade;             /**< Valores registrados. */
+    uint64_t zeros;                  /**< Valores iguais a zero. */
+    uint64_t maximo;                 /**< Maior valor registrado. */
+    uint64_t baldes[ESBOCO_BALDES];  /**< Valores positivos por faixa. */
+} EsbocoQuantis;
+
+/**
+ * @brief Média e variância acumuladas uma amostra por vez (algoritmo de Welford).
+ */
+typedef struct {
+    uint64_t n;    /**< Amostras acumuladas. */
+    double media;  /**< Média das amostras. */
+    double m2;     /**< Soma dos quadrados dos desvios em relação à média. */
+    double minimo; /**< Menor amostra. */
+    double maximo; /**< Maior amostra. */
+} EstatisticaCorrente;
+
+/**
+ * @brief Trabalhador do conjunto: uma thread com a sua própria simulação e os seus agregados.
+ *
+ * `faixa` guarda as replicações ainda não iniciadas, (início << 32) | fim, e
+ * é a única palavra escrita por outras threads: o dono retira do início e
+ * quem fica sem trabalho rouba a metade final. Ela ocupa uma linha de cache
+ * própria, e o restante só é escrito pelo dono.
+ */
+typedef struct {
+    volatile uint64_t faixa;                          /**< Replicações pendentes do trabalhador. */
+    char preenchimento[METRICAS_LINHA_CACHE - sizeof(uint64_t)];
+    struct ConjuntoReplicacoes* conjunto;             /**< Estado compartilhado do conjunto. */
+    int indice;                                       /**< Posição do trabalhador no conjunto. */
+    int falhou;                                       /**< 1 se faltou memória para uma replicação. */
+    ThreadNativa thread;                              /**< Thread do trabalhador. */
+    Simulacao sim;                                    /**< Simulação reaproveitada a cada replicação. */
+    uint64_t executadas;                              /**< Replicações executadas. */
+    uint64_t roubos;                                  /**< Vezes em que tomou trabalho de outro. */
+    uint64_t roubadas;                                /**< Replicações tomadas de outros trabalhadores. */
+    uint64_t eventos;                                 /**< Eventos processados nas replicações. */
+    EstatisticaCorrente indicadores[NUM_INDICADORES]; /**< Indicadores das replicações executadas. */
+    EsbocoQuantis esperas;                            /**< Esperas de todas as paradas das replicações executadas. */
+} TrabalhadorConjunto;
+
+/**
+ * @brief Estado compartilhado do conjunto, só lido pelos trabalhadores (exceto o progresso).
+ */
+typedef struct ConjuntoReplicacoes {
+    const Rede* rede;                   /**< Rede de todas as replicações, somente leitura. */
+    uint64_t semente;                   /**< A replicação r usa a semente `semente + r`. */
+    uint64_t duracaoMs;                 /**< Tempo simulado de cada replicação. */
+    uint32_t replicacoes;               /**< Total de replicações. */
+    int numTrabalhadores;               /**< Threads do conjunto. */
+    TrabalhadorConjunto* trabalhadores; /**< Um por thread. */
+    volatile uint32_t concluidas;       /**< Replicações terminadas (ou abandonadas por falta de memória). */
+} ConjuntoReplicacoes;
+
+#define FAIXA_CONJUNTO(inicio, fim) (((uint64_t)(inicio) << 32) | (uint32_t)(fim))
+
+static void esbocoRegistrar(struct EsbocoQuantis* esboco, uint64_t valor) {
+    esboco->quantidade++;
+    if (valor > esboco->maximo) esboco->maximo = valor;
+    if (valor == 0) {
+        esboco->zeros++;
+        return;
+    }
+    int i = (int)ceil(log((double)valor) / log(ESBOCO_GAMA));
+    esboco->baldes[i < ESBOCO_BALDES ? i : ESBOCO_BALDES - 1]++;
+}
+
+static void esbocoCombinar(EsbocoQuantis* destino, const EsbocoQuantis* origem) {
+    destino->quantidade += origem->quantidade;
+    destino->zeros += origem->zeros;
+    if (origem->maximo > destino->maximo) destino->maximo = origem->maximo;
+    for (int i = 0; i < ESBOCO_BALDES; i++) destino->baldes[i] += origem->baldes[i];
+}
+
+/**
+ * @brief Quantil `q` (entre 0 e 1) dos valores registrados, em ms.
+ */
+static double esbocoQuantil(const EsbocoQuantis* esboco, double q) {
+    if (esboco->quantidade == 0) return 0.0;
+
+    uint64_t posicao = (uint64_t)(q * (double)(esboco->quantidade - 1));
+    uint64_t acumulado = esboco->zeros;
+    if (posicao < acumulado) return 0.0;
+    for (int i = 0; i < ESBOCO_BALDES; i++) {
+        acumulado += esboco->baldes[i];
+        // O centro da faixa, em escala relativa, erra no máximo ESBOCO_PRECISAO
+        if (posicao < acumulado) return fmin(2.0 * pow(ESBOCO_GAMA, i) / (ESBOCO_GAMA + 1.0), (double)esboco->maximo);
+    }
+    return (double)esboco->maximo;
+}
+
+static void estatisticaRegistrar(EstatisticaCorrente* e, double x) {
+    e->n++;
+    double desvio = x - e->media;
+    e->media += desvio / (double)e->n;
+    e->m2 += desvio * (x - e->media);
+    if (e->n == 1 || x < e->minimo) e->minimo = x;
+    if (e->n == 1 || x > e->maximo) e->maximo = x;
+}
+
+/**
+ * @brief Junta as amostras de `origem` a `destino` (fórmula de Chan para as variâncias).
+ */
+static void estatisticaCombinar(EstatisticaCorrente* destino, const EstatisticaCorrente* origem) {
+    if (origem->n == 0) return;
+    if (destino->n == 0) {
+        *destino = *origem;
+        return;
+    }
+    double n = (double)(destino->n + origem->n);
+    double delta = origem->media - destino->media;
+    destino->m2 += origem->m2 + delta * delta * (double)destino->n * (double)origem->n / n;
+    destino->media += delta * (double)origem->n / n;
+    destino->n += origem->n;
+    if (origem->minimo < destino->minimo) destino->minimo = origem->minimo;
+    if (origem->maximo > destino->maximo) destino->maximo = origem->maximo;
+}
+
+static inline double estatisticaDesvio(const EstatisticaCorrente* e) {
+    return (e->n > 1) ? sqrt(e->m2 / (double)(e->n - 1)) : 0.0;
+}
+
+/**
+ * @brief Meia largura do intervalo de confiança de 95% da média (aproximação normal).
+ */
+static inline double estatisticaIntervalo(const EstatisticaCorrente* e) {
+    return (e->n > 1) ? CONJUNTO_Z_95 * estatisticaDesvio(e) / sqrt((double)e->n) : 0.0;
+}
+
+/**
+ * @brief Retira a próxima replicação da própria faixa.
+ *
+ * @return Retorna 1 com a replicação em `replicacao`, 0 se a faixa estiver vazia.
+ */
+static int conjuntoRetirar(TrabalhadorConjunto* t, uint32_t* replicacao) {
+    for (;;) {
+        uint64_t faixa = atomicoLerRelaxado64(&t->faixa);
+        uint32_t inicio = (uint32_t)(faixa >> 32), fim = (uint32_t)faixa;
+        if (inicio >= fim) return 0;
+        if (atomicoTrocarSeIgual64(&t->faixa, faixa, FAIXA_CONJUNTO(inicio + 1, fim))) {
+            *replicacao = inicio;
+            return 1;
+        }
+    }
+}
+
+/**
+ * @brief Toma a metade final da faixa do primeiro trabalhador com replicações pendentes.
+ *
+ * As vítimas são percorridas a partir da vizinha, para que os ladrões não
+ * disputem sempre a mesma faixa. A faixa do ladrão está vazia, então
+ * ninguém mais a altera até ela receber o trabalho roubado.
+ *
+ * @return Retorna 1 se a faixa do ladrão recebeu trabalho, 0 se não há mais nada a roubar.
+ */
+static int conjuntoRoubar(ConjuntoReplicacoes* conjunto, TrabalhadorConjunto* ladrao) {
+    for (int k = 1; k < conjunto->numTrabalhadores; k++) {
+        TrabalhadorConjunto* vitima = &conjunto->trabalhadores[(ladrao->indice + k) % conjunto->numTrabalhadores];
+        uint64_t faixa = atomicoLerRelaxado64(&vitima->faixa);
+        uint32_t inicio = (uint32_t)(faixa >> 32), fim = (uint32_t)faixa;
+        if (inicio >= fim) continue;
+
+        uint32_t metade = (fim - inicio + 1) / 2;
+        if (!atomicoTrocarSeIgual64(&vitima->faixa, faixa, FAIXA_CONJUNTO(inicio, fim - metade))) {
+            k--; // A vítima ou outro ladrão mexeu na faixa: tenta de novo
+            continue;
+        }
+        atomicoEscrever64(&ladrao->faixa, FAIXA_CONJUNTO(fim - metade, fim));
+        ladrao->roubos++;
+        ladrao->roubadas += metade;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Executa uma replicação e acumula os seus indicadores nos agregados do trabalhador.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int conjuntoReplicar(TrabalhadorConjunto* t, uint32_t replicacao) {
+    const ConjuntoReplicacoes* conjunto = t->conjunto;
+    Simulacao* sim = &t->sim;
+
+    if (!simulacaoIniciar(sim, conjunto->rede, conjunto->semente + replicacao)) {
+        simulacaoLiberar(sim);
+        return 0;
+    }
+    sim->esboco = &t->esperas;
+    simulacaoExecutar(sim, conjunto->duracaoMs);
+
+    double valores[NUM_INDICADORES];
+    valores[INDICADOR_ESPERA_MEDIA] = sim->esperas ? sim->tempoEsperaTotal / 1000.0 / sim->esperas : 0.0;
+    valores[INDICADOR_SAIDAS_HORA] = sim->veiculosSairam * 3600000.0 / conjunto->duracaoMs;
+    valores[INDICADOR_PARADAS] = sim->veiculoCounter ? (double)sim->esperas / sim->veiculoCounter : 0.0;
+    valores[INDICADOR_PICO] = sim->picoAtivos;
+    valores[INDICADOR_DESCARTADOS] = (double)sim->veiculosDescartados;
+    for (int i = 0; i < NUM_INDICADORES; i++) estatisticaRegistrar(&t->indicadores[i], valores[i]);
+
+    t->eventos += sim->eventosProcessados;
+    t->executadas++;
+    simulacaoLiberar(sim);
+    return 1;
+}
+
+/**
+ * @brief Corpo de um trabalhador: esvazia a própria faixa e depois rouba das outras.
+ */
+static void prvTrabalharConjunto(void* pvParametro) {
+    TrabalhadorConjunto* t = (TrabalhadorConjunto*)pvParametro;
+    ConjuntoReplicacoes* conjunto = t->conjunto;
+    uint32_t replicacao;
+
+    do {
+        while (conjuntoRetirar(t, &replicacao)) {
+            if (!t->falhou && !conjuntoReplicar(t, replicacao)) {
+                printf("Erro ao alocar memoria para a replicacao %u.\n", replicacao);
+                t->falhou = 1;
+            }
+            atomicoSomar32(&conjunto->concluidas, 1);
+        }
+    } while (conjuntoRoubar(conjunto, t));
+}
+
+/**
+ * @brief Quantidade de replicações e de threads: SIM_REPLICACOES e SIM_THREADS ou os padrões.
+ */
+static void conjuntoParametros(uint32_t* replicacoes, int* threads) {
+    const char* variavel = getenv("SIM_REPLICACOES");
+    *replicacoes = CONJUNTO_REPLICACOES;
+    if (variavel != NULL && strtoul(variavel, NULL, 10) > 0) *replicacoes = (uint32_t)strtoul(variavel, NULL, 10);
+
+    variavel = getenv("SIM_THREADS");
+    *threads = (variavel != NULL && atoi(variavel) > 0) ? atoi(variavel) : processadoresDisponiveis();
+    if (*threads > CONJUNTO_MAX_THREADS) *threads = CONJUNTO_MAX_THREADS;
+    if ((uint32_t)*threads > *replicacoes) *threads = (int)*replicacoes;
+}
+
+/**
+ * @brief Executa o conjunto de replicações e imprime as estatísticas agregadas.
+ *
+ * Cada thread recebe uma faixa contígua de replicações e simula uma de cada
+ * vez na sua própria instância, sobre a mesma rede somente leitura. Os
+ * indicadores de cada replicação entram em médias e variâncias correntes, e
+ * as esperas de cada parada no esboço de quantis da thread, de modo que a
+ * memória não cresce com o número de replicações. No fim os agregados das
+ * threads são combinados. Como a semente de cada replicação depende só do
+ * seu número, o resultado não depende de qual thread a executou.
+ */
+static void executarConjunto(void) {
+    static ConjuntoReplicacoes conjunto;
+    Rede rede;
+    uint32_t replicacoes;
+    int threads;
+
+    conjuntoParametros(&replicacoes, &threads);
+    conjunto.semente = sementeExecucao();
+    if (!redeCriar(&rede, conjunto.semente)) return;
+
+    conjunto.rede = &rede;
+    conjunto.duracaoMs = (uint64_t)SIM_DURACAO_S * 1000;
+    conjunto.replicacoes = replicacoes;
+    conjunto.numTrabalhadores = threads;
+    conjunto.trabalhadores = (TrabalhadorConjunto*)calloc((size_t)threads, sizeof(TrabalhadorConjunto));
+    if (conjunto.trabalhadores == NULL) {
+        printf("Erro ao alocar memoria para os trabalhadores do conjunto.\n");
+        redeLiberar(&rede);
+        return;
+    }
+
+    printf("Conjunto de %u replicacoes de %.1f h, %d threads (sementes %llu a %llu)\n", replicacoes,
+        SIM_DURACAO_S / 3600.0, threads, (unsigned long long)conjunto.semente,
+        (unsigned long long)(conjunto.semente + replicacoes - 1));
+
+    // Faixas iniciais contíguas e do mesmo tamanho; o roubo corrige o desequilíbrio
+    for (int k = 0; k < threads; k++) {
+        TrabalhadorConjunto* t = &conjunto.trabalhadores[k];
+        t->conjunto = &conjunto;
+        t->indice = k;
+        t->faixa = FAIXA_CONJUNTO((uint64_t)replicacoes * k / threads, (uint64_t)replicacoes * (k + 1) / threads);
+    }
+
+    uint64_t inicio = relogioNs();
+    int criadas = 0;
+    for (; criadas < threads; criadas++) {
+        if (!threadCriar(&conjunto.trabalhadores[criadas].thread, prvTrabalharConjunto, &conjunto.trabalhadores[criadas])) {
+            // As faixas das threads que faltaram são roubadas pelas demais
+            printf("Erro ao criar a thread %d do conjunto.\n", criadas);
+            break;
+        }
+    }
+    if (criadas == 0) prvTrabalharConjunto(&conjunto.trabalhadores[0]);
+
+    while (criadas > 0 && atomicoLer32(&conjunto.concluidas) < replicacoes) {
+        threadDormirMs(CONJUNTO_PROGRESSO_MS);
+        fprintf(stderr, "  %u de %u replicacoes concluidas\n", atomicoLer32(&conjunto.concluidas), replicacoes);
+    }
+    for (int k = 0; k < criadas; k++) threadAguardar(conjunto.trabalhadores[k].thread);
+    double segundos = (relogioNs() - inicio) / 1e9;
+
+    // Combina os agregados das threads
+    EstatisticaCorrente indicadores[NUM_INDICADORES] = { { 0 } };
+    EsbocoQuantis* esperas = (EsbocoQuantis*)calloc(1, sizeof(EsbocoQuantis));
+    uint64_t executadas = 0, eventos = 0, roubos = 0, roubadas = 0, menor = UINT64_MAX, maior = 0;
+    if (esperas == NULL) {
+        printf("Erro ao alocar memoria para o esboco do conjunto.\n");
+        free(conjunto.trabalhadores);
+        redeLiberar(&rede);
+        return;
+    }
+    for (int k = 0; k < threads; k++) {
+        const TrabalhadorConjunto* t = &conjunto.trabalhadores[k];
+        for (int i = 0; i < NUM_INDICADORES; i++) estatisticaCombinar(&indicadores[i], &t->indicadores[i]);
+        esbocoCombinar(esperas, &t->esperas);
+        executadas += t->executadas;
+        eventos += t->eventos;
+        roubos += t->roubos;
+        roubadas += t->roubadas;
+        if (t->executadas < menor) menor = t->executadas;
+        if (t->executadas > maior) maior = t->executadas;
+    }
+
+    printf("  Tempo: %.3f s, %.1f replicacoes/s, %.0f eventos/s\n", segundos, segundos > 0 ? executadas / segundos : 0.0,
+        segundos > 0 ? eventos / segundos : 0.0);
+    printf("  Replicacoes executadas: %llu (por thread: %llu a %llu), roubos de trabalho: %llu (%llu replicacoes)\n",
+        (unsigned long long)executadas, (unsigned long long)menor, (unsigned long long)maior,
+        (unsigned long long)roubos, (unsigned long long)roubadas);
+    printf("  %-28s | %12s | %10s | %12s | %12s | %12s\n", "indicador por replicacao", "media", "IC 95% +-",
+        "desvio", "minimo", "maximo");
+    for (int i = 0; i < NUM_INDICADORES; i++) {
+        const EstatisticaCorrente* e = &indicadores[i];
+        printf("  %-28s | %12.4f | %10.4f | %12.4f | %12.4f | %12.4f\n", nomesIndicadores[i], e->media,
+            estatisticaIntervalo(e), estatisticaDesvio(e), e->minimo, e->maximo);
+    }
+    printf("  Espera por parada, todas as replicacoes (%llu paradas, erro de %.0f%%): p50 %.2f s, p90 %.2f s, "
+        "p99 %.2f s, p99.9 %.2f s, maxima %.2f s\n", (unsigned long long)esperas->quantidade, ESBOCO_PRECISAO * 100,
+        esbocoQuantil(esperas, 0.5) / 1000.0, esbocoQuantil(esperas, 0.9) / 1000.0, esbocoQuantil(esperas, 0.99) / 1000.0,
+        esbocoQuantil(esperas, 0.999) / 1000.0, esperas->maximo / 1000.0);
+
+    free(esperas);
+    free(conjunto.trabalhadores);
+    redeLiberar(&rede);
+}
+
+#endif /* MODO_SIMULACAO == MODO_CONJUNTO */
+
+/*----------------- MOTOR MESOSCÓPICO ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_MESOSCOPICO )
+
+#ifndef MESO_PASSO_MS
+#define MESO_PASSO_MS 30000 // Passo de tempo do motor mesoscópico (menor que o percurso de uma via)
+#endif
+#define MESO_FAIXAS 4       // Faixas de velocidade dos pelotões
+#define MESO_VELOCIDADES 31 // Velocidades sorteadas para um veículo: a base da direção mais 0 a 30 km/h
+
+/**
+ * @brief Pelotão: veículos da mesma faixa de velocidade que entraram juntos em uma via.
+ *
+ * O modelo é de fluxo, então a quantidade pode ser fracionária.
+ */
+typedef struct {
+    float quantidade;  /**< Veículos do pelotão. */
+    float esperaMs;    /**< Espera média pelo verde no destino, calculada na saída (ver `mesoEsperaPelotaoMs`). */
+    uint64_t chegada;  /**< Instante em que o pelotão chega à faixa de retenção do destino, em ms. */
+} Pelotao;
+
+/**
+ * @brief Fila circular dos pelotões de uma faixa de velocidade em uma via.
+ *
+ * Todos os pelotões da faixa levam o mesmo tempo para percorrer a via e cada
+ * passo cria no máximo um, que sai até um ciclo depois do fim do passo, então
+ * eles chegam na ordem em que entraram e a fila não passa de
+ * (percurso + ciclo) / passo + 2 pelotões; por segurança, com a fila cheia
+ * o pelotão se junta ao último.
+ */
+typedef struct {
+    uint32_t base;         /**< Primeira posição da fila no vetor `pelotoes`. */
+    uint32_t capacidade;   /**< Pelotões que cabem na fila. */
+    uint32_t inicio;       /**< Pelotão mais próximo do destino. */
+    uint32_t quantidade;   /**< Pelotões na via. */
+    uint32_t percursoMs;   /**< Tempo médio de percurso da via na faixa. */
+    uint32_t saidaNoCiclo; /**< Posição no ciclo do destino da última saída calculada (UINT32_MAX: nenhuma). */
+    float esperaMs;        /**< Espera pelo verde calculada para `saidaNoCiclo`. */
+} FilaPelotoes;
+
+/**
+ * @brief Aproximação (cruzamento e direção) no motor mesoscópico: uma fila vertical por faixa.
+ */
+typedef struct {
+    double fila[MESO_FAIXAS];     /**< Veículos parados na faixa de retenção, por faixa de velocidade. */
+    double chegadas[MESO_FAIXAS]; /**< Veículos que chegaram no passo atual, por faixa de velocidade. */
+    double daVia;                 /**< Parte da fila que chegou pela via e ainda a ocupa. */
+    double geradas;               /**< Parte das chegadas do passo que entrou na rede pela aproximação. */
+    double instanteChegadas;      /**< Soma de quantidade x instante de chegada dos pelotões do passo, em ms. */
+    double capacidade;            /**< Veículos que os verdes iniciados no passo conseguem liberar. */
+    double travessias;            /**< Veículos que atravessaram desde o início. */
+    double atrasoMs;              /**< Soma dos atrasos dos veículos, em veículos x ms. */
+    uint32_t verdeMs;             /**< Verde da aproximação no plano do cruzamento. */
+    uint32_t vermelhoMs;          /**< Vermelho da aproximação (o verde da outra fase). */
+    int viaChegada;               /**< Via que chega à aproximação (-1 se nenhuma). */
+} AproximacaoMeso;
+
+/**
+ * @brief Estado completo de uma execução do motor mesoscópico.
+ *
+ * Não há registro por veículo: o custo de um passo depende só da quantidade
+ * de cruzamentos, vias e trocas de fase, e não da demanda.
+ */
+typedef struct {
+    const Rede* rede;               /**< Rede viária simulada. */
+    uint64_t agora;                 /**< Início do passo atual, em ms. */
+    uint32_t* fase;                 /**< Palavra de fase de cada cruzamento (ver FASE_ABERTO). */
+    uint64_t* proximaTroca;         /**< Próxima troca de fase de cada cruzamento, em ms. */
+    AproximacaoMeso* aproximacoes;  /**< Indexadas por cruzamento * NUM_DIRECOES + direção - 1. */
+    FilaPelotoes* filas;            /**< Indexadas por via * MESO_FAIXAS + faixa. */
+    Pelotao* pelotoes;              /**< Posições das filas de todas as vias, em um único bloco. */
+    uint32_t numPelotoes;           /**< Total de posições em `pelotoes`. */
+    double* ocupacao;               /**< Veículos em cada via, andando ou parados na aproximação do destino. */
+    uint64_t passos;                /**< Passos executados. */
+    uint64_t pelotoesCriados;       /**< Pelotões que entraram em alguma via. */
+    double* adiados;                /**< Veículos esperando para entrar por cada cruzamento (controle de admissão). */
+    double criados;                 /**< Veículos que entraram na rede. */
+    double veiculosAdiados;         /**< Entradas adiadas pelo controle de admissão. */
+    double veiculosDescartados;     /**< Entradas descartadas pelo controle de admissão. */
+    double sairam;                  /**< Veículos que deixaram a rede. */
+    double picoAtivos;              /**< Maior número de veículos simultâneos na rede. */
+} SimulacaoMeso;
+
+/**
+ * @brief Fração dos veículos que sorteiam uma velocidade da faixa `faixa`.
+ */
+static inline double mesoFracaoFaixa(int faixa) {
+    int inicio = faixa * MESO_VELOCIDADES / MESO_FAIXAS;
+    int fim = (faixa + 1) * MESO_VELOCIDADES / MESO_FAIXAS;
+    return (double)(fim - inicio) / MESO_VELOCIDADES;
+}
+
+/**
+ * @brief Velocidade base dos veículos da direção, como em `criarVeiculo`.
+ */
+static inline int mesoVelocidadeBase(int direcao) {
+    return (direcao > 2) ? 20 : 30;
+}
+
+/**
+ * @brief Tempo médio de percurso da via `link` para as velocidades da faixa, em ms.
+ */
+static uint32_t mesoPercursoMs(const Rede* rede, int link, int faixa) {
+    int inicio = faixa * MESO_VELOCIDADES / MESO_FAIXAS;
+    int fim = (faixa + 1) * MESO_VELOCIDADES / MESO_FAIXAS;
+    int base = mesoVelocidadeBase(rede->linkDirecao[link]);
+    uint64_t soma = 0;
+
+    for (int v = inicio; v < fim; v++) soma += (uint64_t)redeTempoPercurso(rede, link, base + v) * 1000;
+    return (uint32_t)(soma / (uint64_t)(fim - inicio));
+}
+
+/**
+ * @brief Libera a memória alocada pelo motor mesoscópico.
+ */
+static void mesoLiberar(SimulacaoMeso* sim) {
+    free(sim->fase);
+    free(sim->proximaTroca);
+    free(sim->aproximacoes);
+    free(sim->filas);
+    free(sim->pelotoes);
+    free(sim->ocupacao);
+    free(sim->adiados);
+    *sim = (SimulacaoMeso){ 0 };
+}
+
+/**
+ * @brief Bytes alocados pelo motor mesoscópico (fixos desde a inicialização).
+ */
+static size_t mesoBytes(const SimulacaoMeso* sim) {
+    size_t n = (size_t)sim->rede->numCruzamentos;
+    size_t links = (size_t)sim->rede->numLinks;
+    return n * (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(double) + NUM_DIRECOES * sizeof(AproximacaoMeso)) +
+        links * (MESO_FAIXAS * sizeof(FilaPelotoes) + sizeof(double)) + (size_t)sim->numPelotoes * sizeof(Pelotao);
+}
+
+/**
+ * @brief Inicializa o motor mesoscópico sobre `rede`, com os semáforos como em `simulacaoIniciarRegiao`.
+ *
+ * As filas de pelotões de todas as vias recebem as suas posições aqui, em um
+ * único vetor, e nada mais é alocado durante a execução.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int mesoIniciar(SimulacaoMeso* sim, const Rede* rede) {
+    int n = rede->numCruzamentos;
+
+    *sim = (SimulacaoMeso){ 0 };
+    sim->rede = rede;
+    sim->fase = (uint32_t*)malloc((size_t)n * sizeof(uint32_t));
+    sim->proximaTroca = (uint64_t*)malloc((size_t)n * sizeof(uint64_t));
+    sim->aproximacoes = (AproximacaoMeso*)calloc((size_t)n * NUM_DIRECOES, sizeof(AproximacaoMeso));
+    sim->filas = (FilaPelotoes*)malloc((size_t)(rede->numLinks ? rede->numLinks : 1) * MESO_FAIXAS * sizeof(FilaPelotoes));
+    sim->ocupacao = (double*)calloc((size_t)(rede->numLinks ? rede->numLinks : 1), sizeof(double));
+    sim->adiados = (double*)calloc((size_t)n, sizeof(double));
+    if (sim->fase == NULL || sim->proximaTroca == NULL || sim->aproximacoes == NULL || sim->filas == NULL ||
+        sim->ocupacao == NULL || sim->adiados == NULL) {
+        printf("Erro ao alocar memoria para o motor mesoscopico.\n");
+        return 0;
+    }
+
+    for (int c = 0; c < n; c++) {
+        sim->fase[c] = faseInicial(c, 0);
+        sim->proximaTroca[c] = rede->plano[c].defasagemMs;
+        for (int d = 0; d < NUM_DIRECOES; d++) {
+            AproximacaoMeso* a = &sim->aproximacoes[c * NUM_DIRECOES + d];
+            uint32_t propria = (FASE_ABERTO(d + 1) & FASE_VERTICAL) ? FASE_VERTICAL : FASE_HORIZONTAL;
+            a->verdeMs = redeVerdeMs(rede, c, propria);
+            a->vermelhoMs = redeVerdeMs(rede, c, propria ^ FASE_DIRECOES);
+            a->viaChegada = -1;
+        }
+    }
+
+    for (int link = 0; link < rede->numLinks; link++) {
+        sim->aproximacoes[rede->linkDestino[link] * NUM_DIRECOES + rede->linkDirecao[link] - 1].viaChegada = link;
+        for (int f = 0; f < MESO_FAIXAS; f++) {
+            uint32_t percurso = mesoPercursoMs(rede, link, f);
+            const PlanoSemaforico* plano = &rede->plano[rede->linkOrigem[link]];
+            uint32_t capacidade = (percurso + plano->verdeMs[0] + plano->verdeMs[1]) / MESO_PASSO_MS + 2;
+            sim->filas[link * MESO_FAIXAS + f] = (FilaPelotoes){ sim->numPelotoes, capacidade, 0, 0, percurso, UINT32_MAX, 0.0f };
+            sim->numPelotoes += capacidade;
+        }
+    }
+    sim->pelotoes = (Pelotao*)malloc((size_t)(sim->numPelotoes ? sim->numPelotoes : 1) * sizeof(Pelotao));
+    if (sim->pelotoes == NULL) {
+        printf("Erro ao alocar memoria para os pelotoes do motor mesoscopico.\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Veículos que entram pelo cruzamento `c` por ms no instante `agora`.
+ *
+ * Sem demanda própria a geração única da rede (um veículo a cada
+ * SIM_PERIODO_GERACAO_US, em média) é dividida igualmente entre os cruzamentos.
+ */
+static double mesoTaxaEntrada(const Rede* rede, int c, uint64_t agora, int porEntrada) {
+    if (!porEntrada) return 1000.0 / SIM_PERIODO_GERACAO_US / rede->numCruzamentos;
+
+    const DemandaEntrada* demanda = &rede->demanda[c];
+    double fator = (demanda->perfil == PERFIL_HORARIO) ? perfilHorario[(agora / 3600000) % 24] / 100.0 : 1.0;
+    return demanda->veiculosPorHora * fator / 3600000.0;
+}
+
+/**
+ * @brief Espera pelo verde de quem chega à aproximação (`c`, `direcao`) no instante `chegada`, em ms.
+ *
+ * O plano é periódico depois da primeira troca: a fase seguinte à inicial
+ * abre em `defasagemMs` e as duas se alternam com o ciclo do plano. Antes da
+ * primeira troca nenhuma aproximação descarrega, como em `tratarFase`.
+ */
+static uint64_t mesoEsperaVerdeMs(const Rede* rede, int c, int direcao, uint64_t chegada) {
+    uint32_t primeira = faseAlternar(faseInicial(c, 0)) & FASE_DIRECOES;
+    uint64_t verdePrimeira = redeVerdeMs(rede, c, primeira);
+    uint64_t ciclo = verdePrimeira + redeVerdeMs(rede, c, primeira ^ FASE_DIRECOES);
+    uint64_t abre = (primeira & FASE_ABERTO(direcao)) ? 0 : verdePrimeira; // Início do verde no ciclo
+    uint64_t defasagem = rede->plano[c].defasagemMs;
+
+    if (chegada < defasagem) return defasagem + abre - chegada;
+    if (ciclo == 0) return 0;
+
+    uint64_t u = (chegada - defasagem) % ciclo;
+    if (abre == 0) return (u < verdePrimeira) ? 0 : ciclo - u;
+    return (u >= abre) ? 0 : abre - u;
+}
+
+/**
+ * @brief Espera média pelo verde de um pelotão que sai no instante `saida` pela faixa `faixa` da via `link`.
+ *
+ * Os veículos de um verde a montante saem separados pelo intervalo de
+ * saturação, e cada velocidade da faixa leva um tempo de percurso próprio,
+ * então a média percorre as saídas e as velocidades em vez de usar o
+ * percurso médio: assim a chegada cai no verde ou no vermelho do destino
+ * conforme a defasagem entre os dois cruzamentos.
+ */
+static double mesoEsperaPelotaoMs(const Rede* rede, int link, int faixa, uint64_t saida) {
+    int inicio = faixa * MESO_VELOCIDADES / MESO_FAIXAS;
+    int fim = (faixa + 1) * MESO_VELOCIDADES / MESO_FAIXAS;
+    int base = mesoVelocidadeBase(rede->linkDirecao[link]);
+    int origem = rede->linkOrigem[link];
+    uint32_t verde = redeVerdeMs(rede, origem, (FASE_ABERTO(rede->linkDirecao[link]) & FASE_VERTICAL) ? FASE_VERTICAL : FASE_HORIZONTAL);
+    int saidas = (int)ceil((double)verde / INTERVALO_SATURACAO_MS);
+    uint64_t soma = 0;
+
+    if (saidas < 1) saidas = 1;
+    for (int v = inicio; v < fim; v++) {
+        uint64_t chegada = saida + (uint64_t)redeTempoPercurso(rede, link, base + v) * 1000;
+        for (int k = 0; k < saidas; k++) {
+            soma += mesoEsperaVerdeMs(rede, rede->linkDestino[link], rede->linkDirecao[link],
+                chegada + (uint64_t)k * INTERVALO_SATURACAO_MS);
+        }
+    }
+    return (double)soma / ((fim - inicio) * saidas);
+}
+
+/**
+ * @brief Atrasos de sinal de uma aproximação no passo, em ms.
+ *
+ * O atraso uniforme de Webster, r² / (2C(1 - y)), vale para chegadas
+ * espalhadas no ciclo (os veículos que entram na rede pela aproximação). O
+ * incremental do HCM, T/2 [(x - 1) + sqrt((x - 1)² + 4x / (cT))] com T igual
+ * ao passo, vale para todas e cobre a variação das chegadas dentro do passo;
+ * com a capacidade de ceil(verde / INTERVALO_SATURACAO_MS) veículos por verde.
+ * O grau de saturação `x` é limitado a 1: acima disso quem responde pelo
+ * atraso é a fila residual.
+ *
+ * @param chegadasPorMs Taxa de chegada no passo.
+ * @param uniforme Recebe o atraso uniforme.
+ * @return O atraso incremental.
+ */
+static double mesoAtrasoSinalMs(const AproximacaoMeso* a, double chegadasPorMs, double* uniforme) {
+    double ciclo = (double)a->verdeMs + a->vermelhoMs;
+    *uniforme = 0.0;
+    if (ciclo <= 0 || chegadasPorMs <= 0 || a->verdeMs == 0) return 0.0;
+
+    double capacidadePorMs = ceil((double)a->verdeMs / INTERVALO_SATURACAO_MS) / ciclo;
+    double x = chegadasPorMs / capacidadePorMs;
+    if (x > 1.0) x = 1.0;
+    double y = x * capacidadePorMs * INTERVALO_SATURACAO_MS;
+
+    *uniforme = (double)a->vermelhoMs * a->vermelhoMs / (2.0 * ciclo * (1.0 - y));
+    return MESO_PASSO_MS / 2.0 * ((x - 1.0) + sqrt((x - 1.0) * (x - 1.0) + 4.0 * x / (capacidadePorMs * MESO_PASSO_MS)));
+}
+
+/**
+ * @brief Coloca um pelotão no fim da fila da faixa `faixa` da via `link`, saindo no instante `saida`.
+ *
+ * A espera pelo verde no destino só depende da posição da saída no ciclo do
+ * destino, que se repete a cada passo com planos de mesmo ciclo; por isso a
+ * fila guarda a última calculada.
+ */
+static void mesoEntrarNaVia(SimulacaoMeso* sim, int link, int faixa, double quantidade, uint64_t saida) {
+    const Rede* rede = sim->rede;
+    FilaPelotoes* fila = &sim->filas[link * MESO_FAIXAS + faixa];
+    uint32_t fim = fila->inicio + fila->quantidade;
+    int destino = rede->linkDestino[link];
+    uint64_t ciclo = (uint64_t)rede->plano[destino].verdeMs[0] + rede->plano[destino].verdeMs[1];
+
+    if (saida < rede->plano[destino].defasagemMs || ciclo == 0) {
+        fila->saidaNoCiclo = UINT32_MAX;
+        fila->esperaMs = (float)mesoEsperaPelotaoMs(rede, link, faixa, saida);
+    }
+    else if ((saida - rede->plano[destino].defasagemMs) % ciclo != fila->saidaNoCiclo) {
+        fila->saidaNoCiclo = (uint32_t)((saida - rede->plano[destino].defasagemMs) % ciclo);
+        fila->esperaMs = (float)mesoEsperaPelotaoMs(rede, link, faixa, saida);
+    }
+
+    if (fila->quantidade == fila->capacidade) {
+        Pelotao* ultimo = &sim->pelotoes[fila->base + (fim - 1) % fila->capacidade];
+        ultimo->esperaMs = (float)((ultimo->quantidade * ultimo->esperaMs + quantidade * fila->esperaMs) /
+            (ultimo->quantidade + quantidade));
+        ultimo->quantidade += (float)quantidade;
+    }
+    else {
+        sim->pelotoes[fila->base + (fim >= fila->capacidade ? fim - fila->capacidade : fim)] =
+            (Pelotao){ (float)quantidade, fila->esperaMs, saida + fila->percursoMs };
+        fila->quantidade++;
+    }
+    sim->ocupacao[link] += quantidade;
+    sim->pelotoesCriados++;
+}
+
+/**
+ * @brief Descarrega a aproximação (`c`, `direcao`) no fim do passo.
+ *
+ * Os liberados saem de todas as faixas de velocidade na proporção da fila e
+ * entram na via à frente como um pelotão por faixa. O pelotão sai no primeiro
+ * verde depois da chegada média dos liberados (a fila anterior conta como
+ * chegada no início do passo), o que preserva a posição da saída no ciclo e
+ * não adianta a viagem; sem via à frente eles deixam a rede.
+ */
+static void mesoDescarregar(SimulacaoMeso* sim, int c, int direcao, uint64_t inicio) {
+    AproximacaoMeso* a = &sim->aproximacoes[c * NUM_DIRECOES + direcao - 1];
+    int link = redeLinkNaDirecao(sim->rede, c, direcao);
+    double filaInicial = 0.0, chegadas = 0.0;
+
+    for (int f = 0; f < MESO_FAIXAS; f++) {
+        filaInicial += a->fila[f];
+        chegadas += a->chegadas[f];
+        a->fila[f] += a->chegadas[f];
+        a->chegadas[f] = 0.0;
+    }
+    double fila = filaInicial + chegadas;
+
+    double liberados = a->capacidade;
+#if ( FILAS_POR_VIA == 1 )
+    if (link >= 0 && redeCapacidadeVia(sim->rede, link) > 0) {
+        double livre = redeCapacidadeVia(sim->rede, link) - sim->ocupacao[link];
+        if (liberados > livre) liberados = (livre > 0.0) ? livre : 0.0;
+    }
+#endif
+    if (liberados > fila) liberados = fila;
+
+    if (liberados > 0.0) {
+        double proporcao = liberados / fila;
+        uint64_t chegadaMedia = (uint64_t)((filaInicial * inicio + a->geradas * (inicio + MESO_PASSO_MS / 2) +
+            a->instanteChegadas) / fila);
+        uint64_t saida = chegadaMedia + mesoEsperaVerdeMs(sim->rede, c, direcao, chegadaMedia);
+        for (int f = 0; f < MESO_FAIXAS; f++) {
+            double saindo = a->fila[f] * proporcao;
+            a->fila[f] -= saindo;
+            if (saindo <= 0.0) continue;
+            if (link >= 0) {
+                mesoEntrarNaVia(sim, link, f, saindo, saida);
+            }
+            else {
+                sim->sairam += saindo;
+            }
+        }
+        if (a->viaChegada >= 0) {
+            double daVia = a->daVia * proporcao;
+            a->daVia -= daVia;
+            sim->ocupacao[a->viaChegada] -= daVia;
+        }
+        a->travessias += liberados;
+    }
+
+    double uniforme;
+    double incremental = mesoAtrasoSinalMs(a, chegadas / MESO_PASSO_MS, &uniforme);
+    a->atrasoMs += chegadas * incremental + a->geradas * uniforme + (filaInicial + fila - liberados) / 2.0 * MESO_PASSO_MS;
+    a->geradas = 0.0;
+    a->instanteChegadas = 0.0;
+}
+
+/**
+ * @brief Executa um passo de MESO_PASSO_MS: sinais, demanda, chegadas e descarga das aproximações.
+ *
+ * Cada verde iniciado no passo libera até ceil(verde / INTERVALO_SATURACAO_MS)
+ * veículos da aproximação, como a faixa de retenção do modelo microscópico,
+ * limitados pelo espaço livre na via à frente. O que não sai fica na fila
+ * vertical para o próximo passo. O atraso soma a espera pelo verde de cada
+ * pelotão que chega (ver `mesoEsperaPelotaoMs`), os atrasos de sinal de
+ * `mesoAtrasoSinalMs` e a área da fila residual.
+ */
+static void mesoPasso(SimulacaoMeso* sim, int porEntrada) {
+    const Rede* rede = sim->rede;
+    uint64_t inicio = sim->agora;
+    uint64_t fim = inicio + MESO_PASSO_MS;
+
+    for (int c = 0; c < rede->numCruzamentos; c++) {
+        AproximacaoMeso* aproximacoes = &sim->aproximacoes[c * NUM_DIRECOES];
+
+        // Verdes que começam no passo
+        for (int d = 0; d < NUM_DIRECOES; d++) aproximacoes[d].capacidade = 0.0;
+        while (sim->proximaTroca[c] < fim) {
+            sim->fase[c] = faseAlternar(sim->fase[c]);
+            uint32_t verde = redeVerdeMs(rede, c, sim->fase[c]);
+            for (int d = 0; d < NUM_DIRECOES; d++) {
+                if (sim->fase[c] & FASE_ABERTO(d + 1)) aproximacoes[d].capacidade += ceil((double)verde / INTERVALO_SATURACAO_MS);
+            }
+            sim->proximaTroca[c] += verde ? verde : MESO_PASSO_MS;
+        }
+
+        // Demanda do passo com o controle de admissão de `admitirVeiculo`: entra só o que cabe até
+        // ADMISSAO_FILA_MAX veículos parados no cruzamento, e o resto espera ou desiste
+        double chegando = mesoTaxaEntrada(rede, c, inicio, porEntrada) * MESO_PASSO_MS;
+        double parados = 0.0;
+        for (int d = 0; d < NUM_DIRECOES; d++) {
+            for (int f = 0; f < MESO_FAIXAS; f++) parados += aproximacoes[d].fila[f];
+        }
+        double vagas = (parados < ADMISSAO_FILA_MAX) ? ADMISSAO_FILA_MAX - parados : 0.0;
+        double esperando = sim->adiados[c] + chegando;
+        double entrando = (esperando < vagas) ? esperando : vagas;
+        double adiados = esperando - entrando;
+        if (adiados > sim->adiados[c]) sim->veiculosAdiados += (adiados < chegando ? adiados : chegando);
+        if (adiados > ADMISSAO_MAX_ADIADOS) {
+            sim->veiculosDescartados += adiados - ADMISSAO_MAX_ADIADOS;
+            adiados = ADMISSAO_MAX_ADIADOS;
+        }
+        sim->adiados[c] = adiados;
+
+        // Os que entram se dividem igualmente entre as direções e pelas faixas de velocidade
+        sim->criados += entrando;
+        for (int d = 0; d < NUM_DIRECOES; d++) {
+            aproximacoes[d].geradas += entrando / NUM_DIRECOES;
+            for (int f = 0; f < MESO_FAIXAS; f++) aproximacoes[d].chegadas[f] += entrando / NUM_DIRECOES * mesoFracaoFaixa(f);
+        }
+    }
+
+    // Pelotões que chegam à faixa de retenção do destino durante o passo
+    for (int link = 0; link < rede->numLinks; link++) {
+        AproximacaoMeso* a = &sim->aproximacoes[rede->linkDestino[link] * NUM_DIRECOES + rede->linkDirecao[link] - 1];
+        for (int f = 0; f < MESO_FAIXAS; f++) {
+            FilaPelotoes* fila = &sim->filas[link * MESO_FAIXAS + f];
+            while (fila->quantidade > 0 && sim->pelotoes[fila->base + fila->inicio].chegada < fim) {
+                const Pelotao* p = &sim->pelotoes[fila->base + fila->inicio];
+                a->chegadas[f] += p->quantidade;
+                a->daVia += p->quantidade;
+                a->instanteChegadas += (double)p->quantidade * (double)(p->chegada > inicio ? p->chegada : inicio);
+                a->atrasoMs += (double)p->quantidade * p->esperaMs;
+                fila->inicio = (fila->inicio + 1 == fila->capacidade) ? 0 : fila->inicio + 1;
+                fila->quantidade--;
+            }
+        }
+    }
+
+    for (int c = 0; c < rede->numCruzamentos; c++) {
+        for (int d = 1; d <= NUM_DIRECOES; d++) mesoDescarregar(sim, c, d, inicio);
+    }
+
+    double ativos = sim->criados - sim->sairam;
+    if (ativos > sim->picoAtivos) sim->picoAtivos = ativos;
+    sim->agora = fim;
+    sim->passos++;
+}
+
+/**
+ * @brief Executa passos até que o relógio simulado alcance `duracaoMs`.
+ */
+static void mesoExecutar(SimulacaoMeso* sim, uint64_t duracaoMs) {
+    int porEntrada = redeDemandaPorEntrada(sim->rede);
+
+    while (sim->agora + MESO_PASSO_MS <= duracaoMs) mesoPasso(sim, porEntrada);
+}
+
+/**
+ * @brief Soma os baldes de um histograma de métricas (quantidade de registros).
+ */
+static uint64_t mesoContarHistograma(const HistogramaMetricas* h) {
+    uint64_t total = 0;
+    for (int b = 0; b <= METRICAS_BALDES; b++) total += h->baldes[b];
+    return total;
+}
+
+/**
+ * @brief Compara o motor mesoscópico com o de eventos discretos na mesma rede, demanda e duração.
+ *
+ * O modelo microscópico roda com as métricas de tráfego ligadas, que dão a
+ * vazão e a espera média de cada aproximação. O relatório mostra, por
+ * aproximação com tráfego, as travessias por hora e o atraso médio nos dois
+ * modelos, e no fim os totais, o tempo de execução e a memória de cada um.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int mesoValidar(const SimulacaoMeso* meso, const Rede* rede, uint64_t semente, uint64_t duracaoMs,
+    double segundosMeso) {
+    static Simulacao sim;
+    double horas = duracaoMs / 3600000.0;
+
+    if (!simulacaoIniciar(&sim, rede, semente) || !metricasIniciar(rede, 1, NULL)) {
+        simulacaoLiberar(&sim);
+        return 0;
+    }
+    sim.metricas = metricasFragmento(0);
+
+    uint64_t inicio = relogioNs();
+    simulacaoExecutar(&sim, duracaoMs);
+    double segundosMicro = (relogioNs() - inicio) / 1e9;
+
+    printf("Validacao contra o modelo microscopico (eventos discretos, semente %llu):\n", (unsigned long long)semente);
+    printf("  cruzamento dir | travessias/h micro    meso   erro | atraso medio micro    meso (s)\n");
+
+    double travessiasMicro = 0.0, travessiasMeso = 0.0, atrasoMicro = 0.0, atrasoMeso = 0.0, erroMaximo = 0.0;
+    for (int c = 0; c < rede->numCruzamentos; c++) {
+        for (int d = 1; d <= NUM_DIRECOES; d++) {
+            const MetricasAproximacao* m = metricasAproximacao(c, d);
+            const AproximacaoMeso* a = &meso->aproximacoes[c * NUM_DIRECOES + d - 1];
+            uint64_t micro = mesoContarHistograma(&m->espera);
+            if (micro == 0 && a->travessias < 0.5) continue;
+
+            double porHoraMicro = micro / horas;
+            double porHoraMeso = a->travessias / horas;
+            double erro = micro ? 100.0 * (porHoraMeso - porHoraMicro) / porHoraMicro : 0.0;
+            if (fabs(erro) > erroMaximo) erroMaximo = fabs(erro);
+            printf("  %10s %3s | %18.1f %7.1f %5.1f%% | %18.2f %7.2f\n", rede->nome[c], nomeDirecao(d),
+                porHoraMicro, porHoraMeso, erro, micro ? m->espera.somaMs / 1000.0 / micro : 0.0,
+                a->travessias > 0 ? a->atrasoMs / 1000.0 / a->travessias : 0.0);
+
+            travessiasMicro += micro;
+            travessiasMeso += a->travessias;
+            atrasoMicro += m->espera.somaMs / 1000.0;
+            atrasoMeso += a->atrasoMs / 1000.0;
+        }
+    }
+
+    size_t bytesMicro = simulacaoBytes(&sim);
+    size_t bytesMeso = mesoBytes(meso);
+    printf("  Travessias: micro %.0f, meso %.0f (%+.1f%%; maior erro por aproximacao %.1f%%)\n",
+        travessiasMicro, travessiasMeso, travessiasMicro ? 100.0 * (travessiasMeso - travessiasMicro) / travessiasMicro : 0.0,
+        erroMaximo);
+    printf("  Atraso medio por travessia: micro %.2f s, meso %.2f s\n",
+        travessiasMicro ? atrasoMicro / travessiasMicro : 0.0, travessiasMeso ? atrasoMeso / travessiasMeso : 0.0);
+    printf("  Veiculos criados: micro %d, meso %.0f; descartados: micro %llu, meso %.0f\n", sim.veiculoCounter,
+        meso->criados, (unsigned long long)sim.veiculosDescartados, meso->veiculosDescartados);
+    printf("  Tempo de execucao: micro %.4f s (%llu eventos), meso %.4f s (%llu passos) -> %.0fx\n",
+        segundosMicro, (unsigned long long)sim.eventosProcessados, segundosMeso, (unsigned long long)meso->passos,
+        segundosMeso > 0 ? segundosMicro / segundosMeso : 0.0);
+    printf("  Memoria: micro %llu bytes (%d registros de veiculo), meso %llu bytes -> %.0fx\n",
+        (unsigned long long)bytesMicro, sim.capacidadeRegistros, (unsigned long long)bytesMeso,
+        bytesMeso ? (double)bytesMicro / bytesMeso : 0.0);
+
+    metricasLiberar();
+    simulacaoLiberar(&sim);
+    return 1;
+}
+
+/**
+ * @brief Executa o motor mesoscópico e imprime o resumo; com SIM_VALIDAR=1 compara com o microscópico.
+ */
+static void executarMesoscopico(void) {
+    static SimulacaoMeso sim;
+    Rede rede;
+    uint64_t semente = sementeExecucao();
+    uint64_t duracao = (uint64_t)SIM_DURACAO_S * 1000;
+
+    if (!redeCriar(&rede, semente)) return;
+    if (!mesoIniciar(&sim, &rede)) {
+        mesoLiberar(&sim);
+        redeLiberar(&rede);
+        return;
+    }
+
+    uint64_t inicio = relogioNs();
+    mesoExecutar(&sim, duracao);
+    double segundos = (relogioNs() - inicio) / 1e9;
+
+    double travessias = 0.0, atraso = 0.0;
+    for (int i = 0; i < rede.numCruzamentos * NUM_DIRECOES; i++) {
+        travessias += sim.aproximacoes[i].travessias;
+        atraso += sim.aproximacoes[i].atrasoMs;
+    }
+
+    printf("Simulacao mesoscopica concluida.\n");
+    printf("  Tempo simulado: %.1f h em %.4f s (%.0fx o tempo real), passos de %.0f s\n",
+        sim.agora / 3600000.0, segundos, segundos > 0 ? (sim.agora / 1000.0) / segundos : 0.0, MESO_PASSO_MS / 1000.0);
+    printf("  Passos: %llu, pelotoes criados: %llu\n", (unsigned long long)sim.passos,
+        (unsigned long long)sim.pelotoesCriados);
+    printf("  Veiculos criados: %.0f, sairam da rede: %.0f, ainda na rede: %.0f (pico %.0f)\n",
+        sim.criados, sim.sairam, sim.criados - sim.sairam, sim.picoAtivos);
+    printf("  Travessias: %.0f, atraso medio: %.2f s\n", travessias, travessias > 0 ? atraso / 1000.0 / travessias : 0.0);
+    printf("  Entradas adiadas: %.0f, descartadas: %.0f\n", sim.veiculosAdiados, sim.veiculosDescartados);
+    printf("  Memoria: %llu bytes\n", (unsigned long long)mesoBytes(&sim));
+
+    const char* validar = getenv("SIM_VALIDAR");
+    if (validar != NULL && strcmp(validar, "1") == 0) mesoValidar(&sim, &rede, semente, duracao, segundos);
+
+    mesoLiberar(&sim);
+    redeLiberar(&rede);
+}
+
+#endif /* MODO_SIMULACAO == MODO_MESOSCOPICO */
+
+#endif /* motor de eventos discretos */
+
+/*----------------- BENCHMARK DA LEITURA DE SEMÁFOROS ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_BENCH_SEMAFORO )
+
+#define BENCH_SEMAFORO_DURACAO_MS 500  // Duração de cada medição, em milissegundos
+#define BENCH_SEMAFORO_MAX_LEITORES 32 // Maior quantidade de threads leitoras medida
+#define BENCH_SEMAFORO_CRUZAMENTO 5     // Cruzamento consultado no mapa, no meio de uma palavra dividida com outros
+#define BENCH_SEMAFORO_REDE 10000       // Cruzamentos das consultas à rede inteira (grade 100x100)
+
+// Caminhos comparados
+#define CAMINHO_MUTEX 0 // Quatro booleanos com um mutex cada
+#define CAMINHO_FASE  1 // Palavra de fase do cruzamento
+#define CAMINHO_MAPA  2 // Mapa de sinais da rede
+
+/**
+ * @brief Cruzamento compartilhado entre a thread que troca as fases e as leitoras.
+ *
+ * Contém as três representações comparadas: quatro booleanos com um mutex
+ * cada (como era o `Cruzamento` antes da palavra de fase), a palavra de fase
+ * e o mapa de sinais da rede, em que o cruzamento divide a palavra com outros.
+ */
+typedef struct {
+    volatile uint32_t parar;               /**< Diferente de zero encerra a medição. */
+    int caminho;                           /**< CAMINHO_MUTEX, CAMINHO_FASE ou CAMINHO_MAPA. */
+    bool semaforo[NUM_DIRECOES];           /**< Caminho antigo: estado de cada direção. */
+    MutexNativo mutex[NUM_DIRECOES];       /**< Caminho antigo: um mutex por direção. */
+    volatile uint32_t fase;                /**< Palavra de fase publicada atomicamente. */
+    MapaSinais mapa;                       /**< Mapa de sinais com o cruzamento BENCH_SEMAFORO_CRUZAMENTO. */
+    uint64_t trocas;                       /**< Trocas de fase feitas durante a medição. */
+} BancadaSemaforo;
+
+/**
+ * @brief Estado de uma thread leitora, alinhado para evitar compartilhamento falso.
+ */
+typedef struct {
+    BancadaSemaforo* bancada;  /**< Cruzamento consultado. */
+    uint64_t consultas;        /**< Consultas de uma direção realizadas. */
+    uint64_t inconsistentes;   /**< Observações com NS e EW no mesmo estado. */
+    uint32_t semente;          /**< Estado do gerador usado para sortear a direção. */
+    char preenchimento[64];    /**< Separa as leitoras em linhas de cache distintas. */
+} LeitorSemaforo;
+
+static int consultarComMutex(BancadaSemaforo* b, int direcao) {
+    mutexTravar(&b->mutex[direcao - 1]);
+    bool aberto = b->semaforo[direcao - 1];
+    mutexDestravar(&b->mutex[direcao - 1]);
+    return aberto ? 1 : 0;
+}
+
+static int consultarFase(BancadaSemaforo* b, int direcao) {
+    return (atomicoLer32(&b->fase) & FASE_ABERTO(direcao)) ? 1 : 0;
+}
+
+static int consultarSemaforo(BancadaSemaforo* b, int direcao) {
+    switch (b->caminho) {
+    case CAMINHO_MUTEX: return consultarComMutex(b, direcao);
+    case CAMINHO_FASE: return consultarFase(b, direcao);
+    default: return sinaisVerde(&b->mapa, BENCH_SEMAFORO_CRUZAMENTO, direcao);
+    }
+}
+
+/**
+ * @brief Thread leitora: consulta direções sorteadas até o fim da medição.
+ *
+ * A cada 64 consultas observa o cruzamento inteiro e conta os estados em que
+ * NS e EW aparecem iguais, o que só ocorre quando a troca não é atômica.
+ */
+static void prvLeitorSemaforo(void* pvParametro) {
+    LeitorSemaforo* leitor = (LeitorSemaforo*)pvParametro;
+    BancadaSemaforo* b = leitor->bancada;
+    uint32_t x = leitor->semente;
+
+    while (!atomicoLer32(&b->parar)) {
+        for (int i = 0; i < 64; i++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            int direcao = (int)(x & 3) + 1;
+            leitor->consultas += consultarSemaforo(b, direcao) | 1;
+        }
+
+        int ns, ew;
+        if (b->caminho == CAMINHO_MUTEX) {
+            ns = consultarComMutex(b, NS);
+            ew = consultarComMutex(b, EW);
+        }
+        else if (b->caminho == CAMINHO_FASE) {
+            uint32_t fase = atomicoLer32(&b->fase);
+            ns = (fase & FASE_ABERTO(NS)) != 0;
+            ew = (fase & FASE_ABERTO(EW)) != 0;
+        }
+        else {
+            uint64_t palavra = atomicoLerRelaxado64(&b->mapa.palavras[BENCH_SEMAFORO_CRUZAMENTO >> 3]);
+            uint64_t cruzamento = palavra >> SINAIS_CRUZAMENTO(BENCH_SEMAFORO_CRUZAMENTO);
+            ns = (int)(cruzamento >> (2 * (NS - 1))) & 1;
+            ew = (int)(cruzamento >> (2 * (EW - 1))) & 1;
+        }
+        if (ns == ew) leitor->inconsistentes++;
+    }
+}
+
+/**
+ * @brief Thread que troca as fases continuamente, como um `vCruzamentoTask` sem espera.
+ */
+static void prvTrocaFaseBench(void* pvParametro) {
+    BancadaSemaforo* b = (BancadaSemaforo*)pvParametro;
+
+    while (!atomicoLer32(&b->parar)) {
+        if (b->caminho == CAMINHO_MUTEX) {
+            for (int d = 0; d < NUM_DIRECOES; d++) {
+                mutexTravar(&b->mutex[d]);
+                b->semaforo[d] = !b->semaforo[d];
+                mutexDestravar(&b->mutex[d]);
+            }
+        }
+        else {
+            atomicoEscrever32(&b->fase, faseAlternar(b->fase));
+            if (b->caminho == CAMINHO_MAPA) sinaisPublicarFase(&b->mapa, BENCH_SEMAFORO_CRUZAMENTO, b->fase);
+        }
+        b->trocas++;
+        threadCeder();
+    }
+}
+
+/**
+ * @brief Mede a vazão de consultas com `leitores` threads para um dos caminhos.
+ *
+ * @return Consultas por segundo; `inconsistentes` recebe o total de estados inconsistentes observados.
+ */
+static double medirLeituraSemaforo(int leitores, int caminho, uint64_t* inconsistentes) {
+    static LeitorSemaforo estado[BENCH_SEMAFORO_MAX_LEITORES];
+    ThreadNativa threads[BENCH_SEMAFORO_MAX_LEITORES];
+    ThreadNativa escritora;
+    BancadaSemaforo b = { 0 };
+
+    b.caminho = caminho;
+    b.fase = faseInicial(0, 0);
+    if (!sinaisCriar(&b.mapa, 64)) {
+        *inconsistentes = 0;
+        return 0.0;
+    }
+    sinaisPublicarFase(&b.mapa, BENCH_SEMAFORO_CRUZAMENTO, b.fase);
+    for (int d = 0; d < NUM_DIRECOES; d++) {
+        b.semaforo[d] = (b.fase & FASE_ABERTO(d + 1)) != 0;
+        mutexIniciar(&b.mutex[d]);
+    }
+
+    int criadas = 0;
+    for (int i = 0; i < leitores; i++) {
+        estado[i] = (LeitorSemaforo){ &b, 0, 0, 2463534242u + 7919u * (uint32_t)i, { 0 } };
+        if (threadCriar(&threads[criadas], prvLeitorSemaforo, &estado[i])) criadas++;
+    }
+    int escritoraCriada = threadCriar(&escritora, prvTrocaFaseBench, &b);
+
+    uint64_t inicio = relogioNs();
+    while (relogioNs() - inicio < (uint64_t)BENCH_SEMAFORO_DURACAO_MS * 1000000u) {
+        threadCeder();
+    }
+    atomicoEscrever32(&b.parar, 1);
+    double segundos = (relogioNs() - inicio) / 1e9;
+
+    for (int i = 0; i < criadas; i++) threadAguardar(threads[i]);
+    if (escritoraCriada) threadAguardar(escritora);
+    for (int d = 0; d < NUM_DIRECOES; d++) mutexDestruir(&b.mutex[d]);
+    sinaisLiberar(&b.mapa);
+
+    uint64_t consultas = 0;
+    *inconsistentes = 0;
+    for (int i = 0; i < criadas; i++) {
+        consultas += estado[i].consultas;
+        *inconsistentes += estado[i].inconsistentes;
+    }
+    return consultas / segundos;
+}
+
+/**
+ * @brief Cruzamento como era antes do mapa de sinais: o estado dos sinais junto com os dados frios.
+ */
+typedef struct {
+    const char* id;                   /**< Nome do cruzamento. */
+    bool semaforo[NUM_DIRECOES];      /**< Estado de cada direção. */
+    bool parados[NUM_DIRECOES];       /**< Veículos parados em cada aproximação. */
+    void* mutex[NUM_DIRECOES];        /**< Um mutex por direção. */
+    void* vizinho[NUM_DIRECOES];      /**< Cruzamentos adjacentes. */
+} CruzamentoMisturado;
+
+/**
+ * @brief Mede as consultas à rede inteira nos dois arranjos, em nanossegundos por varredura.
+ *
+ * Os sinais e as filas são sorteados uma vez e gravados nos dois arranjos;
+ * as contagens precisam coincidir.
+ */
+static void medirConsultasRede(void) {
+    int n = BENCH_SEMAFORO_REDE;
+    CruzamentoMisturado* misturados = (CruzamentoMisturado*)calloc((size_t)n, sizeof(CruzamentoMisturado));
+    int* lista = (int*)malloc((size_t)n * NUM_DIRECOES * sizeof(int));
+    MapaSinais mapa;
+
+    if (misturados == NULL || lista == NULL || !sinaisCriar(&mapa, n)) {
+        printf("Erro ao alocar memoria para as consultas a rede.\n");
+        free(misturados);
+        free(lista);
+        return;
+    }
+
+    uint32_t x = 2463534242u;
+    for (int c = 0; c < n; c++) {
+        uint32_t fase = faseInicial(c, 0);
+        sinaisPublicarFase(&mapa, c, fase);
+        for (int d = NS; d <= WE; d++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            misturados[c].semaforo[d - 1] = (fase & FASE_ABERTO(d)) != 0;
+            misturados[c].parados[d - 1] = (x & 3) == 0;
+            sinaisMarcarFila(&mapa, c, d, misturados[c].parados[d - 1]);
+        }
+    }
+
+    printf("\nConsultas a rede inteira: %d cruzamentos, %zu bytes por cruzamento contra 1 byte no mapa\n",
+        n, sizeof(CruzamentoMisturado));
+    printf("%-30s | %14s | %14s | %8s | %10s\n", "consulta", "misturado (ns)", "mapa (ns)", "ganho", "resultado");
+
+    static const char* nomes[] = { "aproximacoes com verde", "aproximacoes com vermelho", "vermelho com veiculos parados",
+        "listar as com verde" };
+    for (int consulta = 0; consulta < 4; consulta++) {
+        double tempos[2] = { 0.0, 0.0 };
+        int resultados[2] = { 0, 0 };
+        for (int arranjo = 0; arranjo < 2; arranjo++) {
+            uint64_t inicio = relogioNs(), varreduras = 0;
+            do {
+                int r = 0;
+                if (arranjo == 1) {
+                    r = (consulta == 3) ? sinaisListar(&mapa, SINAIS_VERDES, lista, n * NUM_DIRECOES) : sinaisContar(&mapa, consulta);
+                }
+                else {
+                    for (int c = 0; c < n; c++) {
+                        for (int d = 0; d < NUM_DIRECOES; d++) {
+                            const CruzamentoMisturado* m = &misturados[c];
+                            int selecionada = (consulta == SINAIS_VERMELHOS) ? !m->semaforo[d] :
+                                (consulta == SINAIS_VERMELHOS_COM_FILA) ? !m->semaforo[d] && m->parados[d] : m->semaforo[d];
+                            if (selecionada && consulta == 3) lista[r] = c * NUM_DIRECOES + d;
+                            r += selecionada;
+                        }
+                    }
+                }
+                resultados[arranjo] = r;
+                varreduras++;
+            } while (relogioNs() - inicio < (uint64_t)BENCH_SEMAFORO_DURACAO_MS * 1000000u / 4);
+            tempos[arranjo] = (double)(relogioNs() - inicio) / varreduras;
+        }
+
+        printf("%-30s | %14.0f | %14.0f | %7.1fx | %10d%s\n", nomes[consulta], tempos[0], tempos[1],
+            tempos[1] > 0 ? tempos[0] / tempos[1] : 0.0, resultados[1], resultados[0] == resultados[1] ? "" : " (diverge!)");
+    }
+
+    sinaisLiberar(&mapa);
+    free(misturados);
+    free(lista);
+}
+
+/**
+ * @brief Compara a vazão de consultas ao semáforo com mutexes por direção, com a palavra de fase e com o mapa de sinais.
+ */
+static void executarBenchSemaforo(void) {
+    printf("Consultas concorrentes ao estado de um cruzamento (%d ms por medicao)\n", BENCH_SEMAFORO_DURACAO_MS);
+    printf("%9s | %18s | %18s | %18s | %8s | %21s\n", "leitores", "mutex (consultas/s)", "fase (consultas/s)",
+        "mapa (consultas/s)", "ganho", "inconsistentes");
+
+    for (int leitores = 1; leitores <= BENCH_SEMAFORO_MAX_LEITORES; leitores *= 2) {
+        uint64_t inconsistentesMutex, inconsistentesFase, inconsistentesMapa;
+        double mutex = medirLeituraSemaforo(leitores, CAMINHO_MUTEX, &inconsistentesMutex);
+        double fase = medirLeituraSemaforo(leitores, CAMINHO_FASE, &inconsistentesFase);
+        double mapa = medirLeituraSemaforo(leitores, CAMINHO_MAPA, &inconsistentesMapa);
+
+        printf("%9d | %18.3e | %18.3e | %18.3e | %7.1fx | %6llu / %-6llu / %-6llu\n",
+            leitores, mutex, fase, mapa, mutex > 0 ? mapa / mutex : 0.0, (unsigned long long)inconsistentesMutex,
+            (unsigned long long)inconsistentesFase, (unsigned long long)inconsistentesMapa);
+    }
+    printf("Ganho: mapa sobre mutex. Inconsistentes: observacoes com NS e EW no mesmo estado (mutex / fase / mapa).\n");
+
+    medirConsultasRede();
+}
+
+#endif /* MODO_SIMULACAO == MODO_BENCH_SEMAFORO */
+
+/*----------------- TABELA DE VEÍCULOS E CINEMÁTICA EM LOTE ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_BENCH_CINEMATICA )
+
+#define CINEMATICA_PASSO_S 0.1f            // Passo de tempo da atualização em lote, em segundos
+#define CINEMATICA_VARIACAO_KMH 5.0f       // Variação máxima da velocidade em torno da desejada, em km/h
+#define CINEMATICA_VELOCIDADE_MIN_KMH 5.0f // Menor velocidade de um veículo em movimento, em km/h
+
+// Estado de um veículo na tabela
+#define VEICULO_PARADO       0u // Na faixa de retenção do fim da via
+#define VEICULO_EM_MOVIMENTO 1u // Percorrendo a via
+
+/**
+ * @brief Tabela de veículos em estrutura de vetores (SoA).
+ *
+ * Cada campo é um vetor contíguo alinhado a 64 bytes, indexado pelo veículo,
+ * para que a atualização de todos os veículos a cada passo seja um laço sem
+ * desvios que o compilador vetoriza. O comprimento e a velocidade máxima da
+ * via ficam copiados na tabela para que o laço não consulte a rede.
+ */
+typedef struct {
+    int quantidade;          /**< Veículos na tabela. */
+    int capacidade;          /**< Capacidade de cada vetor. */
+    void* bloco;             /**< Bloco único que contém todos os vetores. */
+    float* velocidade;       /**< Velocidade atual, em km/h. */
+    float* velocidadeBase;   /**< Velocidade desejada do motorista, em km/h. */
+    float* velocidadeMax;    /**< Velocidade máxima da via atual, em km/h. */
+    float* posicao;          /**< Distância percorrida na via atual, em metros. */
+    float* comprimento;      /**< Comprimento da via atual, em metros. */
+    float* tempoRestante;    /**< Tempo estimado até a faixa de retenção, em segundos. */
+    int32_t* link;           /**< Via atual (índice na rede). */
+    uint32_t* estado;        /**< VEICULO_PARADO ou VEICULO_EM_MOVIMENTO. */
+    uint32_t* semente;       /**< Estado do gerador xorshift de cada veículo. */
+} TabelaVeiculos;
+
+/**
+ * @brief Aloca uma tabela vazia para até `capacidade` veículos.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se não houver memória.
+ */
+static int tabelaVeiculosIniciar(TabelaVeiculos* t, int capacidade) {
+    // Cada vetor ocupa um múltiplo de 64 bytes para que todos fiquem alinhados
+    size_t elementos = ((size_t)capacidade + 15) & ~(size_t)15;
+    size_t vetor = elementos * sizeof(float);
+
+    *t = (TabelaVeiculos){ 0 };
+    t->bloco = malloc(9 * vetor + 64);
+    if (t->bloco == NULL) return 0;
+
+    char* p = (char*)(((uintptr_t)t->bloco + 63) & ~(uintptr_t)63);
+    t->velocidade = (float*)p;       p += vetor;
+    t->velocidadeBase = (float*)p;   p += vetor;
+    t->velocidadeMax = (float*)p;    p += vetor;
+    t->posicao = (float*)p;          p += vetor;
+    t->comprimento = (float*)p;      p += vetor;
+    t->tempoRestante = (float*)p;    p += vetor;
+    t->link = (int32_t*)p;           p += vetor;
+    t->estado = (uint32_t*)p;        p += vetor;
+    t->semente = (uint32_t*)p;
+    t->capacidade = capacidade;
+    return 1;
+}
+
+static void tabelaVeiculosLiberar(TabelaVeiculos* t) {
+    free(t->bloco);
+    *t = (TabelaVeiculos){ 0 };
+}
+
+/**
+ * @brief Coloca o veículo `i` no início da via `link`, copiando os dados da via.
+ */
+static void tabelaVeiculosEntrarNaVia(TabelaVeiculos* t, int i, const Rede* rede, int link) {
+    t->link[i] = link;
+    t->posicao[i] = 0.0f;
+    t->comprimento[i] = (float)rede->linkComprimento[link];
+    t->velocidadeMax[i] = (float)rede->linkVelocidadeMax[link];
+    t->estado[i] = VEICULO_EM_MOVIMENTO;
+}
 
-/*
- * Prototypes for the standard FreeRTOS application hook (callback) functions
- * implemented within this file.  See http://www.freertos.org/a00016.html .
+/**
+ * @brief Acrescenta um veículo à tabela no início da via `link`.
+ *
+ * @return Índice do veículo, ou -1 se a tabela estiver cheia.
  */
-void vApplicationMallocFailedHook( void );
-void vApplicationIdleHook( void );
-void vApplicationStackOverflowHook( TaskHandle_t pxTask, char *pcTaskName );
-void vApplicationTickHook( void );
-void vApplicationGetIdleTaskMemory( StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize );
-void vApplicationGetTimerTaskMemory( StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer, uint32_t *pulTimerTaskStackSize );
+static int tabelaVeiculosInserir(TabelaVeiculos* t, const Rede* rede, int link, float velocidadeBase, uint32_t semente) {
+    if (t->quantidade == t->capacidade) return -1;
+
+    int i = t->quantidade++;
+    t->velocidadeBase[i] = velocidadeBase;
+    t->velocidade[i] = velocidadeBase;
+    t->tempoRestante[i] = 0.0f;
+    t->semente[i] = semente ? semente : 1; // xorshift não pode partir de zero
+    tabelaVeiculosEntrarNaVia(t, i, rede, link);
+    return i;
+}
 
-/*
- * Writes trace data to a disk file when the trace recording is stopped.
- * This function will simply overwrite any trace files that already exist.
+/**
+ * @brief Laço da cinemática em lote sobre os vetores da tabela.
+ *
+ * Os vetores são parâmetros `__restrict` para que o compilador saiba que
+ * não se sobrepõem e vetorize o laço, que não tem desvios nem acessos
+ * indiretos.
  */
-static void prvSaveTraceFile( void );
+static int cinematicaLote(int n, float passo, float* __restrict velocidade, const float* __restrict velocidadeBase,
+    const float* __restrict velocidadeMax, float* __restrict posicao, const float* __restrict comprimento,
+    float* __restrict tempoRestante, uint32_t* __restrict estado, uint32_t* __restrict semente) {
+    int chegadas = 0;
+
+    for (int i = 0; i < n; i++) {
+        uint32_t x = xorshift32(semente[i]);
+        semente[i] = x;
+
+        // 24 bits aleatórios mapeados em [-CINEMATICA_VARIACAO_KMH, +CINEMATICA_VARIACAO_KMH)
+        float variacao = (float)(int32_t)(x >> 8) * (2.0f * CINEMATICA_VARIACAO_KMH / 16777216.0f) - CINEMATICA_VARIACAO_KMH;
+        float v = velocidadeBase[i] + variacao;
+        v = (v < CINEMATICA_VELOCIDADE_MIN_KMH) ? CINEMATICA_VELOCIDADE_MIN_KMH : v;
+        v = (v > velocidadeMax[i]) ? velocidadeMax[i] : v;
+
+        // Veículos parados (estado 0) não avançam
+        float p = posicao[i] + v * (1.0f / 3.6f) * passo * (float)(int32_t)estado[i];
+        // A comparação vem antes do limite ao fim da via para que o laço continue vetorizável
+        float c = comprimento[i];
+        uint32_t movendo = (p < c) ? VEICULO_EM_MOVIMENTO : VEICULO_PARADO;
+        p = (p > c) ? c : p;
+        chegadas += (int)(estado[i] & ~movendo);
+
+        velocidade[i] = v;
+        posicao[i] = p;
+        tempoRestante[i] = (c - p) * 3.6f / v;
+        estado[i] = movendo;
+    }
+    return chegadas;
+}
 
-/*-----------------------------------------------------------*/
+/**
+ * @brief Avança um passo de `passo` segundos para todos os veículos da tabela.
+ *
+ * Para cada veículo sorteia a velocidade em torno da desejada
+ * (±CINEMATICA_VARIACAO_KMH, limitada pela via), avança a posição, recalcula
+ * o tempo até a faixa de retenção e marca como parados os que a alcançaram.
+ *
+ * @return Quantidade de veículos que alcançaram o fim da via neste passo.
+ */
+static int cinematicaAtualizar(TabelaVeiculos* t, float passo) {
+    return cinematicaLote(t->quantidade, passo, t->velocidade, t->velocidadeBase, t->velocidadeMax,
+        t->posicao, t->comprimento, t->tempoRestante, t->estado, t->semente);
+}
 
-/* When configSUPPORT_STATIC_ALLOCATION is set to 1 the application writer can
-use a callback function to optionally provide the memory required by the idle
-and timer tasks.  This is the stack that will be used by the timer task.  It is
-declared here, as a global, so it can be checked by a test that is implemented
-in a different file. */
-StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+/*----------------- BENCHMARK DA CINEMÁTICA EM LOTE ------------------*/
 
-/* Notes if the trace is running or not. */
-static BaseType_t xTraceRunning = pdTRUE;
+#define BENCH_CINEMATICA_DURACAO_MS 500   // Duração de cada medição, em milissegundos
+#define BENCH_CINEMATICA_PILHA_BYTES 256  // Espaço entre veículos do modelo por task (TCB e pilha de cada task)
 
-/*-----------------------------------------------------------*/
+/**
+ * @brief Veículo do modelo por task: registro próprio no heap, atualizado individualmente.
+ *
+ * Reproduz a forma do `Veiculo` do modo em tempo real, com velocidade inteira
+ * e `tempoDeslocamento` recalculado com `round`, como em `vVeiculoCreator`.
+ */
+typedef struct {
+    int id;                /**< Identificador do veículo. */
+    int velocidade;        /**< Velocidade atual, em km/h. */
+    int velocidadeBase;    /**< Velocidade desejada do motorista, em km/h. */
+    int tempoDeslocamento; /**< Tempo estimado até a faixa de retenção, em segundos. */
+    int link;              /**< Via atual (índice na rede). */
+    int parado;            /**< 1 na faixa de retenção, 0 percorrendo a via. */
+    float posicao;         /**< Distância percorrida na via atual, em metros. */
+    uint32_t semente;      /**< Estado do gerador xorshift do veículo. */
+} VeiculoIndividual;
+
+/**
+ * @brief Atualiza um veículo do modelo por task, como faria a task do próprio veículo.
+ *
+ * @return Retorna 1 se o veículo alcançou o fim da via neste passo.
+ */
+static int atualizarVeiculoIndividual(VeiculoIndividual* veiculo, const Rede* rede, float passo) {
+    uint32_t x = xorshift32(veiculo->semente);
+    veiculo->semente = x;
 
+    int velocidadeMax = rede->linkVelocidadeMax[veiculo->link];
+    float comprimento = (float)rede->linkComprimento[veiculo->link];
 
+    veiculo->velocidade = veiculo->velocidadeBase + (int)(x % 11) - 5;
+    if (veiculo->velocidade < (int)CINEMATICA_VELOCIDADE_MIN_KMH) veiculo->velocidade = (int)CINEMATICA_VELOCIDADE_MIN_KMH;
+    if (veiculo->velocidade > velocidadeMax) veiculo->velocidade = velocidadeMax;
 
+    if (veiculo->parado) return 0;
 
+    veiculo->posicao += veiculo->velocidade * 0.27778f * passo;
+    if (veiculo->posicao >= comprimento) {
+        veiculo->posicao = comprimento;
+        veiculo->parado = 1;
+    }
+    veiculo->tempoDeslocamento = (int)round((comprimento - veiculo->posicao) / (veiculo->velocidade * 0.27778));
+    return veiculo->parado;
+}
 
+/**
+ * @brief Próxima via de quem alcançou o fim de `link`: segue na mesma direção
+ * ou, na borda da rede, reentra por uma via sorteada.
+ */
+static int proximaViaBench(const Rede* rede, int link, GeradorAleatorio* gerador) {
+    int proxima = redeLinkNaDirecao(rede, rede->linkDestino[link], rede->linkDirecao[link]);
+    if (proxima >= 0) return proxima;
 
+    return geradorIntervalo(gerador, (uint32_t)rede->numLinks);
+}
 
+/**
+ * @brief Sorteia a via inicial e a velocidade desejada de um veículo, como em `vVeiculoCreator`.
+ *
+ * Os dois modelos usam o mesmo fluxo (FLUXO_CINEMATICA), de modo que medem a mesma frota.
+ *
+ * @return Semente do gerador xorshift próprio do veículo, usado nas variações de velocidade.
+ */
+static uint32_t sortearVeiculoBench(const Rede* rede, GeradorAleatorio* gerador, int* link, int* velocidadeBase) {
+    *link = geradorIntervalo(gerador, (uint32_t)rede->numLinks);
+    *velocidadeBase = (rede->linkDirecao[*link] > 2) ? geradorIntervalo(gerador, 31) + 20 : geradorIntervalo(gerador, 31) + 30;
+    return geradorProximo(gerador) | 1; // xorshift não pode partir de zero
+}
 
+/**
+ * @brief Mede veículos atualizados por segundo na tabela SoA.
+ */
+static double medirCinematicaLote(const Rede* rede, int quantidade) {
+    TabelaVeiculos tabela;
+    GeradorAleatorio gerador;
 
+    geradorIniciar(&gerador, SIM_SEMENTE, FLUXO_CINEMATICA);
 
+    if (!tabelaVeiculosIniciar(&tabela, quantidade)) {
+        printf("Erro ao alocar memoria para a tabela de veiculos.\n");
+        return 0.0;
+    }
+    for (int i = 0; i < quantidade; i++) {
+        int link, velocidadeBase;
+        uint32_t sementeVeiculo = sortearVeiculoBench(rede, &gerador, &link, &velocidadeBase);
+        tabelaVeiculosInserir(&tabela, rede, link, (float)velocidadeBase, sementeVeiculo);
+    }
 
+    uint64_t atualizados = 0;
+    uint64_t inicio = relogioNs();
+    uint64_t fim = inicio + (uint64_t)BENCH_CINEMATICA_DURACAO_MS * 1000000;
+    uint64_t agora;
+
+    do {
+        if (cinematicaAtualizar(&tabela, CINEMATICA_PASSO_S) > 0) {
+            // Trecho escalar: apenas os veículos que chegaram ao fim da via trocam de via
+            for (int i = 0; i < tabela.quantidade; i++) {
+                if (tabela.estado[i] == VEICULO_PARADO) {
+                    tabelaVeiculosEntrarNaVia(&tabela, i, rede, proximaViaBench(rede, tabela.link[i], &gerador));
+                }
+            }
+        }
+        atualizados += (uint64_t)tabela.quantidade;
+        agora = relogioNs();
+    } while (agora < fim);
 
+    tabelaVeiculosLiberar(&tabela);
+    return atualizados / ((agora - inicio) / 1e9);
+}
 
+/**
+ * @brief Mede veículos atualizados por segundo no modelo por task.
+ *
+ * Cada veículo é alocado separadamente e seguido de um bloco do tamanho do
+ * TCB e da pilha de uma task, e a ordem de atualização é embaralhada como a
+ * ordem em que o agendador acorda as tasks. O custo das trocas de contexto
+ * do FreeRTOS não entra na medição, de forma que o ganho real é maior.
+ */
+static double medirCinematicaIndividual(const Rede* rede, int quantidade) {
+    VeiculoIndividual** veiculos = (VeiculoIndividual**)malloc((size_t)quantidade * sizeof(VeiculoIndividual*));
+    void** pilhas = (void**)malloc((size_t)quantidade * sizeof(void*));
+    GeradorAleatorio gerador;
+    double resultado = 0.0;
+    int criados = 0;
+
+    geradorIniciar(&gerador, SIM_SEMENTE, FLUXO_CINEMATICA);
+    if (veiculos == NULL || pilhas == NULL) goto fim;
+
+    for (; criados < quantidade; criados++) {
+        VeiculoIndividual* veiculo = (VeiculoIndividual*)malloc(sizeof(VeiculoIndividual));
+        pilhas[criados] = malloc(BENCH_CINEMATICA_PILHA_BYTES);
+        if (veiculo == NULL || pilhas[criados] == NULL) {
+            free(veiculo);
+            free(pilhas[criados]);
+            printf("Erro ao alocar memoria para os veiculos do modelo por task.\n");
+            goto fim;
+        }
 
-/*----------------- INCIO ------------------*/
+        *veiculo = (VeiculoIndividual){ 0 };
+        veiculo->id = criados;
+        veiculo->semente = sortearVeiculoBench(rede, &gerador, &veiculo->link, &veiculo->velocidadeBase);
+        veiculos[criados] = veiculo;
+    }
 
+    // Embaralha a ordem de atualização (Fisher-Yates)
+    for (int i = quantidade - 1; i > 0; i--) {
+        int j = geradorIntervalo(&gerador, (uint32_t)(i + 1));
+        VeiculoIndividual* tmp = veiculos[i];
+        veiculos[i] = veiculos[j];
+        veiculos[j] = tmp;
+    }
 
-#include <stdbool.h>
+    uint64_t atualizados = 0;
+    uint64_t inicio = relogioNs();
+    uint64_t fim = inicio + (uint64_t)BENCH_CINEMATICA_DURACAO_MS * 1000000;
+    uint64_t agora;
+
+    do {
+        for (int i = 0; i < quantidade; i++) {
+            VeiculoIndividual* veiculo = veiculos[i];
+            if (atualizarVeiculoIndividual(veiculo, rede, CINEMATICA_PASSO_S)) {
+                veiculo->link = proximaViaBench(rede, veiculo->link, &gerador);
+                veiculo->posicao = 0.0f;
+                veiculo->parado = 0;
+            }
+        }
+        atualizados += (uint64_t)quantidade;
+        agora = relogioNs();
+    } while (agora < fim);
 
-#define NUM_CRUZAMENTOS 4
-#define TEMPO_CICLO 3 // Tempo do ciclo semafrico em segundos
+    resultado = atualizados / ((agora - inicio) / 1e9);
 
-// Definies das direes
-#define NS 1
-#define SN 2
-#define EW 3
-#define WE 4
+fim:
+    for (int i = 0; i < criados; i++) {
+        free(veiculos[i]);
+        free(pilhas[i]);
+    }
+    free(veiculos);
+    free(pilhas);
+    return resultado;
+}
 
 /**
- * @brief Estrutura que representa um cruzamento de trnsito.
- *
- * A estrutura contm informaes sobre o estado dos semforos do cruzamento
- * e referncias para os cruzamentos adjacentes, conforme a direo.
+ * @brief Compara a atualização em lote da tabela SoA com o modelo por task.
  */
-typedef struct Cruzamento {
-    char id;                      /**< Identificador do cruzamento (A, B, C, D). */
-    bool semaforoNS;              /**< Estado do semforo na direo Norte-Sul (NS). */
-    bool semaforoSN;              /**< Estado do semforo na direo Sul-Norte (SN). */
-    bool semaforoEW;              /**< Estado do semforo na direo Leste-Oeste (EW). */
-    bool semaforoWE;              /**< Estado do semforo na direo Oeste-Leste (WE). */
-    SemaphoreHandle_t mutexNS;    /**< Mutex para controlar acesso ao semforo NS. */
-    SemaphoreHandle_t mutexSN;    /**< Mutex para controlar acesso ao semforo SN. */
-    SemaphoreHandle_t mutexEW;    /**< Mutex para controlar acesso ao semforo EW. */
-    SemaphoreHandle_t mutexWE;    /**< Mutex para controlar acesso ao semforo WE. */
-    struct Cruzamento* proximoNS; /**< Prximo cruzamento na direo NS. */
-    struct Cruzamento* proximoSN; /**< Prximo cruzamento na direo SN. */
-    struct Cruzamento* proximoEW; /**< Prximo cruzamento na direo EW. */
-    struct Cruzamento* proximoWE; /**< Prximo cruzamento na direo WE. */
-} Cruzamento;
+static void executarBenchCinematica(void) {
+    static const int quantidades[] = { 1000, 10000, 100000, 1000000 };
+    Rede rede;
+
+    if (!redeCriarGrade(&rede, REDE_LINHAS, REDE_COLUNAS)) {
+        printf("Erro ao alocar memoria para a rede de cruzamentos.\n");
+        return;
+    }
+
+    printf("Atualizacao da cinematica, passo de %.1f s, rede %dx%d (%d ms por medicao)\n",
+        CINEMATICA_PASSO_S, rede.linhas, rede.colunas, BENCH_CINEMATICA_DURACAO_MS);
+    printf("%9s | %24s | %24s | %8s\n", "veiculos", "por task (veiculos/s)", "SoA em lote (veiculos/s)", "ganho");
+
+    for (size_t k = 0; k < sizeof(quantidades) / sizeof(quantidades[0]); k++) {
+        double individual = medirCinematicaIndividual(&rede, quantidades[k]);
+        double lote = medirCinematicaLote(&rede, quantidades[k]);
+
+        printf("%9d | %24.3e | %24.3e | %7.1fx\n",
+            quantidades[k], individual, lote, individual > 0 ? lote / individual : 0.0);
+    }
+
+    redeLiberar(&rede);
+}
+
+#endif /* MODO_SIMULACAO == MODO_BENCH_CINEMATICA */
+
+/*----------------- BENCHMARK DOS TEMPORIZADORES ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_BENCH_TEMPORIZADORES )
+
+#define BENCH_TEMPORIZADORES_MAXIMO 1000000     // Maior quantidade de temporizadores pendentes medida
+#define BENCH_TEMPORIZADORES_POR_TICK 4         // Expirações médias por tick (define o intervalo dos sorteios)
+#define BENCH_TEMPORIZADORES_MEDIDOS 2000000    // Expirações medidas em cada cenário
 
 /**
- * @brief Estrutura que representa um veculo.
- *
- * A estrutura contm informaes sobre o veculo, como velocidade,
- * direo, tempo de deslocamento e referncia ao cruzamento atual.
+ * @brief Entrada do heap binário usado como referência (ordem por expiração, como a fila de eventos).
  */
 typedef struct {
-    int id;                        /**< Identificador do veculo. */
-    int velocidade;                /**< Velocidade do veculo em km/h. */
-    int direcao;                   /**< Direo do veculo (1-NS, 2-SN, 3-EW, 4-WE). */
-    int tempoDeslocamento;         /**< Tempo necessrio para atravessar o cruzamento. */
-    Cruzamento* cruzamento;        /**< Cruzamento atual onde o veculo est. */
-} Veiculo;
+    uint32_t expiracao;
+    uint32_t indice;
+} EntradaHeapTemporizador;
+
+static void heapTemporizadorInserir(EntradaHeapTemporizador* heap, size_t* tamanho, EntradaHeapTemporizador e) {
+    size_t i = (*tamanho)++;
+    while (i > 0 && heap[(i - 1) / 2].expiracao > e.expiracao) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = e;
+}
+
+static EntradaHeapTemporizador heapTemporizadorRemover(EntradaHeapTemporizador* heap, size_t* tamanho) {
+    EntradaHeapTemporizador topo = heap[0];
+    EntradaHeapTemporizador ultimo = heap[--*tamanho];
+    size_t i = 0;
 
-// Array global para armazenar referncias aos cruzamentos
-Cruzamento* cruzamentos[NUM_CRUZAMENTOS];
+    for (;;) {
+        size_t filho = 2 * i + 1;
+        if (filho >= *tamanho) break;
+        if (filho + 1 < *tamanho && heap[filho + 1].expiracao < heap[filho].expiracao) filho++;
+        if (heap[filho].expiracao >= ultimo.expiracao) break;
+        heap[i] = heap[filho];
+        i = filho;
+    }
+    heap[i] = ultimo;
+    return topo;
+}
 
 /**
- * @brief Funo que simula o comportamento de um cruzamento.
+ * @brief Mede o custo por temporizador com `quantidade` pendentes, na roda ou no heap.
  *
- * A funo alterna o estado dos semforos em um ciclo pr-definido,
- * abrindo e fechando cada direo de acordo com o tempo configurado.
+ * A carga imita os veículos: cada temporizador que expira atualiza o seu
+ * objeto e é registrado de novo com um prazo sorteado, de modo que a
+ * quantidade pendente fica constante. O relógio avança um tick por vez.
+ * Antes da medição cada temporizador expira ao menos uma vez, para que a roda
+ * tenha as cascatas do regime permanente.
  *
- * @param pvParameters Ponteiro para os parmetros da funo (deve ser um `Cruzamento*`).
+ * @return Nanossegundos por temporizador (registro, expiração e a sua parte do avanço dos ticks).
  */
-void vCruzamentoTask(void* pvParameters) {
-    Cruzamento* cruzamento = (Cruzamento*)pvParameters;
+static double medirTemporizadores(uint32_t quantidade, int usarRoda) {
+    static RodaTemporizacao roda;
+    uint32_t intervalo = quantidade * 2 / BENCH_TEMPORIZADORES_POR_TICK;
+    uint32_t* disparos = (uint32_t*)calloc(quantidade, sizeof(uint32_t));
+    uint32_t* expirados = (uint32_t*)malloc((size_t)quantidade * sizeof(uint32_t));
+    void* area = usarRoda ? malloc(RODA_BYTES(quantidade)) : NULL;
+    EntradaHeapTemporizador* heap = usarRoda ? NULL : (EntradaHeapTemporizador*)malloc((size_t)quantidade * sizeof(EntradaHeapTemporizador));
+    size_t tamanhoHeap = 0;
+    GeradorAleatorio gerador;
+    double ns = 0.0;
+
+    if (disparos == NULL || expirados == NULL || (area == NULL && heap == NULL)) goto fim;
+    if (intervalo < 1) intervalo = 1;
+    geradorIniciar(&gerador, sementeExecucao(), FLUXO_BENCH);
+
+    if (usarRoda) rodaIniciar(&roda, 0, area, quantidade);
+    for (uint32_t i = 0; i < quantidade; i++) {
+        uint32_t expiracao = 1 + geradorIntervalo(&gerador, intervalo);
+        if (usarRoda) {
+            rodaInserir(&roda, expiracao, i);
+        }
+        else {
+            heapTemporizadorInserir(heap, &tamanhoHeap, (EntradaHeapTemporizador){ expiracao, i });
+        }
+    }
 
-    for (;;) {
-        // Alterna o estado dos semforos
-        xSemaphoreTake(cruzamento->mutexNS, portMAX_DELAY);
-        cruzamento->semaforoNS = !cruzamento->semaforoNS;
-        xSemaphoreGive(cruzamento->mutexNS);
+    uint64_t aquecimento = quantidade > 100000 ? quantidade : 100000;
+    uint64_t total = 0, inicio = 0;
+    uint32_t agora = 0;
+
+    while (total < aquecimento + BENCH_TEMPORIZADORES_MEDIDOS) {
+        if (total >= aquecimento && inicio == 0) inicio = relogioNs();
+        agora++;
+
+        if (usarRoda) {
+            // O lote inteiro é conhecido, então os objetos seguintes são antecipados para a cache
+            size_t n = rodaAvancar(&roda, agora, expirados);
+            for (size_t k = 0; k < n; k++) {
+                if (k + 8 < n) rodaPrefetch(&disparos[expirados[k + 8]]);
+                disparos[expirados[k]]++;
+                rodaInserir(&roda, agora + 1 + geradorIntervalo(&gerador, intervalo), expirados[k]);
+            }
+            total += n;
+        }
+        else {
+            while (heap[0].expiracao <= agora) {
+                EntradaHeapTemporizador e = heapTemporizadorRemover(heap, &tamanhoHeap);
+                disparos[e.indice]++;
+                e.expiracao = agora + 1 + geradorIntervalo(&gerador, intervalo);
+                heapTemporizadorInserir(heap, &tamanhoHeap, e);
+                total++;
+            }
+        }
+    }
+    ns = (double)(relogioNs() - inicio) / (double)(total - aquecimento);
+
+fim:
+    free(disparos);
+    free(expirados);
+    free(area);
+    free(heap);
+    return ns;
+}
+
+/**
+ * @brief Compara o custo por temporizador da roda e do heap de 100 a BENCH_TEMPORIZADORES_MAXIMO pendentes.
+ */
+static void executarBenchTemporizadores(void) {
+    double menor = 0.0, maior = 0.0;
+
+    printf("Temporizadores pendentes constantes, %d expiracoes por tick em media, %d expiracoes por medicao\n",
+        BENCH_TEMPORIZADORES_POR_TICK, BENCH_TEMPORIZADORES_MEDIDOS);
+    printf("%12s | %18s | %18s | %8s\n", "pendentes", "roda (ns/temp.)", "heap (ns/temp.)", "ganho");
+
+    for (uint32_t quantidade = 100; quantidade <= BENCH_TEMPORIZADORES_MAXIMO; quantidade *= 10) {
+        double roda = medirTemporizadores(quantidade, 1);
+        double heap = medirTemporizadores(quantidade, 0);
+
+        if (menor == 0.0 || roda < menor) menor = roda;
+        if (roda > maior) maior = roda;
+        printf("%12lu | %18.1f | %18.1f | %7.1fx\n", (unsigned long)quantidade, roda, heap, roda > 0 ? heap / roda : 0.0);
+    }
+    printf("Roda: maior custo por temporizador / menor = %.2f\n", menor > 0 ? maior / menor : 0.0);
+}
+
+#endif /* MODO_SIMULACAO == MODO_BENCH_TEMPORIZADORES */
+
+/*----------------- LEITURA DE LOGS E TRACES ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_DECODIFICAR_LOG ) || ( MODO_SIMULACAO == MODO_EXPORTAR_TRACE )
 
-        xSemaphoreTake(cruzamento->mutexSN, portMAX_DELAY);
-        cruzamento->semaforoSN = !cruzamento->semaforoSN;
-        xSemaphoreGive(cruzamento->mutexSN);
+/**
+ * @brief Registros lidos de um log ou de um trace contínuo, já ordenados pelo instante.
+ */
+typedef struct {
+    uint32_t origem;             /**< MODO_SIMULACAO que gravou o arquivo. */
+    int numCruzamentos;          /**< Quantidade de nomes em `nomes`. */
+    uint64_t semente;            /**< Semente da execução. */
+    char (*nomes)[16];           /**< Nomes dos cruzamentos. */
+    RegistroEvento* registros;   /**< Registros em ordem de tempo. */
+    size_t quantidade;           /**< Quantidade de registros. */
+    uint64_t perdidos;           /**< Registros mais antigos que o anel do trace já havia sobrescrito. */
+} ArquivoEventos;
 
-        xSemaphoreTake(cruzamento->mutexEW, portMAX_DELAY);
-        cruzamento->semaforoEW = !cruzamento->semaforoEW;
-        xSemaphoreGive(cruzamento->mutexEW);
+static const RegistroEvento* registrosOrdenados;
 
-        xSemaphoreTake(cruzamento->mutexWE, portMAX_DELAY);
-        cruzamento->semaforoWE = !cruzamento->semaforoWE;
-        xSemaphoreGive(cruzamento->mutexWE);
+/**
+ * @brief Ordena os registros pelo instante, mantendo a ordem do arquivo nos empates.
+ */
+static int compararRegistrosLog(const void* a, const void* b) {
+    uint32_t i = *(const uint32_t*)a;
+    uint32_t j = *(const uint32_t*)b;
+    uint64_t ti = registrosOrdenados[i].tempo;
+    uint64_t tj = registrosOrdenados[j].tempo;
+
+    if (ti != tj) return (ti < tj) ? -1 : 1;
+    return (i > j) - (i < j);
+}
 
-        // Imprime o estado atual do cruzamento
-        printf("Cruzamento %c: NS: %s, SN: %s, EW: %s, WE: %s\n",
-            cruzamento->id,
-            cruzamento->semaforoNS ? "\033[32mAberto\033[0m" : "\033[31mFechado\033[0m",
-            cruzamento->semaforoSN ? "\033[32mAberto\033[0m" : "\033[31mFechado\033[0m",
-            cruzamento->semaforoEW ? "\033[32mAberto\033[0m" : "\033[31mFechado\033[0m",
-            cruzamento->semaforoWE ? "\033[32mAberto\033[0m" : "\033[31mFechado\033[0m");
+/**
+ * @brief Lê os registros de um log: todos os que seguem os nomes, até o fim do arquivo.
+ */
+static int eventosLerLog(FILE* arquivo, ArquivoEventos* eventos) {
+    size_t capacidade = 0;
 
-        // Aguarda o prximo ciclo
-        vTaskDelay(pdMS_TO_TICKS(TEMPO_CICLO * 1000));
+    for (;;) {
+        if (eventos->quantidade == capacidade) {
+            size_t novaCapacidade = capacidade ? capacidade * 2 : 4096;
+            RegistroEvento* novos = (RegistroEvento*)realloc(eventos->registros, novaCapacidade * sizeof(RegistroEvento));
+            if (novos == NULL) return 0;
+            eventos->registros = novos;
+            capacidade = novaCapacidade;
+        }
+        size_t lidos = fread(&eventos->registros[eventos->quantidade], sizeof(RegistroEvento),
+            capacidade - eventos->quantidade, arquivo);
+        eventos->quantidade += lidos;
+        if (lidos == 0) return 1;
     }
 }
 
 /**
- * @brief Verifica se um semforo est aberto para a direo especificada.
+ * @brief Lê o anel de um trace contínuo, do registro mais antigo ao mais recente.
  *
- * A funo utiliza semforos binrios para garantir acesso exclusivo ao estado
- * do semforo e verifica se o semforo na direo desejada est aberto.
- *
- * @param cruzamento Ponteiro para o cruzamento onde o semforo ser verificado.
- * @param direcao Direo do semforo a ser verificado (NS, SN, EW, WE).
- * @return Retorna 1 se o semforo estiver aberto, 0 caso contrrio.
+ * O arquivo pode estar sendo gravado: os contadores são relidos depois da
+ * cópia, e os registros sobrescritos durante ela são descartados. Um
+ * cabeçalho com mais registros gravados do que iniciados, ou com mais
+ * registros válidos do que cabem no anel, é recusado.
  */
-int verificarSemaforoAberto(Cruzamento* cruzamento, int direcao) {
-    bool semaforoAberto = false;
-
-    switch (direcao) {
-    case NS:
-        xSemaphoreTake(cruzamento->mutexNS, portMAX_DELAY);
-        semaforoAberto = cruzamento->semaforoNS;
-        xSemaphoreGive(cruzamento->mutexNS);
-        break;
-    case SN:
-        xSemaphoreTake(cruzamento->mutexSN, portMAX_DELAY);
-        semaforoAberto = cruzamento->semaforoSN;
-        xSemaphoreGive(cruzamento->mutexSN);
-        break;
-    case EW:
-        xSemaphoreTake(cruzamento->mutexEW, portMAX_DELAY);
-        semaforoAberto = cruzamento->semaforoEW;
-        xSemaphoreGive(cruzamento->mutexEW);
-        break;
-    case WE:
-        xSemaphoreTake(cruzamento->mutexWE, portMAX_DELAY);
-        semaforoAberto = cruzamento->semaforoWE;
-        xSemaphoreGive(cruzamento->mutexWE);
-        break;
-    default:
-        return 0; // Direo invlida
+static int eventosLerTrace(FILE* arquivo, const CabecalhoTrace* cabecalho, ArquivoEventos* eventos) {
+    long inicioAnel = (long)(sizeof(CabecalhoTrace) + (size_t)cabecalho->numCruzamentos * 16);
+    uint32_t capacidade = cabecalho->capacidade;
+    uint64_t gravados = cabecalho->gravados;
+    CabecalhoTrace depois;
+
+    if (capacidade == 0 || (capacidade & (capacidade - 1)) != 0) return 0;
+    eventos->registros = (RegistroEvento*)malloc((size_t)capacidade * sizeof(RegistroEvento));
+    if (eventos->registros == NULL) return 0;
+    if (fseek(arquivo, inicioAnel, SEEK_SET) != 0 ||
+        fread(eventos->registros, sizeof(RegistroEvento), capacidade, arquivo) != capacidade) {
+        return 0;
+    }
+    // Os contadores só são relidos depois que a cópia do anel terminou
+    atomicoBarreiraAquisicao();
+    if (fseek(arquivo, 0, SEEK_SET) != 0 || fread(&depois, sizeof(depois), 1, arquivo) != 1) return 0;
+
+    // O drenador avança `iniciados` antes de `gravados`, então a releitura nunca tem menos iniciados
+    if (gravados > depois.iniciados) return 0;
+
+    // Só os registros que nenhuma gravação iniciada até o fim da cópia pode ter alcançado são válidos
+    uint64_t primeiro = (depois.iniciados > capacidade) ? depois.iniciados - capacidade : 0;
+    if (primeiro > gravados) primeiro = gravados;
+    if (gravados - primeiro > capacidade) return 0;
+    eventos->perdidos = primeiro;
+    eventos->quantidade = (size_t)(gravados - primeiro);
+
+    // Desenrola o anel a partir do mais antigo
+    RegistroEvento* lineares = (RegistroEvento*)malloc((eventos->quantidade + 1) * sizeof(RegistroEvento));
+    if (lineares == NULL) return 0;
+    for (size_t i = 0; i < eventos->quantidade; i++) {
+        lineares[i] = eventos->registros[(primeiro + i) & (capacidade - 1)];
     }
+    free(eventos->registros);
+    eventos->registros = lineares;
+    return 1;
+}
 
-    return semaforoAberto ? 1 : 0;
+/**
+ * @brief Libera o que `eventosCarregar` alocou.
+ */
+static void eventosLiberar(ArquivoEventos* eventos) {
+    free(eventos->registros);
+    free(eventos->nomes);
+    eventos->registros = NULL;
+    eventos->nomes = NULL;
 }
 
 /**
- * @brief Simula o comportamento de um veculo em um cruzamento.
+ * @brief Lê um log binário ou um trace contínuo e ordena os registros pelo instante.
  *
- * A funo controla o movimento do veculo, verificando o estado dos semforos
- * e movimentando-o entre cruzamentos adjacentes conforme a direo escolhida.
+ * Os canais são drenados em blocos, então os registros de tasks diferentes
+ * chegam ao arquivo fora de ordem. As mensagens de erro vão para a saída de
+ * erro, já que o exportador escreve o JSON na saída padrão.
  *
- * @param pvParameters Ponteiro para os parmetros da funo (deve ser um `Veiculo*`).
+ * @return Retorna 1 em caso de sucesso, 0 se o arquivo for inválido ou faltar memória.
  */
-void vVeiculoTask(void* pvParameters) {
-    Veiculo* veiculo = (Veiculo*)pvParameters;
-    char* direcao;
-
-    switch (veiculo->direcao) {
-    case NS: direcao = "NS"; break;
-    case SN: direcao = "SN"; break;
-    case EW: direcao = "EW"; break;
-    case WE: direcao = "WE"; break;
+static int eventosCarregar(const char* caminho, ArquivoEventos* eventos) {
+    FILE* arquivo = fopen(caminho, "rb");
+    union { CabecalhoLog log; CabecalhoTrace trace; } cabecalho;
+    uint32_t* ordem = NULL;
+    int trace = 0;
+    int sucesso = 0;
+
+    memset(eventos, 0, sizeof(*eventos));
+    if (arquivo == NULL) {
+        fprintf(stderr, "Erro ao abrir o arquivo %s.\n", caminho);
+        return 0;
     }
 
-    printf("Veiculo ID: %d, Velocidade: %d km/h, Cruzamento: %c, Direcao: %s\n",
-        veiculo->id, veiculo->velocidade, veiculo->cruzamento->id, direcao);
+    // O cabeçalho do trace é o maior; um log curto o suficiente para não preenchê-lo não tem registros
+    memset(&cabecalho, 0, sizeof(cabecalho));
+    size_t lidos = fread(&cabecalho, 1, sizeof(cabecalho), arquivo);
+    if (lidos >= sizeof(CabecalhoTrace) && memcmp(cabecalho.trace.magica, "SIMTRACE", 8) == 0 &&
+        cabecalho.trace.versao == TRACE_VERSAO && cabecalho.trace.tamanhoRegistro == sizeof(RegistroEvento)) {
+        trace = 1;
+        eventos->origem = cabecalho.trace.origem;
+        eventos->numCruzamentos = (int)cabecalho.trace.numCruzamentos;
+        eventos->semente = cabecalho.trace.semente;
+        fseek(arquivo, (long)sizeof(CabecalhoTrace), SEEK_SET);
+    }
+    else if (lidos >= sizeof(CabecalhoLog) && memcmp(cabecalho.log.magica, "SIMLOG", 7) == 0 &&
+        cabecalho.log.versao == LOG_VERSAO && cabecalho.log.tamanhoRegistro == sizeof(RegistroEvento)) {
+        eventos->origem = cabecalho.log.origem;
+        eventos->numCruzamentos = (int)cabecalho.log.numCruzamentos;
+        eventos->semente = cabecalho.log.semente;
+        fseek(arquivo, (long)sizeof(CabecalhoLog), SEEK_SET);
+    }
+    else {
+        fprintf(stderr, "Arquivo de log ou trace invalido ou de outra versao: %s.\n", caminho);
+        goto fim;
+    }
+    if (eventos->numCruzamentos < 0 || eventos->numCruzamentos > REDE_MAX_CRUZAMENTOS) {
+        fprintf(stderr, "Arquivo com %d cruzamentos: %s.\n", eventos->numCruzamentos, caminho);
+        goto fim;
+    }
 
-    for (;;) {
-        if (verificarSemaforoAberto(veiculo->cruzamento, veiculo->direcao)) {
-            // O semforo est aberto, o veculo pode atravessar
-            printf("Veiculo ID: %d, Direcao: %s - Atravessando o semaforo.\n", veiculo->id, direcao);
-            vTaskDelay(pdMS_TO_TICKS(veiculo->tempoDeslocamento)); // Simula a travessia
+    eventos->nomes = (char (*)[16])malloc((size_t)eventos->numCruzamentos * sizeof(eventos->nomes[0]) + 1);
+    if (eventos->nomes == NULL ||
+        fread(eventos->nomes, sizeof(eventos->nomes[0]), (size_t)eventos->numCruzamentos, arquivo) != (size_t)eventos->numCruzamentos) {
+        fprintf(stderr, "Arquivo truncado: %s.\n", caminho);
+        goto fim;
+    }
+    // Os nomes vão para o texto e o JSON como strings, então cada um termina no seu campo de 16 bytes
+    for (int c = 0; c < eventos->numCruzamentos; c++) eventos->nomes[c][sizeof(eventos->nomes[c]) - 1] = '\0';
 
-            // Move para o prximo cruzamento, verificando se  nulo
-            switch (veiculo->direcao) {
-            case NS: veiculo->cruzamento = veiculo->cruzamento->proximoNS; break;
-            case SN: veiculo->cruzamento = veiculo->cruzamento->proximoSN; break;
-            case EW: veiculo->cruzamento = veiculo->cruzamento->proximoEW; break;
-            case WE: veiculo->cruzamento = veiculo->cruzamento->proximoWE; break;
-            }
+    if (!(trace ? eventosLerTrace(arquivo, &cabecalho.trace, eventos) : eventosLerLog(arquivo, eventos))) {
+        fprintf(stderr, "Erro ao ler os registros de %s.\n", caminho);
+        goto fim;
+    }
 
-            if (veiculo->cruzamento == NULL) {
-                printf("Veiculo ID: %d - Saiu da rede de cruzamentos.\n", veiculo->id);
-                vTaskDelete(NULL); // Encerra a task quando o veculo sai da rede
-            }
-            else {
-                printf("Veiculo ID: %d - Chegou ao cruzamento %c.\n", veiculo->id, veiculo->cruzamento->id);
-            }
-        }
-        else {
-            // O semforo est fechado, o veculo deve esperar
-            printf("Veiculo ID: %d, Direcao: %s - Esperando o semaforo.\n", veiculo->id, direcao);
-            vTaskDelay(pdMS_TO_TICKS(1000)); // Espera antes de tentar novamente
-        }
+    ordem = (uint32_t*)malloc((eventos->quantidade + 1) * sizeof(uint32_t));
+    RegistroEvento* ordenados = (RegistroEvento*)malloc((eventos->quantidade + 1) * sizeof(RegistroEvento));
+    if (ordem == NULL || ordenados == NULL) {
+        fprintf(stderr, "Erro ao alocar memoria para os registros.\n");
+        free(ordenados);
+        goto fim;
     }
+    for (size_t i = 0; i < eventos->quantidade; i++) ordem[i] = (uint32_t)i;
+    registrosOrdenados = eventos->registros;
+    qsort(ordem, eventos->quantidade, sizeof(uint32_t), compararRegistrosLog);
+    for (size_t i = 0; i < eventos->quantidade; i++) ordenados[i] = eventos->registros[ordem[i]];
+    free(eventos->registros);
+    eventos->registros = ordenados;
+    sucesso = 1;
+
+fim:
+    free(ordem);
+    fclose(arquivo);
+    if (!sucesso) eventosLiberar(eventos);
+    return sucesso;
 }
 
+#endif /* MODO_SIMULACAO == MODO_DECODIFICAR_LOG || MODO_SIMULACAO == MODO_EXPORTAR_TRACE */
+
+/*----------------- DECODIFICADOR DO LOG ------------------*/
+
+#if ( MODO_SIMULACAO == MODO_DECODIFICAR_LOG )
+
 /**
- * @brief Gera veculos indefinidamente e atribui-os a cruzamentos.
+ * @brief Lê um log binário (ou um trace contínuo) e imprime as mensagens no formato original.
  *
- * A funo cria novos veculos com direes e velocidades aleatrias,
- * e os distribui entre os cruzamentos disponveis.
- *
- * @param pvParameters Parmetros passados para a funo (no utilizado neste caso).
+ * @return Retorna 1 em caso de sucesso, 0 se o arquivo for inválido.
  */
-void vVeiculoCreator(void* pvParameters) {
-    int veiculoCounter = 0;
+static int decodificarLog(const char* caminho) {
+    ArquivoEventos eventos;
 
-    while (1) {
-        Veiculo* novoVeiculo = (Veiculo*)pvPortMalloc(sizeof(Veiculo));
-        if (novoVeiculo == NULL) {
-            printf("Erro ao alocar memoria para um novo veiculo.\n");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
+    if (!eventosCarregar(caminho, &eventos)) return 0;
 
-        novoVeiculo->id = veiculoCounter++;
-        novoVeiculo->direcao = (rand() % 4) + 1; // Direo aleatria entre 1 e 4
+    printf("Log de %s: %llu registros, semente %llu.\n", caminho, (unsigned long long)eventos.quantidade,
+        (unsigned long long)eventos.semente);
+    if (eventos.perdidos > 0) {
+        printf("Os %llu registros mais antigos ja haviam sido sobrescritos no anel.\n", (unsigned long long)eventos.perdidos);
+    }
+    for (size_t i = 0; i < eventos.quantidade; i++) {
+        char linha[160];
+        logFormatar(&eventos.registros[i], eventos.origem, (const char (*)[16])eventos.nomes, eventos.numCruzamentos,
+            linha, sizeof(linha));
+        fputs(linha, stdout);
+    }
 
-        // Inicializa a velocidade do veculo
-        novoVeiculo->velocidade = (novoVeiculo->direcao > 2) ? (rand() % 31) + 20 : (rand() % 31) + 30;
-        novoVeiculo->tempoDeslocamento = (int)round(500 / (novoVeiculo->velocidade * 0.27778));
+    eventosLiberar(&eventos);
+    return 1;
+}
 
-        // Escolhe um cruzamento aleatrio
-        int cruzamentoIndex = rand() % NUM_CRUZAMENTOS;
-        novoVeiculo->cruzamento = cruzamentos[cruzamentoIndex];
+#endif /* MODO_SIMULACAO == MODO_DECODIFICAR_LOG */
 
-        if (novoVeiculo->cruzamento == NULL) {
-            printf("Erro: veiculo foi atribuido a um cruzamento nulo.\n");
-            vPortFree(novoVeiculo);
-            continue;
-        }
+/*----------------- EXPORTADOR PARA O CHROME/PERFETTO ------------------*/
 
-        // Cria uma task para o novo veculo
-        if (xTaskCreate(vVeiculoTask, "VeiculoTask", configMINIMAL_STACK_SIZE, (void*)novoVeiculo, 1, NULL) != pdPASS) {
-            printf("Falha ao criar veiculo ID %d\n", novoVeiculo->id);
-            vPortFree(novoVeiculo);
-        }
+#if ( MODO_SIMULACAO == MODO_EXPORTAR_TRACE )
 
-        vTaskDelay(pdMS_TO_TICKS((rand() % 3) * 1000)); // Aguarda antes de criar outro veculo
-    }
+// Processos do trace exportado: cada um agrupa as trilhas de um tipo de entidade
+#define TRACE_PID_TAREFAS    1 // Uma trilha por task, com as fatias em que ela executou
+#define TRACE_PID_SEMAFOROS  2 // Uma trilha por cruzamento, com as fatias de cada fase
+#define TRACE_PID_VEICULOS   3 // Uma trilha assíncrona por veículo, da entrada à saída da rede
+
+#define VEICULO_NA_REDE   1 // Estado do veículo no exportador: a fatia do veículo está aberta
+#define VEICULO_ESPERANDO 2 // A fatia de espera pelo verde está aberta
+
+static int eventosExportados;
+
+/**
+ * @brief Abre um evento JSON, separando-o do anterior.
+ */
+static void exportarAbrirEvento(void) {
+    fputs(eventosExportados++ ? ",\n" : "\n", stdout);
 }
 
 /**
- * @brief Cria os cruzamentos e define as conexes entre eles.
+ * @brief Escreve `texto` como string JSON, entre aspas.
  *
- * A funo inicializa todos os cruzamentos e define as conexes de acordo
- * com o layout especificado. Os semforos comeam alternadamente abertos.
+ * Os nomes vêm do log ou do cenário e podem ter aspas, barras invertidas ou
+ * caracteres de controle; estes saem como \uXXXX.
  */
-void CruzamentoCreator() {
-    char cruzamentoID = 'A';
-
-    for (int i = 0; i < NUM_CRUZAMENTOS; i++) {
-        Cruzamento* cruzamento = (Cruzamento*)pvPortMalloc(sizeof(Cruzamento));
-        if (cruzamento == NULL) {
-            printf("Erro ao alocar memoria para o cruzamento %c.\n", cruzamentoID + i);
-            continue;
+static void exportarTexto(const char* texto) {
+    putchar('"');
+    for (const unsigned char* p = (const unsigned char*)texto; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            putchar('\\');
+            putchar(*p);
         }
+        else if (*p < 0x20) printf("\\u%04x", (unsigned)*p);
+        else putchar(*p);
+    }
+    putchar('"');
+}
 
-        cruzamento->id = cruzamentoID++;
-        cruzamento->semaforoNS = (i % 2 == 0); // Semforos alternados comeam verdes
-        cruzamento->semaforoSN = (i % 2 == 0);
-        cruzamento->semaforoEW = !(i % 2 == 0);
-        cruzamento->semaforoWE = !(i % 2 == 0);
-
-        // Inicializa os semforos binrios
-        cruzamento->mutexNS = xSemaphoreCreateBinary();
-        cruzamento->mutexSN = xSemaphoreCreateBinary();
-        cruzamento->mutexEW = xSemaphoreCreateBinary();
-        cruzamento->mutexWE = xSemaphoreCreateBinary();
+static void exportarNomeTrilha(int pid, uint32_t tid, const char* nome) {
+    exportarAbrirEvento();
+    printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":", pid, (unsigned)tid);
+    exportarTexto(nome);
+    fputs("}}", stdout);
+}
 
-        // Libera os mutexes iniciais
-        xSemaphoreGive(cruzamento->mutexNS);
-        xSemaphoreGive(cruzamento->mutexSN);
-        xSemaphoreGive(cruzamento->mutexEW);
-        xSemaphoreGive(cruzamento->mutexWE);
+/**
+ * @brief Fatia completa ("X") de `inicio` a `fim`, em ms.
+ */
+static void exportarFatia(int pid, uint32_t tid, const char* nome, uint64_t inicio, uint64_t fim) {
+    exportarAbrirEvento();
+    fputs("{\"name\":", stdout);
+    exportarTexto(nome);
+    printf(",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%llu,\"dur\":%llu}", pid, (unsigned)tid,
+        (unsigned long long)inicio * 1000, (unsigned long long)(fim - inicio) * 1000);
+}
 
-        // Inicializa ponteiros para os prximos cruzamentos como NULL
-        cruzamento->proximoNS = NULL;
-        cruzamento->proximoSN = NULL;
-        cruzamento->proximoEW = NULL;
-        cruzamento->proximoWE = NULL;
+/**
+ * @brief Evento assíncrono aninhável de um veículo: "b" abre, "e" fecha e "n" marca um instante.
+ */
+static void exportarVeiculo(char fase, int veiculo, const char* nome, uint64_t tempo) {
+    exportarAbrirEvento();
+    fputs("{\"name\":", stdout);
+    exportarTexto(nome);
+    printf(",\"cat\":\"veiculo\",\"ph\":\"%c\",\"id\":%d,\"pid\":%d,\"tid\":0,\"ts\":%llu}", fase,
+        veiculo, TRACE_PID_VEICULOS, (unsigned long long)tempo * 1000);
+}
 
-        cruzamentos[i] = cruzamento;
+/**
+ * @brief Nome de uma fase: as direções abertas, ou "Vermelho" com todas fechadas.
+ */
+static void exportarNomeFase(uint32_t fase, char* nome, size_t tamanho) {
+    size_t n = (size_t)snprintf(nome, tamanho, "Verde");
+    for (int d = 1; d <= NUM_DIRECOES && n < tamanho; d++) {
+        if (fase & FASE_ABERTO(d)) n += (size_t)snprintf(nome + n, tamanho - n, " %s", nomeDirecao(d));
+    }
+    if (n == 5) snprintf(nome, tamanho, "Vermelho");
+    else if ((fase & FASE_PROTEGIDA) && n < tamanho) {
+        snprintf(nome + n, tamanho - n, (FASE_ESTAGIO(fase) & 1u) ? " (esquerdas)" : " (reto e direita)");
+    }
+}
 
-        if (xTaskCreate(vCruzamentoTask, "CruzamentoTask", configMINIMAL_STACK_SIZE, (void*)cruzamento, 1, NULL) != pdPASS) {
-            printf("Falha ao criar o cruzamento %c.\n", cruzamento->id);
-            vPortFree(cruzamento);
+/**
+ * @brief Converte um log ou trace contínuo para o formato JSON de eventos do Chrome, aceito pelo Perfetto.
+ *
+ * As trocas de task viram fatias na trilha de cada task, as trocas de fase
+ * viram fatias na trilha de cada cruzamento e cada veículo vira uma fatia
+ * assíncrona com a espera pelo verde aninhada e instantes para as chegadas e
+ * travessias. Fatias ainda abertas no último registro são fechadas nele. O
+ * JSON vai para a saída padrão.
+ *
+ * @return Retorna 1 em caso de sucesso, 0 se o arquivo for inválido ou faltar memória.
+ */
+static int exportarTraceChrome(const char* caminho) {
+    ArquivoEventos eventos;
+    uint64_t* inicioFase = NULL;
+    uint32_t* fases = NULL;
+    uint8_t* estados = NULL;
+    uint32_t* tarefasVistas = NULL;
+    size_t numTarefasVistas = 0, capacidadeTarefasVistas = 0;
+    int sucesso = 0;
+
+    if (!eventosCarregar(caminho, &eventos)) return 0;
+
+    int maiorVeiculo = -1;
+    for (size_t i = 0; i < eventos.quantidade; i++) {
+        if (eventos.registros[i].tipo != LOG_TAREFA && eventos.registros[i].veiculo > maiorVeiculo) {
+            maiorVeiculo = eventos.registros[i].veiculo;
         }
     }
+    inicioFase = (uint64_t*)malloc((size_t)(eventos.numCruzamentos + 1) * sizeof(uint64_t));
+    fases = (uint32_t*)malloc((size_t)(eventos.numCruzamentos + 1) * sizeof(uint32_t));
+    estados = (uint8_t*)calloc((size_t)maiorVeiculo + 2, 1);
+    if (inicioFase == NULL || fases == NULL || estados == NULL) {
+        fprintf(stderr, "Erro ao alocar memoria para a exportacao.\n");
+        goto fim;
+    }
+    for (int c = 0; c < eventos.numCruzamentos; c++) inicioFase[c] = UINT64_MAX; // Nenhuma fase vista
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"otherData\":{\"arquivo\":", stdout);
+    exportarTexto(caminho);
+    printf(",\"origem\":%u,\"semente\":%llu,\"registros\":%llu,\"perdidos\":%llu},\n\"traceEvents\":[", (unsigned)eventos.origem,
+        (unsigned long long)eventos.semente, (unsigned long long)eventos.quantidade, (unsigned long long)eventos.perdidos);
+    eventosExportados = 0;
+    static const char* nomesProcessos[] = { "Tasks", "Semaforos", "Veiculos" };
+    for (int pid = TRACE_PID_TAREFAS; pid <= TRACE_PID_VEICULOS; pid++) {
+        exportarAbrirEvento();
+        printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}", pid, nomesProcessos[pid - 1]);
+    }
+
+    uint32_t tarefaAtual = 0;
+    uint64_t inicioTarefa = UINT64_MAX; // Nenhuma task vista
+    uint64_t ultimo = 0;
+    for (size_t i = 0; i < eventos.quantidade; i++) {
+        const RegistroEvento* r = &eventos.registros[i];
+        int c = r->cruzamento;
+        const char* cruzamento = (c >= 0 && c < eventos.numCruzamentos) ? eventos.nomes[c] : "?";
+        char nome[64];
+
+        ultimo = r->tempo;
+        if (r->tipo == LOG_TAREFA) {
+            char nomeTarefa[48];
+            if (inicioTarefa != UINT64_MAX) {
+                logNomeTarefa(tarefaAtual, (const char (*)[16])eventos.nomes, eventos.numCruzamentos, nomeTarefa, sizeof(nomeTarefa));
+                exportarFatia(TRACE_PID_TAREFAS, tarefaAtual, nomeTarefa, inicioTarefa, r->tempo);
+            }
+            tarefaAtual = (uint32_t)r->veiculo;
+            inicioTarefa = r->tempo;
+
+            size_t t = 0;
+            while (t < numTarefasVistas && tarefasVistas[t] != tarefaAtual) t++;
+            if (t == numTarefasVistas) {
+                if (numTarefasVistas == capacidadeTarefasVistas) {
+                    capacidadeTarefasVistas = capacidadeTarefasVistas ? capacidadeTarefasVistas * 2 : 64;
+                    uint32_t* novas = (uint32_t*)realloc(tarefasVistas, capacidadeTarefasVistas * sizeof(uint32_t));
+                    if (novas == NULL) goto fim;
+                    tarefasVistas = novas;
+                }
+                tarefasVistas[numTarefasVistas++] = tarefaAtual;
+                logNomeTarefa(tarefaAtual, (const char (*)[16])eventos.nomes, eventos.numCruzamentos, nomeTarefa, sizeof(nomeTarefa));
+                exportarNomeTrilha(TRACE_PID_TAREFAS, tarefaAtual, nomeTarefa);
+            }
+            continue;
+        }
 
-    // Definindo as conexes entre os cruzamentos
-    cruzamentos[0]->proximoNS = cruzamentos[2]; // A -> C (NS)
-    cruzamentos[0]->proximoWE = cruzamentos[1]; // A -> B (WE)
+        if (r->tipo == LOG_FASE) {
+            if (c < 0 || c >= eventos.numCruzamentos) continue;
+            if (inicioFase[c] == UINT64_MAX) {
+                snprintf(nome, sizeof(nome), "Cruzamento %s", cruzamento);
+                exportarNomeTrilha(TRACE_PID_SEMAFOROS, (uint32_t)c, nome);
+            }
+            else if (fases[c] != r->fase) {
+                exportarNomeFase(fases[c], nome, sizeof(nome));
+                exportarFatia(TRACE_PID_SEMAFOROS, (uint32_t)c, nome, inicioFase[c], r->tempo);
+            }
+            else {
+                continue; // Mesma fase: a fatia continua
+            }
+            inicioFase[c] = r->tempo;
+            fases[c] = r->fase;
+            continue;
+        }
 
-    cruzamentos[1]->proximoNS = cruzamentos[3]; // B -> D (NS)
-    cruzamentos[1]->proximoEW = cruzamentos[0]; // B -> A (EW)
+        if (r->veiculo < 0) continue;
+        uint8_t* estado = &estados[r->veiculo];
+        snprintf(nome, sizeof(nome), "Veiculo %d", (int)r->veiculo);
+        if (!(*estado & VEICULO_NA_REDE)) {
+            // Veículos que entraram antes do registro mais antigo do anel começam no primeiro registro visto
+            exportarVeiculo('b', r->veiculo, nome, r->tempo);
+            *estado |= VEICULO_NA_REDE;
+        }
 
-    cruzamentos[2]->proximoSN = cruzamentos[0]; // C -> A (SN)
-    cruzamentos[2]->proximoWE = cruzamentos[3]; // C -> D (WE)
+        switch (r->tipo) {
+        case LOG_VEICULO_ESPERANDO:
+            if (!(*estado & VEICULO_ESPERANDO)) {
+                snprintf(nome, sizeof(nome), "Espera em %s %s", cruzamento, nomeDirecao(r->direcao));
+                exportarVeiculo('b', r->veiculo, nome, r->tempo);
+                *estado |= VEICULO_ESPERANDO;
+            }
+            break;
+        case LOG_VEICULO_ATRAVESSANDO:
+            if (*estado & VEICULO_ESPERANDO) {
+                snprintf(nome, sizeof(nome), "Espera em %s %s", cruzamento, nomeDirecao(r->direcao));
+                exportarVeiculo('e', r->veiculo, nome, r->tempo);
+                *estado &= (uint8_t)~VEICULO_ESPERANDO;
+            }
+            snprintf(nome, sizeof(nome), "Travessia em %s %s", cruzamento, nomeDirecao(r->direcao));
+            exportarVeiculo('n', r->veiculo, nome, r->tempo);
+            break;
+        case LOG_VEICULO_CHEGOU:
+            snprintf(nome, sizeof(nome), "Chegada em %s", cruzamento);
+            exportarVeiculo('n', r->veiculo, nome, r->tempo);
+            break;
+        case LOG_VEICULO_SAIU:
+            if (*estado & VEICULO_ESPERANDO) exportarVeiculo('e', r->veiculo, "Espera", r->tempo);
+            exportarVeiculo('e', r->veiculo, nome, r->tempo);
+            *estado = 0;
+            break;
+        default:
+            break; // LOG_VEICULO_CRIADO só abre a fatia do veículo
+        }
+    }
 
-    cruzamentos[3]->proximoSN = cruzamentos[1]; // D -> B (NS)
-    cruzamentos[3]->proximoEW = cruzamentos[2]; // D -> C (EW)
+    // Fecha o que continuava aberto no último registro
+    if (inicioTarefa != UINT64_MAX && ultimo > inicioTarefa) {
+        char nomeTarefa[48];
+        logNomeTarefa(tarefaAtual, (const char (*)[16])eventos.nomes, eventos.numCruzamentos, nomeTarefa, sizeof(nomeTarefa));
+        exportarFatia(TRACE_PID_TAREFAS, tarefaAtual, nomeTarefa, inicioTarefa, ultimo);
+    }
+    for (int c = 0; c < eventos.numCruzamentos; c++) {
+        char nome[64];
+        if (inicioFase[c] == UINT64_MAX || ultimo <= inicioFase[c]) continue;
+        exportarNomeFase(fases[c], nome, sizeof(nome));
+        exportarFatia(TRACE_PID_SEMAFOROS, (uint32_t)c, nome, inicioFase[c], ultimo);
+    }
+    for (int v = 0; v <= maiorVeiculo; v++) {
+        char nome[32];
+        if (estados[v] & VEICULO_ESPERANDO) exportarVeiculo('e', v, "Espera", ultimo);
+        snprintf(nome, sizeof(nome), "Veiculo %d", v);
+        if (estados[v] & VEICULO_NA_REDE) exportarVeiculo('e', v, nome, ultimo);
+    }
+    printf("\n]}\n");
+
+    fprintf(stderr, "%llu registros de %s convertidos em %d eventos", (unsigned long long)eventos.quantidade, caminho,
+        eventosExportados);
+    if (eventos.perdidos > 0) fprintf(stderr, " (%llu registros mais antigos sobrescritos no anel)", (unsigned long long)eventos.perdidos);
+    fprintf(stderr, ".\n");
+    sucesso = 1;
+
+fim:
+    free(tarefasVistas);
+    free(estados);
+    free(fases);
+    free(inicioFase);
+    eventosLiberar(&eventos);
+    return sucesso;
 }
 
+#endif /* MODO_SIMULACAO == MODO_EXPORTAR_TRACE */
+
 /**
- * @brief Funo principal que inicializa o sistema de controle de trfego.
+ * @brief Função principal que inicializa o sistema de controle de tráfego.
  *
- * A funo configura a memria do FreeRTOS, cria os cruzamentos e inicializa
- * a task responsvel por criar veculos.
+ * A função configura a memória do FreeRTOS, cria os cruzamentos e inicializa
+ * a task responsável por criar veículos. No modo de eventos discretos apenas
+ * executa a simulação e imprime o resumo.
  *
- * @return Sempre retorna 0.
+ * @return Retorna 0, ou 1 se o decodificador não conseguir ler o log.
  */
-int main(void) {
+int main(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
 
+#if ( MODO_SIMULACAO == MODO_EVENTOS_DISCRETOS )
+    // Sem tasks nem agendador: a simulação roda o mais rápido possível
+    executarEventosDiscretos();
+    return 0;
+#elif ( MODO_SIMULACAO == MODO_BENCH_SEMAFORO )
+    executarBenchSemaforo();
+    return 0;
+#elif ( MODO_SIMULACAO == MODO_BENCH_CINEMATICA )
+    executarBenchCinematica();
+    return 0;
+#elif ( MODO_SIMULACAO == MODO_BENCH_TEMPORIZADORES )
+    executarBenchTemporizadores();
+    return 0;
+#elif ( MODO_SIMULACAO == MODO_PARALELO )
+    executarParalelo();
+    return 0;
+#elif ( MODO_SIMULACAO == MODO_MESOSCOPICO )
+    executarMesoscopico();
+    return 0;
+#elif ( MODO_SIMULACAO == MODO_CONJUNTO )
+    executarConjunto();
+    return 0;
+#elif ( MODO_SIMULACAO == MODO_BENCH_SIMULADOR )
+    // Só o JSON vai para a saída padrão: simulador > resultado.json
+    executarBenchSimulador();
+    return 0;
+#elif ( MODO_SIMULACAO == MODO_DECODIFICAR_LOG )
+    // Uso: simulador [arquivo]; sem argumento lê o log padrão
+    return decodificarLog((argc > 1) ? argv[1] : LOG_ARQUIVO) ? 0 : 1;
+#elif ( MODO_SIMULACAO == MODO_EXPORTAR_TRACE )
+    // Uso: simulador [arquivo] > trace.json; sem argumento lê o trace contínuo padrão
+    return exportarTraceChrome((argc > 1) ? argv[1] : TRACE_ARQUIVO) ? 0 : 1;
+#elif ( MODO_SIMULACAO == MODO_COMPILAR_CENARIO )
+    // Uso: simulador cenario.txt cenario.bin
+    if (argc < 3) {
+        printf("Uso: %s <cenario de entrada> <cenario binario de saida>\n", argv[0]);
+        return 1;
+    }
+    return compilarCenario(argv[1], argv[2]) ? 0 : 1;
+#else
     /* This demo uses heap_5.c, so start by defining some heap regions.  heap_5
     is only used for test and example reasons.  Heap_4 is more appropriate.  See
     http://www.freertos.org/a00111.html for an explanation. */
     prvInitialiseHeap();
     /* Initialise the trace recorder.  Use of the trace recorder is optional.
-    See http://www.FreeRTOS.org/trace for more information. */
-    vTraceEnable(TRC_START);
+    See http://www.FreeRTOS.org/trace for more information.  Com SIM_TRACE o
+    trace contínuo em arquivo mapeado substitui o gravador em RAM. */
+    if (traceDestino() == NULL) {
+        vTraceEnable(TRC_START);
+    }
+    else {
+        xTraceRunning = pdFALSE;
+    }
 
-    // Cria os cruzamentos
+    // Cria os cruzamentos e prepara as vagas de veículos
     CruzamentoCreator();
+    poolVeiculosIniciar();
+    canalTarefas = logAbrirCanal(0);
+
+    // Cria a task responsável por gerar veículos indefinidamente
+    TaskHandle_t tarefa = NULL;
+    xTaskCreate(vVeiculoCreator, "VeiculoCreator", configMINIMAL_STACK_SIZE, NULL, 1, &tarefa);
+    tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_CRIADOR, 0));
+
+    // Cria a task que relata as esperas em sinal vermelho
+    tarefa = NULL;
+    xTaskCreate(vRelatorioEsperaTask, "RelatorioEspera", configMINIMAL_STACK_SIZE, NULL, 1, &tarefa);
+    tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_RELATORIO, 0));
+
+#if ( TEMPORIZACAO_POR_RODA == 1 )
+    // Acima das demais tasks, para que prazos vencidos não esperem o fim de outro processamento
+    tarefa = NULL;
+    xTaskCreate(vTemporizacaoTask, "Temporizacao", configMINIMAL_STACK_SIZE, NULL, 2, &tarefa);
+    tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_TEMPORIZACAO, 0));
+#endif
+
+    // Cria a task que grava o log de eventos (ou o trace contínuo), se ele estiver ligado
+    if (logAtivo()) {
+        tarefa = NULL;
+        xTaskCreate(vDrenarLogTask, "DrenarLog", configMINIMAL_STACK_SIZE, NULL, 1, &tarefa);
+        tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_LOG, 0));
+    }
+
+    // Cria a task que exporta as métricas, se elas estiverem ligadas
+    if (metricasFragmento(0) != NULL) {
+        tarefa = NULL;
+        xTaskCreate(vMetricasTask, "Metricas", configMINIMAL_STACK_SIZE, NULL, tskIDLE_PRIORITY, &tarefa);
+        tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_METRICAS, 0));
+    }
 
-    // Cria a task responsvel por gerar veculos indefinidamente
-    xTaskCreate(vVeiculoCreator, "VeiculoCreator", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
+    // Cria as tasks que publicam e leem os instantâneos da rede, se eles estiverem ligados
+    if (instantaneosAtivos) {
+        tarefa = NULL;
+        xTaskCreate(vInstantaneosTask, "Instantaneos", configMINIMAL_STACK_SIZE, NULL, 1, &tarefa);
+        tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_INSTANTANEOS, 0));
+    }
+    if (instantaneosAtivos && destinoInstantaneos != NULL) {
+        tarefa = NULL;
+        xTaskCreate(vExportarInstantaneosTask, "ExportarInstantaneos", configMINIMAL_STACK_SIZE, NULL, tskIDLE_PRIORITY, &tarefa);
+        tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_INSTANTANEOS, 1));
+    }
+    if (instantaneosAtivos && tela.atual != NULL) {
+        tarefa = NULL;
+        xTaskCreate(vTelaTask, "Tela", configMINIMAL_STACK_SIZE, NULL, tskIDLE_PRIORITY, &tarefa);
+        tarefaNumerar(tarefa, TAREFA_NUMERO(TAREFA_TELA, 0));
+    }
 
     // Inicia o agendador do FreeRTOS
     vTaskStartScheduler();
@@ -476,6 +9907,7 @@ int main(void) {
     // Loop infinito para manter o programa ativo
     for (;;);
     return 0;
+#endif
 }
 
 
@@ -502,6 +9934,8 @@ int main(void) {
 
 
 
+
+#if ( mainUSAR_FREERTOS == 1 )
 
 void vApplicationMallocFailedHook( void )
 {
@@ -579,6 +10013,13 @@ void vApplicationTickHook( void )
 	added here, but the tick hook is called from an interrupt context, so
 	code must not attempt to block, and only the interrupt safe FreeRTOS API
 	functions can be used (those that end in FromISR()). */
+	#if ( MODO_SIMULACAO == MODO_TEMPO_REAL )
+	{
+		/* Amostra as trocas de task para o trace contínuo. */
+		traceAmostrarTarefa();
+	}
+	#endif
+
 	#if ( mainCREATE_SIMPLE_BLINKY_DEMO_ONLY != 1 )
 	{
 		vFullDemoTickHookFunction();
@@ -640,7 +10081,7 @@ static void prvSaveTraceFile( void )
 {
 FILE* pxOutputFile;
 
-	fopen_s( &pxOutputFile, "Trace.dump", "wb");
+	pxOutputFile = fopen( "Trace.dump", "wb" );
 
 	if( pxOutputFile != NULL )
 	{
@@ -737,3 +10178,5 @@ static StaticTask_t xTimerTaskTCB;
 	*pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
 }
 
+#endif /* mainUSAR_FREERTOS */
+